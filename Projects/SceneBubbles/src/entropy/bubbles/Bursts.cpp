@@ -2,12 +2,58 @@
 
 #include "ofGraphics.h"
 
+#include <array>
+#include <numeric>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace entropy
 {
 	namespace bubbles
 	{
+		namespace
+		{
+			const uint32_t kInvalidBucket = std::numeric_limits<uint32_t>::max();
+
+			//--------------------------------------------------------------
+			glm::ivec3 getCell(const glm::vec3 & pos, float cellSize)
+			{
+				return glm::ivec3(glm::floor(pos / cellSize));
+			}
+
+			//--------------------------------------------------------------
+			uint32_t getBucket(const glm::ivec3 & cell, uint32_t bucketMask)
+			{
+				return ((uint32_t(cell.x) * 73856093u) ^ (uint32_t(cell.y) * 19349663u) ^ (uint32_t(cell.z) * 83492791u)) & bucketMask;
+			}
+
+			//--------------------------------------------------------------
+			int getMaxThreads()
+			{
+#ifdef _OPENMP
+				return omp_get_max_threads();
+#else
+				return 1;
+#endif
+			}
+
+			//--------------------------------------------------------------
+			int getThreadNum()
+			{
+#ifdef _OPENMP
+				return omp_get_thread_num();
+#else
+				return 0;
+#endif
+			}
+		}
+
 		//--------------------------------------------------------------
 		Bursts::Bursts()
+			: headless(false)
+			, frameCount(0)
 		{}
 
 		//--------------------------------------------------------------
@@ -17,14 +63,18 @@ namespace entropy
 		}
 
 		//--------------------------------------------------------------
-		void Bursts::init()
+		void Bursts::init(bool headless)
 		{
-			this->shader.setupShaderFromFile(GL_VERTEX_SHADER, "shaders/burst.vert");
-			this->shader.setupShaderFromFile(GL_FRAGMENT_SHADER, "shaders/burst.frag");
-			this->shader.bindAttribute(ExtraAttribute::Age, "age");
-			this->shader.bindDefaults();
-			this->shader.linkProgram();
-			
+			this->headless = headless;
+			if (!headless)
+			{
+				this->shader.setupShaderFromFile(GL_VERTEX_SHADER, "shaders/burst.vert");
+				this->shader.setupShaderFromFile(GL_FRAGMENT_SHADER, "shaders/burst.frag");
+				this->shader.bindAttribute(ExtraAttribute::Age, "age");
+				this->shader.bindDefaults();
+				this->shader.linkProgram();
+			}
+
 			// Add parameter listeners.
 			this->parameterListeners.push_back(this->resolution.newListener([this](int &)
 			{
@@ -54,6 +104,9 @@ namespace entropy
 			this->links.clear();
 
 			this->zombies.clear();
+			this->indices.clear();
+
+			this->frameCount = 0;
 		}
 
 		//--------------------------------------------------------------
@@ -65,25 +118,25 @@ namespace entropy
 				this->unitSphere = ofMesh::sphere(1.0f, this->resolution);
 			}
 
-			for (auto & vert : this->unitSphere.getVertices())
+			// Reuse as many zombie particles as possible, the most recent first, and
+			// grow the lists once for the rest of the drop.
+			const auto & verts = this->unitSphere.getVertices();
+			const auto numReused = std::min(verts.size(), this->zombies.size());
+			const auto firstNew = this->pos.size();
+			if (numReused < verts.size())
 			{
-				size_t idx;
-				if (this->zombies.empty())
-				{
-					// Add a new particle at the end of the list.
-					idx = this->pos.size();
-					this->pos.resize(idx + 1);
-					this->vel.resize(idx + 1);
-					this->acc.resize(idx + 1);
-					this->age.resize(idx + 1);
-					this->links.resize(idx + 1);
-				}
-				else
-				{
-					// Reuse a zombie particle.
-					idx = this->zombies.back();
-					this->zombies.pop_back();
-				}
+				const auto size = firstNew + verts.size() - numReused;
+				this->pos.resize(size);
+				this->vel.resize(size);
+				this->acc.resize(size);
+				this->age.resize(size);
+				this->links.resize(size);
+			}
+
+			for (size_t v = 0; v < verts.size(); ++v)
+			{
+				const auto & vert = verts[v];
+				const auto idx = (v < numReused) ? this->zombies[this->zombies.size() - 1 - v] : firstNew + v - numReused;
 
 				// Set initial values for the drop.
 				this->pos[idx] = glm::vec3(center + vert * radius * 2.0f);
@@ -94,46 +147,76 @@ namespace entropy
 
 				this->age[idx] = this->maxAge;
 			}
+			this->zombies.resize(this->zombies.size() - numReused);
 		}
 
 		//--------------------------------------------------------------
 		void Bursts::update(double dt)
-		{			
-#pragma omp parallel for
-			for (int i = 0; i < this->pos.size(); ++i)
+		{
+			// Each thread collects the particles that die in its own list. A static
+			// schedule splits the particles in contiguous ranges in thread order,
+			// so appending the lists in thread order keeps the free list the same
+			// whatever the number of threads.
+			this->threadZombies.resize(std::max<size_t>(this->threadZombies.size(), getMaxThreads()));
+			for (auto & dead : this->threadZombies)
 			{
-				if (this->age[i] > 0.0f)
+				dead.clear();
+			}
+			const int numParticles = this->pos.size();
+#pragma omp parallel
+			{
+				auto & dead = this->threadZombies[getThreadNum()];
+#pragma omp for schedule(static)
+				for (int i = 0; i < numParticles; ++i)
 				{
-					// Add forces.
-					//acc[i] += this->gravity * dt;
-					//this->acc[i] -= (this->vel[i] * this->drag.get());
+					if (this->age[i] > 0.0f)
+					{
+						// Add forces.
+						//acc[i] += this->gravity * dt;
+						//this->acc[i] -= (this->vel[i] * this->drag.get());
 
-					// Apply physics.
-					this->vel[i] += this->acc[i];
-					this->pos[i] += this->vel[i] * dt;
-					this->vel[i] *= (1.0f - dt);
-					this->acc[i] = glm::vec3(0.0f);
+						// Apply physics.
+						this->vel[i] += this->acc[i];
+						this->pos[i] += this->vel[i] * dt;
+						this->vel[i] *= (1.0f - dt);
+						this->acc[i] = glm::vec3(0.0f);
 
-					if (glm::length(this->pos[i]) > this->worldBounds)
-					{
-						// Mark dead if out of bounds.
-						this->age[i] = 0.0f;
-					}
-					else
-					{
-						// Get older.
-						this->age[i] -= dt;
-					}
+						if (glm::length(this->pos[i]) > this->worldBounds)
+						{
+							// Mark dead if out of bounds.
+							this->age[i] = 0.0f;
+						}
+						else
+						{
+							// Get older.
+							this->age[i] -= dt;
+						}
 
-					if (this->age[i] <= 0.0f)
-					{
-						this->zombies.push_back(i);
+						if (this->age[i] <= 0.0f)
+						{
+							dead.push_back(i);
+						}
 					}
+
+					this->links[i] = 0;
 				}
+			}
+			for (auto & dead : this->threadZombies)
+			{
+				this->zombies.insert(this->zombies.end(), dead.begin(), dead.end());
+			}
 
-				this->links[i] = 0;
+			++this->frameCount;
+			if (this->compactRate > 0 && this->frameCount % this->compactRate == 0 && !this->zombies.empty())
+			{
+				this->compact();
 			}
 
+			// Add lines to any particles that are close together.
+			this->linkParticles();
+
+			if (this->headless) return;
+
 			// Update the vbo.
 			if (this->pos.size() <= this->vbo.getNumVertices())
 			{
@@ -145,41 +228,334 @@ namespace entropy
 				this->vbo.setVertexData(this->pos.data(), this->pos.size(), GL_DYNAMIC_DRAW);
 				this->vbo.setAttributeData(ExtraAttribute::Age, this->age.data(), 1, this->age.size(), GL_DYNAMIC_DRAW);
 			}
+			this->vbo.setIndexData(this->indices.data(), this->indices.size(), GL_STATIC_DRAW);
+		}
+
+		//--------------------------------------------------------------
+		void Bursts::compact()
+		{
+			size_t numAlive = 0;
+			for (size_t i = 0; i < this->pos.size(); ++i)
+			{
+				if (this->age[i] > 0.0f)
+				{
+					if (numAlive != i)
+					{
+						this->pos[numAlive] = this->pos[i];
+						this->vel[numAlive] = this->vel[i];
+						this->acc[numAlive] = this->acc[i];
+						this->age[numAlive] = this->age[i];
+						this->links[numAlive] = this->links[i];
+					}
+					++numAlive;
+				}
+			}
+
+			this->pos.resize(numAlive);
+			this->vel.resize(numAlive);
+			this->acc.resize(numAlive);
+			this->age.resize(numAlive);
+			this->links.resize(numAlive);
+
+			this->zombies.clear();
+		}
+
+		//--------------------------------------------------------------
+		bool Bursts::check() const
+		{
+			auto ok = true;
+			const auto numParticles = this->pos.size();
+			if (this->vel.size() != numParticles || this->acc.size() != numParticles || this->age.size() != numParticles || this->links.size() != numParticles)
+			{
+				ofLogError("Bursts::check") << "Attributes of " << numParticles << " particles out of sync";
+				return false;
+			}
+
+			std::vector<bool> free(numParticles, false);
+			for (auto idx : this->zombies)
+			{
+				if (idx >= numParticles)
+				{
+					ofLogError("Bursts::check") << "Zombie " << idx << " past the end " << numParticles;
+					ok = false;
+				}
+				else if (free[idx])
+				{
+					ofLogError("Bursts::check") << "Zombie " << idx << " is in the free list twice";
+					ok = false;
+				}
+				else if (this->age[idx] > 0.0f)
+				{
+					ofLogError("Bursts::check") << "Zombie " << idx << " is alive";
+					ok = false;
+				}
+				else
+				{
+					free[idx] = true;
+				}
+			}
+			const auto numDead = std::count_if(this->age.begin(), this->age.end(), [](float age)
+			{
+				return age <= 0.0f;
+			});
+			if (numDead != this->zombies.size())
+			{
+				ofLogError("Bursts::check") << numDead << " dead particles but " << this->zombies.size() << " zombies";
+				ok = false;
+			}
+
+			std::vector<int> numLinks(numParticles, 0);
+			for (size_t k = 0; k + 1 < this->indices.size(); k += 2)
+			{
+				for (auto idx : { this->indices[k], this->indices[k + 1] })
+				{
+					if (idx >= numParticles || this->age[idx] <= 0.0f)
+					{
+						ofLogError("Bursts::check") << "Link " << k / 2 << " to dead particle " << idx;
+						ok = false;
+					}
+					else if (++numLinks[idx] > this->maxLinks)
+					{
+						ofLogError("Bursts::check") << "Particle " << idx << " has more than " << this->maxLinks << " links";
+						ok = false;
+					}
+				}
+			}
+			return ok;
+		}
+
+		//--------------------------------------------------------------
+		uint64_t Bursts::getStateHash() const
+		{
+			uint64_t hash = 14695981039346656037ull;
+			auto add = [&hash](const void * data, size_t size)
+			{
+				auto bytes = static_cast<const uint8_t *>(data);
+				for (size_t i = 0; i < size; ++i)
+				{
+					hash = (hash ^ bytes[i]) * 1099511628211ull;
+				}
+			};
+			add(this->pos.data(), this->pos.size() * sizeof(glm::vec3));
+			add(this->vel.data(), this->vel.size() * sizeof(glm::vec3));
+			add(this->age.data(), this->age.size() * sizeof(float));
+			add(this->zombies.data(), this->zombies.size() * sizeof(size_t));
+			add(this->indices.data(), this->indices.size() * sizeof(ofIndexType));
+			return hash;
+		}
+
+		//--------------------------------------------------------------
+		void Bursts::linkParticles()
+		{
+			this->indices.clear();
+
+			const auto numParticles = this->pos.size();
+			this->cellSize = this->worldBounds * this->maxDistance;
+			if (numParticles == 0 || this->cellSize <= 0.0f) return;
+
+			this->minDistSq = (this->worldBounds * this->minDistance) * (this->worldBounds * this->minDistance);
+			this->maxDistSq = this->cellSize * this->cellSize;
+
+			// With few particles, or cells so wide that most particles are in the
+			// 27 around any of them, particles fill up after testing the first few
+			// after them and the hash costs more than it saves.
+			const auto numCells = 2.0f * this->worldBounds / this->cellSize;
+			if (numParticles < size_t(BruteForceMaxParticles) || numCells < BruteForceMinCells)
+			{
+				this->linkParticlesBruteForce();
+				return;
+			}
+
+			// Hash the live particles, about two buckets per particle. Counts go to
+			// each bucket's end, filling backwards moves them to its start and
+			// leaves every bucket sorted.
+			uint32_t numBuckets = 64;
+			while (numBuckets < numParticles * 2)
+			{
+				numBuckets *= 2;
+			}
+			this->bucketMask = numBuckets - 1;
+
+			this->particleBuckets.resize(numParticles);
+			this->bucketStarts.assign(numBuckets + 1, 0);
+			for (size_t i = 0; i < numParticles; ++i)
+			{
+				if (this->age[i] > 0.0f)
+				{
+					this->particleBuckets[i] = getBucket(getCell(this->pos[i], this->cellSize), this->bucketMask);
+					++this->bucketStarts[this->particleBuckets[i]];
+				}
+				else
+				{
+					this->particleBuckets[i] = kInvalidBucket;
+				}
+			}
+			std::partial_sum(this->bucketStarts.begin(), this->bucketStarts.end(), this->bucketStarts.begin());
+			this->bucketParticles.resize(this->bucketStarts.back());
+			this->bucketPositions.resize(this->bucketStarts.back());
+			for (auto i = numParticles; i-- > 0;)
+			{
+				if (this->particleBuckets[i] != kInvalidBucket)
+				{
+					const auto k = --this->bucketStarts[this->particleBuckets[i]];
+					this->bucketParticles[k] = i;
+					this->bucketPositions[k] = this->pos[i];
+				}
+			}
+
+			// Gather the first candidates of every particle, only the ones after
+			// it so every pair is found once. Most particles are full before going
+			// through that many, the rest carry on from their cursor below.
+			const size_t limit = this->maxLinks * 2;
+			const int numBlocks = int((numParticles + LinkBlockSize - 1) / LinkBlockSize);
+			if (this->linkCandidates.size() < size_t(numBlocks))
+			{
+				this->linkCandidates.resize(numBlocks);
+			}
+#pragma omp parallel for schedule(dynamic, 1)
+			for (int block = 0; block < numBlocks; ++block)
+			{
+				auto & candidates = this->linkCandidates[block];
+				candidates.offsets.clear();
+				candidates.neighbours.clear();
+				candidates.more.clear();
+				candidates.cursors.clear();
+
+				const auto end = std::min(numParticles, size_t(block + 1) * LinkBlockSize);
+				for (auto i = size_t(block) * LinkBlockSize; i < end; ++i)
+				{
+					candidates.offsets.push_back(candidates.neighbours.size());
+					LinkCursor cursor{ 0, 0 };
+					auto more = false;
+					if (this->particleBuckets[i] != kInvalidBucket)
+					{
+						more = this->gatherLinkCandidates(i, cursor, limit, candidates.scratch);
+						candidates.neighbours.insert(candidates.neighbours.end(), candidates.scratch.begin(), candidates.scratch.end());
+					}
+					candidates.more.push_back(more);
+					candidates.cursors.push_back(cursor);
+				}
+				candidates.offsets.push_back(candidates.neighbours.size());
+			}
+
+			// Link in index order.
+			auto link = [this](size_t i, uint32_t j)
+			{
+				if (this->links[j] < this->maxLinks)
+				{
+					this->indices.push_back(i);
+					this->indices.push_back(j);
 
-			// Go through all particles and add lines to any that are close together.
-			const auto minDistSq = (this->worldBounds * this->minDistance) * (this->worldBounds * this->minDistance);
-			const auto maxDistSq = (this->worldBounds * this->maxDistance) * (this->worldBounds * this->maxDistance);
-			std::vector<ofIndexType> indices;
-			//auto & verts = this->vboMesh.getVertices();
-//#pragma omp parallel for collapse(2)
-			for (int i = 0; i < this->pos.size(); ++i)
+					++this->links[i];
+					++this->links[j];
+				}
+			};
+			for (int block = 0; block < numBlocks; ++block)
 			{
-				if (this->age[i] > 0.0f && this->links[i] < this->maxLinks)
+				auto & candidates = this->linkCandidates[block];
+				for (size_t k = 0; k + 1 < candidates.offsets.size(); ++k)
 				{
-					for (int j = i; j < this->pos.size(); ++j)
+					const auto i = size_t(block) * LinkBlockSize + k;
+					for (auto c = candidates.offsets[k]; c < candidates.offsets[k + 1] && this->links[i] < this->maxLinks; ++c)
+					{
+						link(i, candidates.neighbours[c]);
+					}
+
+					auto more = candidates.more[k] != 0;
+					while (more && this->links[i] < this->maxLinks)
 					{
-						if (this->age[j] > 0.0f && this->links[j] < this->maxLinks)
+						more = this->gatherLinkCandidates(i, candidates.cursors[k], limit, this->moreCandidates);
+						for (auto j : this->moreCandidates)
 						{
-							const auto distSq = glm::distance2(this->pos[i], this->pos[j]);
-							if (minDistSq <= distSq && distSq <= maxDistSq)
-							{
-								indices.push_back(i);
-								indices.push_back(j);
-
-								++this->links[i];
-								++this->links[j];
-							}
+							if (this->links[i] >= this->maxLinks) break;
+							link(i, j);
 						}
 					}
 				}
 			}
+		}
 
-			this->vbo.setIndexData(indices.data(), indices.size(), GL_STATIC_DRAW);
+		//--------------------------------------------------------------
+		void Bursts::linkParticlesBruteForce()
+		{
+			const auto numParticles = this->pos.size();
+			for (size_t i = 0; i < numParticles; ++i)
+			{
+				if (this->age[i] <= 0.0f) continue;
+
+				for (auto j = i + 1; j < numParticles && this->links[i] < this->maxLinks; ++j)
+				{
+					if (this->age[j] > 0.0f && this->links[j] < this->maxLinks)
+					{
+						const auto distSq = glm::distance2(this->pos[i], this->pos[j]);
+						if (this->minDistSq <= distSq && distSq <= this->maxDistSq)
+						{
+							this->indices.push_back(i);
+							this->indices.push_back(j);
+
+							++this->links[i];
+							++this->links[j];
+						}
+					}
+				}
+			}
+		}
+
+		//--------------------------------------------------------------
+		bool Bursts::gatherLinkCandidates(size_t i, LinkCursor & cursor, size_t limit, std::vector<uint32_t> & candidates) const
+		{
+			candidates.clear();
+
+			// Its own cell first. Neighbouring cells can hash to the same bucket,
+			// only search it once.
+			const auto cell = getCell(this->pos[i], this->cellSize);
+			std::array<uint32_t, 27> buckets;
+			size_t numBuckets = 0;
+			buckets[numBuckets++] = this->particleBuckets[i];
+			for (int z = -1; z <= 1; ++z)
+			{
+				for (int y = -1; y <= 1; ++y)
+				{
+					for (int x = -1; x <= 1; ++x)
+					{
+						const auto bucket = getBucket(cell + glm::ivec3(x, y, z), this->bucketMask);
+						if (std::find(buckets.begin(), buckets.begin() + numBuckets, bucket) == buckets.begin() + numBuckets)
+						{
+							buckets[numBuckets++] = bucket;
+						}
+					}
+				}
+			}
+
+			for (; cursor.bucket < numBuckets; ++cursor.bucket, cursor.offset = 0)
+			{
+				// Buckets are sorted, skip to the ones after it.
+				const auto first = this->bucketStarts[buckets[cursor.bucket]];
+				const auto last = this->bucketStarts[buckets[cursor.bucket] + 1];
+				const auto after = std::upper_bound(this->bucketParticles.begin() + first, this->bucketParticles.begin() + last, uint32_t(i));
+				cursor.offset = std::max(cursor.offset, uint32_t(after - this->bucketParticles.begin() - first));
+				for (; first + cursor.offset < last; ++cursor.offset)
+				{
+					// Full ones wouldn't be linked anyway.
+					const auto j = this->bucketParticles[first + cursor.offset];
+					if (this->links[j] >= this->maxLinks) continue;
+
+					const auto distSq = glm::distance2(this->pos[i], this->bucketPositions[first + cursor.offset]);
+					if (this->minDistSq <= distSq && distSq <= this->maxDistSq)
+					{
+						if (candidates.size() == limit) return true;
+						candidates.push_back(j);
+					}
+				}
+			}
+			return false;
 		}
 
 		//--------------------------------------------------------------
 		void Bursts::draw(float alpha)
 		{
+			if (this->headless) return;
+
 			ofPushStyle();
 			{
 				ofEnableAlphaBlending();
@@ -21,7 +21,9 @@ namespace entropy
 			Bursts();
 			~Bursts();
 
-			void init();
+			// A headless Bursts doesn't load its shader or upload anything, so it
+			// can be updated without a GL context.
+			void init(bool headless = false);
 			void exit();
 
 			void reset();
@@ -31,6 +33,25 @@ namespace entropy
 			void update(double dt);
 			void draw(float alpha = 1.0f);
 
+			// Every dead particle is in the free list once, the links are between
+			// live particles and within maxLinks. Logs what's wrong.
+			bool check() const;
+
+			// FNV-1a of the particles, the free list and the links, to compare runs.
+			uint64_t getStateHash() const;
+
+			size_t getNumParticles() const { return this->pos.size(); }
+			size_t getNumAlive() const { return this->pos.size() - this->zombies.size(); }
+			size_t getNumLinks() const { return this->indices.size() / 2; }
+
+			// Particles per block of the parallel link search.
+			static const int LinkBlockSize = 256;
+			// Links are found testing every pair below this many particles, or
+			// with fewer grid cells than this across the world, the default 0.25
+			// max distance gives 8.
+			static const int BruteForceMaxParticles = 1024;
+			static const int BruteForceMinCells = 10;
+
 			ofParameter<bool> enabled{ "Enabled", true };
 			ofParameter<int> resolution{ "Resolution", 8, 4, 64 };
 			ofParameter<ofFloatColor> color{ "Color", ofFloatColor::white };
@@ -41,6 +62,8 @@ namespace entropy
 			ofParameter<float> minDistance{ "Min Distance", 0.08f, 0.01f, 1.0f };
 			ofParameter<float> maxDistance{ "Max Distance", 0.25f, 0.01f, 1.0f };
 			ofParameter<int> maxLinks{ "Max Links", 8, 2, 64 };
+			// Frames between moving the live particles to the front, 0 to never.
+			ofParameter<int> compactRate{ "Compact Rate", 60, 0, 600 };
 
 			ofParameterGroup parameters{ "Bursts",
 				enabled,
@@ -50,10 +73,41 @@ namespace entropy
 				forceMultiplier, forceRandom,
 				worldBounds,
 				minDistance, maxDistance,
-				maxLinks
+				maxLinks,
+				compactRate
 			};
 
 		protected:
+			// Moves the live particles to the front in the same order, so the vbo
+			// only has live particles, and empties the free list.
+			void compact();
+
+			// Links every live particle to the ones between minDistance and
+			// maxDistance, at most maxLinks per particle. Neighbours are found in
+			// a uniform grid with cells maxDistance wide, hashed into buckets, and
+			// each particle links to the ones after it going through its own cell
+			// first. The first few candidates of every particle are gathered in
+			// parallel, then linked in index order so the links don't depend on
+			// the scheduling. Falls back to linkParticlesBruteForce when the grid
+			// doesn't pay off.
+			void linkParticles();
+
+			// Links every live particle to the ones after it in index order,
+			// testing every pair.
+			void linkParticlesBruteForce();
+
+			// Where the search for a particle's candidates is at, which of its
+			// neighbouring buckets and how far into it.
+			struct LinkCursor
+			{
+				uint32_t bucket;
+				uint32_t offset;
+			};
+
+			// The next limit candidates of particle i from the cursor on. Returns
+			// whether there are more.
+			bool gatherLinkCandidates(size_t i, LinkCursor & cursor, size_t limit, std::vector<uint32_t> & candidates) const;
+
 			ofVbo vbo;
 			ofShader shader;
 
@@ -65,7 +119,38 @@ namespace entropy
 
 			std::vector<float> age;
 			std::vector<int> links;
+			// Free list, dead particles in the order they died.
 			std::vector<size_t> zombies;
+			// The particles that died this update on each thread.
+			std::vector<std::vector<size_t>> threadZombies;
+
+			bool headless;
+			int frameCount;
+
+			// Spatial hash, the live particles of each bucket in index order and
+			// their positions.
+			std::vector<uint32_t> particleBuckets;
+			std::vector<uint32_t> bucketStarts;
+			std::vector<uint32_t> bucketParticles;
+			std::vector<glm::vec3> bucketPositions;
+			float cellSize;
+			uint32_t bucketMask;
+			float minDistSq;
+			float maxDistSq;
+
+			// Per block, the first candidates of each particle and where to
+			// carry on from if there are more.
+			struct LinkCandidates
+			{
+				std::vector<uint32_t> offsets;
+				std::vector<uint32_t> neighbours;
+				std::vector<uint8_t> more;
+				std::vector<LinkCursor> cursors;
+				std::vector<uint32_t> scratch;
+			};
+			std::vector<LinkCandidates> linkCandidates;
+			std::vector<uint32_t> moreCandidates;
+			std::vector<ofIndexType> indices;
 
 			std::vector<ofEventListener> parameterListeners;
 		};
@@ -2,10 +2,13 @@
 
 // Uncomment one of the following lines to pick the type of simulation.
 // Note that COMPUTE_GL_3D requires OpenGL 4.3 i.e. no OS X
+// COMPUTE_CPU_* run the ripples on the CPU, they only need GL to draw.
 #define COMPUTE_GL_2D 1
 #define COMPUTE_GL_3D 1
 //#define COMPUTE_CL_2D 1
 //#define COMPUTE_CL_3D 1
+//#define COMPUTE_CPU_2D 1
+//#define COMPUTE_CPU_3D 1
 
 #define USE_TEX_ARRAY 0
 #define USE_COMPUTE_SHADER 1
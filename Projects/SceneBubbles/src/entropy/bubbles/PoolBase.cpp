@@ -50,10 +50,12 @@ namespace entropy
 				{
 					// Compute a new frame every frame.
 					this->computeFrame();
-					this->setDrawTextureIndex(this->currIdx);
 
 					// Update the rate.
 					this->currRippleRate = this->rippleRate;
+
+					// The first cycle mixes from the frame drawn now.
+					this->setDrawTextureIndex(this->currRippleRate > 1 ? this->holdTarget() : this->currIdx);
 				}
 				else
 				{
@@ -61,7 +63,7 @@ namespace entropy
 					if (frame == 0)
 					{
 						// End of the cycle, draw the previous computed frame.
-						this->setDrawTextureIndex(this->currIdx);
+						this->setDrawTextureIndex(this->holdTarget());
 						
 						// Update the rate.
 						this->currRippleRate = this->rippleRate;
@@ -92,8 +94,28 @@ namespace entropy
 				this->addDrop();
 			}
 
-			this->stepRipple();
-			this->copyResult();
+			this->stepRipples(this->rippleSteps);
+		}
+
+		//--------------------------------------------------------------
+		void PoolBase::stepRipples(int numSteps)
+		{
+			for (int i = 0; i < numSteps; ++i)
+			{
+				if (i > 0)
+				{
+					std::swap(this->currIdx, this->prevIdx);
+				}
+
+				this->stepRipple();
+				this->copyResult();
+			}
+		}
+
+		//--------------------------------------------------------------
+		int PoolBase::holdTarget()
+		{
+			return this->currIdx;
 		}
 
 		/*
@@ -121,6 +143,7 @@ namespace entropy
 				ofxImGui::AddParameter(this->dropRate);
 
 				ofxImGui::AddParameter(this->rippleRate);
+				ofxImGui::AddParameter(this->rippleSteps);
 
 				ofxImGui::AddParameter(this->damping);
 				ofxImGui::AddParameter(this->radius);
@@ -39,6 +39,7 @@ namespace entropy
 			ofParameter<int> dropRate{ "Drop Rate", 1, 1, 60 };
 
 			ofParameter<int> rippleRate{ "Ripple Rate", 1, 1, 120 };
+			ofParameter<int> rippleSteps{ "Ripple Steps", 1, 1, 16 };
 
 			ofParameter<float> damping{ "Damping", 0.995f, 0.0f, 1.0f };
 			ofParameter<float> radius{ "Radius", 30.0f, 1.0f, 60.0f };
@@ -51,7 +52,7 @@ namespace entropy
 				alpha,
 				dropColor1, dropColor2,
 				dropping, dropRate,
-				rippleRate,
+				rippleRate, rippleSteps,
 				damping, radius, ringSize
 			};
 
@@ -65,8 +66,13 @@ namespace entropy
 			virtual void addDrop() = 0;
 			virtual void stepRipple() = 0;
 			virtual void copyResult() = 0;
+			virtual void stepRipples(int numSteps);
 			virtual void mixFrames(float pct) = 0;
 
+			// The buffer holding the frame reached at the end of a cycle, drawn
+			// and mixed from during the next one. Returns currIdx by default.
+			virtual int holdTarget();
+
 			virtual void setDrawTextureIndex(int idx) = 0;
 
 			glm::vec3 dimensions;
@@ -0,0 +1,167 @@
+#include "PoolCPU2D.h"
+
+#ifdef COMPUTE_CPU_2D
+
+#include "ofGraphics.h"
+
+namespace entropy
+{
+	namespace bubbles
+	{
+		//--------------------------------------------------------------
+		PoolCPU2D::PoolCPU2D()
+			: PoolBase()
+			, targetIdx(3)
+			, drawIdx(0)
+			, textureDirty(false)
+			, headless(false)
+		{
+			// Update parameter group.
+			this->parameters.setName("Pool CPU 2D");
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::init()
+		{
+			this->init(false);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::init(bool headless)
+		{
+			this->headless = headless;
+
+			PoolBase::init();
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::resize()
+		{
+			// Allocate the fields, the texture follows on the next upload.
+			this->ripple.allocate(glm::ivec2(this->dimensions));
+			this->textureDirty = true;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::reset()
+		{
+			PoolBase::reset();
+
+			// Clear the fields.
+			this->ripple.clear();
+			this->textureDirty = true;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::update(double dt)
+		{
+			PoolBase::update(dt);
+
+			if (!this->headless)
+			{
+				this->updateTexture();
+			}
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::addDrop()
+		{
+			// Same random draws in the same order as PoolGL2D, and the same flip.
+			const auto & color = (ofRandomuf() < 0.5 ? this->dropColor1.get() : this->dropColor2.get());
+			const auto x = ofRandom(0.0f, this->dimensions.x);
+			const auto y = ofRandom(0.0f, this->dimensions.y);
+
+			this->ripple.addRing(this->prevIdx, glm::vec3(x, this->dimensions.y - y, 0.0f), this->radius, 0.5f, color);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::stepRipple()
+		{
+			this->ripple.step(this->tempIdx, this->prevIdx, this->currIdx, this->damping / 10.0f + 0.9f);  // 0.9 - 1.0 range
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::copyResult()
+		{
+			this->ripple.swap(this->currIdx, this->tempIdx);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::stepRipples(int numSteps)
+		{
+			if (numSteps <= 1)
+			{
+				PoolBase::stepRipples(numSteps);
+				return;
+			}
+
+			// All the steps in one pass over the field, the newest ends up in prev.
+			this->ripple.advance(this->prevIdx, this->currIdx, this->tempIdx, this->damping / 10.0f + 0.9f, numSteps);
+			std::swap(this->currIdx, this->prevIdx);
+		}
+
+		//--------------------------------------------------------------
+		int PoolCPU2D::holdTarget()
+		{
+			this->ripple.copy(this->targetIdx, this->currIdx);
+			return this->targetIdx;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::mixFrames(float pct)
+		{
+			this->ripple.mix(this->tempIdx, this->targetIdx, this->currIdx, pct);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::setDrawTextureIndex(int idx)
+		{
+			this->drawIdx = idx;
+			this->textureDirty = true;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::updateTexture()
+		{
+			if (!this->textureDirty) return;
+
+			if (this->texture.getWidth() != this->dimensions.x || this->texture.getHeight() != this->dimensions.y)
+			{
+				// Same format as the GL pool.
+				this->texture.allocate(this->dimensions.x, this->dimensions.y, GL_RGBA16F);
+				this->texture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+			}
+			this->texture.loadData(this->ripple.getData(this->drawIdx), this->dimensions.x, this->dimensions.y, GL_RGBA);
+			this->textureDirty = false;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU2D::draw()
+		{
+			if (this->headless) return;
+
+			ofPushStyle();
+			{
+				ofEnableAlphaBlending();
+				ofSetColor(255, this->alpha * 255);
+
+				this->texture.draw(0, 0);
+			}
+			ofPopStyle();
+		}
+
+		//--------------------------------------------------------------
+		const ofTexture & PoolCPU2D::getTexture() const
+		{
+			return this->texture;
+		}
+
+		//--------------------------------------------------------------
+		const RippleCPU & PoolCPU2D::getRipple() const
+		{
+			return this->ripple;
+		}
+	}
+}
+
+#endif // COMPUTE_CPU_2D
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "entropy/bubbles/Constants.h"
+#ifdef COMPUTE_CPU_2D
+
+#include "ofTexture.h"
+
+#include "PoolBase.h"
+#include "RippleCPU.h"
+
+namespace entropy
+{
+	namespace bubbles
+	{
+		class PoolCPU2D
+			: public PoolBase
+		{
+		public:
+			PoolCPU2D();
+
+			// A headless pool never touches its texture, so it can be updated without
+			// a GL context.
+			void init() override;
+			void init(bool headless);
+			void resize() override;
+
+			void reset() override;
+			void update(double dt) override;
+			void draw() override;
+
+			const ofTexture & getTexture() const;
+			const RippleCPU & getRipple() const;
+
+		protected:
+			void addDrop() override;
+			void stepRipple() override;
+			void copyResult() override;
+			void stepRipples(int numSteps) override;
+			void mixFrames(float pct) override;
+			int holdTarget() override;
+			void setDrawTextureIndex(int idx) override;
+
+			void updateTexture();
+
+			RippleCPU ripple;
+
+			// The frame reached at the end of the last cycle, in its own buffer
+			// so computing the next one never writes into what's drawn.
+			int targetIdx;
+
+			ofTexture texture;
+			int drawIdx;
+			bool textureDirty;
+			bool headless;
+		};
+	}
+}
+#endif // COMPUTE_CPU_2D
@@ -0,0 +1,180 @@
+#include "PoolCPU3D.h"
+
+#ifdef COMPUTE_CPU_3D
+
+#include "ofGraphics.h"
+
+namespace entropy
+{
+	namespace bubbles
+	{
+		//--------------------------------------------------------------
+		PoolCPU3D::PoolCPU3D()
+			: PoolBase()
+			, targetIdx(3)
+			, drawIdx(0)
+			, textureDirty(false)
+			, headless(false)
+		{}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::init()
+		{
+			this->init(false);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::init(bool headless)
+		{
+			this->headless = headless;
+
+			PoolBase::init();
+
+			// Init parameters.
+			this->parameters.setName("Pool CPU 3D");
+			this->parameters.add(filterMode, volumeSize);
+
+			this->parameterListeners.push_back(this->filterMode.newListener([this](int & value)
+			{
+				if (this->headless) return;
+
+				GLuint mode = (static_cast<FilterMode>(value) == FilterMode::Linear ? GL_LINEAR : GL_NEAREST);
+				this->texture.setMinMagFilters(mode, mode);
+			}));
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::resize()
+		{
+			// Allocate the fields, the texture follows on the next upload.
+			this->ripple.allocate(glm::ivec3(this->dimensions));
+			this->textureDirty = true;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::reset()
+		{
+			PoolBase::reset();
+
+			// Clear the fields.
+			this->ripple.clear();
+			this->textureDirty = true;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::update(double dt)
+		{
+			PoolBase::update(dt);
+
+			if (!this->headless)
+			{
+				this->updateTexture();
+			}
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::addDrop()
+		{
+			// Same random draws in the same order as PoolGL3D.
+			const auto burstPos = glm::vec3(ofRandom(this->dimensions.x), ofRandom(this->dimensions.y), ofRandom(this->dimensions.z));
+			static const auto burstThickness = 1.0f;
+			const auto & color = (ofRandomuf() < 0.5 ? this->dropColor1.get() : this->dropColor2.get());
+
+			this->ripple.addRing(this->prevIdx, burstPos, this->radius, burstThickness, color);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::stepRipple()
+		{
+			this->ripple.step(this->tempIdx, this->prevIdx, this->currIdx, this->damping / 10.0f + 0.9f);  // 0.9 - 1.0 range
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::copyResult()
+		{
+			this->ripple.swap(this->currIdx, this->tempIdx);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::stepRipples(int numSteps)
+		{
+			if (numSteps <= 1)
+			{
+				PoolBase::stepRipples(numSteps);
+				return;
+			}
+
+			// All the steps in one pass over the field, the newest ends up in prev.
+			this->ripple.advance(this->prevIdx, this->currIdx, this->tempIdx, this->damping / 10.0f + 0.9f, numSteps);
+			std::swap(this->currIdx, this->prevIdx);
+		}
+
+		//--------------------------------------------------------------
+		int PoolCPU3D::holdTarget()
+		{
+			this->ripple.copy(this->targetIdx, this->currIdx);
+			return this->targetIdx;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::mixFrames(float pct)
+		{
+			this->ripple.mix(this->tempIdx, this->targetIdx, this->currIdx, pct);
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::setDrawTextureIndex(int idx)
+		{
+			this->drawIdx = idx;
+			this->textureDirty = true;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::updateTexture()
+		{
+			if (!this->textureDirty) return;
+
+			const auto & texData = this->texture.texData;
+			if (texData.width != this->dimensions.x || texData.height != this->dimensions.y || texData.depth != this->dimensions.z)
+			{
+				// Same format as the GL pool.
+				this->texture.allocate(this->dimensions.x, this->dimensions.y, this->dimensions.z, GL_RGBA16F);
+				GLuint mode = (static_cast<FilterMode>(this->filterMode.get()) == FilterMode::Linear ? GL_LINEAR : GL_NEAREST);
+				this->texture.setMinMagFilters(mode, mode);
+				this->volumetrics.setup(&this->texture, glm::vec3(1.0f));
+			}
+			this->texture.loadData(this->ripple.getData(this->drawIdx), this->dimensions.x, this->dimensions.y, this->dimensions.z, 0, 0, 0, GL_RGBA);
+			this->textureDirty = false;
+		}
+
+		//--------------------------------------------------------------
+		void PoolCPU3D::draw()
+		{
+			if (this->headless) return;
+
+			ofPushStyle();
+			{
+				ofEnableAlphaBlending();
+				ofSetColor(255, this->alpha * 255);
+
+				this->volumetrics.setRenderSettings(1.0, 1.0, 1.0, 0.1);
+				this->volumetrics.drawVolume(0.0f, 0.0f, 0.0f, this->volumeSize, 0);
+			}
+			ofPopStyle();
+		}
+
+		//--------------------------------------------------------------
+		const ofxTexture & PoolCPU3D::getDrawTexture() const
+		{
+			return this->texture;
+		}
+
+		//--------------------------------------------------------------
+		const RippleCPU & PoolCPU3D::getRipple() const
+		{
+			return this->ripple;
+		}
+	}
+}
+
+#endif // COMPUTE_CPU_3D
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "entropy/bubbles/Constants.h"
+#ifdef COMPUTE_CPU_3D
+
+#include "ofxVolumetrics3D.h"
+
+#include "PoolBase.h"
+#include "RippleCPU.h"
+
+namespace entropy
+{
+	namespace bubbles
+	{
+		class PoolCPU3D
+			: public PoolBase
+		{
+		public:
+			enum class FilterMode
+			{
+				Linear,
+				Nearest
+			};
+
+			PoolCPU3D();
+
+			// A headless pool never touches its texture, so it can be updated without
+			// a GL context.
+			void init() override;
+			void init(bool headless);
+			void resize() override;
+
+			void reset() override;
+			void update(double dt) override;
+			void draw() override;
+
+			ofParameter<int> filterMode{ "Filter Mode", static_cast<int>(FilterMode::Linear), static_cast<int>(FilterMode::Linear), static_cast<int>(FilterMode::Nearest) };
+			ofParameter<float> volumeSize{ "Volume Size", 800.0f, 512.0f, 12000.0f };
+
+			const ofxTexture & getDrawTexture() const;
+			const RippleCPU & getRipple() const;
+
+		protected:
+			void addDrop() override;
+			void stepRipple() override;
+			void copyResult() override;
+			void stepRipples(int numSteps) override;
+			void mixFrames(float pct) override;
+			int holdTarget() override;
+			void setDrawTextureIndex(int idx) override;
+
+			void updateTexture();
+
+			RippleCPU ripple;
+
+			// The frame reached at the end of the last cycle, in its own buffer
+			// so computing the next one never writes into what's drawn.
+			int targetIdx;
+
+			ofxTexture3d texture;
+			ofxVolumetrics3D volumetrics;
+			int drawIdx;
+			bool textureDirty;
+			bool headless;
+		};
+	}
+}
+
+#endif // COMPUTE_CPU_3D
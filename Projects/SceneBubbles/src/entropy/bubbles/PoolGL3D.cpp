@@ -383,6 +383,7 @@ namespace entropy
 					ofxImGui::AddParameter(this->bursts.worldBounds);
 					ofxImGui::AddRange("Distance", this->bursts.minDistance, this->bursts.maxDistance);
 					ofxImGui::AddParameter(this->bursts.maxLinks);
+					ofxImGui::AddParameter(this->bursts.compactRate);
 
 					ofxImGui::EndTree(settings);
 				}
@@ -0,0 +1,522 @@
+#include "RippleCPU.h"
+
+#include "ofUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace entropy
+{
+	namespace bubbles
+	{
+		namespace
+		{
+			//--------------------------------------------------------------
+			// Steps count floats of a row, the left and right neighbours are a cell
+			// (4 floats) away. Sums start from 0 like the shader, so a -0 neighbour
+			// gives the same sign.
+			inline void stepRow2D(float * out, const float * row, const float * rowDown, const float * rowUp, const float * center, int count, float damping)
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					const float sum = 0.0f + row[i - 4] + row[i + 4] + rowDown[i] + rowUp[i];
+					out[i] = (sum / 2.0f - center[i]) * damping;
+				}
+			}
+
+			//--------------------------------------------------------------
+			inline void stepRow3D(float * out, const float * row, const float * rowDown, const float * rowUp, const float * rowBack, const float * rowFront, const float * center, int count, float damping)
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					const float sum = 0.0f + row[i - 4] + row[i + 4] + rowDown[i] + rowUp[i] + rowBack[i] + rowFront[i];
+					out[i] = (sum / 3.0f - center[i]) * damping;
+				}
+			}
+		}
+
+		//--------------------------------------------------------------
+		RippleCPU::RippleCPU()
+			: halfPrecision(true)
+			, tileSize2D(256, 16)
+			, tileSize3D(64, 8)
+			, blockSize2D(512, 64, 1)
+			, blockSize3D(32, 32, 32)
+			, dimensions(0)
+			, threeD(false)
+		{}
+
+		//--------------------------------------------------------------
+		void RippleCPU::allocate(const glm::ivec2 & dimensions)
+		{
+			this->dimensions = glm::ivec3(dimensions.x, dimensions.y, 1);
+			this->threeD = false;
+			this->clear();
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::allocate(const glm::ivec3 & dimensions)
+		{
+			this->dimensions = dimensions;
+			this->threeD = true;
+			this->clear();
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::clear()
+		{
+			for (auto & buffer : this->buffers)
+			{
+				buffer.assign(this->getNumCells() * 4, 0.0f);
+			}
+			this->zeroRow.assign(this->dimensions.x * 4, 0.0f);
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::addRing(int idx, const glm::vec3 & center, float radius, float thickness, const ofFloatColor & color)
+		{
+			// 2D cells are sampled at their centre like the fragments that draw the
+			// circle, 3D cells at their corner like gl_GlobalInvocationID in drop3D.
+			const auto offset = this->threeD ? 0.0f : 0.5f;
+			const auto extent = glm::vec3(radius + thickness + 1.0f);
+			auto minCell = glm::max(glm::ivec3(glm::floor(center - extent)), glm::ivec3(0));
+			auto maxCell = glm::min(glm::ivec3(glm::ceil(center + extent)), this->dimensions - 1);
+			if (!this->threeD)
+			{
+				minCell.z = 0;
+				maxCell.z = 0;
+			}
+
+			float value[4] = { color.r, color.g, color.b, color.a };
+			if (this->halfPrecision)
+			{
+				this->roundRow(value, 4);
+			}
+
+			auto data = this->buffers[idx].data();
+			const int zBegin = minCell.z;
+			const int zEnd = maxCell.z + 1;
+#pragma omp parallel for
+			for (int z = zBegin; z < zEnd; ++z)
+			{
+				for (int y = minCell.y; y <= maxCell.y; ++y)
+				{
+					for (int x = minCell.x; x <= maxCell.x; ++x)
+					{
+						auto cellPos = glm::vec3(x + offset, y + offset, this->threeD ? z : center.z);
+						if (std::abs(glm::distance(center, cellPos) - radius) <= thickness)
+						{
+							auto cell = data + ((size_t(z) * this->dimensions.y + y) * this->dimensions.x + x) * 4;
+							std::memcpy(cell, value, sizeof(value));
+						}
+					}
+				}
+			}
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::step(int dstIdx, int prevIdx, int currIdx, float damping)
+		{
+			const auto then = ofGetElapsedTimeMicros();
+
+			auto dst = this->buffers[dstIdx].data();
+			const auto prev = this->buffers[prevIdx].data();
+			const auto curr = this->buffers[currIdx].data();
+
+			const auto size = glm::ivec2(this->dimensions.x, this->dimensions.y);
+			const auto tileSize = this->threeD ? this->tileSize3D : this->tileSize2D;
+			const auto numTiles = (size + tileSize - 1) / tileSize;
+			const int totalTiles = numTiles.x * numTiles.y;
+#pragma omp parallel for schedule(static)
+			for (int t = 0; t < totalTiles; ++t)
+			{
+				const auto from = glm::ivec2(t % numTiles.x, t / numTiles.x) * tileSize;
+				const auto to = glm::min(from + tileSize, size);
+				if (this->threeD)
+				{
+					this->stepTile3D(dst, prev, curr, damping, from, to);
+				}
+				else
+				{
+					this->stepTile2D(dst, prev, curr, damping, from, to);
+				}
+			}
+
+			this->stats.steps += 1;
+			this->stats.cells += this->getNumCells();
+			this->stats.micros += ofGetElapsedTimeMicros() - then;
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::stepTile2D(float * dst, const float * prev, const float * curr, float damping, const glm::ivec2 & from, const glm::ivec2 & to) const
+		{
+			const int width = this->dimensions.x;
+			const int height = this->dimensions.y;
+			const size_t rowStride = size_t(width) * 4;
+
+			for (int y = from.y; y < to.y; ++y)
+			{
+				// Out of range rows clamp to the edge.
+				const float * row = prev + y * rowStride;
+				const float * rowDown = prev + std::max(y - 1, 0) * rowStride;
+				const float * rowUp = prev + std::min(y + 1, height - 1) * rowStride;
+				const float * center = curr + y * rowStride;
+				float * out = dst + y * rowStride;
+
+				const int begin = std::max(from.x, 1) * 4;
+				const int end = std::min(to.x, width - 1) * 4;
+				if (begin < end)
+				{
+					stepRow2D(out + begin, row + begin, rowDown + begin, rowUp + begin, center + begin, end - begin, damping);
+				}
+
+				// Edge cells clamp left and right too.
+				for (int x : { 0, width - 1 })
+				{
+					if (x < from.x || x >= to.x) continue;
+					const int left = std::max(x - 1, 0) * 4;
+					const int right = std::min(x + 1, width - 1) * 4;
+					for (int c = 0; c < 4; ++c)
+					{
+						const int i = x * 4 + c;
+						const float sum = 0.0f + row[left + c] + row[right + c] + rowDown[i] + rowUp[i];
+						out[i] = (sum / 2.0f - center[i]) * damping;
+					}
+					if (width == 1) break;
+				}
+
+				if (this->halfPrecision)
+				{
+					this->roundRow(out + from.x * 4, (to.x - from.x) * 4);
+				}
+			}
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::stepTile3D(float * dst, const float * prev, const float * curr, float damping, const glm::ivec2 & from, const glm::ivec2 & to) const
+		{
+			const int width = this->dimensions.x;
+			const int height = this->dimensions.y;
+			const int depth = this->dimensions.z;
+			const size_t rowStride = size_t(width) * 4;
+			const size_t planeStride = rowStride * height;
+			const float * zero = this->zeroRow.data();
+
+			// Stream the tile through z, the planes above and below it are still in
+			// cache from the previous and next slices.
+			for (int z = 0; z < depth; ++z)
+			{
+				for (int y = from.y; y < to.y; ++y)
+				{
+					// Out of range neighbours are zero.
+					const size_t offset = z * planeStride + y * rowStride;
+					const float * row = prev + offset;
+					const float * rowDown = (y > 0) ? row - rowStride : zero;
+					const float * rowUp = (y < height - 1) ? row + rowStride : zero;
+					const float * rowBack = (z > 0) ? row - planeStride : zero;
+					const float * rowFront = (z < depth - 1) ? row + planeStride : zero;
+					const float * center = curr + offset;
+					float * out = dst + offset;
+
+					const int begin = std::max(from.x, 1) * 4;
+					const int end = std::min(to.x, width - 1) * 4;
+					if (begin < end)
+					{
+						stepRow3D(out + begin, row + begin, rowDown + begin, rowUp + begin, rowBack + begin, rowFront + begin, center + begin, end - begin, damping);
+					}
+
+					for (int x : { 0, width - 1 })
+					{
+						if (x < from.x || x >= to.x) continue;
+						for (int c = 0; c < 4; ++c)
+						{
+							const int i = x * 4 + c;
+							const float left = (x > 0) ? row[i - 4] : 0.0f;
+							const float right = (x < width - 1) ? row[i + 4] : 0.0f;
+							const float sum = 0.0f + left + right + rowDown[i] + rowUp[i] + rowBack[i] + rowFront[i];
+							out[i] = (sum / 3.0f - center[i]) * damping;
+						}
+						if (width == 1) break;
+					}
+
+					if (this->halfPrecision)
+					{
+						this->roundRow(out + from.x * 4, (to.x - from.x) * 4);
+					}
+				}
+			}
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::advance(int latestIdx, int previousIdx, int tempIdx, float damping, int numSteps)
+		{
+			if (numSteps <= 1)
+			{
+				// A single step doesn't need the halos.
+				this->step(tempIdx, latestIdx, previousIdx, damping);
+				std::swap(this->buffers[previousIdx], this->buffers[latestIdx]);
+				std::swap(this->buffers[latestIdx], this->buffers[tempIdx]);
+				return;
+			}
+
+			const auto then = ofGetElapsedTimeMicros();
+
+			// The tiles read latest and previous and write temp and spare, nothing
+			// is overwritten while another tile might still need it.
+			this->spare.resize(this->buffers[tempIdx].size());
+			auto dstLatest = this->buffers[tempIdx].data();
+			auto dstPrevious = this->spare.data();
+			const auto latest = this->buffers[latestIdx].data();
+			const auto previous = this->buffers[previousIdx].data();
+
+			const auto blockSize = this->threeD ? this->blockSize3D : this->blockSize2D;
+			const auto numBlocks = (this->dimensions + blockSize - 1) / blockSize;
+			const int totalBlocks = numBlocks.x * numBlocks.y * numBlocks.z;
+#pragma omp parallel
+			{
+				// Each thread keeps its tile buffers from one tile to the next.
+				std::vector<float> local[3];
+#pragma omp for schedule(dynamic, 1)
+				for (int b = 0; b < totalBlocks; ++b)
+				{
+					const auto from = glm::ivec3(b % numBlocks.x, (b / numBlocks.x) % numBlocks.y, b / (numBlocks.x * numBlocks.y)) * blockSize;
+					const auto to = glm::min(from + blockSize, this->dimensions);
+					this->advanceTile(local, dstLatest, dstPrevious, latest, previous, damping, numSteps, from, to);
+				}
+			}
+
+			std::swap(this->buffers[latestIdx], this->buffers[tempIdx]);
+			std::swap(this->buffers[previousIdx], this->spare);
+
+			this->stats.steps += numSteps;
+			this->stats.cells += this->getNumCells() * numSteps;
+			this->stats.micros += ofGetElapsedTimeMicros() - then;
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::advanceTile(std::vector<float> (&local)[3], float * dstLatest, float * dstPrevious, const float * latest, const float * previous, float damping, int numSteps, const glm::ivec3 & from, const glm::ivec3 & to) const
+		{
+			const auto & dims = this->dimensions;
+
+			// Load the tile and numSteps cells around it, each step shrinks the part
+			// that's still exact by one cell, except on the edges of the field.
+			auto lo = glm::max(from - numSteps, glm::ivec3(0));
+			auto hi = glm::min(to + numSteps, dims);
+			if (!this->threeD)
+			{
+				lo.z = 0;
+				hi.z = 1;
+			}
+
+			// One ghost cell around what's loaded holds the boundary, zero in 3D and
+			// a copy of the edge in 2D.
+			const auto ghost = glm::ivec3(1, 1, this->threeD ? 1 : 0);
+			const auto size = hi - lo + ghost * 2;
+			const size_t rowStride = size_t(size.x) * 4;
+			const size_t planeStride = rowStride * size.y;
+			auto index = [&](int x, int y, int z)
+			{
+				return (z - lo.z + ghost.z) * planeStride + (y - lo.y + ghost.y) * rowStride + (x - lo.x + ghost.x) * 4;
+			};
+			for (auto & buffer : local)
+			{
+				buffer.resize(planeStride * size.z);
+				if (this->threeD)
+				{
+					// Only the ghosts need clearing, the rest is loaded or computed
+					// before it's read.
+					auto data = buffer.data();
+					std::fill(data + index(lo.x - 1, lo.y - 1, lo.z - 1), data + index(lo.x - 1, lo.y - 1, lo.z), 0.0f);
+					std::fill(data + index(lo.x - 1, lo.y - 1, hi.z), data + index(lo.x - 1, lo.y - 1, hi.z + 1), 0.0f);
+					for (int z = lo.z; z < hi.z; ++z)
+					{
+						std::fill(data + index(lo.x - 1, lo.y - 1, z), data + index(lo.x - 1, lo.y, z), 0.0f);
+						std::fill(data + index(lo.x - 1, hi.y, z), data + index(lo.x - 1, hi.y + 1, z), 0.0f);
+						for (int y = lo.y; y < hi.y; ++y)
+						{
+							std::fill(data + index(lo.x - 1, y, z), data + index(lo.x, y, z), 0.0f);
+							std::fill(data + index(hi.x, y, z), data + index(hi.x + 1, y, z), 0.0f);
+						}
+					}
+				}
+			}
+
+			const size_t fieldRowStride = size_t(dims.x) * 4;
+			const size_t fieldPlaneStride = fieldRowStride * dims.y;
+			const size_t loadSize = size_t(hi.x - lo.x) * 4 * sizeof(float);
+			for (int z = lo.z; z < hi.z; ++z)
+			{
+				for (int y = lo.y; y < hi.y; ++y)
+				{
+					const size_t offset = z * fieldPlaneStride + y * fieldRowStride + lo.x * 4;
+					std::memcpy(local[0].data() + index(lo.x, y, z), latest + offset, loadSize);
+					std::memcpy(local[1].data() + index(lo.x, y, z), previous + offset, loadSize);
+				}
+			}
+
+			int latestLocal = 0;
+			int previousLocal = 1;
+			int freeLocal = 2;
+			for (int s = 1; s <= numSteps; ++s)
+			{
+				float * prev = local[latestLocal].data();
+				const float * curr = local[previousLocal].data();
+				float * dst = local[freeLocal].data();
+
+				if (!this->threeD)
+				{
+					// Clamp to the edge.
+					if (lo.x == 0)
+					{
+						for (int y = lo.y; y < hi.y; ++y)
+						{
+							std::memcpy(prev + index(-1, y, 0), prev + index(0, y, 0), 4 * sizeof(float));
+						}
+					}
+					if (hi.x == dims.x)
+					{
+						for (int y = lo.y; y < hi.y; ++y)
+						{
+							std::memcpy(prev + index(dims.x, y, 0), prev + index(dims.x - 1, y, 0), 4 * sizeof(float));
+						}
+					}
+					if (lo.y == 0)
+					{
+						std::memcpy(prev + index(lo.x, -1, 0), prev + index(lo.x, 0, 0), loadSize);
+					}
+					if (hi.y == dims.y)
+					{
+						std::memcpy(prev + index(lo.x, dims.y, 0), prev + index(lo.x, dims.y - 1, 0), loadSize);
+					}
+				}
+
+				auto stepLo = glm::ivec3(0);
+				auto stepHi = glm::ivec3(1);
+				for (int a = 0; a < (this->threeD ? 3 : 2); ++a)
+				{
+					stepLo[a] = (lo[a] == 0) ? 0 : lo[a] + s;
+					stepHi[a] = (hi[a] == dims[a]) ? dims[a] : hi[a] - s;
+				}
+
+				const int count = (stepHi.x - stepLo.x) * 4;
+				for (int z = stepLo.z; z < stepHi.z; ++z)
+				{
+					for (int y = stepLo.y; y < stepHi.y; ++y)
+					{
+						const size_t offset = index(stepLo.x, y, z);
+						if (this->threeD)
+						{
+							stepRow3D(dst + offset, prev + offset, prev + offset - rowStride, prev + offset + rowStride, prev + offset - planeStride, prev + offset + planeStride, curr + offset, count, damping);
+						}
+						else
+						{
+							stepRow2D(dst + offset, prev + offset, prev + offset - rowStride, prev + offset + rowStride, curr + offset, count, damping);
+						}
+						if (this->halfPrecision)
+						{
+							this->roundRow(dst + offset, count);
+						}
+					}
+				}
+
+				const int newLatest = freeLocal;
+				freeLocal = previousLocal;
+				previousLocal = latestLocal;
+				latestLocal = newLatest;
+			}
+
+			// Only the tile goes back, the halo was someone else's.
+			const size_t storeSize = size_t(to.x - from.x) * 4 * sizeof(float);
+			for (int z = from.z; z < to.z; ++z)
+			{
+				for (int y = from.y; y < to.y; ++y)
+				{
+					const size_t offset = z * fieldPlaneStride + y * fieldRowStride + from.x * 4;
+					std::memcpy(dstLatest + offset, local[latestLocal].data() + index(from.x, y, z), storeSize);
+					std::memcpy(dstPrevious + offset, local[previousLocal].data() + index(from.x, y, z), storeSize);
+				}
+			}
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::mix(int dstIdx, int prevIdx, int currIdx, float pct)
+		{
+			auto dst = this->buffers[dstIdx].data();
+			const auto prev = this->buffers[prevIdx].data();
+			const auto curr = this->buffers[currIdx].data();
+
+			// One row per iteration, there's no neighbourhood to keep in cache.
+			const int numRows = this->dimensions.y * this->dimensions.z;
+			const int rowSize = this->dimensions.x * 4;
+#pragma omp parallel for schedule(static)
+			for (int r = 0; r < numRows; ++r)
+			{
+				const size_t offset = size_t(r) * rowSize;
+				for (int i = 0; i < rowSize; ++i)
+				{
+					// GLSL mix() is x * (1 - a) + y * a.
+					dst[offset + i] = prev[offset + i] * (1.0f - pct) + curr[offset + i] * pct;
+				}
+				if (this->halfPrecision)
+				{
+					this->roundRow(dst + offset, rowSize);
+				}
+			}
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::swap(int idxA, int idxB)
+		{
+			std::swap(this->buffers[idxA], this->buffers[idxB]);
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::copy(int dstIdx, int srcIdx)
+		{
+			this->buffers[dstIdx] = this->buffers[srcIdx];
+		}
+
+		//--------------------------------------------------------------
+		float RippleCPU::roundToHalf(float value)
+		{
+			// No branches, so rows of these vectorize.
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			const uint32_t sign = bits & 0x80000000u;
+			const uint32_t magnitude = bits ^ sign;
+
+			// Normal halves keep 10 of the 23 mantissa bits.
+			const uint32_t normal = (magnitude + 0x0fffu + ((magnitude >> 13) & 1u)) & ~0x1fffu;
+
+			// Subnormal halves are multiples of 2^-24, which is the float spacing
+			// between 0.5 and 1.
+			float subnormal;
+			std::memcpy(&subnormal, &magnitude, sizeof(subnormal));
+			subnormal = (subnormal + 0.5f) - 0.5f;
+			uint32_t subnormalBits;
+			std::memcpy(&subnormalBits, &subnormal, sizeof(subnormalBits));
+
+			// Selects with masks, 65520 and up round to inf and NaN stays NaN.
+			const uint32_t isNormal = 0u - uint32_t(magnitude >= 0x38800000u);
+			const uint32_t isInf = 0u - uint32_t(magnitude >= 0x477ff000u);
+			const uint32_t isNaN = 0u - uint32_t(magnitude > 0x7f800000u);
+			uint32_t rounded = (normal & isNormal) | (subnormalBits & ~isNormal);
+			rounded = (0x7f800000u & isInf) | (rounded & ~isInf);
+			rounded = (magnitude & isNaN) | (rounded & ~isNaN);
+
+			bits = sign | rounded;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		//--------------------------------------------------------------
+		void RippleCPU::roundRow(float * row, int count) const
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				row[i] = roundToHalf(row[i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "ofColor.h"
+#include "ofVectorMath.h"
+
+namespace entropy
+{
+	namespace bubbles
+	{
+		// The ripple fields of the CPU pools, four RGBA float buffers like the
+		// textures of the GL pools, stepped the same way as ripple.frag (2D) and
+		// ripple3D.comp (3D).
+		//
+		// The field is split in tiles that are stepped in parallel, a 3D tile is
+		// a column of cells streamed through z so the three planes of the
+		// previous buffer it reads stay in cache. Rows inside a tile are plain
+		// float loops the compiler vectorizes.
+		//
+		// Sums are done in the shaders' order, and with halfPrecision every
+		// value written is rounded to the nearest half like the RGBA16F textures.
+		// RippleBenchmark checks the bits against a CPU transcription of the
+		// shaders, not against a readback of the GL pools, so the driver's own
+		// float rounding isn't covered.
+		class RippleCPU
+		{
+		public:
+			struct Stats
+			{
+				uint64_t steps = 0;
+				uint64_t cells = 0;
+				uint64_t micros = 0;
+
+				double getCellsPerSecond() const
+				{
+					return this->micros ? this->cells * 1000000.0 / this->micros : 0.0;
+				}
+			};
+
+			RippleCPU();
+
+			// 2D fields clamp to the edge like the sampler2DRect of ripple.frag,
+			// 3D fields are zero outside like imageLoad in ripple3D.comp.
+			void allocate(const glm::ivec2 & dimensions);
+			void allocate(const glm::ivec3 & dimensions);
+
+			void clear();
+
+			// Sets the cells within thickness of the sphere (circle in 2D) to color,
+			// like drop3D.comp.
+			void addRing(int idx, const glm::vec3 & center, float radius, float thickness, const ofFloatColor & color);
+
+			// dst = (average of the prev neighbours - curr) * damping.
+			void step(int dstIdx, int prevIdx, int currIdx, float damping);
+
+			// Advances numSteps steps. latest has the newest field and previous the one
+			// before, like prev and curr after PoolBase's swap, and they still do
+			// afterwards. temp is scratch.
+			//
+			// The steps are done a tile at a time while it's in cache, each tile loads
+			// numSteps cells around itself so it doesn't need its neighbours, and the
+			// fields are read and written once for all the steps. Same bits as
+			// calling step() numSteps times.
+			void advance(int latestIdx, int previousIdx, int tempIdx, float damping, int numSteps);
+
+			// dst = mix(prev, curr, pct).
+			void mix(int dstIdx, int prevIdx, int currIdx, float pct);
+
+			// Swaps two buffers, what copyResult does on the GPU.
+			void swap(int idxA, int idxB);
+
+			// dst = src.
+			void copy(int dstIdx, int srcIdx);
+
+			const glm::ivec3 & getDimensions() const { return this->dimensions; }
+			bool is3D() const { return this->threeD; }
+			size_t getNumCells() const { return size_t(this->dimensions.x) * this->dimensions.y * this->dimensions.z; }
+
+			// RGBA floats, x first then y then z.
+			const float * getData(int idx) const { return this->buffers[idx].data(); }
+			float * getData(int idx) { return this->buffers[idx].data(); }
+
+			const Stats & getStats() const { return this->stats; }
+			void resetStats() { this->stats = Stats(); }
+
+			// Rounds to the nearest half, ties to even, like a store to RGBA16F.
+			static float roundToHalf(float value);
+
+			bool halfPrecision;
+
+			// Cells per tile in x and y, 3D tiles go through the whole depth.
+			glm::ivec2 tileSize2D;
+			glm::ivec2 tileSize3D;
+
+			// Cells per tile in advance(), without the halo.
+			glm::ivec3 blockSize2D;
+			glm::ivec3 blockSize3D;
+
+		protected:
+			void stepTile2D(float * dst, const float * prev, const float * curr, float damping, const glm::ivec2 & from, const glm::ivec2 & to) const;
+			void stepTile3D(float * dst, const float * prev, const float * curr, float damping, const glm::ivec2 & from, const glm::ivec2 & to) const;
+
+			void advanceTile(std::vector<float> (&local)[3], float * dstLatest, float * dstPrevious, const float * latest, const float * previous, float damping, int numSteps, const glm::ivec3 & from, const glm::ivec3 & to) const;
+
+			void roundRow(float * row, int count) const;
+
+			std::vector<float> buffers[4];
+			std::vector<float> spare;
+			std::vector<float> zeroRow;
+
+			glm::ivec3 dimensions;
+			bool threeD;
+
+			Stats stats;
+		};
+	}
+}
@@ -16,6 +16,12 @@
 #ifdef COMPUTE_CL_3D
 #include "CmbSceneCL3D.h"
 #endif
+#ifdef COMPUTE_CPU_2D
+#include "entropy/bubbles/PoolCPU2D.h"
+#endif
+#ifdef COMPUTE_CPU_3D
+#include "entropy/bubbles/PoolCPU3D.h"
+#endif
 
 namespace entropy
 {
@@ -53,7 +59,7 @@ namespace entropy
 #ifdef COMPUTE_GL_2D
 			entropy::bubbles::PoolGL2D pool2D;
 #endif
-#ifdef COMPUTE_GL_2D
+#ifdef COMPUTE_GL_3D
 			entropy::bubbles::PoolGL3D pool3D;
 #endif
 #ifdef COMPUTE_CL_2D
@@ -62,6 +68,12 @@ namespace entropy
 #ifdef COMPUTE_CL_3D
 			entropy::bubbles::PoolCL3D pool3D;
 #endif
+#ifdef COMPUTE_CPU_2D
+			entropy::bubbles::PoolCPU2D pool2D;
+#endif
+#ifdef COMPUTE_CPU_3D
+			entropy::bubbles::PoolCPU3D pool3D;
+#endif
 
 			geom::Sphere sphereGeom;
 			ofTexture sphereTexture;
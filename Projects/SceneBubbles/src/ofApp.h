@@ -13,6 +13,12 @@
 #ifdef COMPUTE_GL_3D
 	#include "entropy/bubbles/PoolGL3D.h"
 #endif
+#ifdef COMPUTE_CPU_2D
+	#include "entropy/bubbles/PoolCPU2D.h"
+#endif
+#ifdef COMPUTE_CPU_3D
+	#include "entropy/bubbles/PoolCPU3D.h"
+#endif
 #include "entropy/geom/Box.h"
 #include "entropy/geom/Sphere.h"
 #include "entropy/render/PostEffects.h"
@@ -51,9 +57,15 @@ protected:
 #ifdef COMPUTE_GL_2D
 	entropy::bubbles::PoolGL2D pool2D;
 #endif
-#ifdef COMPUTE_GL_2D
+#ifdef COMPUTE_GL_3D
 	entropy::bubbles::PoolGL3D pool3D;
 #endif
+#ifdef COMPUTE_CPU_2D
+	entropy::bubbles::PoolCPU2D pool2D;
+#endif
+#ifdef COMPUTE_CPU_3D
+	entropy::bubbles::PoolCPU3D pool3D;
+#endif
 
 	entropy::geom::Box boxGeom;
 
@@ -29,16 +29,26 @@
  *  POSSIBILITY OF SUCH DAMAGE. 
  *
  */
-
-/* Currently this octree just builds to a maximum depth rather than a number of particles
- * per subdivision that way memory allocation has to only happen once and particles don't have
- * to be moved around if a subdivision becomes too full */
+/* Barnes-Hut octree over the particles of a ParticleStore. Nodes split while
+ * they hold more than MAX_LEAF_SIZE particles so dense clusters get deeper
+ * subdivisions instead of degrading to O(n^2) inside a fixed depth leaf.
+ *
+ * Nodes live in one array, the 8 children of a node are contiguous and
+ * always come after their parent, and the particles of a node are a range
+ * of the points array so building doesn't allocate once the arrays have
+ * grown to the number of particles.
+ *
+ * Every node stores the monopole, dipole and quadrupole moments of its
+ * charges around the center of charge (weighted by abs charge like before).
+ * With QUADRUPOLES off only the monopole is used, which is cheaper but needs
+ * a smaller THETA for the same accuracy, computeForceError measures it. */
 
 #pragma once
 
 #include "ofMain.h"
 
 #include "tbb/tbb.h"
+#include "ParticleStore.h"
 
 namespace nm
 {
@@ -48,13 +58,8 @@ namespace nm
 	public:
 		typedef shared_ptr<Octree> Ptr;
 
-		// hacky C++11 way to get around static const vars in template class
-		// have actually made a cpp class now so can change these back to 
-		// vars rather than functions
-		static constexpr unsigned POINTS_START_SIZE() { return 40; }
-		static constexpr unsigned MAX_DEPTH() { return 4; }
-		static constexpr float THETA() { return .5f; }
-		//static constexpr float FORCE_MULTIPLIER() { return 5e7; }
+		// hard limit so coincident particles don't split forever
+		static constexpr unsigned MAX_DEPTH() { return 16; }
 
 		static ofParameter<float> & CANDIDATE_DISTANCE(){
 			static ofParameter<float> p{"canditate distance", 50.f, 1.f, 100.f, ofParameterScale::Logarithmic};
@@ -64,11 +69,48 @@ namespace nm
 			static ofParameter<float> p{"interaction distance", 20.f, 1.f, 50.f, ofParameterScale::Logarithmic};
 			return p;
 		}
+		// a node is used as a whole when its size / distance is under theta
+		static ofParameter<float> & THETA(){
+			static ofParameter<float> p{"theta", .5f, 0.f, 1.5f};
+			return p;
+		}
+		static ofParameter<int> & MAX_LEAF_SIZE(){
+			static ofParameter<int> p{"max leaf size", 16, 1, 256};
+			return p;
+		}
+		// keep the topology from frame to frame and only move the particles
+		// that left their leaf, see update()
+		static ofParameter<bool> & INCREMENTAL(){
+			static ofParameter<bool> p{"incremental", true};
+			return p;
+		}
+		// rebuild once a leaf holds this many times MAX_LEAF_SIZE particles
+		// or the tree was built for this many times the current particles
+		static ofParameter<float> & REBUILD_IMBALANCE(){
+			static ofParameter<float> p{"rebuild imbalance", 2.f, 1.f, 8.f};
+			return p;
+		}
+		static ofParameter<bool> & QUADRUPOLES(){
+			static ofParameter<bool> p{"quadrupoles", true};
+			return p;
+		}
+		// added to the squared distance between two particles so coincident
+		// particles (pair production creates them) don't get infinite forces
+		static ofParameter<float> & SOFTENING(){
+			static ofParameter<float> p{"softening", 1.f, 0.f, 10.f};
+			return p;
+		}
 		static ofParameterGroup PARAMETERS(){
 			return {
 				"Octree",
 				CANDIDATE_DISTANCE(),
 				INTERACTION_DISTANCE(),
+				THETA(),
+				MAX_LEAF_SIZE(),
+				INCREMENTAL(),
+				REBUILD_IMBALANCE(),
+				QUADRUPOLES(),
+				SOFTENING(),
 			};
 		}
 
@@ -81,71 +123,190 @@ namespace nm
 			Z_SIDE = 0x04
 		};
 
-		Octree();
-		~Octree();
+		// symmetric traceless, sum of q * (3 r r^T - |r|^2 I)
+		struct Quadrupole
+		{
+			float xx, xy, xz, yy, yz, zz;
 
-		void init(const ofVec3f& min, const ofVec3f& max, unsigned depth = 0);
+			inline glm::vec3 operator*(const glm::vec3 & r) const{
+				return glm::vec3(xx * r.x + xy * r.y + xz * r.z,
+								 xy * r.x + yy * r.y + yz * r.z,
+								 xz * r.x + yz * r.y + zz * r.z);
+			}
+		};
 
-		//void updateCenterOfMass();
+		struct Node
+		{
+			glm::vec3 min, max;
+			float size;
+			unsigned depth;
 
-		void updateCenterOfCharge();
+			// index of the first of the 8 children, 0 for leaves
+			unsigned firstChild;
 
-		// if close enough to another point to annihilate it, return that point
-		void sumForces(T& point);// , float forceMultiplier);
-		void findNearestThan(const T& point, float distance, std::vector<T*> & near) const;
+			// the points of the node are points[begin, end)
+			unsigned begin, end;
 
-		template<typename Type>
-		void findNearestThanByType(const T& point, float distance, std::initializer_list<Type> allowedTypes, std::vector<T*> & near) const;
+			float charge;
+			float absCharge;
+			glm::vec3 centerOfCharge;
+			glm::vec3 dipole;
+			Quadrupole quadrupole;
 
-		void addPoint(T& point);
+			inline bool isLeaf() const { return firstChild == 0; }
+			inline bool empty() const { return begin == end; }
+			inline unsigned numPoints() const { return end - begin; }
+		};
 
-		template<size_t N>
-		void addPoints(array<T,N>& points) { addPointsSerial(points); }
-		void addPoints(vector<T>& points) { addPointsSerial(points); }
-		void addPoints(T* points, unsigned numPoints) { addPointsSerial(points, numPoints); }
+		// error of the tree forces against the direct sum for a sample of
+		// the particles, relative to the magnitude of the direct force
+		struct ForceError
+		{
+			size_t numSamples = 0;
+			double meanRelative = 0;
+			double rmsRelative = 0;
+			double maxRelative = 0;
+			uint64_t treeMicros = 0;
+			uint64_t directMicros = 0;
+		};
 
-		template<size_t N>
-		void addPointsSerial(array<T,N>& points);
-		void addPointsSerial(vector<T>& points);
-		void addPointsSerial(T* points, unsigned numPoints);
+		struct UpdateStats
+		{
+			bool rebuilt = true;
+			size_t moved = 0;
+			float imbalance = 1.f;
+		};
 
-		template<size_t N>
-		void addPointsParallel(array<T,N>& points);
-		void addPointsParallel(vector<T>& points);
-		void addPointsParallel(T* points, unsigned numPoints);
+		Octree();
 
-		void clear();
+		void init(const ofVec3f& min, const ofVec3f& max);
 
-		void debugDraw(unsigned depth);
+		// rebuilds the tree from the alive particles, leaves the moments
+		// to updateMoments
+		void build(const ParticleStore& particles);
+
+		// with INCREMENTAL on, keeps the nodes of the last build and only
+		// moves the particles that left their leaf, particles removed from
+		// the store are dropped and new ones inserted. Falls back to build()
+		// when the tree gets too unbalanced for the current particles.
+		// Particles are followed by handle so the store can be compacted
+		// between updates
+		void update(const ParticleStore& particles);
+		const UpdateStats & getUpdateStats() const { return updateStats; }
+
+		// bottom-up, leaves in parallel and then every parent from its children
+		void updateMoments(const ParticleStore& particles);
+
+		// adds the force on every particle in the tree to its force and its
+		// interaction candidates to its partners. Particles in the same leaf
+		// share the traversal, the nodes that are far enough from the whole
+		// leaf are used as multipoles and the rest is summed directly
+		void sumForces(ParticleStore& particles) const;
+
+		// same for a single particle
+		void sumForces(ParticleStore& particles, unsigned point) const;
+
+		// tree force on a particle without touching the store
+		glm::vec3 getForce(const ParticleStore& particles, unsigned point) const;
 
-		void addChildren(bool recursive);
+		// O(n) reference
+		static glm::vec3 getDirectForce(const ParticleStore& particles, unsigned point);
 
-		inline float getCharge() const { return charge; }
+		// compares getForce against getDirectForce for numSamples particles
+		// evenly spread over the store
+		ForceError computeForceError(const ParticleStore& particles, size_t numSamples) const;
 
-		inline float getAbsCharge() const { return absCharge; }
+		// handles of the particles of a type in typeMask that are closer
+		// than distance to pos, skipping exclude, written to results up to
+		// its size. Returns how many were written. Visits every node whose
+		// box overlaps the sphere and doesn't allocate. Positions are the
+		// ones of the last updateMoments, like the forces, so particles that
+		// moved since are matched where they were
+		size_t findNearestThan(const ParticleStore& particles, const glm::vec3 & pos, float distance, Particle::TypeMask typeMask,
+			gsl::span<ParticleStore::Handle> results, ParticleStore::Handle exclude = ParticleStore::INVALID_HANDLE) const;
 
-		inline ofVec3f getCenterOfCharge() const { return centerOfCharge; }
+		// same around a particle, appended to near, at most maxResults
+		void findNearestThan(const ParticleStore& particles, unsigned point, float distance, std::vector<ParticleStore::Handle> & near,
+			size_t maxResults = std::numeric_limits<size_t>::max()) const;
+
+		template<typename Type>
+		void findNearestThanByType(const ParticleStore& particles, unsigned point, float distance, std::initializer_list<Type> allowedTypes,
+			std::vector<ParticleStore::Handle> & near, size_t maxResults = std::numeric_limits<size_t>::max()) const;
+
+		void clear();
+
+		void debugDraw(unsigned depth);
 
-		Octree* getChildren() const { return children; }
+		const std::vector<Node> & getNodes() const { return nodes; }
+		const std::vector<unsigned> & getPoints() const { return points; }
+		// including empty ones
+		size_t getNumLeaves() const { return leaves.size(); }
+		unsigned getDepth() const { return depth; }
 
 		inline ofVec3f getMax() const { return max; }
 		inline ofVec3f getMin() const { return min; }
 
 	private:
+		struct Interactions
+		{
+			std::vector<unsigned> far;
+			std::vector<unsigned> near;
+			std::vector<unsigned> stack;
+		};
+
+		void split(const ParticleStore& particles, unsigned node);
+		bool refit(const ParticleStore& particles);
+		void initNode(Node & node, const glm::vec3 & min, const glm::vec3 & max, unsigned depth, unsigned begin, unsigned end);
+
+		// nodes that can be used as a whole for every point inside box and
+		// the leaves that have to be summed directly
+		void getInteractions(const glm::vec3 & boxMin, const glm::vec3 & boxMax, Interactions & interactions) const;
+
+		// field at a point of the far nodes and the particles of the near
+		// leaves, without the force multiplier. Adds the interaction
+		// candidates to the point's partners if candidates isn't null
+		glm::vec3 getField(const ParticleStore& particles, unsigned point, const Interactions & interactions, ParticleStore * candidates) const;
+
+		// field of the node's moments at pos, without the force multiplier
+		static inline glm::vec3 getFarField(const Node & node, const glm::vec3 & pos, bool quadrupoles);
+		unsigned findLeaf(const glm::vec3 & pos) const;
+
+		// calls found with the handle of every particle matching a
+		// findNearestThan query until it returns false
+		template<typename Callback>
+		void visitNearestThan(const ParticleStore& particles, const glm::vec3 & pos, float distance, Particle::TypeMask typeMask,
+			ParticleStore::Handle exclude, Callback found) const;
+
 		static ofVboMesh boxMesh;
-		static unsigned numOctrees;
 		static float forceMultiplier;
 
-		// hopefully after the first few iterations this shouldn't be resized too often
-		tbb::concurrent_vector<T*> points;
-		ofVec3f min, max, mid;
-		float size;
-		Octree* children;
+		std::vector<Node> nodes;
+		std::vector<unsigned> points;
+		// every leaf, empty ones too, in the same order as their points
+		std::vector<unsigned> leaves;
+		std::vector<unsigned> leafIndices;
+
+		// handle of every point so the tree can follow its particles
+		// across compactions of the store
+		std::vector<ParticleStore::Handle> handles;
+
+		// position and charge of every point in tree order, written by
+		// updateMoments
+		std::vector<glm::vec4> bodies;
+		std::vector<unsigned> scratch;
+		std::vector<unsigned char> octants;
+
+		// refit scratch, per particle and per leaf
+		std::vector<unsigned char> kept;
+		std::vector<unsigned> targets;
+		std::vector<unsigned> keptCounts;
+		std::vector<unsigned> leafOffsets;
+		size_t builtSize;
+		UpdateStats updateStats;
+
+		mutable tbb::enumerable_thread_specific<Interactions> interactions;
+		ofVec3f min, max;
 		unsigned depth;
-		bool hasPoints;
-		float charge; // mass for gravity, charge for electromagnetic systems
-		float absCharge;
-		ofVec3f centerOfCharge;
 	};
 }
 
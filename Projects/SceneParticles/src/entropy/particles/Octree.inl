@@ -29,386 +29,742 @@
  *  POSSIBILITY OF SUCH DAMAGE. 
  *
  */
-
 #include "Octree.h"
 #include "Particle.h"
 
 namespace nm
-{        
-	template<class T>
-	Octree<T>::Octree() :
-		children(NULL),
-		hasPoints(false),
-		charge(0.f),
-		absCharge(0.f),
-		depth(0)
-		//mass(0.f)
+{
+	namespace octree
 	{
+		inline float distanceSquared(const glm::vec3 & boxMin, const glm::vec3 & boxMax, const glm::vec3 & point)
+		{
+			glm::vec3 d = glm::max(glm::max(boxMin - point, point - boxMax), glm::vec3(0.f));
+			return glm::dot(d, d);
+		}
+
+		inline float distanceSquared(const glm::vec3 & min1, const glm::vec3 & max1, const glm::vec3 & min2, const glm::vec3 & max2)
+		{
+			glm::vec3 d = glm::max(glm::max(min1 - max2, min2 - max1), glm::vec3(0.f));
+			return glm::dot(d, d);
+		}
+
+		inline unsigned char getOctant(const glm::vec3 & pos, const glm::vec3 & mid)
+		{
+			unsigned char octant = 0x00;
+			if (pos.x > mid.x) octant |= 0x01;
+			if (pos.y > mid.y) octant |= 0x02;
+			if (pos.z > mid.z) octant |= 0x04;
+			return octant;
+		}
+
+		inline bool areCandidates(const ParticleStore& particles, unsigned point, unsigned other)
+		{
+			return ((particles.getAnnihilationFlag(point) ^ particles.getAnnihilationFlag(other)) == 0xFF) ||
+				/*((point.getFusion1Flag() ^ other->getFusion1Flag()) == 0xFF) ||
+				((point.getFusion2Flag() ^ other->getFusion2Flag()) == 0xFF)))*/
+				(particles.isQuark(point) && particles.isQuark(other));
+		}
 	}
 
 	template<class T>
-	Octree<T>::~Octree()
+	Octree<T>::Octree() :
+		depth(0),
+		builtSize(0)
 	{
-		delete[] children;
 	}
 
 	template<class T>
-	void Octree<T>::init(const ofVec3f& min, const ofVec3f& max, unsigned depth)
+	void Octree<T>::init(const ofVec3f& min, const ofVec3f& max)
 	{
 		this->min = min;
 		this->max = max;
-		this->size = ((max.x - min.x) + (max.y - min.y) + (max.z - min.z)) / 3.f;
-		this->mid = .5f * (min + max);
-		this->depth = depth;
-		if (depth == MAX_DEPTH()) points.reserve(POINTS_START_SIZE());
+		clear();
+	}
+
+	template<class T>
+	void Octree<T>::initNode(Node & node, const glm::vec3 & min, const glm::vec3 & max, unsigned depth, unsigned begin, unsigned end)
+	{
+		node.min = min;
+		node.max = max;
+		glm::vec3 dims = max - min;
+		node.size = std::max(std::max(dims.x, dims.y), dims.z);
+		node.depth = depth;
+		node.firstChild = 0;
+		node.begin = begin;
+		node.end = end;
+		node.charge = 0.f;
+		node.absCharge = 0.f;
+		node.centerOfCharge = .5f * (min + max);
+		node.dipole = glm::vec3(0.f);
+		node.quadrupole = Quadrupole{0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+	}
+
+	template<class T>
+	void Octree<T>::clear()
+	{
+		nodes.clear();
+		points.clear();
+		handles.clear();
+		leaves.clear();
+		nodes.emplace_back();
+		initNode(nodes[0], min, max, 0, 0, 0);
+		leaves.push_back(0);
+		leafIndices.assign(1, 0);
+		depth = 0;
+		builtSize = 0;
 	}
 
 	template<class T>
-	void Octree<T>::updateCenterOfCharge()
+	void Octree<T>::build(const ParticleStore& particles)
 	{
-		if (hasPoints)
+		// the arrays keep their capacity so this only allocates while the
+		// number of particles grows
+		points.clear();
+		for (unsigned i = 0; i < particles.size(); ++i)
 		{
-			if (depth == MAX_DEPTH())
+			if (particles.alive[i]) points.push_back(i);
+		}
+		octants.resize(points.size());
+		scratch.resize(points.size());
+		bodies.resize(points.size());
+
+		nodes.clear();
+		leaves.clear();
+		depth = 0;
+		nodes.emplace_back();
+		initNode(nodes[0], min, max, 0, 0, points.size());
+		split(particles, 0);
+
+		leafIndices.resize(nodes.size());
+		for (unsigned l = 0; l < leaves.size(); ++l)
+		{
+			leafIndices[leaves[l]] = l;
+		}
+		handles.resize(points.size());
+		for (size_t k = 0; k < points.size(); ++k)
+		{
+			handles[k] = particles.getHandle(points[k]);
+		}
+		builtSize = points.size();
+		updateStats = UpdateStats();
+		updateStats.moved = points.size();
+	}
+
+	template<class T>
+	void Octree<T>::update(const ParticleStore& particles)
+	{
+		if (!INCREMENTAL() || builtSize == 0 || !refit(particles))
+		{
+			build(particles);
+		}
+	}
+
+	template<class T>
+	bool Octree<T>::refit(const ParticleStore& particles)
+	{
+		const size_t numParticles = particles.size();
+		kept.assign(numParticles, 0);
+		targets.resize(numParticles);
+		keptCounts.resize(leaves.size());
+		leafOffsets.resize(leaves.size() + 1);
+		scratch.resize(std::max(scratch.size(), points.size()));
+
+		// keep the points that are still alive and inside their leaf, packed
+		// at the start of the leaf's old range in scratch
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leaves.size(), 64),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t l = r.begin(); l != r.end(); ++l)
 			{
-				for (auto * point: points)
+				const Node & leaf = nodes[leaves[l]];
+				unsigned count = 0;
+				for (unsigned k = leaf.begin; k < leaf.end; ++k)
 				{
-					charge += point->getCharge();
-					absCharge += abs(point->getCharge());
-					centerOfCharge += point->pos * abs(point->getCharge());
+					auto point = particles.getIndex(handles[k]);
+					if (point == ParticleStore::INVALID_INDEX || !particles.alive[point]) continue;
+					const glm::vec3 & pos = particles.pos[point];
+					if (pos.x >= leaf.min.x && pos.y >= leaf.min.y && pos.z >= leaf.min.z &&
+						pos.x <= leaf.max.x && pos.y <= leaf.max.y && pos.z <= leaf.max.z)
+					{
+						scratch[leaf.begin + count++] = point;
+						kept[point] = 1;
+					}
 				}
+				keptCounts[l] = count;
 			}
-			else if (children)
+		});
+
+		// the rest, particles that moved out of their leaf and particles
+		// added since, look for their leaf from the root
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numParticles, 1024),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
 			{
-				tbb::task_group taskGroup;
-				for (unsigned i = 0; i < 8; ++i)
+				if (!kept[i] && particles.alive[i])
 				{
-					taskGroup.run([i, this] {
-						children[i].updateCenterOfCharge();
-					});
+					targets[i] = leafIndices[findLeaf(particles.pos[i])];
 				}
-				taskGroup.wait();
+			}
+		});
 
-				for (unsigned i = 0; i < 8; ++i)
-				{
-					absCharge += children[i].getAbsCharge();
-					charge += children[i].getCharge();
-					centerOfCharge += children[i].getAbsCharge() * children[i].getCenterOfCharge();
-				}
+		// new ranges, leaf l gets its kept points plus the ones moving in
+		std::fill(leafOffsets.begin(), leafOffsets.end(), 0);
+		size_t moved = 0;
+		for (size_t i = 0; i < numParticles; ++i)
+		{
+			if (!kept[i] && particles.alive[i])
+			{
+				leafOffsets[targets[i] + 1]++;
+				moved++;
 			}
-			centerOfCharge = centerOfCharge / absCharge;
 		}
+		unsigned maxOccupancy = 0;
+		for (size_t l = 0; l < leaves.size(); ++l)
+		{
+			unsigned occupancy = keptCounts[l] + leafOffsets[l + 1];
+			if (nodes[leaves[l]].depth < MAX_DEPTH()) maxOccupancy = std::max(maxOccupancy, occupancy);
+			leafOffsets[l + 1] = leafOffsets[l] + occupancy;
+		}
+		const size_t numPoints = leafOffsets.back();
 
-		/*
-		centerOfMass = centerOfMass / mass;
-		if (children)
+		float imbalance = float(maxOccupancy) / std::max(1, MAX_LEAF_SIZE().get());
+		imbalance = std::max(imbalance, float(builtSize) / std::max<size_t>(numPoints, 1));
+		if (imbalance > REBUILD_IMBALANCE())
 		{
-		tbb::parallel_for(tbb::blocked_range<size_t>(0, 8),
-		[&](const tbb::blocked_range<size_t>& r) {
-		for(size_t i = r.begin(); i != r.end(); ++i) children[i].updateCenterOfForce();
+			return false;
+		}
+
+		points.resize(numPoints);
+		handles.resize(numPoints);
+		octants.resize(numPoints);
+		bodies.resize(numPoints);
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leaves.size(), 64),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t l = r.begin(); l != r.end(); ++l)
+			{
+				auto first = scratch.begin() + nodes[leaves[l]].begin;
+				std::copy(first, first + keptCounts[l], points.begin() + leafOffsets[l]);
+			}
 		});
-		//tbb::task_group taskGroup;
-		//for (unsigned i = 0; i < 8; ++i)
-		//{
-		//    const unsigned idx = i;
-		//    taskGroup.run([&]{ children[idx].updateCenterOfMass(); });
-		//}
-		//taskGroup.wait();
-		}*/
+
+		// movers in index order so the tree doesn't depend on scheduling
+		for (size_t l = 0; l < leaves.size(); ++l)
+		{
+			keptCounts[l] += leafOffsets[l];
+		}
+		for (size_t i = 0; i < numParticles; ++i)
+		{
+			if (!kept[i] && particles.alive[i])
+			{
+				points[keptCounts[targets[i]]++] = i;
+			}
+		}
+
+		for (size_t l = 0; l < leaves.size(); ++l)
+		{
+			nodes[leaves[l]].begin = leafOffsets[l];
+			nodes[leaves[l]].end = leafOffsets[l + 1];
+		}
+		for (size_t n = nodes.size(); n > 0; --n)
+		{
+			Node & node = nodes[n - 1];
+			if (node.isLeaf()) continue;
+			node.begin = nodes[node.firstChild].begin;
+			node.end = nodes[node.firstChild + 7].end;
+		}
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numPoints, 4096),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t k = r.begin(); k != r.end(); ++k)
+			{
+				handles[k] = particles.getHandle(points[k]);
+			}
+		});
+
+		updateStats.rebuilt = false;
+		updateStats.moved = moved;
+		updateStats.imbalance = imbalance;
+		return true;
 	}
 
 	template<class T>
-	void Octree<T>::sumForces(T& point)//, float forceMultiplier)
+	void Octree<T>::split(const ParticleStore& particles, unsigned n)
 	{
-		if (hasPoints)
+		const unsigned nodeDepth = nodes[n].depth;
+		const unsigned begin = nodes[n].begin;
+		const unsigned end = nodes[n].end;
+		depth = std::max(depth, nodeDepth);
+		if (end - begin <= unsigned(std::max(1, MAX_LEAF_SIZE().get())) || nodeDepth == MAX_DEPTH())
+		{
+			leaves.push_back(n);
+			return;
+		}
+
+		// counting sort of the node's points by octant
+		const glm::vec3 nodeMin = nodes[n].min;
+		const glm::vec3 nodeMax = nodes[n].max;
+		const glm::vec3 mid = .5f * (nodeMin + nodeMax);
+		unsigned counts[8] = {0};
+		for (unsigned k = begin; k < end; ++k)
+		{
+			auto octant = octree::getOctant(particles.pos[points[k]], mid);
+			octants[k] = octant;
+			counts[octant]++;
+		}
+		unsigned offsets[8];
+		offsets[0] = begin;
+		for (unsigned i = 1; i < 8; ++i) offsets[i] = offsets[i - 1] + counts[i - 1];
+		unsigned starts[8];
+		std::copy(offsets, offsets + 8, starts);
+		for (unsigned k = begin; k < end; ++k)
+		{
+			scratch[offsets[octants[k]]++] = points[k];
+		}
+		std::copy(scratch.begin() + begin, scratch.begin() + end, points.begin() + begin);
+
+		unsigned firstChild = nodes.size();
+		nodes.resize(firstChild + 8);
+		nodes[n].firstChild = firstChild;
+		for (unsigned i = 0; i < 8; ++i)
+		{
+			glm::vec3 childMin(mid);
+			glm::vec3 childMax(mid);
+
+			if (i & X_SIDE) childMax.x = nodeMax.x;
+			else childMin.x = nodeMin.x;
+
+			if (i & Y_SIDE) childMax.y = nodeMax.y;
+			else childMin.y = nodeMin.y;
+
+			if (i & Z_SIDE) childMax.z = nodeMax.z;
+			else childMin.z = nodeMin.z;
+
+			initNode(nodes[firstChild + i], childMin, childMax, nodeDepth + 1, starts[i], starts[i] + counts[i]);
+		}
+
+		for (unsigned i = 0; i < 8; ++i)
 		{
-			if (depth < MAX_DEPTH())
+			split(particles, firstChild + i);
+		}
+	}
+
+	template<class T>
+	void Octree<T>::updateMoments(const ParticleStore& particles)
+	{
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leaves.size(), 16),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t l = r.begin(); l != r.end(); ++l)
 			{
-				ofVec3f direction = centerOfCharge - point.pos;
-				float distSq = direction.lengthSquared();
-				float dist = sqrt(distSq);
-				if (dist > INTERACTION_DISTANCE() && size / dist < THETA())
+				Node & node = nodes[leaves[l]];
+				float charge = 0.f;
+				float absCharge = 0.f;
+				glm::vec3 center(0.f);
+				for (unsigned k = node.begin; k < node.end; ++k)
 				{
-					// far enough away to use this node
-					//if(point.anihilationRatio>0.001){
-						point.setForce(point.getForce() - forceMultiplier * direction * point.getCharge() * charge / (distSq * dist));
-					//}
+					auto point = points[k];
+					bodies[k] = glm::vec4(particles.pos[point], particles.charge[point]);
+					charge += particles.charge[point];
+					absCharge += abs(particles.charge[point]);
+					center += particles.pos[point] * abs(particles.charge[point]);
 				}
-				else if (children)
+				node.charge = charge;
+				node.absCharge = absCharge;
+				node.centerOfCharge = absCharge > 0.f ? center / absCharge : .5f * (node.min + node.max);
+
+				glm::vec3 dipole(0.f);
+				Quadrupole quadrupole{0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+				for (unsigned k = node.begin; k < node.end; ++k)
 				{
-					for (unsigned i = 0; i < 8; ++i)
-					{
-						children[i].sumForces(point);// , forceMultiplier);
-					}
+					auto point = points[k];
+					float q = particles.charge[point];
+					glm::vec3 s = particles.pos[point] - node.centerOfCharge;
+					float s2 = glm::dot(s, s);
+					dipole += q * s;
+					quadrupole.xx += q * (3.f * s.x * s.x - s2);
+					quadrupole.xy += q * 3.f * s.x * s.y;
+					quadrupole.xz += q * 3.f * s.x * s.z;
+					quadrupole.yy += q * (3.f * s.y * s.y - s2);
+					quadrupole.yz += q * 3.f * s.y * s.z;
+					quadrupole.zz += q * (3.f * s.z * s.z - s2);
 				}
+				node.dipole = dipole;
+				node.quadrupole = quadrupole;
 			}
-			else
+		});
+
+		// children always come after their parent so going backwards
+		// visits every child before its parent
+		for (size_t n = nodes.size(); n > 0; --n)
+		{
+			Node & node = nodes[n - 1];
+			if (node.isLeaf()) continue;
+
+			node.charge = 0.f;
+			node.absCharge = 0.f;
+			glm::vec3 center(0.f);
+			for (unsigned i = 0; i < 8; ++i)
 			{
-				for (auto * other: points)
-				{
-					if(!other->alive) continue;
-					if (&point != other)
-					{
-						ofVec3f direction = centerOfCharge - point.pos;
-						float distSq = direction.lengthSquared();
-						float dist = sqrt(distSq);
-						glm::vec3 force = point.getForce();
-						//if(point.anihilationRatio>0.001){
-							force -= forceMultiplier * direction * point.getCharge() * charge / (distSq * dist);
-						//}
-						if (dist < CANDIDATE_DISTANCE() &&
-							(((point.getAnnihilationFlag() ^ other->getAnnihilationFlag()) == 0xFF) ||
-							/*((point.getFusion1Flag() ^ other->getFusion1Flag()) == 0xFF) ||
-							((point.getFusion2Flag() ^ other->getFusion2Flag()) == 0xFF)))*/
-							 (point.isQuark() && other->isQuark())))
-						{
-//							if(dist < INTERACTION_DISTANCE()){
-//								force += (other->pos - point.pos) * 100000;
-//							}
-							point.potentialInteractionPartners.push_back(other);
-						}
-						point.setForce(force);
-					}
-				}
+				const Node & child = nodes[node.firstChild + i];
+				node.charge += child.charge;
+				node.absCharge += child.absCharge;
+				center += child.absCharge * child.centerOfCharge;
 			}
-		}
+			node.centerOfCharge = node.absCharge > 0.f ? center / node.absCharge : .5f * (node.min + node.max);
 
+			// move the children's moments to the parent's center
+			glm::vec3 dipole(0.f);
+			Quadrupole quadrupole{0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+			for (unsigned i = 0; i < 8; ++i)
+			{
+				const Node & child = nodes[node.firstChild + i];
+				if (child.empty()) continue;
+				const glm::vec3 d = child.centerOfCharge - node.centerOfCharge;
+				const glm::vec3 & p = child.dipole;
+				const float q = child.charge;
+				const float pd = 2.f * glm::dot(p, d) + q * glm::dot(d, d);
+				dipole += p + q * d;
+				quadrupole.xx += child.quadrupole.xx + 6.f * p.x * d.x + 3.f * q * d.x * d.x - pd;
+				quadrupole.xy += child.quadrupole.xy + 3.f * (p.x * d.y + p.y * d.x) + 3.f * q * d.x * d.y;
+				quadrupole.xz += child.quadrupole.xz + 3.f * (p.x * d.z + p.z * d.x) + 3.f * q * d.x * d.z;
+				quadrupole.yy += child.quadrupole.yy + 6.f * p.y * d.y + 3.f * q * d.y * d.y - pd;
+				quadrupole.yz += child.quadrupole.yz + 3.f * (p.y * d.z + p.z * d.y) + 3.f * q * d.y * d.z;
+				quadrupole.zz += child.quadrupole.zz + 6.f * p.z * d.z + 3.f * q * d.z * d.z - pd;
+			}
+			node.dipole = dipole;
+			node.quadrupole = quadrupole;
+		}
 	}
 
 	template<class T>
-	void Octree<T>::findNearestThan(const T& point, float distance, std::vector<T*> & nearList) const{
-		if(hasPoints){
-			if (depth < MAX_DEPTH())
+	void Octree<T>::getInteractions(const glm::vec3 & boxMin, const glm::vec3 & boxMax, Interactions & interactions) const
+	{
+		const float theta = THETA();
+		const float theta2 = theta * theta;
+		const float candidateDistance2 = CANDIDATE_DISTANCE() * CANDIDATE_DISTANCE();
+
+		interactions.far.clear();
+		interactions.near.clear();
+		interactions.stack.clear();
+		interactions.stack.push_back(0);
+		while (!interactions.stack.empty())
+		{
+			unsigned n = interactions.stack.back();
+			interactions.stack.pop_back();
+			const Node & node = nodes[n];
+			if (node.empty()) continue;
+
+			// a node can only be used as a whole if none of its particles
+			// can be an interaction candidate of any point in the box
+			if (octree::distanceSquared(node.min, node.max, boxMin, boxMax) >= candidateDistance2)
 			{
-				if (children)
+				float distance2 = octree::distanceSquared(boxMin, boxMax, node.centerOfCharge);
+				if (node.size * node.size < theta2 * distance2)
 				{
-					unsigned char octant = 0x00;
-					if (point.pos.x > mid.x) octant |= X_SIDE;
-					if (point.pos.y > mid.y) octant |= Y_SIDE;
-					if (point.pos.z > mid.z) octant |= Z_SIDE;
-					children[octant].findNearestThan(point, distance, nearList);
+					interactions.far.push_back(n);
+					continue;
 				}
 			}
+
+			if (node.isLeaf())
+			{
+				interactions.near.push_back(n);
+			}
 			else
 			{
-				for (auto * other: points)
+				for (unsigned i = 8; i > 0; --i)
 				{
-					if (&point > other)
-					{
-						ofVec3f direction = centerOfCharge - point.pos;
-						float distSq = direction.lengthSquared();
-						float dist = sqrt(distSq);
-						if (dist < distance){
-							nearList.push_back(other);
-						}
-					}
+					interactions.stack.push_back(node.firstChild + i - 1);
 				}
 			}
 		}
 	}
 
+	template<class T>
+	inline glm::vec3 Octree<T>::getFarField(const Node & node, const glm::vec3 & pos, bool quadrupoles)
+	{
+		const glm::vec3 r = pos - node.centerOfCharge;
+		const float invDist2 = 1.f / glm::dot(r, r);
+		const float invDist = sqrt(invDist2);
+		const float invDist3 = invDist * invDist2;
+		glm::vec3 field = node.charge * invDist3 * r;
+		if (quadrupoles)
+		{
+			const float invDist5 = invDist3 * invDist2;
+			const glm::vec3 qr = node.quadrupole * r;
+			field += (3.f * glm::dot(node.dipole, r) * invDist5) * r - invDist3 * node.dipole;
+			field += (2.5f * glm::dot(r, qr) * invDist5 * invDist2) * r - invDist5 * qr;
+		}
+		return field;
+	}
 
 	template<class T>
-	template<typename Type>
-	void Octree<T>::findNearestThanByType(const T& point, float distance, std::initializer_list<Type> allowedTypes, std::vector<T*> & nearList) const{
-		if(hasPoints){
-			if (depth < MAX_DEPTH())
+	glm::vec3 Octree<T>::getField(const ParticleStore& particles, unsigned point, const Interactions & interactions, ParticleStore * candidates) const
+	{
+		const glm::vec3 pos = particles.pos[point];
+		const bool quadrupoles = QUADRUPOLES();
+		const float softening2 = SOFTENING() * SOFTENING();
+		const float candidateDistance2 = CANDIDATE_DISTANCE() * CANDIDATE_DISTANCE();
+
+		glm::vec3 field(0.f);
+		for (auto n: interactions.far)
+		{
+			field += getFarField(nodes[n], pos, quadrupoles);
+		}
+
+		for (auto n: interactions.near)
+		{
+			// bodies are in tree order so this loop is contiguous and
+			// vectorizes. Without softening the point itself and any body
+			// on top of it have no direction, they're masked to 0 instead
+			// of multiplying an infinite 1/r^3 by r = 0
+			const Node & leaf = nodes[n];
+			glm::vec3 leafField(0.f);
+			for (unsigned k = leaf.begin; k < leaf.end; ++k)
 			{
-				if (children)
-				{
-					unsigned char octant = 0x00;
-					if (point.pos.x > mid.x) octant |= X_SIDE;
-					if (point.pos.y > mid.y) octant |= Y_SIDE;
-					if (point.pos.z > mid.z) octant |= Z_SIDE;
-					children[octant].findNearestThanByType(point, distance, allowedTypes, nearList);
-				}
+				const glm::vec3 r = pos - bodies[k].xyz();
+				const float softDistSq = glm::dot(r, r) + softening2;
+				const float invDist = softDistSq > 0.f ? 1.f / sqrt(softDistSq) : 0.f;
+				leafField += (bodies[k].w * invDist * invDist * invDist) * r;
 			}
-			else
+			field += leafField;
+
+			if (candidates && octree::distanceSquared(leaf.min, leaf.max, pos) < candidateDistance2)
 			{
-				for (auto * other: points)
+				for (unsigned k = leaf.begin; k < leaf.end; ++k)
 				{
-					if (&point > other)
+					const unsigned other = points[k];
+					if (other != point &&
+						glm::distance2(pos, bodies[k].xyz()) < candidateDistance2 &&
+						octree::areCandidates(particles, point, other))
 					{
-						bool allowedType = false;
-						for(auto t: allowedTypes){
-							allowedType |= (t == other->getType());
-						}
-						if(!allowedType){
-							continue;
-						}
-						ofVec3f direction = centerOfCharge - point.pos;
-						float distSq = direction.lengthSquared();
-						float dist = sqrt(distSq);
-						if (dist < distance){
-							nearList.push_back(other);
-						}
+						candidates->addPartner(point, particles.getHandle(other));
 					}
 				}
 			}
 		}
+		return field;
 	}
 
 	template<class T>
-	void Octree<T>::clear()
+	void Octree<T>::sumForces(ParticleStore& particles) const
 	{
-		hasPoints = false;
-		//points.clear();
-		//mass = 0.f;
-		charge = 0.f;
-		absCharge = 0.f;
-		//centerOfMass.set(0.f);
-		centerOfCharge.set(0.f);
-		if (children)
-		{
-			tbb::parallel_for(tbb::blocked_range<size_t>(0, 8),
-				[&](const tbb::blocked_range<size_t>& r) {
-				for (size_t i = r.begin(); i != r.end(); ++i) children[i].clear();
-			});
-			/*
-			tbb::task_group taskGroup;
-			for (unsigned i = 0; i < 8; ++i)
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leaves.size()),
+			[&](const tbb::blocked_range<size_t>& r) {
+			auto & leafInteractions = interactions.local();
+			for (size_t l = r.begin(); l != r.end(); ++l)
 			{
-			const unsigned idx = i;
-			taskGroup.run([&]{ children[idx].clear(); });
+				const Node & leaf = nodes[leaves[l]];
+				if (leaf.empty()) continue;
+				getInteractions(leaf.min, leaf.max, leafInteractions);
+				for (unsigned k = leaf.begin; k < leaf.end; ++k)
+				{
+					const unsigned point = points[k];
+					const glm::vec3 field = getField(particles, point, leafInteractions, &particles);
+					particles.force[point] += forceMultiplier * particles.charge[point] * field;
+				}
 			}
-			taskGroup.wait();*/
-		}
-		if(!points.empty()){
-			points.clear();
-		}
+		});
 	}
 
-
 	template<class T>
-	template<size_t N>
-	void Octree<T>::addPointsSerial(std::array<T,N>& points)
+	void Octree<T>::sumForces(ParticleStore& particles, unsigned point) const
 	{
-		addPointsSerial(points.data(), points.size());
+		auto & pointInteractions = interactions.local();
+		const glm::vec3 pos = particles.pos[point];
+		getInteractions(pos, pos, pointInteractions);
+		const glm::vec3 field = getField(particles, point, pointInteractions, &particles);
+		particles.force[point] += forceMultiplier * particles.charge[point] * field;
 	}
 
 	template<class T>
-	void Octree<T>::addPointsSerial(vector<T>& points)
+	glm::vec3 Octree<T>::getForce(const ParticleStore& particles, unsigned point) const
 	{
-		addPointsSerial(points.data(), points.size());
+		auto & pointInteractions = interactions.local();
+		const glm::vec3 pos = particles.pos[point];
+		getInteractions(pos, pos, pointInteractions);
+		return forceMultiplier * particles.charge[point] * getField(particles, point, pointInteractions, nullptr);
 	}
 
 	template<class T>
-	void Octree<T>::addPointsSerial(T* points, unsigned numPoints)
+	glm::vec3 Octree<T>::getDirectForce(const ParticleStore& particles, unsigned point)
 	{
-		for (unsigned i = 0; i < numPoints; ++i)
+		const glm::vec3 pos = particles.pos[point];
+		const float softening2 = SOFTENING() * SOFTENING();
+		glm::vec3 field(0.f);
+		for (unsigned other = 0; other < particles.size(); ++other)
 		{
-			if(points[i].alive) addPoint(points[i]);
+			if (other == point || !particles.alive[other]) continue;
+			const glm::vec3 r = pos - particles.pos[other];
+			const float softDistSq = glm::dot(r, r) + softening2;
+			if (softDistSq == 0.f) continue;
+			field += particles.charge[other] * r / (softDistSq * sqrt(softDistSq));
 		}
+		return forceMultiplier * particles.charge[point] * field;
 	}
 
 	template<class T>
-	void Octree<T>::addPointsParallel(vector<T>& points)
+	typename Octree<T>::ForceError Octree<T>::computeForceError(const ParticleStore& particles, size_t numSamples) const
 	{
-		addPointsParallel(points.data(), points.size());
-	}
+		ForceError error;
+		numSamples = std::min(numSamples, points.size());
+		if (numSamples == 0) return error;
 
-	template<class T>
-	template<size_t N>
-	void Octree<T>::addPointsParallel(std::array<T,N>& points)
-	{
-		addPointsParallel(points.data(), points.size());
+		std::vector<unsigned> samples(numSamples);
+		for (size_t i = 0; i < numSamples; ++i)
+		{
+			samples[i] = points[i * points.size() / numSamples];
+		}
+
+		std::vector<glm::vec3> tree(numSamples);
+		std::vector<glm::vec3> direct(numSamples);
+		auto then = ofGetElapsedTimeMicros();
+		tbb::parallel_for(size_t(0), numSamples, [&](size_t i){
+			tree[i] = getForce(particles, samples[i]);
+		});
+		auto now = ofGetElapsedTimeMicros();
+		error.treeMicros = now - then;
+		then = now;
+		tbb::parallel_for(size_t(0), numSamples, [&](size_t i){
+			direct[i] = getDirectForce(particles, samples[i]);
+		});
+		error.directMicros = ofGetElapsedTimeMicros() - then;
+
+		double sum = 0;
+		double sumSquared = 0;
+		for (size_t i = 0; i < numSamples; ++i)
+		{
+			double magnitude = glm::length(direct[i]);
+			if (magnitude == 0) continue;
+			double relative = glm::length(tree[i] - direct[i]) / magnitude;
+			sum += relative;
+			sumSquared += relative * relative;
+			error.maxRelative = std::max(error.maxRelative, relative);
+			error.numSamples++;
+		}
+		if (error.numSamples > 0)
+		{
+			error.meanRelative = sum / error.numSamples;
+			error.rmsRelative = sqrt(sumSquared / error.numSamples);
+		}
+		return error;
 	}
 
 	template<class T>
-	void Octree<T>::addPointsParallel(T* points, unsigned numPoints)
+	unsigned Octree<T>::findLeaf(const glm::vec3 & pos) const
 	{
-		tbb::parallel_for(tbb::blocked_range<size_t>(0, numPoints),
-			[&](const tbb::blocked_range<size_t>& r) {
-			for (size_t i = r.begin(); i != r.end(); ++i) addPoint(points[i]);
-		});
+		unsigned n = 0;
+		while (!nodes[n].isLeaf())
+		{
+			const Node & node = nodes[n];
+			n = node.firstChild + octree::getOctant(pos, .5f * (node.min + node.max));
+		}
+		return n;
 	}
 
 	template<class T>
-	void Octree<T>::addChildren(bool recursive)
+	template<typename Callback>
+	void Octree<T>::visitNearestThan(const ParticleStore& particles, const glm::vec3 & pos, float distance, Particle::TypeMask typeMask,
+		ParticleStore::Handle exclude, Callback found) const
 	{
-		if (children == NULL)
+		if (points.empty() || distance <= 0.f) return;
+		const float radiusSquared = distance * distance;
+
+		// depth first, a node pushes at most 8 children so the stack never
+		// holds more than 8 per level
+		std::array<unsigned, 8 * (MAX_DEPTH() + 1)> stack;
+		size_t top = 0;
+		stack[top++] = 0;
+		while (top > 0)
 		{
-			children = new Octree[8]();
-			for (unsigned i = 0; i < 8; ++i)
+			const Node & node = nodes[stack[--top]];
+			if (node.empty() || octree::distanceSquared(node.min, node.max, pos) >= radiusSquared) continue;
+
+			// nodes inside the sphere take all their points without
+			// testing them one by one
+			glm::vec3 farthest = glm::max(pos - node.min, node.max - pos);
+			bool inside = glm::dot(farthest, farthest) < radiusSquared;
+			if (!inside && !node.isLeaf())
 			{
-				ofVec3f childMin(mid);
-				ofVec3f childMax(mid);
-
-				if (i & X_SIDE) childMax.x = max.x;
-				else childMin.x = min.x;
-
-				if (i & Y_SIDE) childMax.y = max.y;
-				else childMin.y = min.y;
-
-				if (i & Z_SIDE) childMax.z = max.z;
-				else childMin.z = min.z;
+				for (unsigned i = 8; i > 0; --i) stack[top++] = node.firstChild + i - 1;
+				continue;
+			}
 
-				children[i].init(childMin, childMax, depth + 1);
+			for (unsigned k = node.begin; k < node.end; ++k)
+			{
+				if (!inside)
+				{
+					glm::vec3 d = bodies[k].xyz() - pos;
+					if (glm::dot(d, d) >= radiusSquared) continue;
+				}
 
-				if (recursive && depth < MAX_DEPTH() - 1)
+				// the store might have been compacted since the tree was
+				// built, the handle is what still identifies the particle
+				auto handle = handles[k];
+				if (handle == exclude) continue;
+				auto index = particles.getIndex(handle);
+				if (index == ParticleStore::INVALID_INDEX || !particles.alive[index] ||
+					!(typeMask & Particle::getTypeMask(particles.getType(index))))
 				{
-					children[i].addChildren(recursive);
+					continue;
 				}
+				if (!found(handle)) return;
 			}
 		}
 	}
 
 	template<class T>
-	void Octree<T>::addPoint(T& point)
+	size_t Octree<T>::findNearestThan(const ParticleStore& particles, const glm::vec3 & pos, float distance, Particle::TypeMask typeMask,
+		gsl::span<ParticleStore::Handle> results, ParticleStore::Handle exclude) const
 	{
-		hasPoints = true;
-		if (depth == MAX_DEPTH())
-		{
-			points.push_back(&point);
-		}
-		else
-		{
-			if (children == NULL)
-			{
-				children = new Octree[8]();
-				for (unsigned i = 0; i < 8; ++i)
-				{
-					ofVec3f childMin(mid);
-					ofVec3f childMax(mid);
-
-					if (i & X_SIDE) childMax.x = max.x;
-					else childMin.x = min.x;
-
-					if (i & Y_SIDE) childMax.y = max.y;
-					else childMin.y = min.y;
+		size_t numResults = 0;
+		if (results.empty()) return numResults;
+		visitNearestThan(particles, pos, distance, typeMask, exclude, [&](ParticleStore::Handle handle) {
+			results[numResults++] = handle;
+			return numResults < size_t(results.size());
+		});
+		return numResults;
+	}
 
-					if (i & Z_SIDE) childMax.z = max.z;
-					else childMin.z = min.z;
+	template<class T>
+	void Octree<T>::findNearestThan(const ParticleStore& particles, unsigned point, float distance, std::vector<ParticleStore::Handle> & nearList,
+		size_t maxResults) const
+	{
+		if (maxResults == 0) return;
+		size_t numResults = 0;
+		visitNearestThan(particles, particles.pos[point], distance, Particle::ALL_TYPES, particles.getHandle(point), [&](ParticleStore::Handle handle) {
+			nearList.push_back(handle);
+			return ++numResults < maxResults;
+		});
+	}
 
-					children[i].init(childMin, childMax, depth + 1);
-				}
-			}
-			unsigned char octant = 0x00;
-			if (point.pos.x > mid.x) octant |= X_SIDE;
-			if (point.pos.y > mid.y) octant |= Y_SIDE;
-			if (point.pos.z > mid.z) octant |= Z_SIDE;
-			children[octant].addPoint(point);
-		}
+	template<class T>
+	template<typename Type>
+	void Octree<T>::findNearestThanByType(const ParticleStore& particles, unsigned point, float distance, std::initializer_list<Type> allowedTypes,
+		std::vector<ParticleStore::Handle> & nearList, size_t maxResults) const
+	{
+		if (maxResults == 0) return;
+		Particle::TypeMask typeMask = 0;
+		for (auto type: allowedTypes) typeMask |= Particle::getTypeMask(type);
+		size_t numResults = 0;
+		visitNearestThan(particles, particles.pos[point], distance, typeMask, particles.getHandle(point), [&](ParticleStore::Handle handle) {
+			nearList.push_back(handle);
+			return ++numResults < maxResults;
+		});
 	}
 
 	template<class T>
 	void Octree<T>::debugDraw(unsigned depth)
 	{
 		if (boxMesh.getNumVertices() == 0) boxMesh = ofMesh::box(1.f, 1.f, 1.f, 1, 1, 1);
-		if (hasPoints)
+		for (auto & node: nodes)
 		{
-			if (this->depth == depth)
+			if (node.depth == depth && !node.empty())
 			{
 				ofPushMatrix();
-				ofTranslate(mid);
-				ofScale(max.x - min.x, max.y - min.y, max.z - min.z);
+				ofTranslate(.5f * (node.min + node.max));
+				ofScale(node.max.x - node.min.x, node.max.y - node.min.y, node.max.z - node.min.z);
 				boxMesh.drawWireframe();
 				ofPopMatrix();
 			}
-			else if (children)
-			{
-				for (unsigned i = 0; i < 8; ++i) children[i].debugDraw();
-			}
 		}
 	}
 }
-
@@ -32,7 +32,6 @@
 #pragma once
 
 #include "ofMain.h"
-#include <atomic>
 
 namespace nm
 {
@@ -67,37 +66,28 @@ namespace nm
 			string meshName;
 		};
 
-		static Data DATA[NUM_TYPES];
-		static ofParameterGroup parameters;
-
-		Particle();
-
-		inline void zeroForce() { force = glm::vec3(0.0f); }
-		inline glm::vec3 getForce() const { return force; }
-		inline void setForce(const glm::vec3& force) { this->force = force; }
-
-		inline void setMass(float mass) { this->mass = mass; }
-		inline float getMass() const { return mass; }
+		// one bit per type, for queries that only want some types
+		typedef uint32_t TypeMask;
+		static const TypeMask ALL_TYPES = (TypeMask(1) << NUM_TYPES) - 1;
 
-		inline void setCharge(float charge) { this->charge = charge; }
-		inline float getCharge() const { return charge; }
-
-		inline void setPosition(const glm::vec3& position) { this->pos =  position; }
-		inline void setVelocity(const glm::vec3& velocity) { this->velocity = velocity; }
-		inline glm::vec3 getVelocity() const { return velocity; }
-
-		inline void setRadius(float radius) { this->radius = radius; }
-		inline float getRadius() const { return radius; }
+		static inline TypeMask getTypeMask(Type type) { return TypeMask(1) << type; }
+		static inline TypeMask getTypeMask(std::initializer_list<Type> types){
+			TypeMask mask = 0;
+			for(auto type: types) mask |= getTypeMask(type);
+			return mask;
+		}
 
-		inline void setType(Particle::Type type) { this->type = type; }
-		inline Type getType() const { return type; }
+		static Data DATA[NUM_TYPES];
+		static ofParameterGroup parameters;
 
-		inline unsigned char getAnnihilationFlag() const { return DATA[type].annihilationFlag; }
-		inline unsigned char getFusion1Flag() const { return DATA[type].fusion1Flag; }
-		inline unsigned char getFusion2Flag() const { return DATA[type].fusion2Flag; }
+		// Per particle state lives in ParticleStore, a Particle is only its
+		// type and the data shared by every particle of that type.
+		static inline unsigned char getAnnihilationFlag(Type type) { return DATA[type].annihilationFlag; }
+		static inline unsigned char getFusion1Flag(Type type) { return DATA[type].fusion1Flag; }
+		static inline unsigned char getFusion2Flag(Type type) { return DATA[type].fusion2Flag; }
 
-		bool isMatterQuark(){
-			switch(getType()){
+		static bool isMatterQuark(Type type){
+			switch(type){
 				case nm::Particle::UP_QUARK:
 				case nm::Particle::DOWN_QUARK:
 					return true;
@@ -108,8 +98,8 @@ namespace nm
 			}
 		}
 
-		bool isAntiMatterQuark(){
-			switch(getType()){
+		static bool isAntiMatterQuark(Type type){
+			switch(type){
 				case nm::Particle::ANTI_UP_QUARK:
 				case nm::Particle::ANTI_DOWN_QUARK:
 					return true;
@@ -120,8 +110,8 @@ namespace nm
 			}
 		}
 
-		bool isQuark(){
-			switch(getType()){
+		static bool isQuark(Type type){
+			switch(type){
 				case nm::Particle::ANTI_UP_QUARK:
 				case nm::Particle::ANTI_DOWN_QUARK:
 				case nm::Particle::UP_QUARK:
@@ -131,87 +121,5 @@ namespace nm
 					return false;
 			}
 		}
-		std::vector<Particle *> potentialInteractionPartners;
-		std::pair<Particle*, Particle*> fusionPartners;
-        Type type;
-        float mass;
-        float charge;
-		glm::vec3 velocity;
-		glm::vec3 force;
-		std::atomic<float> anihilationRatio{0};
-		std::atomic<float> fusionRatio{0};
-		float radius;
-		std::atomic<bool> alive{true};
-		size_t id;
-		glm::vec3 pos;
-		bool fusing = false;
-		float age;
-
-		Particle(const Particle & p)
-			:potentialInteractionPartners(p.potentialInteractionPartners)
-			,type(p.type)
-			,mass(p.mass)
-			,charge(p.charge)
-			,velocity(p.velocity)
-			,force(p.force)
-			,anihilationRatio((float)p.anihilationRatio)
-			,fusionRatio((float)p.fusionRatio)
-			,radius(p.radius)
-			,alive((bool)p.alive)
-			,id(p.id)
-			,pos(p.pos)
-			,fusing(p.fusing)
-			,age(p.age)
-
-		{
-
-		}
-
-		Particle & operator=(const Particle & p){
-			if(&p==this) return *this;
-			potentialInteractionPartners = p.potentialInteractionPartners;
-			type = p.type;
-			mass = p.mass;
-			charge = p.charge;
-			velocity = p.velocity;
-			force = p.force;
-			anihilationRatio = anihilationRatio.operator float();
-			fusionRatio = fusionRatio.operator float();
-			radius = p.radius;
-			alive = (bool)p.alive;
-			id = p.id;
-			pos = p.pos;
-			fusing = p.fusing;
-			age = p.age;
-			return *this;
-		}
 	};
 }
-
-namespace std{
-	inline void swap(nm::Particle & p1, nm::Particle & p2){
-		std::swap(p1.potentialInteractionPartners, p2.potentialInteractionPartners);
-		std::swap(p1.type, p2.type);
-		std::swap(p1.mass, p2.mass);
-		std::swap(p1.charge, p2.charge);
-		std::swap(p1.velocity, p2.velocity);
-		std::swap(p1.force, p2.force);
-		std::swap(p1.radius, p2.radius);
-		bool alive1 = p1.alive;
-		bool alive2 = p2.alive;
-		p1.alive = alive2;
-		p2.alive = alive1;
-		std::swap(p1.id, p2.id);
-		std::swap(p1.pos, p2.pos);
-		float ani1 = p1.anihilationRatio;
-		float ani2 = p2.anihilationRatio;
-		p1.anihilationRatio = ani2;
-		p2.anihilationRatio = ani1;
-		float fus1 = p1.fusionRatio;
-		float fus2 = p2.fusionRatio;
-		p1.fusionRatio = fus2;
-		p2.fusionRatio = fus1;
-		std::swap(p1.fusing, p2.fusing);
-		std::swap(p1.age, p2.age);
-	}
-}
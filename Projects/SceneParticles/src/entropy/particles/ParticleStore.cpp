@@ -0,0 +1,324 @@
+/*
+ *  ParticleStore.cpp
+ *
+ *  Copyright (c) 2016, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved. 
+ *  
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met: 
+ *  
+ *  * Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer. 
+ *  * Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution. 
+ *  * Neither the name of Neil Mendoza nor the names of its contributors may be used 
+ *    to endorse or promote products derived from this software without 
+ *    specific prior written permission. 
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ *  POSSIBILITY OF SUCH DAMAGE. 
+ *
+ */
+#include "ParticleStore.h"
+
+namespace nm
+{
+	ParticleStore::ParticleStore() :
+		count(0),
+		capacity(0)
+	{
+	}
+
+	void ParticleStore::setCapacity(size_t capacity)
+	{
+		if (capacity > MAX_CAPACITY)
+		{
+			ofLogError("ParticleStore::setCapacity") << "Capacity " << capacity << " is bigger than the maximum " << MAX_CAPACITY;
+			capacity = MAX_CAPACITY;
+		}
+
+		// release the old particles while the columns still hold them, clear()
+		// goes through their handles to bump the generation of their slots
+		clear();
+		this->capacity = capacity;
+
+		pos.assign(capacity, glm::vec3(0.f));
+		velocity.assign(capacity, glm::vec3(0.f));
+		force.assign(capacity, glm::vec3(0.f));
+		charge.assign(capacity, 0.f);
+		mass.assign(capacity, 0.f);
+		radius.assign(capacity, 0.f);
+		age.assign(capacity, 0.f);
+		anihilationRatio.assign(capacity, 0.f);
+		fusionRatio.assign(capacity, 0.f);
+		type.assign(capacity, Particle::ELECTRON);
+		alive.assign(capacity, tbb::atomic<bool>());
+		fusing.assign(capacity, tbb::atomic<bool>());
+		fusionPartners.assign(capacity, std::make_pair(INVALID_HANDLE, INVALID_HANDLE));
+
+		handles.assign(capacity, INVALID_HANDLE);
+		partners.assign(capacity * MAX_PARTNERS, INVALID_HANDLE);
+		numPartners.assign(capacity, 0);
+
+		slots.assign(capacity, INVALID_INDEX);
+		// generations survive so handles from before stay stale
+		generations.resize(capacity, 0);
+		freeSlots.reserve(capacity);
+		deadPerBlock.reserve(capacity / COMPACTION_BLOCK + 2);
+		dead.reserve(capacity);
+		deadSlots.reserve(capacity);
+		moving.reserve(capacity);
+		clear();
+	}
+
+	void ParticleStore::clear()
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			alive[i] = false;
+			auto slot = handles[i] & SLOT_MASK;
+			slots[slot] = INVALID_INDEX;
+			generations[slot]++;
+			handles[i] = INVALID_HANDLE;
+		}
+		count = 0;
+
+		// hand out the lowest slots first so handles are reproducible
+		freeSlots.clear();
+		for (size_t slot = capacity; slot > 0; --slot)
+		{
+			freeSlots.push_back(slot - 1);
+		}
+	}
+
+	unsigned ParticleStore::add(Particle::Type type, const glm::vec3& position, const glm::vec3& velocity)
+	{
+		if (count == capacity) return INVALID_INDEX;
+
+		unsigned index = count++;
+		unsigned slot = freeSlots.back();
+		freeSlots.pop_back();
+		slots[slot] = index;
+		handles[index] = slot | (Handle(generations[slot]) << SLOT_BITS);
+
+		this->pos[index] = position;
+		this->velocity[index] = velocity;
+		this->force[index] = glm::vec3(0.f);
+		this->type[index] = type;
+		this->charge[index] = Particle::DATA[type].charge;
+		this->mass[index] = Particle::DATA[type].mass;
+		this->radius[index] = ofMap(Particle::DATA[type].mass, 500.f, 2300.f, 5.0f, 8.0f);
+		this->age[index] = 0.f;
+		this->anihilationRatio[index] = 0.f;
+		this->fusionRatio[index] = 0.f;
+		this->alive[index] = true;
+		this->fusing[index] = false;
+		this->fusionPartners[index] = std::make_pair(INVALID_HANDLE, INVALID_HANDLE);
+		numPartners[index] = 0;
+		return index;
+	}
+
+	void ParticleStore::remove(unsigned index)
+	{
+		auto slot = handles[index] & SLOT_MASK;
+		slots[slot] = INVALID_INDEX;
+		generations[slot]++;
+		freeSlots.push_back(slot);
+
+		unsigned last = count - 1;
+		if (index != last)
+		{
+			move(last, index);
+		}
+		alive[last] = false;
+		handles[last] = INVALID_HANDLE;
+		count = last;
+	}
+
+	void ParticleStore::move(unsigned from, unsigned to)
+	{
+		pos[to] = pos[from];
+		velocity[to] = velocity[from];
+		force[to] = force[from];
+		charge[to] = charge[from];
+		mass[to] = mass[from];
+		radius[to] = radius[from];
+		age[to] = age[from];
+		anihilationRatio[to] = anihilationRatio[from];
+		fusionRatio[to] = fusionRatio[from];
+		type[to] = type[from];
+		alive[to] = (bool)alive[from];
+		fusing[to] = (bool)fusing[from];
+		fusionPartners[to] = fusionPartners[from];
+		numPartners[to] = numPartners[from];
+		std::copy(partners.begin() + from * MAX_PARTNERS,
+				  partners.begin() + from * MAX_PARTNERS + numPartners[from],
+				  partners.begin() + to * MAX_PARTNERS);
+		handles[to] = handles[from];
+		slots[handles[to] & SLOT_MASK] = to;
+	}
+
+	size_t ParticleStore::compact()
+	{
+		// dead particles per block and their prefix sum, the rank of a dead
+		// particle among all the dead ones is then known inside its block
+		const size_t numBlocks = (count + COMPACTION_BLOCK - 1) / COMPACTION_BLOCK;
+		deadPerBlock.resize(numBlocks + 1);
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t b = r.begin(); b != r.end(); ++b)
+			{
+				unsigned numDead = 0;
+				for (size_t i = b * COMPACTION_BLOCK; i < std::min((b + 1) * COMPACTION_BLOCK, count); ++i)
+				{
+					numDead += !alive[i];
+				}
+				deadPerBlock[b + 1] = numDead;
+			}
+		});
+		deadPerBlock[0] = 0;
+		for (size_t b = 0; b < numBlocks; ++b)
+		{
+			deadPerBlock[b + 1] += deadPerBlock[b];
+		}
+		const size_t numDead = deadPerBlock[numBlocks];
+		if (numDead == 0) return 0;
+
+		// the alive particles past the new end fill the holes the dead ones
+		// leave before it, the k-th of them goes into the k-th hole. Holes
+		// are only written and moving particles only read so the moves are
+		// independent
+		const size_t newCount = count - numDead;
+		dead.resize(numDead);
+		deadSlots.resize(numDead);
+		moving.resize(numDead);
+		size_t numHoles = deadPerBlock[newCount / COMPACTION_BLOCK];
+		for (size_t i = newCount / COMPACTION_BLOCK * COMPACTION_BLOCK; i < newCount; ++i)
+		{
+			numHoles += !alive[i];
+		}
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t b = r.begin(); b != r.end(); ++b)
+			{
+				// nothing to do in blocks before the new end without holes
+				size_t deadBefore = deadPerBlock[b];
+				if (deadPerBlock[b + 1] == deadBefore && (b + 1) * COMPACTION_BLOCK <= newCount) continue;
+				for (size_t i = b * COMPACTION_BLOCK; i < std::min((b + 1) * COMPACTION_BLOCK, count); ++i)
+				{
+					if (!alive[i])
+					{
+						dead[deadBefore++] = i;
+					}
+					else if (i >= newCount)
+					{
+						// alive particles past the new end before this one
+						moving[(i - newCount) - (deadBefore - numHoles)] = i;
+					}
+				}
+			}
+		});
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numDead, 256),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t k = r.begin(); k != r.end(); ++k)
+			{
+				auto slot = handles[dead[k]] & SLOT_MASK;
+				slots[slot] = INVALID_INDEX;
+				generations[slot]++;
+				deadSlots[k] = slot;
+			}
+		});
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numHoles, 256),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t k = r.begin(); k != r.end(); ++k)
+			{
+				move(moving[k], dead[k]);
+			}
+		});
+		tbb::parallel_for(tbb::blocked_range<size_t>(newCount, count, 4096),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				alive[i] = false;
+				handles[i] = INVALID_HANDLE;
+			}
+		});
+
+		// in index order so the handles given to new particles are reproducible
+		freeSlots.insert(freeSlots.end(), deadSlots.begin(), deadSlots.end());
+		count = newCount;
+		return numDead;
+	}
+
+	bool ParticleStore::check() const
+	{
+		bool ok = true;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!alive[i])
+			{
+				ofLogError("ParticleStore::check") << "Dead particle " << i << " before the end " << count;
+				ok = false;
+			}
+			if (getIndex(handles[i]) != i)
+			{
+				ofLogError("ParticleStore::check") << "Handle of particle " << i << " resolves to " << getIndex(handles[i]);
+				ok = false;
+			}
+		}
+		auto aliveAfterEnd = std::count_if(alive.begin() + count, alive.end(), [](const tbb::atomic<bool> & alive){
+			return (bool)alive;
+		});
+		if (aliveAfterEnd > 0)
+		{
+			ofLogError("ParticleStore::check") << aliveAfterEnd << " alive particles after the end " << count;
+			ok = false;
+		}
+		if (freeSlots.size() + count != capacity)
+		{
+			ofLogError("ParticleStore::check") << freeSlots.size() << " free slots for " << count << " particles in " << capacity;
+			ok = false;
+		}
+		return ok;
+	}
+
+	unsigned ParticleStore::getIndex(Handle handle) const
+	{
+		if (handle == INVALID_HANDLE) return INVALID_INDEX;
+		auto slot = handle & SLOT_MASK;
+		if (slot >= slots.size() || generations[slot] != (handle >> SLOT_BITS)) return INVALID_INDEX;
+		return slots[slot];
+	}
+
+	uint64_t ParticleStore::hash() const
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		auto add = [&h](const void * data, size_t size){
+			auto bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				h = (h ^ bytes[i]) * 0x100000001b3ull;
+			}
+		};
+		add(&count, sizeof(count));
+		for (size_t i = 0; i < count; ++i)
+		{
+			add(&type[i], sizeof(type[i]));
+			add(&handles[i], sizeof(handles[i]));
+			add(&pos[i], sizeof(pos[i]));
+			add(&velocity[i], sizeof(velocity[i]));
+		}
+		return h;
+	}
+}
@@ -0,0 +1,172 @@
+/*
+ *  ParticleStore.h
+ *
+ *  Copyright (c) 2016, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved. 
+ *  
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met: 
+ *  
+ *  * Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer. 
+ *  * Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution. 
+ *  * Neither the name of Neil Mendoza nor the names of its contributors may be used 
+ *    to endorse or promote products derived from this software without 
+ *    specific prior written permission. 
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ *  POSSIBILITY OF SUCH DAMAGE. 
+ *
+ */
+#pragma once
+
+#include "ofMain.h"
+#include "Particle.h"
+#include "tbb/tbb.h"
+#include <gsl>
+
+namespace nm
+{
+	/* Particles stored as a structure of arrays, every attribute is its own
+	 * cache aligned column indexed by the particle's dense index so the force
+	 * and integration loops only touch the attributes they use.
+	 *
+	 * Dense indices change when a particle is removed, the last particle is
+	 * moved into the hole, so anything that needs to refer to a particle
+	 * across a removal (interaction partners, the camera target...) keeps a
+	 * Handle instead. A handle stays valid until its particle is removed and
+	 * a stale handle resolves to INVALID_INDEX even after its slot is reused.
+	 * The slot is the low half of the handle and its generation the high
+	 * half, a slot would have to be reused 2^32 times for a stale handle to
+	 * resolve again.
+	 *
+	 * Columns are allocated once for the capacity, adding and removing never
+	 * allocates. add(), remove() and compact() aren't thread safe, kill()
+	 * is. */
+	class ParticleStore
+	{
+	public:
+		typedef uint64_t Handle;
+
+		template<typename T>
+		using Column = std::vector<T, tbb::cache_aligned_allocator<T>>;
+
+		static const Handle INVALID_HANDLE = ~Handle(0);
+		static const unsigned INVALID_INDEX = ~0u;
+		static const unsigned MAX_PARTNERS = 16;
+		static const size_t MAX_CAPACITY = size_t(1) << 24;
+
+		ParticleStore();
+
+		// Reallocates the columns, removes every particle
+		void setCapacity(size_t capacity);
+		size_t getCapacity() const { return capacity; }
+
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		bool full() const { return count == capacity; }
+		void clear();
+
+		// Returns the index of the new particle or INVALID_INDEX if full
+		unsigned add(Particle::Type type, const glm::vec3& position, const glm::vec3& velocity);
+
+		// O(1), the last particle takes the place of the removed one
+		void remove(unsigned index);
+
+		// removes every dead particle in parallel, the alive particles at the
+		// end fill the holes and keep their handles so partner and fusion
+		// references still resolve. The result only depends on which
+		// particles are dead, not on how the work was scheduled. Returns
+		// how many were removed
+		size_t compact();
+
+		// logs every inconsistency between the columns and the handles,
+		// returns false if there was any. O(n), for debugging
+		bool check() const;
+
+		// Marks the particle as dead, returns true only for the call that
+		// actually killed it so concurrent kills of the same particle can
+		// be counted once
+		bool kill(unsigned index) { return alive[index].compare_and_swap(false, true); }
+
+		inline Handle getHandle(unsigned index) const { return handles[index]; }
+		unsigned getIndex(Handle handle) const;
+
+		// Interaction partners found while summing forces, at most
+		// MAX_PARTNERS per particle, the rest are ignored
+		inline void clearPartners(unsigned index) { numPartners[index] = 0; }
+		inline bool addPartner(unsigned index, Handle partner){
+			auto & n = numPartners[index];
+			if(n == MAX_PARTNERS) return false;
+			partners[index * MAX_PARTNERS + n++] = partner;
+			return true;
+		}
+		inline gsl::span<const Handle> getPartners(unsigned index) const{
+			return gsl::span<const Handle>(partners.data() + index * MAX_PARTNERS, numPartners[index]);
+		}
+
+		// FNV-1a of the type, handle, position and velocity of every particle
+		// in dense order, two runs from the same state and seed that hash the
+		// same every frame followed the same trajectory
+		uint64_t hash() const;
+
+		inline Particle::Type getType(unsigned index) const { return type[index]; }
+		inline unsigned char getAnnihilationFlag(unsigned index) const { return Particle::getAnnihilationFlag(type[index]); }
+		inline bool isQuark(unsigned index) const { return Particle::isQuark(type[index]); }
+		inline bool isMatterQuark(unsigned index) const { return Particle::isMatterQuark(type[index]); }
+		inline bool isAntiMatterQuark(unsigned index) const { return Particle::isAntiMatterQuark(type[index]); }
+
+		Column<glm::vec3> pos;
+		Column<glm::vec3> velocity;
+		Column<glm::vec3> force;
+		Column<float> charge;
+		Column<float> mass;
+		Column<float> radius;
+		Column<float> age;
+		Column<float> anihilationRatio;
+		Column<float> fusionRatio;
+		Column<Particle::Type> type;
+		Column<tbb::atomic<bool>> alive;
+		Column<tbb::atomic<bool>> fusing;
+		Column<std::pair<Handle, Handle>> fusionPartners;
+
+	private:
+		static const unsigned SLOT_BITS = 32;
+		static const Handle SLOT_MASK = (Handle(1) << SLOT_BITS) - 1;
+		static const size_t COMPACTION_BLOCK = 4096;
+
+		// copies every attribute of from into to, from's handle follows it
+		void move(unsigned from, unsigned to);
+
+		Column<Handle> handles;
+		Column<Handle> partners;
+		Column<unsigned> numPartners;
+
+		// handle slot -> dense index, generation of the slot and the free
+		// slots to hand out
+		std::vector<unsigned> slots;
+		std::vector<uint32_t> generations;
+		std::vector<unsigned> freeSlots;
+
+		// compaction scratch, dead particles per block and the dead and
+		// moving particles in index order
+		std::vector<unsigned> deadPerBlock;
+		std::vector<unsigned> dead;
+		std::vector<unsigned> deadSlots;
+		std::vector<unsigned> moving;
+
+		size_t count;
+		size_t capacity;
+	};
+}
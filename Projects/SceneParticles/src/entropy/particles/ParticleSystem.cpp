@@ -39,30 +39,36 @@ namespace nm
 	const float ParticleSystem::MAX_SPEED_SQUARED = MAX_SPEED * MAX_SPEED;
 
 	ParticleSystem::ParticleSystem() :
-		totalNumParticles(0),
 		roughness(.1f),
+		headless(false),
+		deterministic(false),
+		checkLevel(CHECK_NONE),
+		seed(0),
+		frameNum(0),
 		numDeadParticles(0),
+		numNewParticles(0),
 		numNewPhotons(0)
 	{
+		tboCapacity.fill(0);
+		positionsOffset.fill(0);
+		numPositions.fill(0);
 		this->clearParticles();
 	}
 
-	void ParticleSystem::init(Environment::Ptr universe)
+	void ParticleSystem::init(Environment::Ptr universe, size_t capacity, bool headless)
 	{
 		this->environment = universe;
+		this->headless = headless;
 
 		octree.init(universe->getMin(), universe->getMax());
-		octree.addChildren(true);
 
-		particles.fill(Particle());
-		int i = 0;
-		for(auto &p : particles){
-			p.id = i++;
-		}
-		deadParticles.fill(0);
-		newPhotons.fill(glm::vec3(0));
+		particles.setCapacity(capacity);
+		clearParticles();
+		deadParticles.assign(particles.getCapacity(), 0);
+		newParticles.assign(particles.getCapacity(), NewParticle());
+		newPhotons.assign(particles.getCapacity(), glm::vec3(0));
 
-		for (unsigned i = 0; i < Particle::NUM_TYPES; ++i)
+		for (unsigned i = 0; i < Particle::NUM_TYPES && !headless; ++i)
 		{
 			ostringstream oss;
 			oss << "models/";
@@ -77,25 +83,27 @@ namespace nm
             meshes[i].setUsage(GL_STATIC_DRAW);
 		}
 
-		wallShader.load("shaders/wall");
+		if (!headless)
+		{
+			wallShader.load("shaders/wall");
+		}
 
 		// position stuff
-		for (unsigned i = 0; i < Particle::NUM_TYPES; ++i)
+		positions.assign(particles.getCapacity(), ParticleGpuData());
+		for (unsigned i = 0; i < Particle::NUM_TYPES && !headless; ++i)
 		{
-			positions[i].fill(ParticleGpuData());
-			tbo[i].allocate();
-			tbo[i].setData(sizeof(ParticleGpuData) * MAX_PARTICLES, positions.data(), GL_DYNAMIC_DRAW);
-			positionsTex[i].allocateAsBufferTexture(tbo[i], GL_RGBA32F);
+			allocateGpuData(i, std::min<size_t>(particles.getCapacity(), 5000));
 		}
 
 		pairProductionListener = universe->pairProductionEvent.newListener([this](PairProductionEventArgs & args)
 		{
 			Particle::Type type1, type2;
-			switch (rand() % 3)
+			auto & random = pairProductionRandom;
+			switch (random.uniform(3))
 			{
 			case 0:
 				type1 = Particle::UP_QUARK;
-				if(ofRandomuf()<environment->matterSurveivesChance){
+				if(random.uniform()<environment->matterSurveivesChance){
 					type2 = Particle::ANTI_UP_QUARK;
 				}else{
 					type2 = Particle::UP_QUARK;
@@ -104,7 +112,7 @@ namespace nm
 
 			case 1:
 				type1 = Particle::DOWN_QUARK;
-				 if(ofRandomuf()<environment->matterSurveivesChance){
+				 if(random.uniform()<environment->matterSurveivesChance){
 					 type2 = Particle::ANTI_DOWN_QUARK;
 				 }else{
 					 type2 = Particle::DOWN_QUARK;
@@ -113,38 +121,43 @@ namespace nm
 
 			case 2:
 				type1 = Particle::ELECTRON;
-				if(ofRandomuf()<environment->matterSurveivesChance){
+				if(random.uniform()<environment->matterSurveivesChance){
 					type2 = Particle::POSITRON;
 				}else{
 					type2 = Particle::ELECTRON;
 				}
 				break;
 			}
-			glm::vec3 dir = glm::normalize(glm::perp(args.velocity, glm::sphericalRand(1.f)));
+			glm::vec3 dir = glm::normalize(glm::perp(args.velocity, random.sphere(1.f)));
 			float speed = glm::length(args.velocity);
 			addParticle(type1, args.position, .5f * speed * dir);
 			addParticle(type2, args.position, -.5f * speed * dir);
 		});
 	}
 
+	void ParticleSystem::allocateGpuData(unsigned type, size_t numParticles)
+	{
+		if (numParticles <= tboCapacity[type]) return;
+
+		// grow geometrically so a type that keeps growing doesn't reallocate every frame
+		numParticles = std::min(std::max(numParticles, tboCapacity[type] * 2), particles.getCapacity());
+		if (tboCapacity[type] == 0) tbo[type].allocate();
+		tbo[type].setData(sizeof(ParticleGpuData) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+		positionsTex[type].allocateAsBufferTexture(tbo[type], GL_RGBA32F);
+		tboCapacity[type] = numParticles;
+	}
+
+	void ParticleSystem::setSeed(uint64_t seed)
+	{
+		this->seed = seed;
+		frameNum = 0;
+		pairProductionRandom = Random(seed, ~uint64_t(0));
+	}
+
 	void ParticleSystem::addParticle(Particle::Type type, const glm::vec3& position, const glm::vec3& velocity)
 	{
-		if (totalNumParticles < MAX_PARTICLES)
+		if (particles.add(type, position, velocity) != ParticleStore::INVALID_INDEX)
 		{
-			float radius = ofMap(Particle::DATA[type].mass, 500.f, 2300.f, 5.0f, 8.0f);
-
-			Particle& p = particles[totalNumParticles];
-			p.setPosition(position);
-			p.setVelocity(velocity);
-			p.setType(type);
-			p.setCharge(Particle::DATA[type].charge);
-			p.setMass(Particle::DATA[type].mass);
-			p.setRadius(radius);
-			p.anihilationRatio = 0;
-			p.alive = true;
-			p.age = 0;
-
-			totalNumParticles++;
 			numParticles[type]++;
 		}
 		else ofLogError() << "Cannot add more particles";
@@ -152,14 +165,9 @@ namespace nm
 
 	void ParticleSystem::clearParticles()
 	{
-		totalNumParticles = 0;
-		for(auto & pos: positions){
-			pos.fill(ParticleGpuData());
-		}
-		for(auto & p: particles){
-			p.alive = false;
-		}
+		particles.clear();
 		numParticles.fill(0);
+		numPositions.fill(0);
 	}
 
 	void ParticleSystem::update(double dt)
@@ -167,13 +175,22 @@ namespace nm
 		if(dt == 0) return;
 		dt *= environment->systemSpeed;
 		numDeadParticles = 0;
+		numNewParticles = 0;
 		numNewPhotons = 0;
-		octree.clear();
-		octree.addPoints(particles.data(), totalNumParticles);
-		octree.updateCenterOfCharge();
 
-		tbb::atomic<unsigned> typeIndices[Particle::NUM_TYPES];
-		for (unsigned i = 0; i < Particle::NUM_TYPES; ++i) typeIndices[i] = 0;
+		auto then = ofGetElapsedTimeMicros();
+		auto lap = [&then](uint64_t & timing){
+			auto now = ofGetElapsedTimeMicros();
+			timing = now - then;
+			then = now;
+		};
+
+		octree.update(particles);
+		lap(timings.octree);
+
+		octree.updateMoments(particles);
+		lap(timings.centerOfCharge);
+
 		const glm::vec3 min = environment->getMin();
 		const glm::vec3 max = environment->getMax();
 		const float expansionScalar = environment->getExpansionScalar();
@@ -181,231 +198,303 @@ namespace nm
 		const float fusionThreshold = environment->getFusionThresh(); // was 0.00001
 		Octree<Particle>::setForceMultiplier(environment->getForceMultiplier());
 
-		for(auto & particle: particles){
-			particle.fusing = false;
-		}
+		///////////////////////////////////////////////////////////
+		// attraction/repulsion
+		///////////////////////////////////////////////////////////
 
-		//const float forceMultiplier = universe->getForceMultiplier();
-		tbb::parallel_for(tbb::blocked_range<size_t>(0, totalNumParticles),
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particles.size()),
 			[&](const tbb::blocked_range<size_t>& r) {
 			for (size_t i = r.begin(); i != r.end(); ++i)
 			{
-				///////////////////////////////////////////////////////////
-				// attraction/repulsion
-				///////////////////////////////////////////////////////////
-
 				// zero particle forces
-				particles[i].zeroForce();
-				particles[i].age += dt;
-
-				// sum all forces acting on particle
-				particles[i].potentialInteractionPartners.clear();
+				particles.force[i] = glm::vec3(0.0f);
+				particles.age[i] += dt;
+				particles.fusing[i] = false;
+				particles.clearPartners(i);
+			}
+		});
 
-				if(!particles[i].alive) continue;
+		// sum all forces acting on every particle, leaf by leaf. Forces are
+		// summed for every particle before any of them moves so they only
+		// depend on the positions at the start of the frame
+		octree.sumForces(particles);
+		lap(timings.forces);
 
-				octree.sumForces(particles[i]);// , forceMultiplier);
-				if(particles[i].getType() == Particle::ELECTRON){
-					particles[i].force *= 0.2;
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particles.size()),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				auto & pos = particles.pos[i];
+				auto & velocity = particles.velocity[i];
+				if(particles.getType(i) == Particle::ELECTRON){
+					particles.force[i] *= 0.2;
 				}
 
 				// add velocity (TODO: improved Euler integration)
-				particles[i].setVelocity(particles[i].getVelocity() + particles[i].getForce() * dt / particles[i].getMass());
+				velocity = velocity + particles.force[i] * dt / particles.mass[i];
 
 				// damp velocity
-				float velocity2 = glm::length2(particles[i].getVelocity());
-				if (velocity2 > MIN_SPEED_SQUARED) particles[i].setVelocity(.998f * particles[i].getVelocity());
-				if (velocity2 > MAX_SPEED_SQUARED) particles[i].setVelocity(MAX_SPEED * glm::normalize(particles[i].getVelocity()));
+				float velocity2 = glm::length2(velocity);
+				if (velocity2 > MIN_SPEED_SQUARED) velocity = .998f * velocity;
+				if (velocity2 > MAX_SPEED_SQUARED) velocity = MAX_SPEED * glm::normalize(velocity);
 
 				// add position (TODO: improved Euler integration)
-				particles[i].pos += particles[i].getVelocity() * dt;
-				if(particles[i].potentialInteractionPartners.empty()){
-					particles[i].anihilationRatio = 0;
-					particles[i].fusionRatio = 1;
+				pos += velocity * dt;
+				if(particles.getPartners(i).empty()){
+					particles.anihilationRatio[i] = 0;
+					particles.fusionRatio[i] = 1;
 				}
 
 				// check whether particle is out of bounds
 				for (unsigned j = 0; j < 3; ++j)
 				{
 					// add a little bit so things don't get stuck teleporting on the edges
-					if (particles[i].pos[j] > max[j]) particles[i].pos[j] = min[j] + 10.f;
-					if (particles[i].pos[j] < min[j]) particles[i].pos[j] = max[j] - 10.f;
+					if (pos[j] > max[j]) pos[j] = min[j] + 10.f;
+					if (pos[j] < min[j]) pos[j] = max[j] - 10.f;
 				}
-
-				unsigned idx = typeIndices[particles[i].getType()].fetch_and_increment();
-				positions[particles[i].getType()][idx].transform =
-					glm::translate(expansionScalar * particles[i].pos) *
-					glm::scale(glm::vec3(particles[i].getRadius())) *
-					glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), particles[i].getVelocity(), glm::vec3(0.0f, 1.0f, 0.0f));
-
-				/////////////////////////////////////////////////////////////
-				// particle interactions
-				/////////////////////////////////////////////////////////////
-
-				bool killParticles = false;
-				for(auto * potentialInteractionPartner: particles[i].potentialInteractionPartners){
-					// make the particle with the lower address in memory
-					// the one that is responsible for the interaction
-
-//					if(potentialInteractionPartner){
-//						float distance = glm::distance(potentialInteractionPartner->pos, particles[i].pos);
-//						if(distance < Octree<Particle>::INTERACTION_DISTANCE()){
-//							particles[i].pos += (potentialInteractionPartner->pos - particles[i].pos)*0.01;
-//						}
-//					}
-					if (potentialInteractionPartner && particles[i].id < potentialInteractionPartner->id)
-					{
-						float distance = glm::distance(potentialInteractionPartner->pos, particles[i].pos);
-						if(distance < Octree<Particle>::INTERACTION_DISTANCE()){
-							// have this so later on can have different likelihoods of different
-							// interactions occurring
-
-							// see what type of interaction we have
-							// already doing this check in sumForces() so maybe could remove to optimize but
-							// doesn't seem like it would save a worthwhile amount of time
-							if ((potentialInteractionPartner->getAnnihilationFlag() ^ particles[i].getAnnihilationFlag()) == 0xFF)
+			}
+		});
+		lap(timings.integration);
+
+		/////////////////////////////////////////////////////////////
+		// particle interactions
+		/////////////////////////////////////////////////////////////
+
+		// each dead particle is recorded once even if several threads kill it
+		auto kill = [&](unsigned index){
+			if (particles.kill(index)) deadParticles[numDeadParticles.fetch_and_increment()] = index;
+		};
+
+		auto interact = [&](size_t i){
+			if(!particles.alive[i]) return;
+
+			auto & pos = particles.pos[i];
+			const auto & velocity = particles.velocity[i];
+			const auto type = particles.getType(i);
+			const auto handle = particles.getHandle(i);
+			// the handle already takes all 64 bits, slot and generation, so
+			// the frame goes into the key instead, mix(0) is 0 so frame 0
+			// would share its streams with the ones keyed by the seed alone
+			Random random(seed ^ Random::mix(frameNum + 1), handle);
+
+			bool killParticles = false;
+			for(auto partnerHandle: particles.getPartners(i)){
+				// make the particle with the lower handle
+				// the one that is responsible for the interaction
+				auto partner = particles.getIndex(partnerHandle);
+				if (partner != ParticleStore::INVALID_INDEX && handle < partnerHandle && particles.alive[partner])
+				{
+					float distance = glm::distance(particles.pos[partner], pos);
+					if(distance < Octree<Particle>::INTERACTION_DISTANCE()){
+						// have this so later on can have different likelihoods of different
+						// interactions occurring
+
+						// see what type of interaction we have
+						// already doing this check in sumForces() so maybe could remove to optimize but
+						// doesn't seem like it would save a worthwhile amount of time
+						if ((particles.getAnnihilationFlag(partner) ^ particles.getAnnihilationFlag(i)) == 0xFF)
+						{
+							particles.anihilationRatio[i] = particles.anihilationRatio[i] + dt;// / environment->systemSpeed;
+							if (particles.anihilationRatio[i] > annihilationThreshold)
 							{
-								particles[i].anihilationRatio = particles[i].anihilationRatio + dt;// / environment->systemSpeed;
-								if (particles[i].anihilationRatio > annihilationThreshold)
-								{
-									unsigned newPhotonIdx = numNewPhotons.fetch_and_increment();
-									newPhotons[newPhotonIdx] = (particles[i].pos + potentialInteractionPartner->pos) / 2.f;
-									killParticles = true;
-								}
+								unsigned newPhotonIdx = numNewPhotons.fetch_and_increment();
+								newPhotons[newPhotonIdx] = (pos + particles.pos[partner]) / 2.f;
+								killParticles = true;
 							}
+						}
 
-							if (killParticles)
-							{
-								// Super hack to simulate matter surviving anihilation
-								if(ofRandomuf()<environment->matterSurveivesChance){
-									if(particles[i].isAntiMatterQuark()){
-										deadParticles[numDeadParticles.fetch_and_increment()] = i;
-										particles[i].alive = false;
-									}else{
-										// If matter survives teleport it to the other side of the universe
-										// so we can't see it
-										particles[i].pos = -particles[i].pos;
-										particles[i].potentialInteractionPartners.clear();
-									}
-
-									deadParticles[numDeadParticles.fetch_and_increment()] = potentialInteractionPartner - particles.data();
-									potentialInteractionPartner->alive = false;
+						if (killParticles)
+						{
+							// Super hack to simulate matter surviving anihilation
+							if(random.uniform()<environment->matterSurveivesChance){
+								if(particles.isAntiMatterQuark(i)){
+									kill(i);
 								}else{
-									// interaction is annihilation so kill particle
-									deadParticles[numDeadParticles.fetch_and_increment()] = i;
-									particles[i].alive = false;
-
-									// kill partner (idx of partner is potentialInteractionPartner - particles)
-									deadParticles[numDeadParticles.fetch_and_increment()] = potentialInteractionPartner - particles.data();
-									potentialInteractionPartner->alive = false;
+									// If matter survives teleport it to the other side of the universe
+									// so we can't see it
+									pos = -pos;
+									particles.clearPartners(i);
 								}
-
-								// The particle is probably dead, don't look for more interactions;
-								break;
+								kill(partner);
+							}else{
+								// interaction is annihilation so kill both particles
+								kill(i);
+								kill(partner);
 							}
+
+							// The particle is probably dead, don't look for more interactions;
+							break;
 						}
 					}
 				}
+			}
 
 
-				if(particles[i].fusionPartners.first!=nullptr && particles[i].fusionPartners.second!=nullptr){
-					//TODO: try to keep the same connection
-				}
-				particles[i].fusionPartners.first = nullptr;
-				particles[i].fusionPartners.second = nullptr;
-				if(!killParticles && !particles[i].fusing && environment->state > nm::Environment::BARYOGENESIS){
-					auto type = particles[i].getType();
-					if(type==Particle::DOWN_QUARK || type==Particle::UP_QUARK){
-						const auto & partners = particles[i].potentialInteractionPartners;
-						auto down = std::find_if(partners.begin(), partners.end(), [&](const Particle * p){
-							return p->getType() == Particle::DOWN_QUARK && p->alive &&
-									glm::distance(particles[i].pos, p->pos) < Octree<Particle>::INTERACTION_DISTANCE() &&
-									particles[i].id < p->id &&
-									!p->fusing;
-						});
-						auto up = std::find_if(partners.begin(), partners.end(), [&](const Particle * p){
-							return p->getType() == Particle::UP_QUARK && p->alive &&
-									glm::distance(particles[i].pos, p->pos) < Octree<Particle>::INTERACTION_DISTANCE() &&
-									particles[i].id < p->id &&
-									!p->fusing;
+			particles.fusionPartners[i] = std::make_pair(ParticleStore::INVALID_HANDLE, ParticleStore::INVALID_HANDLE);
+			if(!killParticles && !particles.fusing[i] && environment->state > nm::Environment::BARYOGENESIS){
+				if(type==Particle::DOWN_QUARK || type==Particle::UP_QUARK){
+					const auto partners = particles.getPartners(i);
+					auto findCandidate = [&](Particle::Type candidateType){
+						auto candidate = std::find_if(partners.begin(), partners.end(), [&](ParticleStore::Handle partnerHandle){
+							auto p = particles.getIndex(partnerHandle);
+							return p != ParticleStore::INVALID_INDEX &&
+									particles.getType(p) == candidateType && particles.alive[p] &&
+									glm::distance(pos, particles.pos[p]) < Octree<Particle>::INTERACTION_DISTANCE() &&
+									handle < partnerHandle &&
+									!particles.fusing[p];
 						});
-						if (up != partners.end() && down != partners.end())
+						return candidate == partners.end() ? ParticleStore::INVALID_HANDLE : *candidate;
+					};
+					auto downHandle = findCandidate(Particle::DOWN_QUARK);
+					auto upHandle = findCandidate(Particle::UP_QUARK);
+					auto down = particles.getIndex(downHandle);
+					auto up = particles.getIndex(upHandle);
+					if (up != ParticleStore::INVALID_INDEX && down != ParticleStore::INVALID_INDEX)
+					{
+						particles.fusing[i] = true;
+						particles.fusing[up] = true;
+						particles.fusing[down] = true;
+						particles.fusionPartners[i] = std::make_pair(downHandle, upHandle);
+						particles.fusionRatio[i] = particles.fusionRatio[i] + dt;
+						if (particles.fusionRatio[i] > fusionThreshold)
 						{
-							particles[i].fusing = true;
-							(*up)->fusing = true;
-							(*down)->fusing = true;
-							particles[i].fusionPartners.first = *down;
-							particles[i].fusionPartners.second = *up;
-							particles[i].fusionRatio = particles[i].fusionRatio + dt;
-							if (particles[i].fusionRatio > fusionThreshold)
+							Particle::Type newType = Particle::PROTON;
+							if (type == Particle::DOWN_QUARK)
 							{
-								Particle::Type newType = Particle::PROTON;
-								if (particles[i].getType() == Particle::DOWN_QUARK)
-								{
-									newType = Particle::NEUTRON;
-								}
-								addParticle(
-									newType,
-									(particles[i].pos + (*down)->pos + (*up)->pos) / 3.f,
-									((*up)->getVelocity() + (*down)->getVelocity() + particles[i].getVelocity()) / 3.f
-								);
-								killParticles = true;
+								newType = Particle::NEUTRON;
 							}
-						}else{
-							particles[i].fusionRatio = 0;
+							auto & newParticle = newParticles[numNewParticles.fetch_and_increment()];
+							newParticle.type = newType;
+							newParticle.position = (pos + particles.pos[down] + particles.pos[up]) / 3.f;
+							newParticle.velocity = (particles.velocity[up] + particles.velocity[down] + velocity) / 3.f;
+							killParticles = true;
 						}
+					}else{
+						particles.fusionRatio[i] = 0;
+					}
 
-						if(killParticles){
-							// interaction is fusion so kill particle
-							deadParticles[numDeadParticles.fetch_and_increment()] = i;
-							particles[i].alive = false;
-
-							// kill partners (idx of partner is partner - particles)
-							deadParticles[numDeadParticles.fetch_and_increment()] = *up - particles.data();
-							(*up)->alive = false;
-
-							deadParticles[numDeadParticles.fetch_and_increment()] = *down - particles.data();
-							(*down)->alive = false;
-						}
+					if(killParticles){
+						// interaction is fusion so kill particle and partners
+						kill(i);
+						kill(up);
+						kill(down);
 					}
 				}
 			}
-		});
+		};
 
-		if (numDeadParticles > 0)
+		if (deterministic)
 		{
-			DeadParticlesEventArgs args;
-			args.numDead = numDeadParticles;
-			ofNotifyEvent(environment->deadParticlesEvent, args, this);
+			for (size_t i = 0; i < particles.size(); ++i) interact(i);
 		}
+		else
+		{
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, particles.size()),
+				[&](const tbb::blocked_range<size_t>& r) {
+				for (size_t i = r.begin(); i != r.end(); ++i) interact(i);
+			});
+		}
+		lap(timings.interactions);
 
-		// start deleting particles at the end first so we don't swap out a particle
-		// that is actually dead and would be swapped out later in the iteration
-		std::sort(deadParticles.begin(), deadParticles.begin() + numDeadParticles, std::greater<float>());
-
-		//cout << "Num dead particles is " << numDeadParticles << " / " << totalNumParticles << endl;
-		if (numDeadParticles)
+		for (unsigned i = 0; i < numDeadParticles; ++i)
+		{
+			numParticles[particles.getType(deadParticles[i])].fetch_and_decrement();
+		}
+		if (numDeadParticles * COMPACTION_RATIO > particles.size())
+		{
+			// bursts are compacted in parallel, the holes filled from the end
+			particles.compact();
+		}
+		else
 		{
-			// kill all the particles
+			// a few are cheaper to swap out one by one than scanning the whole
+			// store. Start at the end so we don't swap in a particle that is
+			// dead too, sorted so the result doesn't depend on the kill order
+			std::sort(deadParticles.begin(), deadParticles.begin() + numDeadParticles, std::greater<unsigned>());
 			for (unsigned i = 0; i < numDeadParticles; ++i)
 			{
-				unsigned deadIdx = deadParticles[i];
-				unsigned endIdx = totalNumParticles.fetch_and_decrement() - 1;
-				const auto idx = (unsigned)particles[deadIdx].getType();
-				//cout << "  Killing particle " << i << ": From " << numParticles[idx];
-				numParticles[idx].fetch_and_decrement();
-				//cout << " to " << numParticles[idx] << endl;
-				// replace dead particle with one from the end of the array
-				if (endIdx >= 0 && deadIdx < totalNumParticles) std::swap(particles[deadIdx], particles[endIdx]);
+				particles.remove(deadParticles[i]);
 			}
+		}
 
-//			auto lastAlive = std::remove_if(particles.begin(), particles.begin() + totalNumParticles, [&](Particle & p){
-//				if(!p.alive){
-//					numParticles[p.getType()].fetch_and_decrement();
-//				}
-//				return !p.alive;
-//			});
+		// particles created by fusion
+		for (unsigned i = 0; i < numNewParticles; ++i)
+		{
+			addParticle(newParticles[i].type, newParticles[i].position, newParticles[i].velocity);
+		}
+		lap(timings.compaction);
 
-//			totalNumParticles = lastAlive - particles.begin();
+		// every particle alive now gets a position, new ones included
+		unsigned offset = 0;
+		for (unsigned i = 0; i < Particle::NUM_TYPES; ++i)
+		{
+			positionsOffset[i] = offset;
+			offset += numParticles[i];
+		}
+
+		// the store is split in blocks that count their particles of each
+		// type first, the blocks' offsets into every type's range are then
+		// known before packing so no counter is shared and the particles
+		// keep their store order
+		const size_t numBlocks = (particles.size() + PACKING_BLOCK - 1) / PACKING_BLOCK;
+		packingOffsets.resize(numBlocks);
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t b = r.begin(); b != r.end(); ++b)
+			{
+				auto & counts = packingOffsets[b];
+				counts.fill(0);
+				for (size_t i = b * PACKING_BLOCK; i < std::min<size_t>((b + 1) * PACKING_BLOCK, particles.size()); ++i)
+				{
+					counts[particles.getType(i)]++;
+				}
+			}
+		});
+		auto typeEnds = positionsOffset;
+		for (auto & offsets: packingOffsets)
+		{
+			for (unsigned i = 0; i < Particle::NUM_TYPES; ++i)
+			{
+				auto count = offsets[i];
+				offsets[i] = typeEnds[i];
+				typeEnds[i] += count;
+			}
+		}
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t b = r.begin(); b != r.end(); ++b)
+			{
+				auto offsets = packingOffsets[b];
+				for (size_t i = b * PACKING_BLOCK; i < std::min<size_t>((b + 1) * PACKING_BLOCK, particles.size()); ++i)
+				{
+					auto & instance = positions[offsets[particles.getType(i)]++];
+					instance.positionScale = glm::vec4(expansionScalar * particles.pos[i], particles.radius[i]);
+					instance.velocity = glm::vec4(particles.velocity[i], 0.f);
+				}
+			}
+		});
+		for (unsigned i = 0; i < Particle::NUM_TYPES; ++i)
+		{
+			numPositions[i] = typeEnds[i] - positionsOffset[i];
+		}
+		lap(timings.packing);
+
+		// update the texture buffer objects with the new positions of particles
+		for (unsigned i = 0; i < Particle::NUM_TYPES && !headless; ++i)
+		{
+			allocateGpuData(i, numPositions[i]);
+			//cout << "Updating " << i << " w/ " << numPositions[i] << " particles" << endl;
+			tbo[i].updateData(0, sizeof(ParticleGpuData) * numPositions[i], positions.data() + positionsOffset[i]);
+		}
+		lap(timings.upload);
+
+		++frameNum;
+
+		if (numDeadParticles > 0)
+		{
+			DeadParticlesEventArgs args;
+			args.numDead = numDeadParticles;
+			ofNotifyEvent(environment->deadParticlesEvent, args, this);
 		}
 
 		if (numNewPhotons)
@@ -417,63 +506,60 @@ namespace nm
 			ofNotifyEvent(environment->photonEvent, photonEventArgs, this);
 		}
 
-		// update the texture buffer objects with the new positions of particles
-		for (unsigned i = 0; i < Particle::NUM_TYPES; ++i)
+		if (checkLevel != CHECK_NONE)
 		{
-			//cout << "Updating " << i << " w/ " << numParticles[i] << " particles" << endl;
-			tbo[i].updateData(0, sizeof(ParticleGpuData) * numParticles[i], positions[i].data());
+			check();
 		}
+	}
 
-
-
-		std::array<unsigned,Particle::NUM_TYPES> typeIndicesCheck;
-		typeIndicesCheck.fill(0);
-		for(auto i = particles.begin(); i<particles.begin() + totalNumParticles; ++i){
-			auto & p = *i;
-			typeIndicesCheck[p.getType()]++;
+	void ParticleSystem::check() const
+	{
+		std::array<unsigned, Particle::NUM_TYPES> typeCounts;
+		typeCounts.fill(0);
+		for (size_t i = 0; i < particles.size(); ++i)
+		{
+			typeCounts[particles.getType(i)]++;
 		}
-		for(size_t i=0;i<typeIndicesCheck.size();i++){
-			if(numParticles[i] != typeIndicesCheck[i]){
-				ofLogError() << "num particles for type " << i << " doesn' match " << " class " << numParticles[i] << " check " << typeIndicesCheck[i] << endl;
+		for (size_t i = 0; i < typeCounts.size(); ++i)
+		{
+			if (numParticles[i] != typeCounts[i])
+			{
+				ofLogError("ParticleSystem::check") << "Counted " << numParticles[i] << " particles of type " << i << " but the store has " << typeCounts[i];
 			}
 		}
-		auto wrongAlive = std::count_if(particles.begin() + totalNumParticles, particles.end(), [&](Particle & p){
-			return (bool)p.alive;
-		});
-		if(wrongAlive>0){
-			ofLogError() << wrongAlive << " alive particles after dead zone";
-		}
-		auto wrongDead = std::count_if(particles.begin(), particles.begin() + totalNumParticles, [&](Particle & p){
-			return !p.alive;
-		});
-		if(wrongDead>0){
-			ofLogError() << wrongDead << " dead particles before dead zone";
-		}
-		auto totalFromTypes = std::accumulate(numParticles.begin(), numParticles.end(), 0, [&](int acc, unsigned num){
+		auto totalFromTypes = std::accumulate(numParticles.begin(), numParticles.end(), size_t(0), [&](size_t acc, unsigned num){
 			return acc + num;
 		});
-		if(totalFromTypes!=totalNumParticles){
-			ofLogError() << "total from types " << totalFromTypes << " != " << totalNumParticles;
+		if (totalFromTypes != particles.size())
+		{
+			ofLogError("ParticleSystem::check") << "Total from types " << totalFromTypes << " != " << particles.size();
+		}
+		if (checkLevel == CHECK_ALL)
+		{
+			particles.check();
 		}
-
 	}
 
     void ParticleSystem::draw(ofShader & shader)
 	{
+		if (headless) return;
+
 		for (unsigned i = 0; i < Particle::NUM_TYPES; ++i)
 		{
-			if (numParticles[i])
+			if (numPositions[i])
             {
                 shader.setUniform1f("uScale", 1.0f);
                 shader.setUniform1f("uType", i);
                 shader.setUniformTexture("uOffsetTex", positionsTex[i], 0);
-                meshes[i].drawInstanced(OF_MESH_FILL, numParticles[i]);
+                meshes[i].drawInstanced(OF_MESH_FILL, numPositions[i]);
             }
 		}
 	}
 
 	void ParticleSystem::drawWalls()
 	{
+		if (headless) return;
+
 		// Save state before changing.
 		auto depthTestEnabled = glIsEnabled(GL_DEPTH_TEST);
 		auto cullFaceEnabled = glIsEnabled(GL_CULL_FACE);
@@ -526,18 +612,17 @@ namespace nm
 	void ParticleSystem::serialize(nlohmann::json & json)
 	{
 		auto & jsonGroup = json["particles"];
-		for (int i = 0; i < totalNumParticles; ++i)
+		for (size_t i = 0; i < particles.size(); ++i)
 		{
 			nlohmann::json jsonParticle;
-			Particle & p = particles[i];
-
-			jsonParticle["position"] = ofToString(p.pos);
-			jsonParticle["type"] = p.getType();
-			//jsonParticle["mass"] = p.getMass();
-			//jsonParticle["charge"] = p.getCharge();
-			//jsonParticle["radius"] = p.getRadius();
-			jsonParticle["velocity"] = ofToString(p.getVelocity());
-			jsonParticle["force"] = ofToString(p.getForce());
+
+			jsonParticle["position"] = ofToString(particles.pos[i]);
+			jsonParticle["type"] = particles.getType(i);
+			//jsonParticle["mass"] = particles.mass[i];
+			//jsonParticle["charge"] = particles.charge[i];
+			//jsonParticle["radius"] = particles.radius[i];
+			jsonParticle["velocity"] = ofToString(particles.velocity[i]);
+			jsonParticle["force"] = ofToString(particles.force[i]);
 			
 			jsonGroup.push_back(jsonParticle);
 		}
@@ -549,53 +634,69 @@ namespace nm
 		if (json.count("particles"))
 		{
 			// Reset counts.
-			totalNumParticles = 0;
-			numParticles.fill(0);
+			clearParticles();
 
 			auto & jsonGroup = json["particles"];
 			for (int i = 0; i < jsonGroup.size(); ++i)
 			{
 				const auto & jsonParticle = jsonGroup[i];
 
-				// Set the force first.
-				Particle & p = particles[totalNumParticles];
-				p.setForce(ofFromString<glm::vec3>(jsonParticle["force"]));
-
-				// Set the remaining attributes.
 				const auto type = (Particle::Type)(int)jsonParticle["type"];
 				const auto position = ofFromString<glm::vec3>(jsonParticle["position"]);
 				const auto velocity = ofFromString<glm::vec3>(jsonParticle["velocity"]);
+				auto index = particles.size();
 				addParticle(type, position, velocity);
+
+				// Restore the force after adding, adding resets it.
+				if (particles.size() > index)
+				{
+					particles.force[index] = ofFromString<glm::vec3>(jsonParticle["force"]);
+				}
 			}
 		}
 	}
 
 
 	//--------------------------------------------------------------
-	gsl::span<nm::Particle> ParticleSystem::getParticles(){
-		return gsl::span<nm::Particle>(particles.begin(), particles.begin() + totalNumParticles);
+	const ParticleStore & ParticleSystem::getParticles() const{
+		return particles;
 	}
 
 	//--------------------------------------------------------------
-	std::vector<Particle*> ParticleSystem::findNearestThan(const Particle & p, float distance) const{
-		std::vector<Particle*> nearList;
-		octree.findNearestThan(p, distance, nearList);
+	std::vector<ParticleStore::Handle> ParticleSystem::findNearestThan(unsigned index, float distance, size_t maxResults) const{
+		std::vector<ParticleStore::Handle> nearList;
+		octree.findNearestThan(particles, index, distance, nearList, maxResults);
 		return nearList;
 	}
 
 	//--------------------------------------------------------------
-	std::vector<Particle*> ParticleSystem::findNearestThanByType(const Particle & p, float distance, std::initializer_list<Particle::Type> allowedTypes) const{
-		std::vector<Particle*> nearList;
-		octree.findNearestThanByType(p, distance, allowedTypes, nearList);
+	std::vector<ParticleStore::Handle> ParticleSystem::findNearestThanByType(unsigned index, float distance, std::initializer_list<Particle::Type> allowedTypes, size_t maxResults) const{
+		std::vector<ParticleStore::Handle> nearList;
+		octree.findNearestThanByType(particles, index, distance, allowedTypes, nearList, maxResults);
 		return nearList;
 	}
 
-	nm::Particle * ParticleSystem::getById(size_t id){
-		for(auto & p: getParticles()){
-			if(p.id == id){
-				return &p;
-			}
-		}
-		return nullptr;
+	//--------------------------------------------------------------
+	size_t ParticleSystem::findNearestThan(unsigned index, float distance, Particle::TypeMask typeMask, gsl::span<ParticleStore::Handle> results) const{
+		return octree.findNearestThan(particles, particles.pos[index], distance, typeMask, results, particles.getHandle(index));
+	}
+
+	//--------------------------------------------------------------
+	void ParticleSystem::rebuildOctree()
+	{
+		octree.build(particles);
+		octree.updateMoments(particles);
+	}
+
+	//--------------------------------------------------------------
+	Octree<Particle>::ForceError ParticleSystem::computeForceError(size_t numSamples)
+	{
+		rebuildOctree();
+		return octree.computeForceError(particles, numSamples);
+	}
+
+	//--------------------------------------------------------------
+	unsigned ParticleSystem::getIndex(ParticleStore::Handle handle) const{
+		return particles.getIndex(handle);
 	}
 }
@@ -34,14 +34,20 @@
 #include "ofMain.h"
 #include "Octree.h"
 #include "Particle.h"
+#include "ParticleStore.h"
 #include "Environment.h"
+#include "Random.h"
 #include <gsl>
 
 namespace nm
 {
+	// per instance data read by particle.vert, two RGBA32F texels. The
+	// shader builds the rotation from the velocity so the model matrix
+	// doesn't have to be built and uploaded for every particle
 	struct ParticleGpuData
 	{
-		glm::mat4 transform;
+		glm::vec4 positionScale;
+		glm::vec4 velocity;
 	};
 
 	struct Light
@@ -55,15 +61,72 @@ namespace nm
 	class ParticleSystem
 	{
 	public:
-		static const unsigned MAX_PARTICLES = 5000;
+		static const unsigned DEFAULT_CAPACITY = 100000;
 		static const unsigned NUM_LIGHTS = 2;
 		static const float MIN_SPEED_SQUARED;
 		static const float MAX_SPEED;
 		static const float MAX_SPEED_SQUARED;
+		// the store is compacted in parallel once more than 1 in
+		// COMPACTION_RATIO particles died in a frame
+		static const unsigned COMPACTION_RATIO = 64;
+		// particles per block when packing the instance data
+		static const unsigned PACKING_BLOCK = 4096;
+
+		// duration in microseconds of each phase of the last update
+		struct Timings
+		{
+			uint64_t octree = 0;
+			uint64_t centerOfCharge = 0;
+			uint64_t forces = 0;
+			uint64_t integration = 0;
+			uint64_t interactions = 0;
+			uint64_t compaction = 0;
+			uint64_t packing = 0;
+			uint64_t upload = 0;
+
+			uint64_t total() const{
+				return octree + centerOfCharge + forces + integration + interactions + compaction + packing + upload;
+			}
+		};
 
 		ParticleSystem();
 
-		void init(Environment::Ptr environment);
+		// capacity is the maximum number of particles alive at once, all the
+		// per particle memory is allocated here. A headless system doesn't
+		// load meshes or shaders and doesn't upload anything, the gpu data is
+		// still packed so it can be benchmarked without a GL context
+		void init(Environment::Ptr environment, size_t capacity = DEFAULT_CAPACITY, bool headless = false);
+		size_t getCapacity() const { return particles.getCapacity(); }
+
+		// every random decision of the update is drawn from streams keyed by
+		// this seed, the frame number and the particle's handle so it doesn't
+		// depend on the scheduling of the parallel loops. Resets the frame
+		// number
+		void setSeed(uint64_t seed);
+		uint64_t getFrameNum() const { return frameNum; }
+
+		// runs the interactions serially in index order so which particle
+		// fuses with which and the order of new particles and photons is
+		// reproducible, everything else is already independent of scheduling
+		void setDeterministic(bool deterministic) { this->deterministic = deterministic; }
+		bool isDeterministic() const { return deterministic; }
+
+		const Timings & getTimings() const { return timings; }
+
+		// consistency checks at the end of every update, logged as errors.
+		// CHECK_COUNTS compares the per type counts against the store,
+		// CHECK_ALL also checks every handle, both are O(n)
+		enum CheckLevel
+		{
+			CHECK_NONE,
+			CHECK_COUNTS,
+			CHECK_ALL,
+		};
+		void setCheckLevel(CheckLevel checkLevel) { this->checkLevel = checkLevel; }
+		CheckLevel getCheckLevel() const { return checkLevel; }
+
+		// see ParticleStore::hash
+		uint64_t getStateHash() const { return particles.hash(); }
 
 		void addParticle(Particle::Type type, const glm::vec3& position, const glm::vec3& velocity);
 		void clearParticles();
@@ -82,50 +145,97 @@ namespace nm
 		void serialize(nlohmann::json & json);
 		void deserialize(const nlohmann::json & json);
 
-		gsl::span<nm::Particle> getParticles();
-		std::vector<Particle*> findNearestThan(const Particle & p, float distance) const;
-		std::vector<Particle*> findNearestThanByType(const Particle & p, float distance, std::initializer_list<Particle::Type> allowedTypes) const;
+		const ParticleStore & getParticles() const;
 
-		nm::Particle * getById(size_t id);
+		// see Octree::findNearestThan, every particle closer than distance
+		// to the one at index, whichever octants it's in
+		std::vector<ParticleStore::Handle> findNearestThan(unsigned index, float distance, size_t maxResults = std::numeric_limits<size_t>::max()) const;
+		std::vector<ParticleStore::Handle> findNearestThanByType(unsigned index, float distance, std::initializer_list<Particle::Type> allowedTypes,
+			size_t maxResults = std::numeric_limits<size_t>::max()) const;
+
+		// without allocating, at most results.size(), returns how many
+		size_t findNearestThan(unsigned index, float distance, Particle::TypeMask typeMask, gsl::span<ParticleStore::Handle> results) const;
+
+		const Octree<Particle> & getOctree() const { return octree; }
+
+		// the octree and the moments of the last update are from before the
+		// particles moved, this brings them up to date with the current state
+		void rebuildOctree();
+
+		// rebuilds the octree from the current state and compares its forces
+		// against the direct sum for numSamples particles
+		Octree<Particle>::ForceError computeForceError(size_t numSamples);
+
+		// index of the particle with that handle or ParticleStore::INVALID_INDEX
+		// if it's not alive anymore
+		unsigned getIndex(ParticleStore::Handle handle) const;
 
 		std::string getStatsStr() const{
 			std::stringstream sstr;
-			sstr << "Status system with " << totalNumParticles << " particles: " << endl
-				<< "  " << numParticles[nm::Particle::Type::ELECTRON] << " (" << ofToString(numParticles[nm::Particle::Type::ELECTRON] / (float)totalNumParticles, 2) << ") electrons" << endl
-				<< "  " << numParticles[nm::Particle::Type::POSITRON] << " (" << ofToString(numParticles[nm::Particle::Type::POSITRON] / (float)totalNumParticles, 2) << ") positrons" << endl
-				<< "  " << numParticles[nm::Particle::Type::UP_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::UP_QUARK] / (float)totalNumParticles, 2) << ") up quarks" << endl
-				<< "  " << numParticles[nm::Particle::Type::ANTI_UP_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::ANTI_UP_QUARK] / (float)totalNumParticles, 2) << ") anti up quarks" << endl
-				<< "  " << numParticles[nm::Particle::Type::DOWN_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::DOWN_QUARK] / (float)totalNumParticles, 2) << ") down quarks" << endl
-				<< "  " << numParticles[nm::Particle::Type::ANTI_DOWN_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::ANTI_DOWN_QUARK] / (float)totalNumParticles, 2) << ") anti down quarks" << endl
-				<< "  " << numParticles[nm::Particle::Type::PROTON] << " (" << ofToString(numParticles[nm::Particle::Type::PROTON] / (float)totalNumParticles, 2) << ") protons" << endl
-				<< "  " << numParticles[nm::Particle::Type::NEUTRON] << " (" << ofToString(numParticles[nm::Particle::Type::NEUTRON] / (float)totalNumParticles, 2) << ") neutrons" << endl
+			sstr << "Status system with " << particles.size() << " particles: " << endl
+				<< "  " << numParticles[nm::Particle::Type::ELECTRON] << " (" << ofToString(numParticles[nm::Particle::Type::ELECTRON] / (float)particles.size(), 2) << ") electrons" << endl
+				<< "  " << numParticles[nm::Particle::Type::POSITRON] << " (" << ofToString(numParticles[nm::Particle::Type::POSITRON] / (float)particles.size(), 2) << ") positrons" << endl
+				<< "  " << numParticles[nm::Particle::Type::UP_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::UP_QUARK] / (float)particles.size(), 2) << ") up quarks" << endl
+				<< "  " << numParticles[nm::Particle::Type::ANTI_UP_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::ANTI_UP_QUARK] / (float)particles.size(), 2) << ") anti up quarks" << endl
+				<< "  " << numParticles[nm::Particle::Type::DOWN_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::DOWN_QUARK] / (float)particles.size(), 2) << ") down quarks" << endl
+				<< "  " << numParticles[nm::Particle::Type::ANTI_DOWN_QUARK] << " (" << ofToString(numParticles[nm::Particle::Type::ANTI_DOWN_QUARK] / (float)particles.size(), 2) << ") anti down quarks" << endl
+				<< "  " << numParticles[nm::Particle::Type::PROTON] << " (" << ofToString(numParticles[nm::Particle::Type::PROTON] / (float)particles.size(), 2) << ") protons" << endl
+				<< "  " << numParticles[nm::Particle::Type::NEUTRON] << " (" << ofToString(numParticles[nm::Particle::Type::NEUTRON] / (float)particles.size(), 2) << ") neutrons" << endl
 				<< "  " << "anihilation threshold " << environment->getAnnihilationThresh() << endl
 				<< "  " << "fusion threshold " << environment->getFusionThresh() << endl;
 
 			return sstr.str();
 		}
 	private:
+		struct NewParticle
+		{
+			Particle::Type type;
+			glm::vec3 position;
+			glm::vec3 velocity;
+		};
+
+		void allocateGpuData(unsigned type, size_t numParticles);
+		void check() const;
+
 		ofEventListener pairProductionListener;
 
+		bool headless;
+		bool deterministic;
+		CheckLevel checkLevel;
+		uint64_t seed;
+		uint64_t frameNum;
+		Random pairProductionRandom;
+		Timings timings;
+
 		Environment::Ptr environment;
 		Octree<Particle> octree;
 
-		std::array<nm::Particle, MAX_PARTICLES> particles;
+		ParticleStore particles;
 		std::array<tbb::atomic<unsigned>, Particle::NUM_TYPES> numParticles;
-		tbb::atomic<unsigned> totalNumParticles;
 
-		std::array<unsigned, MAX_PARTICLES> deadParticles;
+		std::vector<unsigned> deadParticles;
 		tbb::atomic<unsigned> numDeadParticles;
 
+		// particles created while updating, added once the dead ones are removed
+		std::vector<NewParticle> newParticles;
+		tbb::atomic<unsigned> numNewParticles;
+
 		std::array<ofVboMesh, Particle::NUM_TYPES> meshes;
 		ofShader wallShader;
 
-		// position stuff
+		// position stuff, every type packs into its own range of positions,
+		// packed once the dead particles are removed and the new ones added
+		// so every particle has a position, the tbos grow as needed
 		std::array<ofBufferObject, Particle::NUM_TYPES> tbo;
-		std::array<std::array<ParticleGpuData, MAX_PARTICLES>, Particle::NUM_TYPES> positions;
+		std::array<size_t, Particle::NUM_TYPES> tboCapacity;
+		std::vector<ParticleGpuData> positions;
+		std::array<unsigned, Particle::NUM_TYPES> positionsOffset;
+		std::array<unsigned, Particle::NUM_TYPES> numPositions;
 		std::array<ofTexture, Particle::NUM_TYPES> positionsTex;
+		// per block and type, first position of the block's particles
+		std::vector<std::array<unsigned, Particle::NUM_TYPES>> packingOffsets;
 
-		std::array<glm::vec3, MAX_PARTICLES> newPhotons;
+		std::vector<glm::vec3> newPhotons;
 		tbb::atomic<unsigned> numNewPhotons;
 	};
 }
@@ -33,25 +33,67 @@
 
 namespace nm
 {
-	Photons::Photons() : 
-		currentPhotonIdx(0)
+	const float Photons::PAIR_PRODUCTION_AGE = 10;
+	const float Photons::BUCKET_DURATION = .25f;
+	const float Photons::RADIUS = 3;
+
+	Photons::Photons() :
+		headless(false),
+		firstBucket(0),
+		time(0)
 	{
 	}
 
-	void Photons::init(Environment::Ptr env)
+	void Photons::init(Environment::Ptr env, bool headless)
 	{
 		this->environment = env;
+		this->headless = headless;
+
+		// photon stuff, everything is allocated up front so emitting photons
+		// never allocates
+		photons.clear();
+		photons.reserve(MAX_PHOTONS);
+		photonSlots.clear();
+		photonSlots.reserve(MAX_PHOTONS);
+		instances.assign(MAX_PHOTONS, glm::vec4(std::numeric_limits<float>::max()));
+		slots.resize(MAX_PHOTONS);
+		freeSlots.resize(MAX_PHOTONS);
+		for(unsigned i = 0; i < MAX_PHOTONS; ++i){
+			freeSlots[i] = MAX_PHOTONS - 1 - i;
+		}
+
+		// a bucket for every emission time a photon can have before it's
+		// eligible, plus the one being filled and the one being promoted
+		buckets.resize(ceil(PAIR_PRODUCTION_AGE / BUCKET_DURATION) + 2);
+		for(auto & bucket: buckets){
+			bucket.clear();
+		}
+		eligible.clear();
+		eligible.reserve(MAX_PHOTONS);
+		time = 0;
+		firstBucket = 0;
+
+		// listen for photon events
+		eventListeners.clear();
+		eventListeners.push_back(environment->photonEvent.newListener([this](PhotonEventArgs& args){
+			for (unsigned i = 0; i < args.numPhotons; ++i){
+				add(args.photons[i]);
+			}
+		}));
+
+		if (headless) return;
 
-		// photon stuff
-		photons.resize(MAX_PHOTONS);
-		scaledPosns.resize(MAX_PHOTONS);
-		
 		photonPosnBuffer.allocate();
-		photonPosnBuffer.setData(scaledPosns, GL_DYNAMIC_DRAW);
-		photonPosnTexture.allocateAsBufferTexture(photonPosnBuffer, GL_RGB32F);
+		photonPosnBuffer.setData(instances, GL_DYNAMIC_DRAW);
+		photonPosnTexture.allocateAsBufferTexture(photonPosnBuffer, GL_RGBA32F);
+
+		sphere = ofSpherePrimitive(1.f, 12).getMesh();
+		sphere.setUsage(GL_STATIC_DRAW);
+		if (ofIsGLProgrammableRenderer()) shader.load("shaders/photon_sphere");
+		else ofLogError() << "Expected programmable renderer";
 
 		// particle stuff
-		unsigned w = MAX_PHOTONS;
+		unsigned w = MAX_TRAILS;
 		unsigned h = PARTICLES_PER_PHOTON;
 
 		trailParticles.init(w, h);
@@ -124,62 +166,121 @@ namespace nm
 //				tryPairProduction();
 //			}
 //		}));
+	}
 
-		// listen for photon events
-		eventListeners.push_back(environment->photonEvent.newListener([this](PhotonEventArgs& args){
-			for (unsigned i = 0; i < args.numPhotons; ++i){
-				currentPhotonIdx = (currentPhotonIdx + 1) % photons.size();
-				auto & photon = photons[currentPhotonIdx];
-				photon.pos = args.photons[i];
-				photon.age = 0;
-				photon.alive = true;
+	void Photons::add(const glm::vec3 & position)
+	{
+		if (photons.size() == MAX_PHOTONS)
+		{
+			// the pool is full, an old photon makes room, one that's eligible
+			// for pair production if there's any
+			unsigned slot = INVALID_SLOT;
+			if (!eligible.empty()) slot = eligible.back();
+			for (unsigned b = firstBucket; slot == INVALID_SLOT; ++b)
+			{
+				auto & bucket = getBucket(b);
+				if (!bucket.empty()) slot = bucket.back();
 			}
-		}));
+			remove(slots[slot].index);
+		}
+
+		unsigned slot = freeSlots.back();
+		freeSlots.pop_back();
+		unsigned bucket = time / BUCKET_DURATION;
+		auto & emitted = getBucket(bucket);
+		slots[slot] = {unsigned(photons.size()), bucket, unsigned(emitted.size())};
+		emitted.push_back(slot);
+
+		Photon photon;
+		photon.pos = position;
+		photon.alive = true;
+		photons.push_back(photon);
+		photonSlots.push_back(slot);
+	}
+
+	void Photons::remove(unsigned index)
+	{
+		unsigned slot = photonSlots[index];
+		auto & set = slots[slot].bucket == ELIGIBLE_BUCKET ? eligible : getBucket(slots[slot].bucket);
+		unsigned moved = set.back();
+		set[slots[slot].position] = moved;
+		slots[moved].position = slots[slot].position;
+		set.pop_back();
+		freeSlots.push_back(slot);
+
+		// the last photon takes its place
+		unsigned last = photons.size() - 1;
+		if (index != last)
+		{
+			photons[index] = photons[last];
+			photonSlots[index] = photonSlots[last];
+			slots[photonSlots[index]].index = index;
+		}
+		photons.pop_back();
+		photonSlots.pop_back();
+	}
+
+	std::vector<unsigned> & Photons::getBucket(unsigned bucket)
+	{
+		return buckets[bucket % buckets.size()];
+	}
+
+	void Photons::promoteBuckets()
+	{
+		// every photon of a bucket is older than PAIR_PRODUCTION_AGE once
+		// the end of the bucket is, only the buckets in the ring can have
+		// photons if a lot of time went by
+		double end = (time - PAIR_PRODUCTION_AGE) / BUCKET_DURATION - 1;
+		unsigned lastBucket = end > firstBucket ? unsigned(ceil(end)) : firstBucket;
+		unsigned b = std::max<unsigned>(firstBucket, std::max<unsigned>(lastBucket, buckets.size()) - buckets.size());
+		for (; b < lastBucket; ++b)
+		{
+			auto & bucket = getBucket(b);
+			for (auto slot : bucket)
+			{
+				slots[slot].bucket = ELIGIBLE_BUCKET;
+				slots[slot].position = eligible.size();
+				eligible.push_back(slot);
+			}
+			bucket.clear();
+		}
+		firstBucket = lastBucket;
 	}
 
 	void Photons::update(double dt)
 	{
 		dt *= environment->systemSpeed;
+		time += dt;
 		const glm::vec3 min = environment->getMin();
 		const glm::vec3 max = environment->getMax();
-		const float expansionScalar = environment->getExpansionScalar();
+		const float step = dt;
 
-		for (unsigned i = 0; i < photons.size(); ++i)
-		{
-			if (photons[i].alive)
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, photons.size(), BLOCK_SIZE),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
 			{
-				photons[i].pos += photons[i].vel * dt;
-				// check whether photon is out of bounds
+				auto pos = photons[i].pos + photons[i].vel * step;
+				// wrap photons out of bounds to the other side, selects
+				// rather than branches so the loop vectorizes
 				for (unsigned j = 0; j < 3; ++j)
 				{
-					if (photons[i].pos[j] > max[j]) photons[i].pos[j] = min[j];
-					if (photons[i].pos[j] < min[j]) photons[i].pos[j] = max[j];
+					pos[j] = pos[j] > max[j] ? min[j] : (pos[j] < min[j] ? max[j] : pos[j]);
 				}
-				scaledPosns[i] = expansionScalar * photons[i].pos;
-				photons[i].age += dt;
+				photons[i].pos = pos;
+				photons[i].age += step;
 			}
-			else scaledPosns[i] = std::numeric_limits<glm::vec3>::max();
-		}
-		photonPosnBuffer.updateData(0, sizeof(scaledPosns[0]) * scaledPosns.size(), &scaledPosns[0].x);
+		});
 		//trailParticles.update();
 
-		if (ofRandomuf() < environment->getPairProductionThresh())
+		promoteBuckets();
+		if (!eligible.empty() && ofRandomuf() < environment->getPairProductionThresh())
 		{
-			// find a particle
-			const unsigned numTries = 100;
-			for (unsigned i = 0; i < numTries; ++i)
-			{
-				unsigned randIdx = ofRandom(photons.size() - 1);
-				if (photons[randIdx].alive && photons[randIdx].age > 10)
-				{
-					PairProductionEventArgs args;
-					args.position = photons[randIdx].pos;
-					args.velocity = photons[randIdx].vel;
-					ofNotifyEvent(environment->pairProductionEvent, args, this);
-					photons[randIdx].alive = false;
-					break;
-				}
-			}
+			unsigned slot = eligible[std::min<size_t>(ofRandom(eligible.size()), eligible.size() - 1)];
+			PairProductionEventArgs args;
+			args.position = photons[slots[slot].index].pos;
+			args.velocity = photons[slots[slot].index].vel;
+			ofNotifyEvent(environment->pairProductionEvent, args, this);
+			remove(slots[slot].index);
 		}
 	}
 
@@ -213,15 +314,32 @@ namespace nm
 //		return false;
 //	}
 
+	void Photons::pack()
+	{
+		const float expansionScalar = environment->getExpansionScalar();
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, photons.size(), BLOCK_SIZE),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				instances[i] = glm::vec4(expansionScalar * photons[i].pos, RADIUS);
+			}
+		});
+	}
+
 	void Photons::draw()
 	{
-		ofEnablePointSprites();
+		// photons emitted since the update are drawn too
+		pack();
+		if (headless || photons.empty()) return;
 
-		for(auto & p: scaledPosns){
-			ofDrawSphere(p, 3);
-		}
+		// only the live prefix
+		photonPosnBuffer.updateData(0, sizeof(instances[0]) * photons.size(), instances.data());
+
+		shader.begin();
+		shader.setUniformTexture("uPhotonsTex", photonPosnTexture, 0);
+		sphere.drawInstanced(OF_MESH_FILL, photons.size());
+		shader.end();
 
-		ofDisablePointSprites();
 		ofDisableBlendMode();
 	}
 }
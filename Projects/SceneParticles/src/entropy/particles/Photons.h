@@ -34,6 +34,7 @@
 #include "ofMain.h"
 #include "ofxGpuParticles.h"
 #include "Environment.h"
+#include "tbb/tbb.h"
 
 namespace nm
 {
@@ -42,14 +43,32 @@ namespace nm
 		glm::vec3 pos;
 		glm::vec3 vel = glm::sphericalRand(300.f);
 		float age = 0;
+		// every photon in the pool is alive, kept for the code that copies
+		// photons out of it
 		bool alive = false;
 	};
 
+	// Photons live densely packed at the front of the pool in no particular
+	// order, a photon that's gone is replaced by the last one. Every photon
+	// also has a slot that doesn't change while it's alive, taken from a free
+	// list, that's what the pair production candidates are kept by.
+	//
+	// Photons all age at the same rate so they're bucketed by the time they
+	// were emitted, once the youngest photon of a bucket is older than
+	// PAIR_PRODUCTION_AGE the whole bucket moves to the eligible set and
+	// picking a candidate is a single random draw.
 	class Photons
 	{
 	public:
-		static const unsigned MAX_PHOTONS = 500;
+		static const unsigned MAX_PHOTONS = 50000;
+		// trails follow the first MAX_TRAILS photons of the pool
+		static const unsigned MAX_TRAILS = 500;
 		static const unsigned PARTICLES_PER_PHOTON = 200;
+		// photons per block of the parallel loops
+		static const unsigned BLOCK_SIZE = 4096;
+		static const float RADIUS;
+		static const float PAIR_PRODUCTION_AGE;
+		static const float BUCKET_DURATION;
 		static ofParameter<float> & LIVE(){
 			static ofParameter<float> live{"photons life", 1, 0, 10};
 			return live;
@@ -57,27 +76,73 @@ namespace nm
 
 		Photons();
 
+		// only the live photons
 		vector<Photon>& getPosnsRef() { return photons; }
+		size_t size() const { return photons.size(); }
+		size_t getNumEligible() const { return eligible.size(); }
 
-		void init(Environment::Ptr environment);
+		// a headless pool doesn't load anything or upload anything, the
+		// instances are still packed so it can be benchmarked without a GL
+		// context
+		void init(Environment::Ptr environment, bool headless = false);
 		void update(double dt);
+
+		// packs the scaled position and radius of every live photon into
+		// one instance stream, draw() does it before drawing
+		void pack();
+		const std::vector<glm::vec4> & getInstances() const { return instances; }
+
+		// uploads the instances and draws every photon as an instance of
+		// the same sphere in a single call
 		void draw();
 
 		bool tryPairProduction();
 
 	private:
+		static const unsigned INVALID_SLOT = std::numeric_limits<unsigned>::max();
+		static const unsigned ELIGIBLE_BUCKET = std::numeric_limits<unsigned>::max();
+
+		struct Slot{
+			unsigned index;
+			// emission bucket or ELIGIBLE_BUCKET
+			unsigned bucket;
+			// position in the bucket or in the eligible set
+			unsigned position;
+		};
+
+		void add(const glm::vec3 & position);
+		void remove(unsigned index);
+		void promoteBuckets();
+		std::vector<unsigned> & getBucket(unsigned bucket);
+
 		std::vector<ofEventListener> eventListeners;
 
 		Environment::Ptr environment;
+		bool headless;
 
 		ofxGpuParticles trailParticles;
 		ofImage particleImage;
 
 		vector<Photon> photons;
-		vector<glm::vec3> scaledPosns;
+		// only the first photons.size() are packed
+		vector<glm::vec4> instances;
+
+		// slot of each photon and the other way around
+		std::vector<unsigned> photonSlots;
+		std::vector<Slot> slots;
+		std::vector<unsigned> freeSlots;
+
+		// ring of the buckets of photons not old enough for pair production
+		// yet, from firstBucket to the one photons are emitted into now
+		std::vector<std::vector<unsigned>> buckets;
+		unsigned firstBucket;
+		std::vector<unsigned> eligible;
+		double time;
 
+		// the instances, read by the trails too
 		ofBufferObject photonPosnBuffer;
 		ofTexture photonPosnTexture;
-		unsigned currentPhotonIdx;
+		ofVboMesh sphere;
+		ofShader shader;
     };
 }
@@ -0,0 +1,87 @@
+/*
+ *  Random.h
+ *
+ *  Copyright (c) 2016, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved. 
+ *  
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met: 
+ *  
+ *  * Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer. 
+ *  * Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution. 
+ *  * Neither the name of Neil Mendoza nor the names of its contributors may be used 
+ *    to endorse or promote products derived from this software without 
+ *    specific prior written permission. 
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ *  POSSIBILITY OF SUCH DAMAGE. 
+ *
+ */
+#pragma once
+
+#include "ofMain.h"
+
+namespace nm
+{
+	/* Counter based random numbers, every value is a hash of the seed, the
+	 * stream and how many values were drawn from the stream before. Streams
+	 * don't share any state so a particle can draw from its own stream
+	 * (keyed by frame and handle) inside a parallel loop and get the same
+	 * numbers no matter which thread updates it or in what order. */
+	class Random
+	{
+	public:
+		Random(uint64_t seed = 0, uint64_t stream = 0) :
+			key(mix(seed ^ mix(stream + GOLDEN_GAMMA))),
+			counter(0)
+		{
+		}
+
+		// splitmix64 finalizer
+		static inline uint64_t mix(uint64_t x){
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+			return x ^ (x >> 31);
+		}
+
+		inline uint64_t next(){
+			return mix(key + ++counter * GOLDEN_GAMMA);
+		}
+
+		// [0, 1)
+		inline float uniform(){
+			return (next() >> 40) * (1.f / 16777216.f);
+		}
+
+		// [0, n)
+		inline unsigned uniform(unsigned n){
+			return unsigned(((next() >> 32) * n) >> 32);
+		}
+
+		// uniformly distributed on the sphere, same as glm::sphericalRand
+		inline glm::vec3 sphere(float radius){
+			float z = 2.f * uniform() - 1.f;
+			float phi = glm::two_pi<float>() * uniform();
+			float r = sqrt(std::max(0.f, 1.f - z * z));
+			return radius * glm::vec3(r * cos(phi), r * sin(phi), z);
+		}
+
+	private:
+		static const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ull;
+
+		uint64_t key;
+		uint64_t counter;
+	};
+}
@@ -0,0 +1,198 @@
+#include "TextMeshCache.h"
+
+namespace nm
+{
+	//--------------------------------------------------------------
+	TextMeshCache::TextMeshCache(){
+
+	}
+
+	//--------------------------------------------------------------
+	TextMeshCache::~TextMeshCache(){
+		close();
+	}
+
+	//--------------------------------------------------------------
+	void TextMeshCache::setup(){
+		setup(Settings());
+	}
+
+	//--------------------------------------------------------------
+	void TextMeshCache::setup(const Settings & settings){
+		close();
+		this->settings = settings;
+		running = true;
+		thread = std::thread(&TextMeshCache::threadedFunction, this);
+	}
+
+	//--------------------------------------------------------------
+	void TextMeshCache::close(){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			running = false;
+			queue.clear();
+		}
+		workAvailable.notify_all();
+		idle.notify_all();
+		if(thread.joinable()){
+			thread.join();
+		}
+
+		// labels still held stay valid, they just aren't cached anymore
+		std::unique_lock<std::mutex> lock(mutex);
+		cache.clear();
+		cacheBytes = 0;
+	}
+
+	//--------------------------------------------------------------
+	TextMeshCache::LabelPtr TextMeshCache::acquire(const std::string & text, const std::string & fontName, const ofTrueTypeFont & font){
+		std::unique_lock<std::mutex> lock(mutex);
+		Key key{text, fontName, font.getSize()};
+		auto it = cache.find(key);
+		if(it != cache.end()){
+			stats.hits += 1;
+			it->second->lastUse = ++useCounter;
+			return it->second;
+		}
+
+		stats.misses += 1;
+		auto label = std::make_shared<Label>();
+		label->lastUse = ++useCounter;
+		if(running){
+			cache[key] = label;
+			queue.push_back(Job{key, &font, label});
+			workAvailable.notify_one();
+		}else{
+			ofLogError("TextMeshCache") << "Acquiring \"" << text << "\" before setup, it will never be built";
+		}
+		return label;
+	}
+
+	//--------------------------------------------------------------
+	std::vector<TextMeshCache::LabelPtr> TextMeshCache::prewarm(const std::vector<std::string> & texts, const std::string & fontName, const std::vector<ofTrueTypeFont> & fonts){
+		std::vector<LabelPtr> labels;
+		labels.reserve(texts.size() * fonts.size());
+		for(auto & font: fonts){
+			for(auto & text: texts){
+				labels.push_back(acquire(text, fontName, font));
+			}
+		}
+		return labels;
+	}
+
+	//--------------------------------------------------------------
+	void TextMeshCache::waitUntilIdle(){
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [&]{
+			return !running || (queue.empty() && !building);
+		});
+	}
+
+	//--------------------------------------------------------------
+	void TextMeshCache::evict(){
+		// only labels nobody holds anymore, the cache's own reference is
+		// the only one left
+		while(cacheBytes > settings.byteBudget){
+			auto lru = cache.end();
+			for(auto it = cache.begin(); it != cache.end(); ++it){
+				auto evictable = it->second->ready && it->second.use_count() == 1;
+				if(evictable && (lru == cache.end() || it->second->lastUse < lru->second->lastUse)){
+					lru = it;
+				}
+			}
+			if(lru == cache.end()){
+				break;
+			}
+			cacheBytes -= lru->second->bytes;
+			cache.erase(lru);
+			stats.evictions += 1;
+		}
+	}
+
+	//--------------------------------------------------------------
+	void TextMeshCache::threadedFunction(){
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true){
+			workAvailable.wait(lock, [&]{
+				return !running || !queue.empty();
+			});
+			if(!running){
+				break;
+			}
+
+			auto job = queue.front();
+			queue.pop_front();
+
+			// nobody wants it anymore, the cache and the job are the only
+			// references left
+			if(job.label.use_count() == 2){
+				cache.erase(job.key);
+				if(queue.empty()){
+					idle.notify_all();
+				}
+				continue;
+			}
+
+			building = true;
+			lock.unlock();
+			auto then = ofGetElapsedTimeMicros();
+			job.label->mesh = job.font->getStringMesh(job.key.text, 0, 0);
+			auto micros = ofGetElapsedTimeMicros() - then;
+			lock.lock();
+
+			job.label->bytes = getBytes(job.label->mesh);
+			job.label->ready = true;
+			cacheBytes += job.label->bytes;
+			stats.meshesBuilt += 1;
+			stats.bytesBuilt += job.label->bytes;
+			stats.buildMicros += micros;
+			evict();
+			building = false;
+			if(queue.empty()){
+				idle.notify_all();
+			}
+		}
+	}
+
+	//--------------------------------------------------------------
+	size_t TextMeshCache::getBytes(const ofMesh & mesh){
+		return mesh.getNumVertices() * sizeof(ofDefaultVertexType) +
+			   mesh.getNumTexCoords() * sizeof(ofDefaultTexCoordType) +
+			   mesh.getNumColors() * sizeof(ofDefaultColorType) +
+			   mesh.getNumNormals() * sizeof(ofDefaultNormalType) +
+			   mesh.getNumIndices() * sizeof(ofIndexType) +
+			   sizeof(Label);
+	}
+
+	//--------------------------------------------------------------
+	size_t TextMeshCache::getCacheBytes() const{
+		std::unique_lock<std::mutex> lock(mutex);
+		return cacheBytes;
+	}
+
+	//--------------------------------------------------------------
+	size_t TextMeshCache::getCacheSize() const{
+		std::unique_lock<std::mutex> lock(mutex);
+		return std::count_if(cache.begin(), cache.end(), [](const std::pair<const Key, std::shared_ptr<Label>> & entry){
+			return entry.second->isReady();
+		});
+	}
+
+	//--------------------------------------------------------------
+	size_t TextMeshCache::getNumPending() const{
+		std::unique_lock<std::mutex> lock(mutex);
+		return queue.size() + (building ? 1 : 0);
+	}
+
+	//--------------------------------------------------------------
+	TextMeshCache::Stats TextMeshCache::getStats() const{
+		std::unique_lock<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	//--------------------------------------------------------------
+	void TextMeshCache::resetStats(){
+		std::unique_lock<std::mutex> lock(mutex);
+		stats = Stats();
+	}
+}
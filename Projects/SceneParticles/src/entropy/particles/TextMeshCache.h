@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ofMain.h"
+#include <condition_variable>
+
+namespace nm
+{
+	// Text meshes keyed by string, font and size, tessellated on a worker
+	// thread so building a label is never on the frame's critical path.
+	//
+	// acquire() returns a reference counted label straight away, it's
+	// drawable once the worker has built its mesh, until then the label
+	// is just skipped. Labels nobody holds anymore stay in the cache in
+	// LRU order until the cache goes over its byte budget, so a label that
+	// comes back with the next burst of particles is usually still there.
+	//
+	// The cache doesn't own the fonts, they have to outlive it. There's a
+	// single worker because ofTrueTypeFont builds its string meshes into a
+	// member, the fonts' string meshes shouldn't be built anywhere else
+	// while the cache is running.
+	class TextMeshCache
+	{
+	public:
+		class Label
+		{
+		public:
+			bool isReady() const { return ready; }
+			const ofMesh & getMesh() const { return mesh; }
+			size_t getBytes() const { return bytes; }
+
+		private:
+			friend class TextMeshCache;
+			ofMesh mesh;
+			std::atomic<bool> ready{false};
+			size_t bytes = 0;
+			uint64_t lastUse = 0;
+		};
+		typedef std::shared_ptr<const Label> LabelPtr;
+
+		struct Settings{
+			size_t byteBudget = size_t(16) * 1024 * 1024;
+		};
+
+		struct Stats{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t evictions = 0;
+			uint64_t meshesBuilt = 0;
+			uint64_t bytesBuilt = 0;
+			uint64_t buildMicros = 0;
+		};
+
+		TextMeshCache();
+		~TextMeshCache();
+
+		void setup();
+		void setup(const Settings & settings);
+		void close();
+
+		// Returns the label for text in that font, queuing its tessellation
+		// if it's not in the cache. Never waits for the worker.
+		LabelPtr acquire(const std::string & text, const std::string & fontName, const ofTrueTypeFont & font);
+
+		// Acquires every text in every font, for the labels known at setup.
+		std::vector<LabelPtr> prewarm(const std::vector<std::string> & texts, const std::string & fontName, const std::vector<ofTrueTypeFont> & fonts);
+
+		// Blocks until everything queued so far is built.
+		void waitUntilIdle();
+
+		size_t getCacheBytes() const;
+		size_t getCacheSize() const;
+		size_t getNumPending() const;
+		Stats getStats() const;
+		void resetStats();
+
+	private:
+		struct Key{
+			std::string text;
+			std::string fontName;
+			int size;
+
+			bool operator<(const Key & other) const{
+				return std::tie(size, fontName, text) < std::tie(other.size, other.fontName, other.text);
+			}
+		};
+
+		struct Job{
+			Key key;
+			const ofTrueTypeFont * font;
+			std::shared_ptr<Label> label;
+		};
+
+		void evict();
+		void threadedFunction();
+		static size_t getBytes(const ofMesh & mesh);
+
+		Settings settings;
+		std::map<Key, std::shared_ptr<Label>> cache;
+		std::deque<Job> queue;
+		std::thread thread;
+		mutable std::mutex mutex;
+		std::condition_variable workAvailable;
+		std::condition_variable idle;
+		size_t cacheBytes = 0;
+		uint64_t useCounter = 0;
+		bool building = false;
+		bool running = false;
+		Stats stats;
+	};
+}
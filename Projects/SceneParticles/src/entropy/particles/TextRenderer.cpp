@@ -1,7 +1,14 @@
 #include "TextRenderer.h"
 
 namespace{
+	const std::string fontName = "fonts/kontrapunkt-bob.light.ttf";
 
+	// labels whose mesh isn't built yet are skipped instead of waiting
+	void drawLabel(const nm::TextMeshCache::LabelPtr & label){
+		if(label && label->isReady()){
+			label->getMesh().draw();
+		}
+	}
 }
 
 void TextRenderer::setup(float worldSize, int width, int height, Screen screen){
@@ -11,7 +18,7 @@ void TextRenderer::setup(float worldSize, int width, int height, Screen screen){
 	this->screen = screen;
 
 
-	ofTtfSettings fontSettings("fonts/kontrapunkt-bob.light.ttf", 20);
+	ofTtfSettings fontSettings(fontName, 20);
 	fontSettings.dpi = 72;
 	fontSettings.antialiased = true;
 	fonts.emplace_back();
@@ -128,27 +135,38 @@ void TextRenderer::setup(float worldSize, int width, int height, Screen screen){
 	shaderSettings.intDefines["HAS_TEXTURE"] = 0;
 	billboardShaderPath.setup(shaderSettings);
 
+	// every label a particle can get, tessellated by the cache's worker
+	// while the paths below tessellate here, setup waits for them at the
+	// end so the first frames draw every label. The map keys are what
+	// draw looks them up by
+	std::vector<std::pair<std::string, std::string>> labels{
+		{"e", "e"},
+		{"p", "p"},
+		{"q", "q"},
+		{"a", "a"},
+		{"n", "n"},
+		{"uq", "uq"},
+		{"dq", "dq"},
+		{"electron", "electron"},
+		{"positron", "positron"},
+		{"quark", "quark"},
+		{"anti", "anti"},
+		{"up quark", "up\nquark"},
+		{"down quark", "down\nquark"},
+		{"neutron", "neutron"},
+		{"proton", "proton"},
+	};
+	std::vector<std::string> texts;
+	for(auto & label: labels){
+		texts.push_back(label.second);
+	}
+	textMeshCache.setup();
+	auto prewarmed = textMeshCache.prewarm(texts, fontName, fonts);
 	particleTexts.resize(fonts.size());
 	for(size_t i = 0; i < fonts.size(); i++){
-		particleTexts[i]["e"] = fonts[i].getStringMesh("e", 0, 0);
-		particleTexts[i]["p"] = fonts[i].getStringMesh("p", 0, 0);
-		particleTexts[i]["q"] = fonts[i].getStringMesh("q", 0, 0);
-		particleTexts[i]["a"] = fonts[i].getStringMesh("a", 0, 0);
-		particleTexts[i]["n"] = fonts[i].getStringMesh("n", 0, 0);
-		particleTexts[i]["uq"] = fonts[i].getStringMesh("uq", 0, 0);
-		particleTexts[i]["dq"] = fonts[i].getStringMesh("dq", 0, 0);
-
-
-		particleTexts[i]["electron"] = fonts[i].getStringMesh("electron", 0, 0);
-		particleTexts[i]["positron"] = fonts[i].getStringMesh("positron", 0, 0);
-
-		particleTexts[i]["quark"] = fonts[i].getStringMesh("quark", 0, 0);
-		particleTexts[i]["anti"] = fonts[i].getStringMesh("anti", 0, 0);
-		particleTexts[i]["up quark"] = fonts[i].getStringMesh("up\nquark", 0, 0);
-		particleTexts[i]["down quark"] = fonts[i].getStringMesh("down\nquark", 0, 0);
-
-		particleTexts[i]["neutron"] = fonts[i].getStringMesh("neutron", 0, 0);
-		particleTexts[i]["proton"] = fonts[i].getStringMesh("proton", 0, 0);
+		for(size_t j = 0; j < labels.size(); j++){
+			particleTexts[i][labels[j].first] = prewarmed[i * labels.size() + j];
+		}
 	}
 
 	particlePaths.resize(fonts.size());
@@ -163,7 +181,12 @@ void TextRenderer::setup(float worldSize, int width, int height, Screen screen){
 		matter.setFilled(true);
 		matter.circle(0,0,fonts[i].getStringBoundingBox("x",0,0).height);
 		particlePaths[i]["q"] = matter;
+
+		// paths tessellate on their first draw otherwise
+		particlePaths[i]["a"].getTessellation();
+		particlePaths[i]["q"].getTessellation();
 	}
+	textMeshCache.waitUntilIdle();
 
 	if(screen == FrontScreen){
 		fboLines.allocate(width/3, height/3, GL_RGBA, 16);
@@ -193,6 +216,7 @@ void TextRenderer::renderLines(nm::ParticleSystem & particles,
 
 	auto maxScreenDistance = (maxDistance * worldSize) * (maxDistance * worldSize);
 	auto scale = environment.getExpansionScalar();
+	const auto & store = particles.getParticles();
 	renderer.drawWithDOF(cam, [&](float accumValue, glm::mat4 projection, glm::mat4 modelview){
 		if(screen == FrontScreen){
 			fboLines.begin();
@@ -209,37 +233,39 @@ void TextRenderer::renderLines(nm::ParticleSystem & particles,
 				line.setMode(OF_PRIMITIVE_LINES);
 				line.getVertices().resize(2);
 				line.getColors().resize(2);
-				for(auto & p1: particles.getParticles()){
-					//if(!p1.alive) continue;
-					auto distance = glm::distance2(cam.getPosition(), p1.pos * scale);
+				for(size_t p1 = 0; p1 < store.size(); ++p1){
+					//if(!store.alive[p1]) continue;
+					auto distance = glm::distance2(cam.getPosition(), store.pos[p1] * scale);
 					auto pct = 1-ofClamp(distance / maxScreenDistance, 0, 1);
-					for(auto * p2: p1.potentialInteractionPartners){
-						if(p1.id < p2->id && ((p1.isAntiMatterQuark() && p2->isMatterQuark()) || (p1.isMatterQuark() && p2->isAntiMatterQuark()))){
-							auto pDistance = glm::distance2(p1.pos * scale, p2->pos * scale);
-							auto pDistance1 = glm::distance(p1.pos * scale, p2->pos * scale);
+					for(auto handle: store.getPartners(p1)){
+						auto p2 = store.getIndex(handle);
+						if(p2 == nm::ParticleStore::INVALID_INDEX) continue;
+						if(store.getHandle(p1) < store.getHandle(p2) && ((store.isAntiMatterQuark(p1) && store.isMatterQuark(p2)) || (store.isMatterQuark(p1) && store.isAntiMatterQuark(p2)))){
+							auto pDistance = glm::distance2(store.pos[p1] * scale, store.pos[p2] * scale);
+							auto pDistance1 = glm::distance(store.pos[p1] * scale, store.pos[p2] * scale);
 							auto ppct = (1-ofClamp(pDistance / maxPDistance, 0, 1)) * ambient;
 							auto light = std::accumulate(photons.begin(), std::min(photons.begin() + 16, photons.end()), 0.f, [&](float acc, nm::Photon & ph){
 								if(ph.alive){
-									auto strength = lightStrenght / glm::distance2(p1.pos * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
+									auto strength = lightStrenght / glm::distance2(store.pos[p1] * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
 									return acc + strength;
 								}else{
 									return acc;
 								}
 							});
 							ppct += light;
-							auto distancep2 = glm::distance2(cam.getPosition(), p2->pos * scale);
+							auto distancep2 = glm::distance2(cam.getPosition(), store.pos[p2] * scale);
 							auto pct2 = (1-ofClamp(distancep2 / maxScreenDistance, 0, 1)) * ambient + light;
-							line.getVertices()[0] = p1.pos;
-							/*if(lookAt.first && lookAt.second && ((p1.id == lookAt.first->id && p2->id == lookAt.second->id) || (p1.id == lookAt.second->id && p2->id == lookAt.first->id))){
+							line.getVertices()[0] = store.pos[p1];
+							/*if(lookAt.first && lookAt.second && ((store.getHandle(p1) == lookAt.first->id && store.getHandle(p2) == lookAt.second->id) || (store.getHandle(p1) == lookAt.second->id && store.getHandle(p2) == lookAt.first->id))){
 								line.getColors()[0] = ofFloatColor(0, pct*ppct, 0, accumValue);
 								line.getColors()[1] = ofFloatColor(0, pct2*ppct, 0, accumValue);
-								line.getVertices()[1] = p2->pos;
+								line.getVertices()[1] = store.pos[p2];
 								line.draw();
 							}else */if(pDistance1 < nm::Octree<nm::Particle>::INTERACTION_DISTANCE()){
-								auto aniPct = p1.anihilationRatio/environment.getAnnihilationThresh();
+								auto aniPct = store.anihilationRatio[p1]/environment.getAnnihilationThresh();
 								line.getColors()[0] = ofFloatColor(pct*ppct*aniPct, 0, 0, accumValue);
 								line.getColors()[1] = ofFloatColor(pct2*ppct*aniPct, 0, 0, accumValue);
-								line.getVertices()[1] = glm::lerp(p1.pos, p2->pos, aniPct);
+								line.getVertices()[1] = glm::lerp(store.pos[p1], store.pos[p2], aniPct);
 
 //								auto white0 = ofFloatColor(pct*ppct*aniPct, 0, 0, accumValue);
 //								auto red0 = ofFloatColor(pct*ppct*aniPct, 0, 0, accumValue);
@@ -249,10 +275,10 @@ void TextRenderer::renderLines(nm::ParticleSystem & particles,
 //								auto red1 = ofFloatColor(pct2*ppct*aniPct, 0, 0, accumValue);
 
 //								line.getColors()[1] = white1.lerp(red1, aniPct);
-								line.getVertices()[1] = p2->pos;
+								line.getVertices()[1] = store.pos[p2];
 								line.draw();
 							}else{
-								line.getVertices()[1] = p2->pos;
+								line.getVertices()[1] = store.pos[p2];
 								line.getColors()[0] = ofFloatColor(pct*ppct, accumValue);
 								line.getColors()[1] = ofFloatColor(pct2*ppct, accumValue);
 								line.draw();
@@ -268,12 +294,12 @@ void TextRenderer::renderLines(nm::ParticleSystem & particles,
 				line.setMode(OF_PRIMITIVE_LINES);
 				line.getVertices().resize(6);
 				line.getColors().resize(6);//.assign(6, ofFloatColor(1));
-				for(auto & p1: particles.getParticles()){
-					auto distancep1 = glm::distance2(cam.getPosition(), p1.pos * scale);
-					auto * p2 = p1.fusionPartners.first;
-					auto * p3 = p1.fusionPartners.second;
-					if(p2 && p3){
-						auto midPoint = (p1.pos + p2->pos + p3->pos) / 3.;
+				for(size_t p1 = 0; p1 < store.size(); ++p1){
+					auto distancep1 = glm::distance2(cam.getPosition(), store.pos[p1] * scale);
+					auto p2 = store.getIndex(store.fusionPartners[p1].first);
+					auto p3 = store.getIndex(store.fusionPartners[p1].second);
+					if(p2 != nm::ParticleStore::INVALID_INDEX && p3 != nm::ParticleStore::INVALID_INDEX){
+						auto midPoint = (store.pos[p1] + store.pos[p2] + store.pos[p3]) / 3.;
 						float ppct = ambient;
 						auto light = std::accumulate(photons.begin(), std::min(photons.begin() + 16, photons.end()), 0.f, [&](float acc, nm::Photon & ph){
 							if(ph.alive){
@@ -284,20 +310,20 @@ void TextRenderer::renderLines(nm::ParticleSystem & particles,
 							}
 						});
 						ppct += light;
-						auto distancep2 = glm::distance2(cam.getPosition(), p2->pos * scale);
-						auto distancep3 = glm::distance2(cam.getPosition(), p3->pos * scale);
+						auto distancep2 = glm::distance2(cam.getPosition(), store.pos[p2] * scale);
+						auto distancep3 = glm::distance2(cam.getPosition(), store.pos[p3] * scale);
 						auto pct1 = (1-ofClamp(distancep1 / maxScreenDistance, 0, 1)) * ambient + light;
 						auto pct2 = (1-ofClamp(distancep2 / maxScreenDistance, 0, 1)) * ambient + light;
 						auto pct3 = (1-ofClamp(distancep3 / maxScreenDistance, 0, 1)) * ambient + light;
-						line.getVertices()[0] = p1.pos;
+						line.getVertices()[0] = store.pos[p1];
 						line.getVertices()[1] = midPoint;
-						/*if(lookAt.first && lookAt.second && ((p1.id == lookAt.first->id && p2->id == lookAt.second->id) || (p1.id == lookAt.second->id && p2->id == lookAt.first->id))){
+						/*if(lookAt.first && lookAt.second && ((store.getHandle(p1) == lookAt.first->id && store.getHandle(p2) == lookAt.second->id) || (store.getHandle(p1) == lookAt.second->id && store.getHandle(p2) == lookAt.first->id))){
 							line.getColors()[0] = ofFloatColor(0, pct*ppct, 0, accumValue);
 							line.getColors()[1] = ofFloatColor(0, pct2*ppct, 0, accumValue);
-							line.getVertices()[1] = p2->pos;
+							line.getVertices()[1] = store.pos[p2];
 							line.draw();
 						}else if(pDistance1 < nm::Octree<nm::Particle>::INTERACTION_DISTANCE()){*/
-							auto fusPct = p1.fusionRatio/environment.getFusionThresh();
+							auto fusPct = store.fusionRatio[p1]/environment.getFusionThresh();
 							line.getColors()[0] = ofFloatColor(pct1*ppct, 0)
 													.lerp(ofFloatColor(pct1*ppct, accumValue), fusPct);
 							line.getColors()[1] = ofFloatColor(pct1*ppct, 0)
@@ -310,13 +336,13 @@ void TextRenderer::renderLines(nm::ParticleSystem & particles,
 													.lerp(ofFloatColor(pct3*ppct, accumValue), fusPct);
 							line.getColors()[5] = ofFloatColor(pct3*ppct, 0)
 													.lerp(ofFloatColor(pct3*ppct, accumValue), fusPct);
-							line.getVertices()[2] = p2->pos;
+							line.getVertices()[2] = store.pos[p2];
 							line.getVertices()[3] = midPoint;
-							line.getVertices()[4] = p3->pos;
+							line.getVertices()[4] = store.pos[p3];
 							line.getVertices()[5] = midPoint;
 							line.draw();
 //						}else{
-//							line.getVertices()[1] = p2->pos;
+//							line.getVertices()[1] = store.pos[p2];
 //							line.getColors()[0] = ofFloatColor(pct*ppct, accumValue);
 //							line.getColors()[1] = ofFloatColor(pct2*ppct, accumValue);
 //							line.draw();
@@ -341,11 +367,12 @@ void TextRenderer::renderLines(nm::ParticleSystem & particles,
 void TextRenderer::draw(nm::ParticleSystem & particles,
 						std::vector<nm::Photon> & photons,
 						nm::Environment & environment,
-						std::pair<nm::Particle*, nm::Particle*> lookAt,
+						std::pair<nm::ParticleStore::Handle, nm::ParticleStore::Handle> lookAt,
 						entropy::render::WireframeFillRenderer & renderer,
 						ofCamera & cam){
 	auto maxScreenDistance = (maxDistance * worldSize) * (maxDistance * worldSize);
 	auto scale = environment.getExpansionScalar();
+	const auto & store = particles.getParticles();
 
 //	glEnable(GL_BLEND);
 //	glBlendFunc(GL_ONE, GL_ONE);
@@ -362,30 +389,32 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 		billboardShaderText.setUniformMatrix4f("projectionMatrix", projection);
 		billboardShaderText.setUniformMatrix4f("modelViewMatrix", modelview);
 		billboardShaderText.setUniformMatrix4f("modelViewProjectionMatrix", projection * modelview);
-		for(auto & p1: particles.getParticles()){
-			if(!p1.alive) continue;
-			auto distance = glm::distance2(cam.getPosition(), p1.pos * scale);
+		for(size_t p1 = 0; p1 < store.size(); ++p1){
+			if(!store.alive[p1]) continue;
+			auto distance = glm::distance2(cam.getPosition(), store.pos[p1] * scale);
 			auto pctDistance = ofClamp(distance / maxScreenDistance, 0, 1);
-			for(auto * p2: p1.potentialInteractionPartners){
-				if(!p2->alive) continue;
-				//if((p2->getAnnihilationFlag() ^ p1.getAnnihilationFlag()) == 0xFF){
+			for(auto handle: store.getPartners(p1)){
+				auto p2 = store.getIndex(handle);
+				if(p2 == nm::ParticleStore::INVALID_INDEX) continue;
+				if(!store.alive[p2]) continue;
+				//if((store.getAnnihilationFlag(p2) ^ store.getAnnihilationFlag(p1)) == 0xFF){
 
 				switch(environment.state.get()){
 					case nm::Environment::BARYOGENESIS:
-//						if((p1.isAntiMatterQuark() && p2->isMatterQuark()) || (p1.isMatterQuark() && p2->isAntiMatterQuark())){
+//						if((store.isAntiMatterQuark(p1) && store.isMatterQuark(p2)) || (store.isMatterQuark(p1) && store.isAntiMatterQuark(p2))){
 //							auto pctColor = (1-pctDistance) * ambient;
 //							auto light = std::accumulate(photons.begin(), std::min(photons.begin() + 16, photons.end()), 0.f, [&](float acc, nm::Photon & ph){
 //								if(ph.alive){
-//									auto strength = lightStrenght / glm::distance2(p1.pos * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
+//									auto strength = lightStrenght / glm::distance2(store.pos[p1] * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
 //									return acc + strength;
 //								}else{
 //									return acc;
 //								}
 //							});
 //							pctColor += light;
-//							auto midPoint = (p1.pos + p2->pos) / 2.;
-//							auto pDistance = glm::distance2(p1.pos * scale, p2->pos * scale);
-//							auto pDistance1 = glm::distance(p1.pos * scale, p2->pos * scale);
+//							auto midPoint = (store.pos[p1] + store.pos[p2]) / 2.;
+//							auto pDistance = glm::distance2(store.pos[p1] * scale, store.pos[p2] * scale);
+//							auto pDistance1 = glm::distance(store.pos[p1] * scale, store.pos[p2] * scale);
 //							auto ppct = ofClamp(pDistance / maxPDistance, 0, 1);
 //							size_t fontSize = ofClamp(size_t(round((particleTexts.size() - 1) * pctDistance)) + 1, 0, particleTexts.size() -1);
 //							billboardShaderText.setUniform1f("pctColor", pctColor);
@@ -393,7 +422,7 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 //							billboardShaderText.setUniform4f("billboard_position", glm::vec4(midPoint, 1.0));
 //							billboardShaderText.setUniformTexture("tex0", fonts[fontSize].getFontTexture(), 0);
 //							if(pDistance1 < nm::Octree<nm::Particle>::INTERACTION_DISTANCE()){
-//								auto aniPct = p1.anihilationRatio/environment.getAnnihilationThresh();
+//								auto aniPct = store.anihilationRatio[p1]/environment.getAnnihilationThresh();
 //								fonts[fontSize].getStringMesh(ofToString(aniPct), 0,0).draw();
 //							}else{
 //								fonts[fontSize].getStringMesh(ofToString(pDistance1), 0,0).draw();
@@ -401,21 +430,21 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 //						}
 					break;
 					case nm::Environment::STANDARD_MODEL:
-//						if((p2->getFusion1Flag() ^ p1.getFusion1Flag()) == 0xFF ||
-//						   (p2->getFusion2Flag() ^ p1.getFusion2Flag()) == 0xFF){
+//						if((store.getFusion1Flag(p2) ^ store.getFusion1Flag(p1)) == 0xFF ||
+//						   (store.getFusion2Flag(p2) ^ store.getFusion2Flag(p1)) == 0xFF){
 //							auto pctColor = (1-pctDistance) * ambient;
 //							auto light = std::accumulate(photons.begin(), std::min(photons.begin() + 16, photons.end()), 0.f, [&](float acc, nm::Photon & ph){
 //								if(ph.alive){
-//									auto strength = lightStrenght / glm::distance2(p1.pos * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
+//									auto strength = lightStrenght / glm::distance2(store.pos[p1] * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
 //									return acc + strength;
 //								}else{
 //									return acc;
 //								}
 //							});
 //							pctColor += light;
-//							auto midPoint = (p1.pos + p2->pos) / 2.;
-//							auto pDistance = glm::distance2(p1.pos * scale, p2->pos * scale);
-//							auto pDistance1 = glm::distance(p1.pos * scale, p2->pos * scale);
+//							auto midPoint = (store.pos[p1] + store.pos[p2]) / 2.;
+//							auto pDistance = glm::distance2(store.pos[p1] * scale, store.pos[p2] * scale);
+//							auto pDistance1 = glm::distance(store.pos[p1] * scale, store.pos[p2] * scale);
 //							auto ppct = ofClamp(pDistance / maxPDistance, 0, 1);
 //							size_t fontSize = ofClamp(size_t(round((particleTexts.size() - 1) * pctDistance)) + 1, 0, particleTexts.size() -1);
 //							billboardShaderText.setUniform1f("pctColor", pctColor);
@@ -423,7 +452,7 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 //							billboardShaderText.setUniform4f("billboard_position", glm::vec4(midPoint, 1.0));
 //							billboardShaderText.setUniformTexture("tex0", fonts[fontSize].getFontTexture(), 0);
 //							if(pDistance1 < nm::Octree<nm::Particle>::INTERACTION_DISTANCE()){
-//								fonts[fontSize].getStringMesh(ofToString(p1.fusionRatio), 0,0).draw();
+//								fonts[fontSize].getStringMesh(ofToString(store.fusionRatio[p1]), 0,0).draw();
 //							}else{
 //								fonts[fontSize].getStringMesh(ofToString(pDistance1), 0,0).draw();
 //							}
@@ -448,14 +477,14 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 		billboardShader.setUniformMatrix4f("projectionMatrix", projection);
 		billboardShader.setUniformMatrix4f("modelViewMatrix", modelview);
 		billboardShader.setUniformMatrix4f("modelViewProjectionMatrix", projection * modelview);
-		for(auto & p: particles.getParticles()){
-			if(!p.alive) continue;
-			auto distance = glm::distance2(cam.getPosition(), p.pos * scale);
+		for(size_t p = 0; p < store.size(); ++p){
+			if(!store.alive[p]) continue;
+			auto distance = glm::distance2(cam.getPosition(), store.pos[p] * scale);
 			auto pctDistance = ofClamp(distance / maxScreenDistance, 0, 1);
 			auto pctColor = (1-pctDistance) * ambient;
 			auto light = std::accumulate(photons.begin(), std::min(photons.begin() + 16, photons.end()), 0.f, [&](float acc, nm::Photon & ph){
 				if(ph.alive){
-					auto strength = lightStrenght / glm::distance2(p.pos * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
+					auto strength = lightStrenght / glm::distance2(store.pos[p] * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
 					return acc + strength;
 				}else{
 					return acc;
@@ -464,12 +493,12 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 			pctColor += light;
 			billboardShader.setUniform1f("pctColor", pctColor);
 			billboardShader.setUniform1f("accumValue", accumValue);
-			billboardShader.setUniform4f("billboard_position", glm::vec4(p.pos * scale, 1.0));
+			billboardShader.setUniform4f("billboard_position", glm::vec4(store.pos[p] * scale, 1.0));
 			std::string text = "";
 			switch(environment.state){
 				case nm::Environment::BARYOGENESIS:
 				case nm::Environment::STANDARD_MODEL:
-					switch(p.getType()){
+					switch(store.getType(p)){
 						case nm::Particle::ANTI_UP_QUARK:
 						case nm::Particle::ANTI_DOWN_QUARK:
 							if(environment.state==nm::Environment::BARYOGENESIS) text = "a";
@@ -491,8 +520,8 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 					}
 				break;
 				case nm::Environment::NUCLEOSYNTHESIS:
-//					if(pctDistance > fulltextDistance && p.age > 1){
-//						switch(p.getType()){
+//					if(pctDistance > fulltextDistance && store.age[p] > 1){
+//						switch(store.getType(p)){
 //							case nm::Particle::ELECTRON:
 //								text = "e";
 //							break;
@@ -516,7 +545,7 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 //							break;
 //						}
 //					}else{
-						switch(p.getType()){
+						switch(store.getType(p)){
 							case nm::Particle::ELECTRON:
 								text = "electron";
 							break;
@@ -546,7 +575,7 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 								fontSize += 1;
 							}
 							billboardShader.setUniformTexture("tex0", fonts[fontSize].getFontTexture(), 0);
-							particleTexts[fontSize][text].draw();
+							drawLabel(particleTexts[fontSize][text]);
 						}
 //					}
 				break;
@@ -564,15 +593,15 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 			billboardShaderText.setUniformMatrix4f("modelViewMatrix", modelview);
 			billboardShaderText.setUniformMatrix4f("modelViewProjectionMatrix", projection * modelview);
 			string text = "e";
-			for(auto & p: particles.getParticles()){
-				if(!p.alive) continue;
-				if(p.getType()!=nm::Particle::ELECTRON) continue;
-				auto distance = glm::distance2(cam.getPosition(), p.pos * scale);
+			for(size_t p = 0; p < store.size(); ++p){
+				if(!store.alive[p]) continue;
+				if(store.getType(p)!=nm::Particle::ELECTRON) continue;
+				auto distance = glm::distance2(cam.getPosition(), store.pos[p] * scale);
 				auto pctDistance = ofClamp(distance / maxScreenDistance, 0, 1);
 				auto pctColor = (1-pctDistance) * ambient;
 				auto light = std::accumulate(photons.begin(), std::min(photons.begin() + 16, photons.end()), 0.f, [&](float acc, nm::Photon & ph){
 					if(ph.alive){
-						auto strength = lightStrenght / glm::distance2(p.pos * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
+						auto strength = lightStrenght / glm::distance2(store.pos[p] * scale, ph.pos * scale) * (1 - ofClamp(ph.age / 3.f / environment.systemSpeed, 0, 1));
 						return acc + strength;
 					}else{
 						return acc;
@@ -581,11 +610,11 @@ void TextRenderer::draw(nm::ParticleSystem & particles,
 				pctColor += light;
 				billboardShaderText.setUniform1f("pctColor", pctColor);
 				billboardShaderText.setUniform1f("accumValue", accumValue);
-				billboardShaderText.setUniform4f("billboard_position", glm::vec4(p.pos * scale, 1.0));
+				billboardShaderText.setUniform4f("billboard_position", glm::vec4(store.pos[p] * scale, 1.0));
 
 				size_t fontSize = size_t(round((particleTexts.size() - 1) * pctDistance)) / 2;
 				billboardShader.setUniformTexture("tex0", fonts[fontSize].getFontTexture(), 0);
-				particleTexts[fontSize][text].draw();
+				drawLabel(particleTexts[fontSize][text]);
 			}
 			billboardShaderText.end();
 		}
@@ -8,6 +8,7 @@
 #include "ofTrueTypeFont.h"
 #include "ParticleSystem.h"
 #include "Photons.h"
+#include "TextMeshCache.h"
 
 
 class TextRenderer
@@ -28,7 +29,7 @@ public:
 	void draw(nm::ParticleSystem & particles,
 			  std::vector<nm::Photon> & photons,
 			  nm::Environment & environment,
-			  std::pair<nm::Particle*, nm::Particle*> lookAt,
+			  std::pair<nm::ParticleStore::Handle, nm::ParticleStore::Handle> lookAt,
 			  entropy::render::WireframeFillRenderer & renderer,
 			  ofCamera & cam);
 
@@ -54,7 +55,8 @@ private:
 	std::vector<ofTrueTypeFont> fonts;
 	ofShader billboardShaderText;
 	ofShader billboardShaderPath;
-	std::vector<std::unordered_map<std::string, ofMesh>> particleTexts;
+	nm::TextMeshCache textMeshCache;
+	std::vector<std::unordered_map<std::string, nm::TextMeshCache::LabelPtr>> particleTexts;
 	std::vector<std::unordered_map<std::string, ofPath>> particlePaths;
 	float worldSize;
 	int width;
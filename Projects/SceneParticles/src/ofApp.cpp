@@ -385,6 +385,7 @@ void ofApp::update()
 
 	environment->update();
 	photons.update(dt);
+	particleSystem.setCheckLevel((nm::ParticleSystem::CheckLevel)parameters.checkLevel.get());
 	particleSystem.update(dt);
 	auto scale = environment->getExpansionScalar();
 
@@ -440,64 +441,65 @@ void ofApp::update()
 
 	// Camera position tracking next annihilation
 	if(parameters.rendering.doCameraTracking){
+		const auto & store = particleSystem.getParticles();
 		auto renewLookAt = arrived;
 		if(arrived && lookAt.first != lookAt.second){
-			auto * lookAt1 = particleSystem.getById(lookAt.first);
-			auto * lookAt2 = particleSystem.getById(lookAt.second);
-			if(lookAt1 && lookAt2){
-				renewLookAt = glm::distance(lookAt1->pos * scale, lookAt2->pos * scale) > nm::Octree<nm::Particle>::INTERACTION_DISTANCE();
+			auto lookAt1 = particleSystem.getIndex(lookAt.first);
+			auto lookAt2 = particleSystem.getIndex(lookAt.second);
+			if(lookAt1 != nm::ParticleStore::INVALID_INDEX && lookAt2 != nm::ParticleStore::INVALID_INDEX){
+				renewLookAt = glm::distance(store.pos[lookAt1] * scale, store.pos[lookAt2] * scale) > nm::Octree<nm::Particle>::INTERACTION_DISTANCE();
 				//cout << "arrived and renew " << renewLookAt << endl;
 			}
 		}
 		if(renewLookAt && timeConnectionLost==0){
 			timeConnectionLost = now;
-			lookAt.first = lookAt.second = 0;
+			lookAt.first = lookAt.second = nm::ParticleStore::INVALID_HANDLE;
 			//cout << "renew started counter" << endl;
 		}
 
 		auto timesinceConnectionLost = now - timeConnectionLost;
 		if(renewLookAt && timesinceConnectionLost > parameters.rendering.minTimeBetweenTravels){
 			//cout << "trying to renew" << endl;
-			auto particles = particleSystem.getParticles();
-			std::vector<nm::Particle*> sortedParticles(particles.size());
-			std::transform(particles.begin(),
-						   particles.end(),
-						   sortedParticles.begin(),
-						   [](nm::Particle & p){ return &p; });
-
-			std::sort(sortedParticles.begin(), sortedParticles.end(), [&](nm::Particle * p1, nm::Particle * p2){
-				return glm::distance2(p1->pos, camera.getGlobalPosition()) > glm::distance2(p2->pos, camera.getGlobalPosition());
+			std::vector<unsigned> sortedParticles(store.size());
+			std::iota(sortedParticles.begin(), sortedParticles.end(), 0);
+
+			std::sort(sortedParticles.begin(), sortedParticles.end(), [&](unsigned p1, unsigned p2){
+				return glm::distance2(store.pos[p1], camera.getGlobalPosition()) > glm::distance2(store.pos[p2], camera.getGlobalPosition());
 			});
 
 
 			switch(environment->state.get()){
 				case nm::Environment::BARYOGENESIS:
-					for(auto * p1: sortedParticles){
-						for(auto * p2: p1->potentialInteractionPartners){
-							auto distance = glm::distance(p1->pos * scale, p2->pos * scale);
-							travelDistance = glm::distance(p1->pos, camera.getGlobalPosition()) / kHalfDim;
+					for(auto p1: sortedParticles){
+						const auto partners = store.getPartners(p1);
+						for(auto handle: partners){
+							auto p2 = store.getIndex(handle);
+							if(p2 == nm::ParticleStore::INVALID_INDEX) continue;
+							auto distance = glm::distance(store.pos[p1] * scale, store.pos[p2] * scale);
+							travelDistance = glm::distance(store.pos[p1], camera.getGlobalPosition()) / kHalfDim;
 							auto minTravelTime = travelDistance / parameters.rendering.travelMaxSpeed;
-							auto annihilationPartners = std::count_if(p1->potentialInteractionPartners.begin(), p1->potentialInteractionPartners.end(), [&](nm::Particle * partner){
-								return (p1->getAnnihilationFlag() ^ partner->getAnnihilationFlag()) == 0xFF;
+							auto annihilationPartners = std::count_if(partners.begin(), partners.end(), [&](nm::ParticleStore::Handle partnerHandle){
+								auto partner = store.getIndex(partnerHandle);
+								return partner != nm::ParticleStore::INVALID_INDEX && (store.getAnnihilationFlag(p1) ^ store.getAnnihilationFlag(partner)) == 0xFF;
 							});
 							auto aproxAnnihilationTime = annihilationPartners * 1.f / environment->systemSpeed;
 
 							bool foundNew = distance < nm::Octree<nm::Particle>::INTERACTION_DISTANCE();
 							foundNew &= distance > nm::Octree<nm::Particle>::INTERACTION_DISTANCE() * 1. / 2.;
-							foundNew &= ((p1->isMatterQuark() && p2->isAntiMatterQuark()) || (p1->isAntiMatterQuark() && p2->isMatterQuark()));
+							foundNew &= ((store.isMatterQuark(p1) && store.isAntiMatterQuark(p2)) || (store.isAntiMatterQuark(p1) && store.isMatterQuark(p2)));
 							foundNew &= minTravelTime < aproxAnnihilationTime * 0.8;
-							foundNew &= p1->anihilationRatio + p2->anihilationRatio > 0.2;
-							foundNew &= p1->pos.x > -kHalfDim * 0.5 && p1->pos.x < kHalfDim * 0.5;
-							foundNew &= p1->pos.y > -kHalfDim * 0.5 && p1->pos.y < kHalfDim * 0.5;
-							foundNew &= p1->pos.z > -kHalfDim * 0.5 && p1->pos.z < kHalfDim * 0.5;
+							foundNew &= store.anihilationRatio[p1] + store.anihilationRatio[p2] > 0.2;
+							foundNew &= store.pos[p1].x > -kHalfDim * 0.5 && store.pos[p1].x < kHalfDim * 0.5;
+							foundNew &= store.pos[p1].y > -kHalfDim * 0.5 && store.pos[p1].y < kHalfDim * 0.5;
+							foundNew &= store.pos[p1].z > -kHalfDim * 0.5 && store.pos[p1].z < kHalfDim * 0.5;
 
 							if(foundNew){
-								if(p1->id<p2->id){
-									lookAt.first = p1->id;
-									lookAt.second = p2->id;
+								if(store.getHandle(p1)<store.getHandle(p2)){
+									lookAt.first = store.getHandle(p1);
+									lookAt.second = store.getHandle(p2);
 								}else{
-									lookAt.first = p2->id;
-									lookAt.second = p1->id;
+									lookAt.first = store.getHandle(p2);
+									lookAt.second = store.getHandle(p1);
 								}
 								timeRenewLookAt = now;
 								prevLookAt = lerpedLookAt;
@@ -505,41 +507,44 @@ void ofApp::update()
 								arrived = false;
 								timeConnectionLost = 0;
 								rotationDirection = round(ofRandomf());
-								// cout << "renewed to " << p1->id << "  " << p2->id << " " << &p1 << " " << p2 << " at distance " << distance << endl;
+								// cout << "renewed to " << store.getHandle(p1) << "  " << store.getHandle(p2) << " " << &p1 << " " << p2 << " at distance " << distance << endl;
 								break;
 							}
 						}
 					}
 				break;
 				case nm::Environment::STANDARD_MODEL:
-					for(auto * p1: sortedParticles){
-						auto * p2 = p1->fusionPartners.first;
-						auto * p3 = p1->fusionPartners.second;
-						if(p2 && p3){
-							auto distance = glm::distance(p1->pos * scale, p2->pos * scale);
-							travelDistance = glm::distance(p1->pos, camera.getGlobalPosition()) / kHalfDim;
+					for(auto p1: sortedParticles){
+						auto p2 = store.getIndex(store.fusionPartners[p1].first);
+						auto p3 = store.getIndex(store.fusionPartners[p1].second);
+						if(p2 != nm::ParticleStore::INVALID_INDEX && p3 != nm::ParticleStore::INVALID_INDEX){
+							const auto partners = store.getPartners(p1);
+							auto distance = glm::distance(store.pos[p1] * scale, store.pos[p2] * scale);
+							travelDistance = glm::distance(store.pos[p1], camera.getGlobalPosition()) / kHalfDim;
 							auto minTravelTime = travelDistance / parameters.rendering.travelMaxSpeed;
-							auto fussionPartners = std::count_if(p1->potentialInteractionPartners.begin(), p1->potentialInteractionPartners.end(), [&](nm::Particle * partner){
-								return (p1->getFusion1Flag() ^ partner->getFusion1Flag()) == 0xFF ||
-									   (p1->getFusion2Flag() ^ partner->getFusion2Flag()) == 0xFF;
+							auto fussionPartners = std::count_if(partners.begin(), partners.end(), [&](nm::ParticleStore::Handle partnerHandle){
+								auto partner = store.getIndex(partnerHandle);
+								return partner != nm::ParticleStore::INVALID_INDEX &&
+									   ((nm::Particle::getFusion1Flag(store.getType(p1)) ^ nm::Particle::getFusion1Flag(store.getType(partner))) == 0xFF ||
+									   (nm::Particle::getFusion2Flag(store.getType(p1)) ^ nm::Particle::getFusion2Flag(store.getType(partner))) == 0xFF);
 							});
 							auto aproxFussionTime = fussionPartners * 1.f / environment->systemSpeed;
 
 							bool foundNew = true;//distance < nm::Octree<nm::Particle>::INTERACTION_DISTANCE();
 //							foundNew &= distance > nm::Octree<nm::Particle>::INTERACTION_DISTANCE() * 1. / 2.;
 //							foundNew &= minTravelTime < aproxFussionTime * 0.8;
-							//foundNew &= p1->anihilationRatio + p2->anihilationRatio > 0.2;
-							foundNew &= p1->pos.x > -kHalfDim * 0.5 && p1->pos.x < kHalfDim * 0.5;
-							foundNew &= p1->pos.y > -kHalfDim * 0.5 && p1->pos.y < kHalfDim * 0.5;
-							foundNew &= p1->pos.z > -kHalfDim * 0.5 && p1->pos.z < kHalfDim * 0.5;
+							//foundNew &= store.anihilationRatio[p1] + store.anihilationRatio[p2] > 0.2;
+							foundNew &= store.pos[p1].x > -kHalfDim * 0.5 && store.pos[p1].x < kHalfDim * 0.5;
+							foundNew &= store.pos[p1].y > -kHalfDim * 0.5 && store.pos[p1].y < kHalfDim * 0.5;
+							foundNew &= store.pos[p1].z > -kHalfDim * 0.5 && store.pos[p1].z < kHalfDim * 0.5;
 
 							if(foundNew){
-								if(p1->id<p2->id){
-									lookAt.first = p1->id;
-									lookAt.second = p2->id;
+								if(store.getHandle(p1)<store.getHandle(p2)){
+									lookAt.first = store.getHandle(p1);
+									lookAt.second = store.getHandle(p2);
 								}else{
-									lookAt.first = p2->id;
-									lookAt.second = p1->id;
+									lookAt.first = store.getHandle(p2);
+									lookAt.second = store.getHandle(p1);
 								}
 								timeRenewLookAt = now;
 								prevLookAt = lerpedLookAt;
@@ -548,11 +553,11 @@ void ofApp::update()
 								rotationDirection = round(ofRandomf());
 								if(parameters.rendering.cutToInteraction){
 									arrived = true;
-									lerpedLookAt = (p1->pos + p2->pos + p3->pos)/3.f;
+									lerpedLookAt = (store.pos[p1] + store.pos[p2] + store.pos[p3])/3.f;
 								}else{
 									arrived = false;
 								}
-								// cout << "renewed to " << p1->id << "  " << p2->id << " " << &p1 << " " << p2 << " at distance " << distance << endl;
+								// cout << "renewed to " << store.getHandle(p1) << "  " << store.getHandle(p2) << " " << &p1 << " " << p2 << " at distance " << distance << endl;
 								break;
 							}
 						}
@@ -567,13 +572,12 @@ void ofApp::update()
 		}
 
 		if(!arrived){
-			auto * lookAt1 = particleSystem.getById(lookAt.first);
-			auto * lookAt2 = particleSystem.getById(lookAt.second);
-			if(lookAt1 && lookAt2){
-				lookAtPos = (lookAt1->pos + lookAt2->pos) / 2.;
+			auto lookAt1 = particleSystem.getIndex(lookAt.first);
+			auto lookAt2 = particleSystem.getIndex(lookAt.second);
+			if(lookAt1 != nm::ParticleStore::INVALID_INDEX && lookAt2 != nm::ParticleStore::INVALID_INDEX){
+				lookAtPos = (store.pos[lookAt1] + store.pos[lookAt2]) / 2.;
 			}
-			currentLookAtParticles.first = lookAt1;
-			currentLookAtParticles.second = lookAt2;
+			currentLookAtParticles = lookAt;
 
 			auto timePassed = now - timeRenewLookAt;
 			auto animationTime = travelDistance / parameters.rendering.travelMaxSpeed;
@@ -593,8 +597,8 @@ void ofApp::update()
 	//		camera.setPosition(newCameraPosition);
 	//		camera.lookAt(lerpedLookAt, glm::vec3(0,1,0));
 		}else{
-			currentLookAtParticles.first = nullptr;
-			currentLookAtParticles.second = nullptr;
+			currentLookAtParticles.first = nm::ParticleStore::INVALID_HANDLE;
+			currentLookAtParticles.second = nm::ParticleStore::INVALID_HANDLE;
 	//		camera.orbitDeg(orbitAngle, 0, 50, lerpedLookAt);
 	//		//	camera.orbitDeg(orbitAngle, 0, parameters.rendering.rotationRadius * kHalfDim);
 	//		orbitAngle += dt * parameters.rendering.rotationSpeed * rotationDirection;
@@ -1006,6 +1010,7 @@ void ofApp::reset()
 
 	// Use the same random seed for each run.
 	ofSeedRandom(3030);
+	particleSystem.setSeed(3030);
 
 	int counts[6];
 	for (int i = 0; i < 6; ++i)
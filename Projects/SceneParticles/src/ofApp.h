@@ -85,6 +85,7 @@ public:
 	struct : ofParameterGroup
 	{
 		ofParameter<bool> debugLights{ "Debug Lights", false };
+		ofParameter<int> checkLevel{ "Check Level", nm::ParticleSystem::CHECK_NONE, nm::ParticleSystem::CHECK_NONE, nm::ParticleSystem::CHECK_ALL };
 
 		//ofParameter<string> stateFile;
 
@@ -189,6 +190,7 @@ public:
 
 		PARAM_DECLARE("Scene",
 			debugLights,
+			checkLevel,
 			//stateFile,
 			rendering,
 			frontBack,
@@ -212,8 +214,8 @@ public:
 	double dt = 0;
 	double orbitAngle = 0;
 
-	std::pair<size_t, size_t> lookAt{0,0};
-	std::pair<nm::Particle*, nm::Particle*> currentLookAtParticles{nullptr,nullptr};
+	std::pair<nm::ParticleStore::Handle, nm::ParticleStore::Handle> lookAt{nm::ParticleStore::INVALID_HANDLE, nm::ParticleStore::INVALID_HANDLE};
+	std::pair<nm::ParticleStore::Handle, nm::ParticleStore::Handle> currentLookAtParticles{nm::ParticleStore::INVALID_HANDLE, nm::ParticleStore::INVALID_HANDLE};
 	glm::vec3 lookAtPos, prevLookAt, lerpedLookAt, prevCameraPosition;
 	bool arrived = true;
 	double timeConnectionLost = 0;
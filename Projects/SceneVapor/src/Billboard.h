@@ -0,0 +1,50 @@
+#ifndef BILLBOARD_H
+#define BILLBOARD_H
+
+#include "ofGraphics.h"
+#include "ofTrueTypeFont.h"
+
+inline void billboard(const ofTrueTypeFont & f, std::string text, glm::mat4 projection, glm::mat4 modelview, glm::vec3 pos){
+	auto rViewport = ofGetCurrentViewport();
+
+	auto mat = projection * modelview;
+	auto dScreen4 = mat * glm::vec4(pos,1.0);
+	auto dScreen = dScreen4.xyz() / dScreen4.w;
+	dScreen += glm::vec3(1.0) ;
+	dScreen *= 0.5;
+
+	dScreen.x += rViewport.x;
+	dScreen.x *= rViewport.width;
+
+	dScreen.y += rViewport.y;
+	dScreen.y *= rViewport.height;
+
+	if (dScreen.z >= 1) return;
+
+
+	ofSetMatrixMode(OF_MATRIX_PROJECTION);
+	ofPushMatrix();
+	ofLoadIdentityMatrix();
+
+	ofSetMatrixMode(OF_MATRIX_MODELVIEW);
+	ofPushMatrix();
+
+	glm::mat4 modelView;
+	modelView = glm::translate(modelView, glm::vec3(-1,-1,0));
+	modelView = glm::scale(modelView, glm::vec3(2/rViewport.width, 2/rViewport.height, 1));
+	modelView = glm::translate(modelView, glm::vec3(dScreen.x, dScreen.y, 0));
+	ofLoadMatrix(modelView);
+	auto m = f.getStringMesh(text, 0, 0, false);
+	f.getFontTexture().bind();
+	m.draw();
+	f.getFontTexture().unbind();
+
+
+	ofSetMatrixMode(OF_MATRIX_PROJECTION);
+	ofPopMatrix();
+
+	ofSetMatrixMode(OF_MATRIX_MODELVIEW);
+	ofPopMatrix();
+}
+
+#endif // BILLBOARD_H
@@ -2,19 +2,23 @@
 #define CONSTANTS_H
 #include "ofConstants.h"
 
-#define FAST_READ 0
+#define FAST_READ 1
 #define READ_TO_BUFFER 0
+#define VERIFY_FRAME_CHECKSUMS 0
 
 #define HDF5_DIRECT 0
 #define USE_RAW 0
-#define USE_VOXELS_COMPUTE_SHADER 0
+#define USE_VOXELS_CODEC 0
 #define USE_PARTICLES_COMPUTE_SHADER 1
 #define USE_PARTICLES_HISTOGRAM 0
-#define USE_VOXELS_DCT_COMPRESSION 0
 #define USE_VBO 0
 #define USE_HALF_PARTICLE 0
+#define USE_LINEAR_OCTREE 1
+#define USE_OCTREE_VOXELS 0 // 3d texture from the octree leafs instead of splatting the particles
 
 #define MAX_PARTICLE_SIZE 10
+#define VOXELS_MAX_ERROR 0 // 0 is lossless
+#define VOXELS_KEY_FRAME_INTERVAL 8 // 1 stores every frame as a key-frame
 #define USE_TEXTURE_3D_MIPMAPS 1
 constexpr size_t MAX_NUM_PARTICLES = 5000000;
 
@@ -0,0 +1,279 @@
+#include "FrameFile.h"
+
+#ifdef TARGET_LINUX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ent
+{
+	// the log streams take them by reference
+	constexpr uint32_t FrameFile::Magic;
+	constexpr uint32_t FrameFile::Version;
+	constexpr uint32_t FrameFile::PageSize;
+
+	namespace{
+		uint64_t alignToPage(uint64_t offset){
+			return (offset + FrameFile::PageSize - 1) / FrameFile::PageSize * FrameFile::PageSize;
+		}
+	}
+
+	//--------------------------------------------------------------
+	FrameFile::FrameFile(){
+
+	}
+
+	//--------------------------------------------------------------
+	FrameFile::~FrameFile(){
+		close();
+	}
+
+	//--------------------------------------------------------------
+	bool FrameFile::load(const std::string & path, bool verifyChecksums){
+		close();
+
+	#if defined(TARGET_LINUX) && FAST_READ
+		auto fd = open(ofToDataPath(path).c_str(), O_RDONLY);
+		if(fd < 0){
+			ofLogError("FrameFile::load") << "Couldn't open " << path;
+			return false;
+		}
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size == 0){
+			ofLogError("FrameFile::load") << "Couldn't stat " << path;
+			::close(fd);
+			return false;
+		}
+		auto filedata = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(filedata == MAP_FAILED){
+			ofLogError("FrameFile::load") << "Couldn't read memory mapped file " << path;
+			return false;
+		}
+		madvise(filedata, st.st_size, MADV_WILLNEED);
+		data = (const char*)filedata;
+		size = st.st_size;
+		mapped = true;
+	#else
+		ofFile file(path, ofFile::ReadOnly, true);
+		if(!file.exists()){
+			ofLogError("FrameFile::load") << "Couldn't open " << path;
+			return false;
+		}
+		buffer = file.readToBuffer();
+		data = buffer.getData();
+		size = buffer.size();
+	#endif
+
+		if(!validate(path, verifyChecksums)){
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	//--------------------------------------------------------------
+	bool FrameFile::validate(const std::string & path, bool verifyChecksums){
+		if(size < sizeof(Header)){
+			ofLogError("FrameFile::load") << path << " is too small to be a frame file";
+			return false;
+		}
+
+		auto header = reinterpret_cast<const Header*>(data);
+		if(header->magic != Magic){
+			ofLogError("FrameFile::load") << path << " is not a frame file";
+			return false;
+		}
+		if(header->version != Version){
+			ofLogError("FrameFile::load") << path << " has version " << header->version << ", expected " << Version;
+			return false;
+		}
+		if(header->pageSize != PageSize){
+			ofLogError("FrameFile::load") << path << " has pages of " << header->pageSize << " bytes, expected " << PageSize;
+			return false;
+		}
+		if(header->fileSize != size){
+			ofLogError("FrameFile::load") << path << " is truncated, expected " << header->fileSize << " bytes, found " << size;
+			return false;
+		}
+		if(sizeof(Header) + header->numSections * sizeof(Section) > size){
+			ofLogError("FrameFile::load") << path << " section table is out of bounds";
+			return false;
+		}
+
+		sections = reinterpret_cast<const Section*>(data + sizeof(Header));
+		numSections = header->numSections;
+		for(uint32_t i = 0; i < numSections; ++i){
+			auto & section = sections[i];
+			if(section.offset % PageSize != 0 || section.offset > size || section.size > size - section.offset){
+				ofLogError("FrameFile::load") << path << " section " << i << " is out of bounds";
+				return false;
+			}
+			if(verifyChecksums && checksum(data + section.offset, section.size) != section.checksum){
+				ofLogError("FrameFile::load") << path << " section " << i << " is corrupted";
+				return false;
+			}
+		}
+
+		auto metadata = getSectionInfo(MetadataSection);
+		if(metadata == nullptr || metadata->size != sizeof(FrameMetadata)){
+			ofLogError("FrameFile::load") << path << " has no valid metadata";
+			return false;
+		}
+
+		return true;
+	}
+
+	//--------------------------------------------------------------
+	void FrameFile::close(){
+	#ifdef TARGET_LINUX
+		if(mapped){
+			munmap((void*)data, size);
+		}
+	#endif
+		buffer.clear();
+		data = nullptr;
+		size = 0;
+		mapped = false;
+		sections = nullptr;
+		numSections = 0;
+	}
+
+	//--------------------------------------------------------------
+	bool FrameFile::isLoaded() const{
+		return data != nullptr;
+	}
+
+	//--------------------------------------------------------------
+	size_t FrameFile::getSize() const{
+		return size;
+	}
+
+	//--------------------------------------------------------------
+	bool FrameFile::hasSection(SectionType type) const{
+		return getSectionInfo(type) != nullptr;
+	}
+
+	//--------------------------------------------------------------
+	const FrameFile::Section * FrameFile::getSectionInfo(SectionType type) const{
+		for(uint32_t i = 0; i < numSections; ++i){
+			if(sections[i].type == type){
+				return &sections[i];
+			}
+		}
+		return nullptr;
+	}
+
+	//--------------------------------------------------------------
+	const char * FrameFile::getSectionData(SectionType type, size_t & sectionSize) const{
+		auto section = getSectionInfo(type);
+		if(section == nullptr){
+			sectionSize = 0;
+			return nullptr;
+		}
+		sectionSize = section->size;
+		return data + section->offset;
+	}
+
+	//--------------------------------------------------------------
+	const FrameMetadata & FrameFile::getMetadata() const{
+		size_t metadataSize;
+		return *reinterpret_cast<const FrameMetadata*>(getSectionData(MetadataSection, metadataSize));
+	}
+
+	//--------------------------------------------------------------
+	void FrameFile::prefault() const{
+		if(!mapped){
+			return;
+		}
+		volatile char sum = 0;
+		for(size_t i = 0; i < size; i += PageSize){
+			sum += data[i];
+		}
+	}
+
+	//--------------------------------------------------------------
+	std::string FrameFile::getPath(const std::string & folder, int frameIndex){
+		return ofFilePath::removeTrailingSlash(folder) + "/" + ofToString(frameIndex) + ".frame";
+	}
+
+	//--------------------------------------------------------------
+	uint64_t FrameFile::checksum(const void * data, size_t size){
+		// FNV-1a over 64bit words, the tail is folded in byte by byte.
+		const uint64_t prime = 0x100000001b3ull;
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto bytes = (const uint8_t*)data;
+		auto numWords = size / sizeof(uint64_t);
+		for(size_t i = 0; i < numWords; ++i){
+			uint64_t word;
+			memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+			hash ^= word;
+			hash *= prime;
+		}
+		for(size_t i = numWords * sizeof(uint64_t); i < size; ++i){
+			hash ^= bytes[i];
+			hash *= prime;
+		}
+		return hash;
+	}
+
+	//--------------------------------------------------------------
+	void FrameFileWriter::addSection(FrameFile::SectionType type, const void * data, size_t size, size_t elementSize){
+		sections.push_back({type, data, size, elementSize});
+	}
+
+	//--------------------------------------------------------------
+	bool FrameFileWriter::save(const std::string & path) const{
+		FrameFile::Header header;
+		header.magic = FrameFile::Magic;
+		header.version = FrameFile::Version;
+		header.numSections = sections.size();
+		header.pageSize = FrameFile::PageSize;
+
+		std::vector<FrameFile::Section> table(sections.size());
+		uint64_t offset = alignToPage(sizeof(header) + sizeof(FrameFile::Section) * table.size());
+		for(size_t i = 0; i < sections.size(); ++i){
+			table[i].type = sections[i].type;
+			table[i].elementSize = sections[i].elementSize;
+			table[i].offset = offset;
+			table[i].size = sections[i].size;
+			table[i].checksum = FrameFile::checksum(sections[i].data, sections[i].size);
+			offset = alignToPage(offset + sections[i].size);
+		}
+		header.fileSize = table.empty() ? offset : table.back().offset + table.back().size;
+
+		auto tmpPath = path + ".tmp";
+		{
+			ofFile file(tmpPath, ofFile::WriteOnly, true);
+			if(!file.is_open()){
+				ofLogError("FrameFileWriter::save") << "Couldn't open " << tmpPath << " for writing";
+				return false;
+			}
+			std::vector<char> padding(FrameFile::PageSize, 0);
+			uint64_t written = 0;
+			auto write = [&](const void * data, size_t size){
+				file.write((const char*)data, size);
+				written += size;
+			};
+			auto pad = [&](uint64_t to){
+				while(written < to){
+					write(padding.data(), std::min<uint64_t>(padding.size(), to - written));
+				}
+			};
+			write(&header, sizeof(header));
+			write(table.data(), table.size() * sizeof(FrameFile::Section));
+			for(size_t i = 0; i < sections.size(); ++i){
+				pad(table[i].offset);
+				write(sections[i].data, sections[i].size);
+			}
+			if(!file.good()){
+				ofLogError("FrameFileWriter::save") << "Error writing " << tmpPath;
+				return false;
+			}
+		}
+
+		return ofFile::moveFromTo(tmpPath, path, true, true);
+	}
+}
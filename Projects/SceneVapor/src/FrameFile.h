@@ -0,0 +1,135 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Constants.h"
+#include <type_traits>
+
+namespace ent
+{
+	// Everything SnapshotRamses needs to know about a precalculated
+	// frame before touching any of the bulk data. Stored as a section
+	// of the frame file so it's read in place, without parsing.
+	struct FrameMetadata{
+		float minDensity;
+		float maxDensity;
+		glm::vec3 minCoords;
+		glm::vec3 maxCoords;
+		float minSize;
+		float maxSize;
+		glm::vec3 minBox;
+		glm::vec3 maxBox;
+		uint64_t numParticles;
+		uint64_t numGroups;
+		uint32_t worldsize;
+		uint32_t halfParticles;
+	};
+	static_assert(std::is_standard_layout<FrameMetadata>::value, "FrameMetadata is written as is to disk");
+	static_assert(sizeof(FrameMetadata) == 88, "FrameMetadata layout changed, bump FrameFile::Version");
+
+	// Single file container for a precalculated frame:
+	//
+	//    header | section table | pad | section | pad | section ...
+	//
+	// Every section starts at a page boundary so the whole file can be
+	// mapped once and each section used in place. Each section carries
+	// a checksum of its contents that can be verified on load.
+	class FrameFile
+	{
+	public:
+		static constexpr uint32_t Magic = 0x4d524645; // "EFRM"
+		static constexpr uint32_t Version = 1;
+		static constexpr uint32_t PageSize = 4096;
+
+		enum SectionType: uint32_t{
+			MetadataSection = 0,
+			ParticlesSection,
+			HalfParticlesSection,
+			GroupsSection,
+			VoxelsSection,
+			RawSection,
+			HalfQuantizationSection,
+		};
+
+		struct Header{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t numSections;
+			uint32_t pageSize;
+			uint64_t fileSize;
+		};
+
+		struct Section{
+			uint32_t type;
+			uint32_t elementSize;
+			uint64_t offset;
+			uint64_t size;
+			uint64_t checksum;
+		};
+
+		FrameFile();
+		~FrameFile();
+		FrameFile(const FrameFile &) = delete;
+		FrameFile & operator=(const FrameFile &) = delete;
+
+		bool load(const std::string & path, bool verifyChecksums = VERIFY_FRAME_CHECKSUMS);
+		void close();
+		bool isLoaded() const;
+		size_t getSize() const;
+
+		bool hasSection(SectionType type) const;
+		const Section * getSectionInfo(SectionType type) const;
+		const char * getSectionData(SectionType type, size_t & size) const;
+		const FrameMetadata & getMetadata() const;
+
+		template<typename T>
+		const T * getSection(SectionType type, size_t & count) const{
+			size_t size = 0;
+			auto data = getSectionData(type, size);
+			count = size / sizeof(T);
+			return reinterpret_cast<const T*>(data);
+		}
+
+		// Touches every page of a mapped file so the first access from
+		// the render thread doesn't have to wait for the disk.
+		void prefault() const;
+
+		static uint64_t checksum(const void * data, size_t size);
+		static std::string getPath(const std::string & folder, int frameIndex);
+
+	private:
+		bool validate(const std::string & path, bool verifyChecksums);
+
+		const char * data = nullptr;
+		size_t size = 0;
+		bool mapped = false;
+		ofBuffer buffer;
+		const Section * sections = nullptr;
+		uint32_t numSections = 0;
+	};
+
+	// Collects the sections of a frame and writes them to disk. The data
+	// passed to addSection has to stay alive until save is called.
+	// The file is written to a temporary path and moved in place at the
+	// end so readers never see a partially written frame.
+	class FrameFileWriter
+	{
+	public:
+		void addSection(FrameFile::SectionType type, const void * data, size_t size, size_t elementSize);
+
+		template<typename T>
+		void addSection(FrameFile::SectionType type, const std::vector<T> & elements){
+			addSection(type, elements.data(), elements.size() * sizeof(T), sizeof(T));
+		}
+
+		bool save(const std::string & path) const;
+
+	private:
+		struct PendingSection{
+			FrameFile::SectionType type;
+			const void * data;
+			size_t size;
+			size_t elementSize;
+		};
+		std::vector<PendingSection> sections;
+	};
+}
@@ -0,0 +1,343 @@
+#include "FramePrefetcher.h"
+
+namespace ent
+{
+	//--------------------------------------------------------------
+	FramePrefetcher::FramePrefetcher(){
+
+	}
+
+	//--------------------------------------------------------------
+	FramePrefetcher::~FramePrefetcher(){
+		close();
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::setup(const Settings & settings){
+		close();
+		this->settings = settings;
+		stats = Stats();
+		running = true;
+		for(size_t i = 0; i < std::max<size_t>(settings.numThreads, 1); ++i){
+			threads.emplace_back(&FramePrefetcher::threadedFunction, this);
+		}
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::close(){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			running = false;
+		}
+		workAvailable.notify_all();
+		for(auto & thread: threads){
+			thread.join();
+		}
+		threads.clear();
+
+		// The workers are gone, nothing can be loading anymore.
+		std::unique_lock<std::mutex> lock(mutex);
+		queue.clear();
+		pool.clear();
+		wanted.clear();
+		poolBytes = 0;
+		lastRequested = -1;
+		direction = 1;
+	}
+
+	//--------------------------------------------------------------
+	std::shared_ptr<const FrameFile> FramePrefetcher::acquire(int frameIndex){
+		std::unique_lock<std::mutex> lock(mutex);
+		frameIndex = wrap(frameIndex);
+
+		auto it = pool.find(frameIndex);
+		if(it != pool.end() && it->second.state == Ready){
+			stats.hits += 1;
+			it->second.lastUse = ++useCounter;
+			return it->second.frame;
+		}
+
+		if(it != pool.end() && (it->second.state == Queued || it->second.state == Loading)){
+			// Already on its way, move it to the front of the queue and
+			// wait for it instead of loading it twice.
+			stats.stalls += 1;
+			if(it->second.state == Queued){
+				queue.erase(std::remove(queue.begin(), queue.end(), frameIndex), queue.end());
+				queue.push_front(frameIndex);
+				workAvailable.notify_one();
+			}
+			auto then = ofGetElapsedTimeMicros();
+			frameLoaded.wait(lock, [&]{
+				auto it = pool.find(frameIndex);
+				return it == pool.end() || it->second.state == Ready || it->second.state == Failed;
+			});
+			stats.stallMicros += ofGetElapsedTimeMicros() - then;
+
+			it = pool.find(frameIndex);
+			if(it != pool.end() && it->second.state == Ready){
+				it->second.lastUse = ++useCounter;
+				return it->second.frame;
+			}
+			return nullptr;
+		}
+
+		// Not in the pool or failed before, the file might have been
+		// precalculated since so try again on this thread.
+		stats.misses += 1;
+		auto path = getFramePath(frameIndex);
+		lock.unlock();
+		auto frame = loadFrame(path);
+		lock.lock();
+		if(!frame){
+			return nullptr;
+		}
+
+		auto & entry = pool[frameIndex];
+		if(entry.state == Ready){
+			entry.lastUse = ++useCounter;
+			return entry.frame;
+		}else if(entry.state == Loading){
+			return frame;
+		}else if(entry.state == Queued){
+			queue.erase(std::remove(queue.begin(), queue.end(), frameIndex), queue.end());
+		}
+		evict(frame->getSize());
+		entry.state = Ready;
+		entry.frame = frame;
+		entry.bytes = frame->getSize();
+		entry.lastUse = ++useCounter;
+		poolBytes += entry.bytes;
+		stats.framesLoaded += 1;
+		stats.bytesLoaded += entry.bytes;
+		return frame;
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::request(int frameIndex){
+		std::unique_lock<std::mutex> lock(mutex);
+		frameIndex = wrap(frameIndex);
+		if(lastRequested != -1 && frameIndex != lastRequested){
+			auto diff = frameIndex - lastRequested;
+			// A jump of more than half the sequence is the loop wrapping
+			// around rather than a change of direction.
+			if(std::abs(diff) > settings.numFrames / 2){
+				diff = -diff;
+			}
+			direction = diff > 0 ? 1 : -1;
+		}
+		lastRequested = frameIndex;
+
+		std::vector<int> frames;
+		for(size_t i = 0; i <= settings.lookAhead; ++i){
+			auto frame = wrap(frameIndex + direction * int(i));
+			if(std::find(frames.begin(), frames.end(), frame) == frames.end()){
+				frames.push_back(frame);
+			}
+		}
+		schedule(frames);
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::prefetchAll(){
+		std::unique_lock<std::mutex> lock(mutex);
+		auto from = lastRequested == -1 ? settings.startIndex : lastRequested;
+		std::vector<int> frames;
+		for(int i = 0; i < settings.numFrames; ++i){
+			frames.push_back(wrap(from + direction * i));
+		}
+		schedule(frames);
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::invalidate(int frameIndex){
+		std::unique_lock<std::mutex> lock(mutex);
+		frameIndex = wrap(frameIndex);
+		auto it = pool.find(frameIndex);
+		if(it == pool.end()){
+			return;
+		}
+		switch(it->second.state){
+			case Ready:
+				poolBytes -= it->second.bytes;
+				stats.evictions += 1;
+				pool.erase(it);
+			break;
+			case Queued:
+				queue.erase(std::remove(queue.begin(), queue.end(), frameIndex), queue.end());
+				pool.erase(it);
+			break;
+			case Failed:
+				pool.erase(it);
+			break;
+			case Loading:
+				// Loading entries are never removed, the worker might have
+				// opened the old file so it drops whatever it loads.
+				it->second.stale = true;
+			break;
+		}
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::schedule(const std::vector<int> & frames){
+		// Pending frames that are not wanted anymore are dropped, the
+		// rest are queued again in order of distance to the playhead.
+		queue.clear();
+		for(auto it = pool.begin(); it != pool.end();){
+			if(it->second.state == Queued && std::find(frames.begin(), frames.end(), it->first) == frames.end()){
+				it = pool.erase(it);
+			}else{
+				++it;
+			}
+		}
+
+		wanted.clear();
+		size_t wantedBytes = 0;
+		for(auto frame: frames){
+			auto it = pool.find(frame);
+			auto bytes = it != pool.end() && it->second.bytes > 0 ?
+						 it->second.bytes :
+						 ofFile(getFramePath(frame), ofFile::Reference).getSize();
+			if(bytes == 0){
+				// Not precalculated yet, acquire will fail and the
+				// snapshot will precalculate it synchronously.
+				continue;
+			}
+			wantedBytes += bytes;
+			if(wantedBytes > settings.byteBudget){
+				break;
+			}
+
+			wanted.push_back(frame);
+			if(it == pool.end()){
+				pool[frame].state = Queued;
+				queue.push_back(frame);
+			}else if(it->second.state == Queued){
+				queue.push_back(frame);
+			}
+		}
+		workAvailable.notify_all();
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::evict(size_t neededBytes){
+		while(poolBytes + neededBytes > settings.byteBudget){
+			auto lru = pool.end();
+			for(auto it = pool.begin(); it != pool.end(); ++it){
+				// Failed entries hold no bytes, dropping them doesn't make
+				// room. acquire() retries them on its own thread anyway.
+				auto isWanted = std::find(wanted.begin(), wanted.end(), it->first) != wanted.end();
+				if(it->second.state == Ready && !isWanted && (lru == pool.end() || it->second.lastUse < lru->second.lastUse)){
+					lru = it;
+				}
+			}
+			if(lru == pool.end()){
+				break;
+			}
+			poolBytes -= lru->second.bytes;
+			pool.erase(lru);
+			stats.evictions += 1;
+		}
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::threadedFunction(){
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true){
+			workAvailable.wait(lock, [&]{
+				return !running || !queue.empty();
+			});
+			if(!running){
+				break;
+			}
+
+			auto frameIndex = queue.front();
+			queue.pop_front();
+			auto it = pool.find(frameIndex);
+			if(it == pool.end() || it->second.state != Queued){
+				continue;
+			}
+			it->second.state = Loading;
+			auto path = getFramePath(frameIndex);
+
+			lock.unlock();
+			auto frame = loadFrame(path);
+			lock.lock();
+
+			// Loading entries are never removed so the entry is still there.
+			auto & entry = pool[frameIndex];
+			if(frame && !entry.stale){
+				evict(frame->getSize());
+				entry.state = Ready;
+				entry.frame = frame;
+				entry.bytes = frame->getSize();
+				entry.lastUse = ++useCounter;
+				poolBytes += entry.bytes;
+				stats.framesLoaded += 1;
+				stats.bytesLoaded += entry.bytes;
+			}else{
+				// Failed frames are retried by acquire on its own thread.
+				entry.state = Failed;
+				entry.stale = false;
+			}
+			frameLoaded.notify_all();
+		}
+	}
+
+	//--------------------------------------------------------------
+	std::shared_ptr<const FrameFile> FramePrefetcher::loadFrame(const std::string & path){
+		auto frame = std::make_shared<FrameFile>();
+		if(!frame->load(path)){
+			return nullptr;
+		}
+		frame->prefault();
+		return frame;
+	}
+
+	//--------------------------------------------------------------
+	int FramePrefetcher::wrap(int frameIndex) const{
+		if(settings.numFrames <= 0){
+			return frameIndex;
+		}
+		auto offset = (frameIndex - settings.startIndex) % settings.numFrames;
+		if(offset < 0){
+			offset += settings.numFrames;
+		}
+		return settings.startIndex + offset;
+	}
+
+	//--------------------------------------------------------------
+	std::string FramePrefetcher::getFramePath(int frameIndex) const{
+		return FrameFile::getPath(settings.folder, frameIndex);
+	}
+
+	//--------------------------------------------------------------
+	size_t FramePrefetcher::getPoolBytes() const{
+		std::unique_lock<std::mutex> lock(mutex);
+		return poolBytes;
+	}
+
+	//--------------------------------------------------------------
+	size_t FramePrefetcher::getPoolSize() const{
+		std::unique_lock<std::mutex> lock(mutex);
+		return std::count_if(pool.begin(), pool.end(), [](const std::pair<const int, Entry> & entry){
+			return entry.second.state == Ready;
+		});
+	}
+
+	//--------------------------------------------------------------
+	FramePrefetcher::Stats FramePrefetcher::getStats() const{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto stats = this->stats;
+		stats.poolBytes = poolBytes;
+		stats.poolFrames = std::count_if(pool.begin(), pool.end(), [](const std::pair<const int, Entry> & entry){
+			return entry.second.state == Ready;
+		});
+		return stats;
+	}
+
+	//--------------------------------------------------------------
+	void FramePrefetcher::resetStats(){
+		std::unique_lock<std::mutex> lock(mutex);
+		stats = Stats();
+	}
+}
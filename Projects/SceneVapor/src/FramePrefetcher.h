@@ -0,0 +1,106 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FrameFile.h"
+#include <condition_variable>
+
+namespace ent
+{
+	// Loads precalculated frame files on worker threads ahead of
+	// playback into a pool bounded by a byte budget. Frames are kept
+	// in LRU order and the look-ahead follows the playback direction
+	// so scrubbing backwards prefetches the previous frames instead.
+	//
+	// It doesn't touch GL so the render thread only has to upload the
+	// frames it acquires, and it can be run without a window.
+	class FramePrefetcher
+	{
+	public:
+		struct Settings{
+			std::string folder;
+			int startIndex = 0;
+			int numFrames = 0;
+			size_t byteBudget = size_t(4) * 1024 * 1024 * 1024;
+			size_t lookAhead = 4;
+			size_t numThreads = 2;
+		};
+
+		struct Stats{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t stalls = 0;
+			uint64_t stallMicros = 0;
+			uint64_t evictions = 0;
+			uint64_t framesLoaded = 0;
+			uint64_t bytesLoaded = 0;
+
+			// State of the pool when the stats were taken, not counters
+			// so resetStats doesn't touch them.
+			size_t poolBytes = 0;
+			size_t poolFrames = 0;
+		};
+
+		FramePrefetcher();
+		~FramePrefetcher();
+
+		void setup(const Settings & settings);
+		void close();
+
+		// Returns the frame, loading it on the calling thread if it's not
+		// in the pool or waiting for it if a worker is already loading it.
+		// Returns nullptr if the frame file can't be loaded.
+		std::shared_ptr<const FrameFile> acquire(int frameIndex);
+
+		// Tells the prefetcher where playback is so it can schedule the
+		// next frames in the current direction.
+		void request(int frameIndex);
+		void prefetchAll();
+
+		// Drops a frame from the pool after its file was written again so
+		// the next acquire loads the new one. Counts as an eviction.
+		void invalidate(int frameIndex);
+
+		std::string getFramePath(int frameIndex) const;
+		size_t getPoolBytes() const;
+		size_t getPoolSize() const;
+		Stats getStats() const;
+		void resetStats();
+
+	private:
+		enum State{
+			Queued,
+			Loading,
+			Ready,
+			Failed,
+		};
+
+		struct Entry{
+			State state = Queued;
+			std::shared_ptr<const FrameFile> frame;
+			size_t bytes = 0;
+			uint64_t lastUse = 0;
+			bool stale = false;
+		};
+
+		int wrap(int frameIndex) const;
+		void schedule(const std::vector<int> & frames);
+		void evict(size_t neededBytes);
+		void threadedFunction();
+		static std::shared_ptr<const FrameFile> loadFrame(const std::string & path);
+
+		Settings settings;
+		std::map<int, Entry> pool;
+		std::deque<int> queue;
+		std::vector<int> wanted;
+		std::vector<std::thread> threads;
+		mutable std::mutex mutex;
+		std::condition_variable workAvailable;
+		std::condition_variable frameLoaded;
+		size_t poolBytes = 0;
+		uint64_t useCounter = 0;
+		int lastRequested = -1;
+		int direction = 1;
+		bool running = false;
+		Stats stats;
+	};
+}
@@ -0,0 +1,246 @@
+#include "HalfParticles.h"
+#include "tbb/tbb.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define HALF_PARTICLES_F16C 1
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define F16C_TARGET
+	#else
+		#define F16C_TARGET __attribute__((target("avx,f16c")))
+	#endif
+#else
+	#define HALF_PARTICLES_F16C 0
+#endif
+
+static_assert(sizeof(HalfParticle) == 6 * sizeof(uint16_t), "HalfParticle is converted as 6 consecutive halfs");
+
+namespace{
+	constexpr size_t ChunkSize = 1024;
+	constexpr size_t ValuesPerParticle = sizeof(HalfParticle) / sizeof(uint16_t);
+
+	// Smallest normal half, smaller densities are stored as subnormals
+	// and their relative error is not meaningful.
+	constexpr float MinNormalHalf = 6.103515625e-05f;
+
+#if HALF_PARTICLES_F16C
+	F16C_TARGET void toHalfF16C(const float * values, size_t count, uint16_t * out){
+		size_t i = 0;
+		for(; i + 8 <= count; i += 8){
+			auto h = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+		}
+		for(; i < count; ++i){
+			auto h = _mm_cvtps_ph(_mm_set_ss(values[i]), _MM_FROUND_TO_NEAREST_INT);
+			out[i] = uint16_t(_mm_extract_epi16(h, 0));
+		}
+	}
+
+	F16C_TARGET void toFloatF16C(const uint16_t * values, size_t count, float * out){
+		size_t i = 0;
+		for(; i + 8 <= count; i += 8){
+			auto h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+			_mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+		}
+		for(; i < count; ++i){
+			out[i] = _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(values[i])));
+		}
+	}
+#endif
+
+	bool detectF16C(){
+	#if !HALF_PARTICLES_F16C
+		return false;
+	#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool f16c = (info[2] & (1 << 29)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		return f16c && avx && osxsave && (_xgetbv(0) & 6) == 6;
+	#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+	#endif
+	}
+
+	inline uint32_t asUint(float value){
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline float asFloat(uint32_t bits){
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// Round to nearest even like F16C, NaNs keep their payload and
+	// become quiet. Subnormals are rounded by the float addition.
+	inline uint16_t toHalfValue(float value){
+		const uint32_t f16Max = (127 + 16) << 23;
+		const uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+		auto bits = asUint(value);
+		auto sign = bits & 0x80000000u;
+		bits ^= sign;
+		uint32_t half;
+		if(bits >= f16Max){
+			half = bits > 0x7f800000u ? 0x7e00 | ((bits >> 13) & 0x3ff) : 0x7c00;
+		}else if(bits < (113u << 23)){
+			half = asUint(asFloat(bits) + asFloat(denormMagic)) - denormMagic;
+		}else{
+			auto mantissaOdd = (bits >> 13) & 1;
+			bits += (uint32_t(15 - 127) << 23) + 0xfff + mantissaOdd;
+			half = bits >> 13;
+		}
+		return uint16_t(half | (sign >> 16));
+	}
+
+	inline float toFloatValue(uint16_t half){
+		uint32_t sign = uint32_t(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x3ff;
+		if(exponent == 0x1f){
+			return asFloat(sign | 0x7f800000u | (mantissa << 13) | (mantissa ? 0x400000u : 0));
+		}else if(exponent == 0){
+			return asFloat(asUint(mantissa * (1.f / 16777216.f)) | sign);
+		}else{
+			return asFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+		}
+	}
+
+	struct ChunkStats{
+		double maxPositionError = 0;
+		double sumSquaredPositionError = 0;
+		double maxSizeError = 0;
+		double maxDensityError = 0;
+		double maxRelativeDensityError = 0;
+	};
+}
+
+bool HalfParticles::hasF16C(){
+	static const bool f16c = detectF16C();
+	return f16c;
+}
+
+void HalfParticles::toHalf(const float * values, size_t count, uint16_t * out){
+#if HALF_PARTICLES_F16C
+	if(hasF16C()){
+		toHalfF16C(values, count, out);
+		return;
+	}
+#endif
+	toHalfScalar(values, count, out);
+}
+
+void HalfParticles::toFloat(const uint16_t * values, size_t count, float * out){
+#if HALF_PARTICLES_F16C
+	if(hasF16C()){
+		toFloatF16C(values, count, out);
+		return;
+	}
+#endif
+	toFloatScalar(values, count, out);
+}
+
+void HalfParticles::toHalfScalar(const float * values, size_t count, uint16_t * out){
+	for(size_t i = 0; i < count; ++i){
+		out[i] = toHalfValue(values[i]);
+	}
+}
+
+void HalfParticles::toFloatScalar(const uint16_t * values, size_t count, float * out){
+	for(size_t i = 0; i < count; ++i){
+		out[i] = toFloatValue(values[i]);
+	}
+}
+
+HalfParticles::Quantization HalfParticles::getQuantization(const ofxRange3f & box){
+	auto span = box.getSpan();
+	auto maxSpan = std::max(std::max(span.x, span.y), span.z);
+	Quantization quantization;
+	quantization.origin = box.getCenter();
+	quantization.scale = maxSpan > 0 ? 2.f / maxSpan : 1.f;
+	return quantization;
+}
+
+void HalfParticles::encode(const Particle * particles, size_t count, const Quantization & quantization, HalfParticle * out, Stats * stats){
+	auto numChunks = (count + ChunkSize - 1) / ChunkSize;
+	std::vector<ChunkStats> chunkStats(stats ? numChunks : 0);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numChunks, 16), [&](const tbb::blocked_range<size_t> & r){
+		std::vector<float> values(ChunkSize * ValuesPerParticle);
+		std::vector<float> decoded(stats ? values.size() : 0);
+		for(size_t c = r.begin(); c < r.end(); ++c){
+			auto begin = c * ChunkSize;
+			auto end = std::min(count, begin + ChunkSize);
+			auto n = end - begin;
+			for(size_t i = 0; i < n; ++i){
+				auto & p = particles[begin + i];
+				auto v = values.data() + i * ValuesPerParticle;
+				v[0] = (p.pos.x - quantization.origin.x) * quantization.scale;
+				v[1] = (p.pos.y - quantization.origin.y) * quantization.scale;
+				v[2] = (p.pos.z - quantization.origin.z) * quantization.scale;
+				v[3] = 0;
+				v[4] = p.size * quantization.scale;
+				v[5] = p.density;
+			}
+			auto halfs = reinterpret_cast<uint16_t*>(out + begin);
+			toHalf(values.data(), n * ValuesPerParticle, halfs);
+
+			if(!stats){
+				continue;
+			}
+			toFloat(halfs, n * ValuesPerParticle, decoded.data());
+			auto & s = chunkStats[c];
+			for(size_t i = 0; i < n; ++i){
+				auto & p = particles[begin + i];
+				auto v = decoded.data() + i * ValuesPerParticle;
+				glm::vec3 pos(v[0], v[1], v[2]);
+				pos = pos / quantization.scale + quantization.origin;
+				auto positionError = glm::length(pos - p.pos.xyz());
+				s.maxPositionError = std::max(s.maxPositionError, double(positionError));
+				s.sumSquaredPositionError += double(positionError) * positionError;
+				s.maxSizeError = std::max(s.maxSizeError, double(std::abs(v[4] / quantization.scale - p.size)));
+				auto densityError = std::abs(v[5] - p.density);
+				s.maxDensityError = std::max(s.maxDensityError, double(densityError));
+				if(std::abs(p.density) >= MinNormalHalf){
+					s.maxRelativeDensityError = std::max(s.maxRelativeDensityError, double(densityError / std::abs(p.density)));
+				}
+			}
+		}
+	});
+
+	if(stats){
+		*stats = Stats();
+		stats->numParticles = count;
+		double sumSquared = 0;
+		for(auto & s: chunkStats){
+			stats->maxPositionError = std::max(stats->maxPositionError, s.maxPositionError);
+			stats->maxSizeError = std::max(stats->maxSizeError, s.maxSizeError);
+			stats->maxDensityError = std::max(stats->maxDensityError, s.maxDensityError);
+			stats->maxRelativeDensityError = std::max(stats->maxRelativeDensityError, s.maxRelativeDensityError);
+			sumSquared += s.sumSquaredPositionError;
+		}
+		stats->rmsPositionError = count > 0 ? sqrt(sumSquared / count) : 0;
+	}
+}
+
+void HalfParticles::decode(const HalfParticle * particles, size_t count, const Quantization & quantization, Particle * out){
+	auto numChunks = (count + ChunkSize - 1) / ChunkSize;
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numChunks, 16), [&](const tbb::blocked_range<size_t> & r){
+		std::vector<float> values(ChunkSize * ValuesPerParticle);
+		for(size_t c = r.begin(); c < r.end(); ++c){
+			auto begin = c * ChunkSize;
+			auto end = std::min(count, begin + ChunkSize);
+			auto n = end - begin;
+			toFloat(reinterpret_cast<const uint16_t*>(particles + begin), n * ValuesPerParticle, values.data());
+			for(size_t i = 0; i < n; ++i){
+				auto v = values.data() + i * ValuesPerParticle;
+				glm::vec3 pos(v[0], v[1], v[2]);
+				out[begin + i] = Particle(pos / quantization.scale + quantization.origin, v[4] / quantization.scale, v[5]);
+			}
+		}
+	});
+}
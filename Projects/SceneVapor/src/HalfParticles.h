@@ -0,0 +1,54 @@
+#ifndef HALF_PARTICLES_H
+#define HALF_PARTICLES_H
+
+#include "ofConstants.h"
+#include "ofVectorMath.h"
+#include "ofxRange.h"
+#include "Particle.h"
+
+// Converts particles to and from HalfParticle. Positions and sizes are
+// stored relative to the box the particles were filtered with, mapped
+// to [-1, 1] so every particle keeps the same absolute precision, about
+// span / 8192, instead of the precision of its world coordinates.
+// Densities are stored as they are.
+//
+// The float <-> half conversion uses F16C, 8 values per instruction,
+// when the cpu supports it and a scalar fallback otherwise. Both round
+// to nearest so files written on either path are the same.
+class HalfParticles
+{
+public:
+	// Stored next to the particles, a decoded position is
+	// pos / scale + origin.
+	struct Quantization{
+		glm::vec3 origin;
+		float scale;
+	};
+
+	struct Stats{
+		size_t numParticles = 0;
+		double maxPositionError = 0;
+		double rmsPositionError = 0;
+		double maxSizeError = 0;
+		double maxDensityError = 0;
+		double maxRelativeDensityError = 0;
+	};
+
+	static Quantization getQuantization(const ofxRange3f & box);
+
+	static void encode(const Particle * particles, size_t count, const Quantization & quantization, HalfParticle * out, Stats * stats = nullptr);
+	static void decode(const HalfParticle * particles, size_t count, const Quantization & quantization, Particle * out);
+
+	static void toHalf(const float * values, size_t count, uint16_t * out);
+	static void toFloat(const uint16_t * values, size_t count, float * out);
+	static bool hasF16C();
+
+	// The fallback toHalf and toFloat use without F16C, to check one
+	// against the other.
+	static void toHalfScalar(const float * values, size_t count, uint16_t * out);
+	static void toFloatScalar(const uint16_t * values, size_t count, float * out);
+};
+
+static_assert(sizeof(HalfParticles::Quantization) == 16, "HalfParticles::Quantization is written as is to disk");
+
+#endif // HALF_PARTICLES_H
@@ -0,0 +1,374 @@
+#include "LinearVaporOctree.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include "of3dGraphics.h"
+#include "ofGraphics.h"
+#include "ofTrueTypeFont.h"
+#include "ofCamera.h"
+#include "ofUtils.h"
+#include "ofxEasing.h"
+#include "Helpers.h"
+#include "Billboard.h"
+#include "tbb/tbb.h"
+
+namespace{
+	inline uint64_t spreadBits(uint64_t v){
+		v &= 0x1fffff;
+		v = (v | v << 32) & 0x1f00000000ffff;
+		v = (v | v << 16) & 0x1f0000ff0000ff;
+		v = (v | v << 8) & 0x100f00f00f00f00f;
+		v = (v | v << 4) & 0x10c30c30c30c30c3;
+		v = (v | v << 2) & 0x1249249249249249;
+		return v;
+	}
+
+	inline uint32_t compactBits(uint64_t v){
+		v &= 0x1249249249249249;
+		v = (v ^ (v >> 2)) & 0x10c30c30c30c30c3;
+		v = (v ^ (v >> 4)) & 0x100f00f00f00f00f;
+		v = (v ^ (v >> 8)) & 0x1f0000ff0000ff;
+		v = (v ^ (v >> 16)) & 0x1f00000000ffff;
+		v = (v ^ (v >> 32)) & 0x1fffff;
+		return v;
+	}
+
+	// x goes in the most significant bit of every triplet so the 3 bits
+	// of a level are the child index in the same order VaporOctree uses.
+	inline uint64_t morton(uint32_t x, uint32_t y, uint32_t z){
+		return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+	}
+
+	template<typename T>
+	void radixSort(std::vector<T> & items, std::vector<T> & tmp){
+		// Blocks have a fixed size so the sort is stable and the result
+		// doesn't depend on the number of threads.
+		const size_t BlockSize = 65536;
+		size_t numBlocks = (items.size() + BlockSize - 1) / BlockSize;
+		std::vector<std::array<uint32_t,256>> offsets(numBlocks);
+		tmp.resize(items.size());
+
+		for(size_t shift = 0; shift < 64; shift += 8){
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1), [&](const tbb::blocked_range<size_t> & r){
+				for(size_t block = r.begin(); block < r.end(); ++block){
+					auto & histogram = offsets[block];
+					histogram.fill(0);
+					auto end = std::min(items.size(), (block + 1) * BlockSize);
+					for(size_t i = block * BlockSize; i < end; ++i){
+						histogram[(items[i].key >> shift) & 0xff] += 1;
+					}
+				}
+			});
+
+			uint32_t total = 0;
+			bool skip = false;
+			for(size_t digit = 0; digit < 256; ++digit){
+				uint32_t digitTotal = 0;
+				for(size_t block = 0; block < numBlocks; ++block){
+					auto count = offsets[block][digit];
+					offsets[block][digit] = total;
+					total += count;
+					digitTotal += count;
+				}
+				// Every key has the same digit, this pass wouldn't move anything.
+				skip |= digitTotal == items.size();
+			}
+			if(skip){
+				continue;
+			}
+
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1), [&](const tbb::blocked_range<size_t> & r){
+				for(size_t block = r.begin(); block < r.end(); ++block){
+					auto & offset = offsets[block];
+					auto end = std::min(items.size(), (block + 1) * BlockSize);
+					for(size_t i = block * BlockSize; i < end; ++i){
+						tmp[offset[(items[i].key >> shift) & 0xff]++] = items[i];
+					}
+				}
+			});
+			std::swap(items, tmp);
+		}
+	}
+}
+
+void LinearVaporOctree::setup(const std::vector<Particle> & particles){
+	if(firstFrame){
+		glm::vec3 min{std::numeric_limits<float>::max()};
+		glm::vec3 max{std::numeric_limits<float>::lowest()};
+		for(auto & p: particles){
+			min = glm::min(min, p.getMinPos());
+			max = glm::max(max, p.getMaxPos());
+		}
+		bb = BoundingBox::fromMinMax(min, max);
+		firstFrame = false;
+	}
+
+	const float cells = float(1 << MaxDepth);
+	glm::vec3 toCells = cells / bb.size;
+	sorted.resize(particles.size());
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particles.size()), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t i = r.begin(); i < r.end(); ++i){
+			auto cell = glm::clamp((particles[i].pos.xyz() - bb.min) * toCells, glm::vec3(0), glm::vec3(cells - 1));
+			sorted[i] = {morton(cell.x, cell.y, cell.z), uint32_t(i)};
+		}
+	});
+
+	std::vector<KeyIndex> tmp;
+	radixSort(sorted, tmp);
+
+	keys.resize(sorted.size());
+	densityPrefix.resize(sorted.size() + 1);
+	densityPrefix[0] = 0;
+	for(size_t i = 0; i < sorted.size(); ++i){
+		keys[i] = sorted[i].key;
+		densityPrefix[i + 1] = densityPrefix[i] + particles[sorted[i].index].density;
+	}
+	nodes.clear();
+}
+
+void LinearVaporOctree::setBoundingBox(const BoundingBox & bb){
+	this->bb = bb;
+	firstFrame = false;
+}
+
+void LinearVaporOctree::compute(size_t resolution, float minDensity, float maxDensity){
+	this->resolution = std::min(resolution, MaxDepth);
+	float span = maxDensity - minDensity;
+	float thresDensity = minDensity + span * 0.002f;
+
+	nodes.clear();
+	nodes.push_back({0, 0, uint32_t(keys.size()), -1, float(densityPrefix.back()), 0, false});
+	maxLevel = 0;
+
+	size_t levelBegin = 0;
+	size_t levelEnd = 1;
+	std::vector<uint32_t> childOffsets;
+	for(size_t level = 0; levelBegin < levelEnd; ++level){
+		auto numNodes = levelEnd - levelBegin;
+		childOffsets.resize(numNodes + 1);
+		childOffsets[0] = 0;
+		for(size_t i = 0; i < numNodes; ++i){
+			auto & node = nodes[levelBegin + i];
+			node.hasParticles = node.density >= thresDensity && node.end > node.begin;
+			auto divides = node.hasParticles && level < this->resolution;
+			childOffsets[i + 1] = childOffsets[i] + (divides ? 8 : 0);
+		}
+		if(childOffsets[numNodes] == 0){
+			break;
+		}
+		maxLevel = level + 1;
+
+		nodes.resize(levelEnd + childOffsets[numNodes]);
+		auto shift = 63 - 3 * (level + 1);
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, numNodes), [&](const tbb::blocked_range<size_t> & r){
+			for(size_t i = r.begin(); i < r.end(); ++i){
+				if(childOffsets[i + 1] == childOffsets[i]){
+					continue;
+				}
+				auto & node = nodes[levelBegin + i];
+				node.firstChild = levelEnd + childOffsets[i];
+				auto begin = keys.begin() + node.begin;
+				auto end = keys.begin() + node.end;
+				for(uint64_t c = 0; c < 8; ++c){
+					auto code = (node.code << 3) | c;
+					auto childBegin = std::lower_bound(begin, end, code << shift);
+					auto childEnd = c == 7 ? end : std::lower_bound(childBegin, end, (code + 1) << shift);
+					Node child;
+					child.code = code;
+					child.begin = childBegin - keys.begin();
+					child.end = childEnd - keys.begin();
+					child.firstChild = -1;
+					child.density = densityPrefix[child.end] - densityPrefix[child.begin];
+					child.level = level + 1;
+					child.hasParticles = false;
+					nodes[node.firstChild + c] = child;
+					begin = childEnd;
+				}
+			}
+		});
+
+		levelBegin = levelEnd;
+		levelEnd = nodes.size();
+	}
+}
+
+bool LinearVaporOctree::isLeaf(const Node & node) const{
+	return node.firstChild < 0;
+}
+
+size_t LinearVaporOctree::meshLevel(const Node & node) const{
+	// VaporOctree numbers the children of the root as level 0 too,
+	// keep the same numbering so minLevel means the same in both.
+	return node.level > 0 ? node.level - 1 : 0;
+}
+
+glm::uvec3 LinearVaporOctree::cell(const Node & node) const{
+	return {compactBits(node.code >> 2), compactBits(node.code >> 1), compactBits(node.code)};
+}
+
+BoundingBox LinearVaporOctree::boundingBox(const Node & node) const{
+	auto cellSize = bb.size / float(1 << node.level);
+	auto min = bb.min + glm::vec3(cell(node)) * cellSize;
+	return BoundingBox::fromMinMax(min, min + cellSize);
+}
+
+float LinearVaporOctree::getDensity() const{
+	return nodes.empty() ? 0.f : nodes[0].density;
+}
+
+ofMesh LinearVaporOctree::getMesh(float minDensity, float maxDensity, VaporOctree::MeshSort meshsort, int minLevel) const{
+	std::vector<const Node*> leafs;
+	for(auto & node: nodes){
+		if(isLeaf(node) && int(meshLevel(node)) >= minLevel){
+			leafs.push_back(&node);
+		}
+	}
+
+	switch (meshsort) {
+		case VaporOctree::SizeLargerFirst:
+			std::sort(leafs.begin(), leafs.end(), [&](const Node * o1, const Node * o2){
+				return meshLevel(*o1) < meshLevel(*o2);
+			});
+		break;
+		case VaporOctree::SizeSmallerFirst:
+			std::sort(leafs.begin(), leafs.end(), [&](const Node * o1, const Node * o2){
+				return meshLevel(*o1) > meshLevel(*o2);
+			});
+		break;
+		case VaporOctree::DensityLargerFirst:
+			std::sort(leafs.begin(), leafs.end(), [&](const Node * o1, const Node * o2){
+				return o1->density * meshLevel(*o1) > o2->density * meshLevel(*o2);
+			});
+		break;
+		case VaporOctree::DensitySmallerFirst:
+			std::sort(leafs.begin(), leafs.end(), [&](const Node * o1, const Node * o2){
+				return o1->density * meshLevel(*o1) < o2->density * meshLevel(*o2);
+			});
+		break;
+	}
+
+	ofMesh mesh;
+	mesh.setMode( OF_PRIMITIVE_LINES );
+	for(auto leaf: leafs){
+		ofFloatColor color;
+		if(!leaf->hasParticles){
+			color.set(1, 0.5);
+		}else{
+			auto alpha = ofxeasing::map(leaf->density, minDensity, maxDensity, 0.5, 1, ofxeasing::sine::easeIn);
+			color.set(1., alpha);
+		}
+		auto box = boundingBox(*leaf);
+		mesh.append(entropy::boxWireframe(box.center, box.size, color));
+	}
+	return mesh;
+}
+
+void LinearVaporOctree::drawLeafs(float minDensity, float maxDensity) const {
+	getMesh(minDensity, maxDensity, VaporOctree::DensityLargerFirst, 0).draw();
+}
+
+void LinearVaporOctree::drawDensities(const ofTrueTypeFont & ttf, const ofCamera & camera, const glm::mat4 & model, float minDensity, float maxDensity) const{
+	for(auto & node: nodes){
+		if(!isLeaf(node)){
+			continue;
+		}
+		if(!node.hasParticles){
+			ofSetColor(255, 60);
+		}else{
+			auto alpha = ofMap(node.density, minDensity, maxDensity, 50, 90);
+			ofSetColor(255, alpha);
+		}
+		billboard(ttf, ofToString(node.density), camera.getProjectionMatrix(), camera.getModelViewMatrix() * model, boundingBox(node).center);
+	}
+}
+
+size_t LinearVaporOctree::getMaxLevel() const {
+	return maxLevel;
+}
+
+size_t LinearVaporOctree::size() const {
+	size_t size = 0;
+	for(auto & node: nodes){
+		if(isLeaf(node) && node.hasParticles){
+			size += node.end - node.begin;
+		}
+	}
+	return size;
+}
+
+size_t LinearVaporOctree::getNumNodes() const {
+	return nodes.size();
+}
+
+std::vector <Particle> LinearVaporOctree::toVector() const {
+	std::vector<Particle> particles;
+	for(auto & node: nodes){
+		if(isLeaf(node) && node.hasParticles){
+			auto box = boundingBox(node);
+			particles.emplace_back(box.center, std::max(box.size.x, std::max(box.size.y, box.size.z)), node.density);
+		}
+	}
+	return particles;
+}
+
+ofFloatPixels LinearVaporOctree::getPixels(size_t z, float minDensity, float maxDensity) const {
+	ofFloatPixels pixels;
+	size_t size = 1 << resolution;
+	pixels.allocate(size, size, 1);
+	rasterize(glm::uvec3(0, 0, z), glm::uvec3(size, size, z + 1), VaporOctree::Occupancy, pixels.getData(), size, size * size);
+	return pixels;
+}
+
+void LinearVaporOctree::rasterize(const glm::uvec3 & min, const glm::uvec3 & max, VaporOctree::RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const{
+	if(nodes.empty() || min.x >= max.x || min.y >= max.y || min.z >= max.z){
+		return;
+	}
+	rasterize(nodes[0], min, max - glm::uvec3(1), min, mode, voxels, rowStride, sliceStride);
+}
+
+void LinearVaporOctree::rasterize(const Node & node, const glm::uvec3 & lo, const glm::uvec3 & hi, const glm::uvec3 & origin, VaporOctree::RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const{
+	if(isLeaf(node)){
+		float value = mode == VaporOctree::Occupancy ? (node.density > 0 ? 1.0 : 0.0) : node.density;
+		for(size_t z = lo.z; z <= hi.z; ++z){
+			for(size_t y = lo.y; y <= hi.y; ++y){
+				auto row = voxels + (z - origin.z) * sliceStride + (y - origin.y) * rowStride;
+				std::fill(row + (lo.x - origin.x), row + (hi.x - origin.x + 1), value);
+			}
+		}
+		return;
+	}
+
+	auto childSize = (1u << resolution) >> (node.level + 1);
+	for(size_t i = 0; i < 8; ++i){
+		auto & child = nodes[node.firstChild + i];
+		auto childMin = cell(child) * childSize;
+		auto childLo = glm::max(lo, childMin);
+		auto childHi = glm::min(hi, childMin + glm::uvec3(childSize - 1));
+		if(childLo.x <= childHi.x && childLo.y <= childHi.y && childLo.z <= childHi.z){
+			rasterize(child, childLo, childHi, origin, mode, voxels, rowStride, sliceStride);
+		}
+	}
+}
+
+std::vector<float> LinearVaporOctree::getVoxels(VaporOctree::RasterMode mode) const{
+	return std::move(getVoxelsPyramid(mode, 1).front());
+}
+
+std::vector<std::vector<float>> LinearVaporOctree::getVoxelsPyramid(VaporOctree::RasterMode mode, size_t numLevels) const{
+	return rasterizeVoxelsPyramid(resolution, numLevels, [&](const glm::uvec3 & min, const glm::uvec3 & max, float * voxels, size_t rowStride, size_t sliceStride){
+		rasterize(min, max, mode, voxels, rowStride, sliceStride);
+	});
+}
+
+float LinearVaporOctree::getDensity(size_t x, size_t y, size_t z) const {
+	if(nodes.empty()){
+		return 0;
+	}
+	const Node * node = &nodes[0];
+	while(!isLeaf(*node)){
+		auto bit = resolution - 1 - node->level;
+		auto child = (((x >> bit) & 1) << 2) | (((y >> bit) & 1) << 1) | ((z >> bit) & 1);
+		node = &nodes[node->firstChild + child];
+	}
+	return node->density;
+}
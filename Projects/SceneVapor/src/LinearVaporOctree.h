@@ -0,0 +1,70 @@
+#ifndef LINEAR_VAPOR_OCTREE_H
+#define LINEAR_VAPOR_OCTREE_H
+
+#include "ofConstants.h"
+#include "ofVectorMath.h"
+#include "ofPixels.h"
+#include "Particle.h"
+#include "ofMesh.h"
+#include "VaporOctree.h"
+
+// Same subdivision as VaporOctree but built from the particles sorted
+// by their 63bit Morton key instead of moving indices down a pointer
+// tree. Nodes live in a flat array ordered level by level, children of
+// a node are contiguous and every node references a contiguous range
+// of the sorted particles so there's no per node allocation.
+class LinearVaporOctree
+{
+	public:
+		void setup(const std::vector<Particle> & particles);
+		void setBoundingBox(const BoundingBox & bb);
+		void compute(size_t resolution, float minDensity, float maxDensity);
+		float getDensity() const;
+		void drawLeafs(float minDensity, float maxDensity) const;
+		void drawDensities(const ofTrueTypeFont & ttf, const ofCamera & camera, const glm::mat4 & model, float minDensity, float maxDensity) const;
+		size_t getMaxLevel() const;
+		size_t size() const;
+		size_t getNumNodes() const;
+		std::vector<Particle> toVector() const;
+		ofFloatPixels getPixels(size_t z, float minDensity, float maxDensity) const;
+		float getDensity(size_t x, size_t y, size_t z) const;
+		ofMesh getMesh(float minDensity, float maxDensity, VaporOctree::MeshSort meshsort, int minLevel) const;
+		void rasterize(const glm::uvec3 & min, const glm::uvec3 & max, VaporOctree::RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const;
+		std::vector<float> getVoxels(VaporOctree::RasterMode mode) const;
+		std::vector<std::vector<float>> getVoxelsPyramid(VaporOctree::RasterMode mode, size_t numLevels) const;
+
+	private:
+		static constexpr size_t MaxDepth = 21;
+
+		struct KeyIndex{
+			uint64_t key;
+			uint32_t index;
+		};
+
+		struct Node{
+			uint64_t code;
+			uint32_t begin;
+			uint32_t end;
+			int32_t firstChild;
+			float density;
+			uint8_t level;
+			bool hasParticles;
+		};
+
+		bool isLeaf(const Node & node) const;
+		size_t meshLevel(const Node & node) const;
+		glm::uvec3 cell(const Node & node) const;
+		BoundingBox boundingBox(const Node & node) const;
+		void rasterize(const Node & node, const glm::uvec3 & lo, const glm::uvec3 & hi, const glm::uvec3 & origin, VaporOctree::RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const;
+
+		std::vector<KeyIndex> sorted;
+		std::vector<uint64_t> keys;
+		std::vector<double> densityPrefix;
+		std::vector<Node> nodes;
+		BoundingBox bb;
+		size_t resolution = 0;
+		size_t maxLevel = 0;
+		bool firstFrame = true;
+};
+
+#endif // LINEAR_VAPOR_OCTREE_H
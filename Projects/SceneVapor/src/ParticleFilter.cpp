@@ -0,0 +1,151 @@
+#include "ParticleFilter.h"
+#include "tbb/tbb.h"
+
+namespace{
+	inline bool inside(const glm::vec3 & p, const glm::vec3 & min, const glm::vec3 & max){
+		return p.x>=min.x && p.y>=min.y && p.z>=min.z && p.x<=max.x && p.y<=max.y && p.z<=max.z;
+	}
+}
+
+void ParticleFilter::process(const Columns & input, const Settings & settings){
+	auto numChunks = (input.count + ChunkSize - 1) / ChunkSize;
+	chunks.resize(numChunks);
+	auto keep = settings.outputParticles || settings.outputColumns;
+	auto boxMin = settings.box.getMin();
+	auto boxMax = settings.box.getMax();
+
+	//------------------------------------
+	// Ranges, histogram and kept particles per chunk
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numChunks, 1), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t c = r.begin(); c < r.end(); ++c){
+			auto & chunk = chunks[c];
+			chunk.minCoord = glm::vec3(std::numeric_limits<float>::max());
+			chunk.maxCoord = glm::vec3(std::numeric_limits<float>::lowest());
+			chunk.minThreshold = chunk.minCoord;
+			chunk.maxThreshold = chunk.maxCoord;
+			chunk.minSize = chunk.minDensity = std::numeric_limits<float>::max();
+			chunk.maxSize = chunk.maxDensity = std::numeric_limits<float>::lowest();
+			chunk.aboveThreshold = false;
+			chunk.histogram.fill(0);
+			chunk.kept.assign(ChunkSize / 64, 0);
+			chunk.numKept = 0;
+
+			auto end = std::min(input.count, (c + 1) * ChunkSize);
+			for(size_t i = c * ChunkSize; i < end; ++i){
+				glm::vec3 pos(input.x[i], input.y[i], input.z[i]);
+				auto size = input.size[i];
+				auto density = input.density[i];
+
+				chunk.minCoord = glm::min(chunk.minCoord, pos);
+				chunk.maxCoord = glm::max(chunk.maxCoord, pos);
+				chunk.minSize = std::min(chunk.minSize, size);
+				chunk.maxSize = std::max(chunk.maxSize, size);
+				chunk.minDensity = std::min(chunk.minDensity, density);
+				chunk.maxDensity = std::max(chunk.maxDensity, density);
+				chunk.histogram[histogramBin(density)] += 1;
+				if(density > settings.densityThreshold){
+					chunk.minThreshold = glm::min(chunk.minThreshold, pos);
+					chunk.maxThreshold = glm::max(chunk.maxThreshold, pos);
+					chunk.aboveThreshold = true;
+				}
+
+				if(!keep){
+					continue;
+				}
+				if(settings.filter){
+					glm::vec3 halfSize(size * 0.5f);
+					if(!inside(pos + halfSize, boxMin, boxMax) ||
+					   !inside(pos - halfSize, boxMin, boxMax) ||
+					   size * settings.scale > settings.maxScaledSize){
+						continue;
+					}
+				}
+				auto bit = i - c * ChunkSize;
+				chunk.kept[bit / 64] |= uint64_t(1) << (bit % 64);
+				chunk.numKept += 1;
+			}
+		}
+	});
+
+	//------------------------------------
+	// Merge
+	stats.coordRange.clear();
+	stats.sizeRange.clear();
+	stats.densityRange.clear();
+	stats.thresholdRange.clear();
+	stats.densityHistogram.fill(0);
+	stats.numParticles = input.count;
+	size_t total = 0;
+	for(auto & chunk: chunks){
+		stats.coordRange.add(chunk.minCoord);
+		stats.coordRange.add(chunk.maxCoord);
+		stats.sizeRange.add(chunk.minSize);
+		stats.sizeRange.add(chunk.maxSize);
+		stats.densityRange.add(chunk.minDensity);
+		stats.densityRange.add(chunk.maxDensity);
+		if(chunk.aboveThreshold){
+			stats.thresholdRange.add(chunk.minThreshold);
+			stats.thresholdRange.add(chunk.maxThreshold);
+		}
+		for(size_t bin = 0; bin < HistogramBins; ++bin){
+			stats.densityHistogram[bin] += chunk.histogram[bin];
+		}
+		chunk.offset = total;
+		total += chunk.numKept;
+	}
+	stats.numKept = total;
+
+	//------------------------------------
+	// Gather the kept particles from the input using the chunk masks
+	particles.resize(settings.outputParticles ? total : 0);
+	for(auto * column: {&columns.x, &columns.y, &columns.z, &columns.size, &columns.density}){
+		column->resize(settings.outputColumns ? total : 0);
+	}
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numChunks, 1), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t c = r.begin(); c < r.end(); ++c){
+			auto & chunk = chunks[c];
+			auto offset = chunk.offset;
+			for(size_t word = 0; word < chunk.kept.size(); ++word){
+				auto bits = chunk.kept[word];
+				for(size_t i = c * ChunkSize + word * 64; bits != 0; ++i, bits >>= 1){
+					if((bits & 1) == 0){
+						continue;
+					}
+					if(settings.outputParticles){
+						particles[offset] = Particle({input.x[i], input.y[i], input.z[i]}, input.size[i], input.density[i]);
+					}
+					if(settings.outputColumns){
+						columns.x[offset] = input.x[i];
+						columns.y[offset] = input.y[i];
+						columns.z[offset] = input.z[i];
+						columns.size[offset] = input.size[i];
+						columns.density[offset] = input.density[i];
+					}
+					offset += 1;
+				}
+			}
+		}
+	});
+}
+
+const ParticleFilter::Stats & ParticleFilter::getStats() const{
+	return stats;
+}
+
+const std::vector<Particle> & ParticleFilter::getParticles() const{
+	return particles;
+}
+
+std::vector<Particle> & ParticleFilter::getParticles(){
+	return particles;
+}
+
+const ParticleFilter::OutputColumns & ParticleFilter::getColumns() const{
+	return columns;
+}
+
+size_t ParticleFilter::histogramBin(float density){
+	uint32_t bits;
+	memcpy(&bits, &density, sizeof(bits));
+	return (bits >> 23) & 0xff;
+}
@@ -0,0 +1,96 @@
+#ifndef PARTICLE_FILTER_H
+#define PARTICLE_FILTER_H
+
+#include "ofConstants.h"
+#include "ofVectorMath.h"
+#include "ofxRange.h"
+#include "Particle.h"
+
+// Single parallel pass over the particle columns as they come from the
+// HDF5 files. In one read it computes the ranges of every column, a
+// density histogram and the range of the particles above a density
+// threshold, and marks the particles that fit in a box. The marked
+// particles are then gathered as Particle and optionally as columns.
+//
+// Particles are processed in fixed size chunks so the output keeps the
+// input order and is the same no matter how many threads run.
+class ParticleFilter
+{
+public:
+	struct Columns{
+		const float * x;
+		const float * y;
+		const float * z;
+		const float * size;
+		const float * density;
+		size_t count;
+	};
+
+	struct OutputColumns{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> size;
+		std::vector<float> density;
+	};
+
+	struct Settings{
+		// Only particles with density over this contribute to
+		// Stats::thresholdRange.
+		float densityThreshold = std::numeric_limits<float>::max();
+
+		// Particles whose cell is not completely inside box or whose
+		// size * scale is bigger than maxScaledSize are dropped.
+		bool filter = false;
+		ofxRange3f box;
+		float scale = 1;
+		float maxScaledSize = std::numeric_limits<float>::max();
+
+		bool outputParticles = true;
+		bool outputColumns = false;
+	};
+
+	// One bin per float exponent, densities are binned by powers of 2.
+	static constexpr size_t HistogramBins = 256;
+
+	struct Stats{
+		ofxRange3f coordRange;
+		ofxRange1f sizeRange;
+		ofxRange1f densityRange;
+		ofxRange3f thresholdRange;
+		std::array<size_t, HistogramBins> densityHistogram;
+		size_t numParticles;
+		size_t numKept;
+	};
+
+	static constexpr size_t ChunkSize = 65536;
+
+	void process(const Columns & columns, const Settings & settings);
+
+	const Stats & getStats() const;
+	const std::vector<Particle> & getParticles() const;
+	std::vector<Particle> & getParticles();
+	const OutputColumns & getColumns() const;
+
+	static size_t histogramBin(float density);
+
+private:
+	struct Chunk{
+		glm::vec3 minCoord, maxCoord;
+		glm::vec3 minThreshold, maxThreshold;
+		float minSize, maxSize;
+		float minDensity, maxDensity;
+		bool aboveThreshold;
+		std::array<uint32_t, HistogramBins> histogram;
+		std::vector<uint64_t> kept;
+		size_t numKept;
+		size_t offset;
+	};
+
+	std::vector<Chunk> chunks;
+	std::vector<Particle> particles;
+	OutputColumns columns;
+	Stats stats;
+};
+
+#endif // PARTICLE_FILTER_H
@@ -0,0 +1,139 @@
+#include "ParticleGrouper.h"
+#include "VoxelFootprint.h"
+#include "tbb/tbb.h"
+#include <numeric>
+
+void ParticleGrouper::group(std::vector<Particle> & particles, const glm::vec3 & offset, float scale, size_t size, std::vector<size_t> & groupIndices){
+	int isize = int(size);
+	stats = Stats();
+	stats.numParticles = particles.size();
+	groupIndices.clear();
+
+	//------------------------------------
+	// Voxel footprint of every particle, same as the compute shader
+	// splats them: doubled size and a single voxel for small particles.
+	footprints.resize(particles.size());
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particles.size()), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t i = r.begin(); i < r.end(); ++i){
+			auto & particle = particles[i];
+			auto & footprint = footprints[i];
+			glm::vec3 pos = (particle.pos.xyz() + offset) * scale;
+			float psize = particle.size * scale * 2;
+			voxel::footprintRange(pos, psize, isize, footprint.min, footprint.max);
+		}
+	});
+
+	auto bricksPerSide = (size + BrickSize - 1) / BrickSize;
+	if(bricksPerSide != this->bricksPerSide){
+		this->bricksPerSide = bricksPerSide;
+		brickIndices.assign(bricksPerSide * bricksPerSide * bricksPerSide, -1);
+		brickPasses.clear();
+		brickMasks.clear();
+	}
+
+	//------------------------------------
+	// First fit colouring, GroupsPerPass colours at a time.
+	colors.resize(particles.size());
+	std::vector<uint32_t> pending(particles.size());
+	std::vector<uint32_t> deferred;
+	std::iota(pending.begin(), pending.end(), 0);
+	uint32_t numColors = 0;
+	for(uint32_t base = 0; !pending.empty(); base += GroupsPerPass){
+		if(pass == std::numeric_limits<uint32_t>::max()){
+			std::fill(brickPasses.begin(), brickPasses.end(), 0);
+			pass = 0;
+		}
+		pass += 1;
+		stats.numPasses += 1;
+
+		deferred.clear();
+		for(auto i: pending){
+			auto & footprint = footprints[i];
+			auto mask = occupied(footprint);
+			if(mask == std::numeric_limits<uint32_t>::max()){
+				deferred.push_back(i);
+				continue;
+			}
+			uint32_t bit = 0;
+			while(mask & (1u << bit)){
+				++bit;
+			}
+			occupy(footprint, 1u << bit);
+			colors[i] = base + bit;
+			numColors = std::max(numColors, colors[i] + 1);
+		}
+		std::swap(pending, deferred);
+	}
+	stats.numGroups = numColors;
+	stats.numBricks = brickPasses.size();
+
+	//------------------------------------
+	// Stable counting sort by colour. First fit never skips a colour so
+	// no group is empty.
+	std::vector<size_t> offsets(numColors + 1, 0);
+	for(auto color: colors){
+		offsets[color + 1] += 1;
+	}
+	for(size_t color = 0; color < numColors; ++color){
+		offsets[color + 1] += offsets[color];
+		groupIndices.push_back(offsets[color + 1]);
+	}
+	std::vector<Particle> grouped(particles.size());
+	for(size_t i = 0; i < particles.size(); ++i){
+		grouped[offsets[colors[i]]++] = particles[i];
+	}
+	std::swap(particles, grouped);
+}
+
+uint32_t * ParticleGrouper::brick(size_t x, size_t y, size_t z){
+	auto b = ((z / BrickSize) * bricksPerSide + y / BrickSize) * bricksPerSide + x / BrickSize;
+	const size_t voxelsPerBrick = BrickSize * BrickSize * BrickSize;
+	auto idx = brickIndices[b];
+	if(idx < 0){
+		idx = brickPasses.size();
+		brickIndices[b] = idx;
+		brickPasses.push_back(pass);
+		brickMasks.resize(brickMasks.size() + voxelsPerBrick, 0);
+	}else if(brickPasses[idx] != pass){
+		brickPasses[idx] = pass;
+		std::fill(brickMasks.begin() + idx * voxelsPerBrick, brickMasks.begin() + (idx + 1) * voxelsPerBrick, 0);
+	}
+	return brickMasks.data() + idx * voxelsPerBrick;
+}
+
+uint32_t ParticleGrouper::occupied(const Footprint & footprint){
+	uint32_t mask = 0;
+	for(size_t z = footprint.min[2]; z < footprint.max[2]; ++z){
+		for(size_t y = footprint.min[1]; y < footprint.max[1]; ++y){
+			for(size_t x = footprint.min[0]; x < footprint.max[0];){
+				auto row = brick(x, y, z) + ((z % BrickSize) * BrickSize + y % BrickSize) * BrickSize;
+				auto end = std::min<size_t>(footprint.max[0], (x / BrickSize + 1) * BrickSize);
+				for(; x < end; ++x){
+					mask |= row[x % BrickSize];
+				}
+			}
+			if(mask == std::numeric_limits<uint32_t>::max()){
+				return mask;
+			}
+		}
+	}
+	return mask;
+}
+
+void ParticleGrouper::occupy(const Footprint & footprint, uint32_t bit){
+	for(size_t z = footprint.min[2]; z < footprint.max[2]; ++z){
+		for(size_t y = footprint.min[1]; y < footprint.max[1]; ++y){
+			for(size_t x = footprint.min[0]; x < footprint.max[0];){
+				auto row = brick(x, y, z) + ((z % BrickSize) * BrickSize + y % BrickSize) * BrickSize;
+				auto end = std::min<size_t>(footprint.max[0], (x / BrickSize + 1) * BrickSize);
+				for(; x < end; ++x){
+					row[x % BrickSize] |= bit;
+				}
+			}
+		}
+	}
+}
+
+const ParticleGrouper::Stats & ParticleGrouper::getStats() const{
+	return stats;
+}
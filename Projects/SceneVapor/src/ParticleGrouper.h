@@ -0,0 +1,57 @@
+#ifndef PARTICLE_GROUPER_H
+#define PARTICLE_GROUPER_H
+
+#include "ofConstants.h"
+#include "ofVectorMath.h"
+#include "Particle.h"
+
+// Splits particles into groups with no two particles of the same group
+// touching the same voxel so every group can be splatted by
+// shaders/particles2texture3d.glsl without write conflicts.
+//
+// Particles are first fit coloured in their original order. Every pass
+// assigns up to 32 groups at once using a bitmask per voxel, so a
+// snapshot needing n groups takes n/32 passes instead of n. Occupancy
+// is kept in 8³ voxel bricks that are only allocated where particles
+// land and are stamped with the pass that last cleared them, so
+// starting a new pass doesn't touch the whole grid.
+class ParticleGrouper
+{
+public:
+	struct Stats{
+		size_t numParticles = 0;
+		size_t numGroups = 0;
+		size_t numPasses = 0;
+		size_t numBricks = 0;
+	};
+
+	static constexpr size_t BrickSize = 8;
+	static constexpr size_t GroupsPerPass = 32;
+
+	// Reorders particles group by group, keeping the original order
+	// inside each group. groupIndices receives the end of every group.
+	void group(std::vector<Particle> & particles, const glm::vec3 & offset, float scale, size_t size, std::vector<size_t> & groupIndices);
+
+	const Stats & getStats() const;
+
+private:
+	struct Footprint{
+		uint16_t min[3];
+		uint16_t max[3];
+	};
+
+	uint32_t * brick(size_t x, size_t y, size_t z);
+	uint32_t occupied(const Footprint & footprint);
+	void occupy(const Footprint & footprint, uint32_t bit);
+
+	std::vector<Footprint> footprints;
+	std::vector<uint32_t> colors;
+	std::vector<int32_t> brickIndices;
+	std::vector<uint32_t> brickPasses;
+	std::vector<uint32_t> brickMasks;
+	size_t bricksPerSide = 0;
+	uint32_t pass = 0;
+	Stats stats;
+};
+
+#endif // PARTICLE_GROUPER_H
@@ -45,6 +45,31 @@ namespace ent
 		m_startIndex = startIndex;
 		m_endIndex = endIndex;
 
+		FramePrefetcher::Settings prefetcherSettings;
+		prefetcherSettings.folder = m_folder;
+		prefetcherSettings.startIndex = startIndex;
+		prefetcherSettings.numFrames = endIndex - startIndex;
+		m_prefetcher.setup(prefetcherSettings);
+
+#if USE_VOXELS_CODEC
+		// Deltas reference the previous frame. The first frames of the
+		// range can be deltas of frames before it, those are loaded
+		// directly since the prefetcher wraps indices into the range.
+		m_snapshot.getVoxelSequence().setup([this](int frameIndex) -> std::shared_ptr<const FrameFile>{
+			if(frameIndex >= m_endIndex){
+				return nullptr;
+			}
+			if(frameIndex < m_startIndex){
+				auto frame = std::make_shared<FrameFile>();
+				if(frameIndex < 0 || !frame->load(m_prefetcher.getFramePath(frameIndex))){
+					return nullptr;
+				}
+				return frame;
+			}
+			return m_prefetcher.acquire(frameIndex);
+		});
+#endif
+
 		// Load the shaders.
 		m_renderShader.setupShaderFromFile(GL_VERTEX_SHADER, "shaders/render.vert");
 		m_renderShader.setupShaderFromFile(GL_FRAGMENT_SHADER, "shaders/render.frag");
@@ -57,23 +82,6 @@ namespace ent
 		m_renderShader.setUniform1f("uDensityMax", m_densityMax * m_densityRange.getSpan());
 		m_renderShader.end();
 
-#if USE_VOXELS_COMPUTE_SHADER
-		frameSettings.voxels2texture.setupShaderFromFile(GL_COMPUTE_SHADER, "shaders/voxels2texture3d.glsl");
-		frameSettings.voxels2texture.linkProgram();
-		nextFrameSettings.voxels2texture = frameSettings.voxels2texture;
-		int maxBufferTextureSize;
-		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxBufferTextureSize);
-		auto maxNumVoxelsBytes = 128*1024*1024; //MB
-		if(maxNumVoxelsBytes>maxBufferTextureSize){
-			cout << "voxels buffer size " << maxNumVoxelsBytes/1024/1024 << "MB > max buffer texture size " << maxBufferTextureSize/1024./1024. << "MB" << endl;
-			std::exit(0);
-		}
-		frameSettings.voxelsBuffer.allocate(maxNumVoxelsBytes, GL_STATIC_DRAW);
-		frameSettings.voxelsTexture.allocateAsBufferTexture(frameSettings.voxelsBuffer, GL_RG32I);
-		nextFrameSettings.voxelsBuffer.allocate(maxNumVoxelsBytes, GL_STATIC_DRAW);
-		nextFrameSettings.voxelsTexture.allocateAsBufferTexture(nextFrameSettings.voxelsBuffer, GL_RG32I);
-#endif
-
 #if USE_PARTICLES_COMPUTE_SHADER
 		frameSettings.particles2texture.setupShaderFromFile(GL_COMPUTE_SHADER, "shaders/particles2texture3d.glsl");
 		frameSettings.particles2texture.linkProgram();
@@ -165,6 +173,8 @@ namespace ent
 	//--------------------------------------------------------------
 	void SequenceRamses::clear()
 	{
+		m_prefetcher.close();
+
 		m_folder = "";
 		m_urlFolder = "";
 		m_startIndex = 0;
@@ -295,7 +305,27 @@ namespace ent
 	//--------------------------------------------------------------
 	void SequenceRamses::preloadAllFrames()
 	{
+		m_prefetcher.prefetchAll();
+	}
+
+	//--------------------------------------------------------------
+	void SequenceRamses::loadSnapshot(SnapshotRamses::Settings & settings)
+	{
+		// Frames that are already precalculated come from the prefetcher
+		// so only the upload happens here, the rest are precalculated
+		// synchronously by the snapshot.
+		auto frame = m_prefetcher.acquire(settings.frameIndex);
+		if(frame && m_snapshot.isFrameUpToDate(*frame, settings.frameIndex, settings.worldsize)){
+			m_snapshot.setup(settings, *frame);
+		}else{
+			m_snapshot.setup(settings);
+		}
 
+		// The pool still has the old file, the deltas after this frame
+		// have to see the new one to notice their reference changed.
+		if(m_snapshot.wasPrecalculated()){
+			m_prefetcher.invalidate(settings.frameIndex);
+		}
 	}
 
 	//--------------------------------------------------------------
@@ -309,6 +339,7 @@ namespace ent
 
 		cout << "load frame " << index << endl;
 		auto range = (m_endIndex - m_startIndex);
+		m_prefetcher.request(m_startIndex + (int(from) % range));
 		if(frameSettings.frameIndex != m_startIndex + (int(from) % range)){
 			if(nextFrameSettings.frameIndex == m_startIndex + (int(from) % range)){
 				std::swap(frameSettings, nextFrameSettings);
@@ -322,7 +353,7 @@ namespace ent
 					m_clearData.data(),
 					frameSettings.worldsize, frameSettings.worldsize, frameSettings.worldsize, 0,0,0, GL_RED
 				);
-				m_snapshot.setup(frameSettings);
+				loadSnapshot(frameSettings);
 			}
 
 			m_coordRange.clear();
@@ -363,7 +394,7 @@ namespace ent
 				m_clearData.data(),
 				frameSettings.worldsize, frameSettings.worldsize, frameSettings.worldsize, 0,0,0, GL_RED
 			);
-			m_snapshot.setup(nextFrameSettings);
+			loadSnapshot(nextFrameSettings);
 		}
 
 		if(m_currentIndex!=index){
@@ -506,4 +537,10 @@ namespace ent
 	{
 		return m_bReady;
 	}
+
+	//--------------------------------------------------------------
+	const FramePrefetcher & SequenceRamses::getPrefetcher() const
+	{
+		return m_prefetcher;
+	}
 }
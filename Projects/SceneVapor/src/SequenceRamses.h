@@ -5,6 +5,7 @@
 #include "ofxRange.h"
 
 #include "SnapshotRamses.h"
+#include "FramePrefetcher.h"
 #include "ofxVolumetrics3D.h"
 #include "ofxTexture3d.h"
 
@@ -53,15 +54,19 @@ namespace ent
 
 		bool isReady() const;
 
+		const FramePrefetcher & getPrefetcher() const;
+
 		float getNormalizeFactor() const{
 			return m_normalizeFactor;
 		}
 
     protected:
 		void setup(int startIndex, int endIndex);
+		void loadSnapshot(SnapshotRamses::Settings & settings);
 
 		// Data
 		SnapshotRamses m_snapshot;
+		FramePrefetcher m_prefetcher;
 
 		std::string m_folder;
 		std::string m_urlFolder;
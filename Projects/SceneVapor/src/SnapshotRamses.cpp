@@ -1,15 +1,13 @@
 #include "SnapshotRamses.h"
 #include "Constants.h"
+#include "FrameFile.h"
+#include "ParticleFilter.h"
+#include "VoxelCodec.h"
+#include "HalfParticles.h"
 #include <numeric>
 #include "H5Cpp.h"
 #include <curl/curl.h>
 
-#ifdef TARGET_LINUX
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#endif
-
 //#include "turbojpeg.h"
 
 namespace ent
@@ -27,29 +25,6 @@ namespace ent
 		ofSystem(command);
 	}
 
-	void readToMemory(const std::string & path, size_t size, char * buffer){
-	#if defined(TARGET_LINUX) && FAST_READ
-		auto fd = open (ofToDataPath(path).c_str(), O_RDONLY, S_IRUSR);
-		char * data = (char*)mmap (nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
-		if(data == (const char *)-1){
-			ofLogError() << "Couldn't read memory mapped file";
-			return;
-		}
-		memcpy(buffer, data, size);
-		munmap(data, size);
-		close(fd);
-	#else
-		ofFile file(path, ofFile::ReadOnly, true);
-		file.read(buffer, size);
-	#endif
-	}
-
-	void readToBuffer(const std::string & path, size_t size, ofBufferObject & buffer){
-		auto data = buffer.map<char>(GL_WRITE_ONLY);
-		readToMemory(path, size, data);
-		buffer.unmap();
-	}
-
 	//--------------------------------------------------------------
 	SnapshotRamses::SnapshotRamses()
 	{
@@ -62,7 +37,7 @@ namespace ent
 		clear();
 	}
 
-	void SnapshotRamses::precalculate(const std::string folder, int frameIndex, float minDensity, float maxDensity, size_t worldsize){
+	void SnapshotRamses::precalculate(const std::string folder, int frameIndex, float minDensity, float maxDensity, size_t worldsize, bool keyFrame){
 		//------------------------------------
 		// Load the HDF5 data.
 		std::vector<float> posX;
@@ -80,10 +55,9 @@ namespace ent
 		auto now = ofGetElapsedTimeMicros();
 		cout << "time to load original files " << float(now - then)/1000 << "ms." << endl;
 
-		std::vector<Particle> particles(posX.size());
-		for(size_t i=0;i<posX.size();++i){
-			particles[i] = {{posX[i], posY[i], posZ[i]}, cellSize[i], density[i]};
-		}
+		ParticleFilter filter;
+		ParticleFilter::Columns columns{posX.data(), posY.data(), posZ.data(), cellSize.data(), density.data(), posX.size()};
+		ParticleFilter::Settings filterSettings;
 
 		//------------------------------------
 		// Precalculate ranges
@@ -91,29 +65,21 @@ namespace ent
 			m_numCells = posX.size();
 
 			if(firstFrame){
-				m_densityRange.clear();
-				m_coordRange.clear();
-				m_sizeRange.clear();
-
 				// Set the ranges for all data.
-				for (size_t i = 0; i < posX.size(); ++i)
-				{
-					m_densityRange.add(density[i]);
-					m_coordRange.add(glm::vec3(posX[i], posY[i], posZ[i]));
-					m_sizeRange.add(cellSize[i]);
-				}
-
-				auto threshold = minDensity * m_densityRange.getMin() + (maxDensity * m_densityRange.getMax() - minDensity * m_densityRange.getMin()) * 0.001f;
-				ofxRange3f range;
-				range.clear();
-				range = std::accumulate(particles.begin(), particles.end(), range, [&](ofxRange3f range, const Particle & p){
-					if(p.density>threshold){
-						range.add(p.pos.xyz());
-					}
-					return range;
-				});
-
-				cout << "num particles after filter: " << particles.size() << endl;
+				then = ofGetElapsedTimeMicros();
+				filterSettings.outputParticles = false;
+				filter.process(columns, filterSettings);
+				m_densityRange = filter.getStats().densityRange;
+				m_coordRange = filter.getStats().coordRange;
+				m_sizeRange = filter.getStats().sizeRange;
+
+				filterSettings.densityThreshold = minDensity * m_densityRange.getMin() + (maxDensity * m_densityRange.getMax() - minDensity * m_densityRange.getMin()) * 0.001f;
+				filter.process(columns, filterSettings);
+				ofxRange3f range = filter.getStats().thresholdRange;
+				now = ofGetElapsedTimeMicros();
+				cout << "time to compute ranges " << float(now - then)/1000 << "ms." << endl;
+
+				cout << "num particles after filter: " << posX.size() << endl;
 				auto min = m_coordRange.getMin();
 				auto max = m_coordRange.getMax();
 				cout << min.x << ", " << min.y << ", " << min.z << " - " << max.x << ", " << max.y << ", " << max.z << endl;
@@ -156,427 +122,245 @@ namespace ent
 			range.add(m_boxRange.max);
 
 			then = ofGetElapsedTimeMicros();
-			this->vaporPixels.setup(particles, worldsize, minDensity * m_densityRange.getMin(), maxDensity * m_densityRange.getMax(), range);
+			filterSettings.densityThreshold = std::numeric_limits<float>::max();
+			filterSettings.filter = true;
+			filterSettings.box = range;
+			filterSettings.scale = Vapor3DTexture::getScale(worldsize, range);
+			filterSettings.maxScaledSize = MAX_PARTICLE_SIZE > -1 ? MAX_PARTICLE_SIZE : std::numeric_limits<float>::max();
+			filterSettings.outputParticles = true;
+			filter.process(columns, filterSettings);
+			now = ofGetElapsedTimeMicros();
+			cout << "time to filter " << filter.getStats().numKept << " particles " << float(now - then)/1000 << "ms." << endl;
+
+			then = ofGetElapsedTimeMicros();
+			this->vaporPixels.setupFiltered(std::move(filter.getParticles()), worldsize, minDensity * m_densityRange.getMin(), maxDensity * m_densityRange.getMax(), range);
 			now = ofGetElapsedTimeMicros();
 			cout << "time to compute 3D texture " << float(now - then)/1000 << "ms." << endl;
 			m_numCells = vaporPixels.getParticlesInBox().size();
 			cout << "octree num particles " << m_numCells << endl;
 		}
 
-
+		#if USE_OCTREE_VOXELS
 		//------------------------------------
-		// Write data to files
+		// Replace the splatted 3d texture with the
+		// octree leafs, rasterized over the same box
+		// at twice the resolution and box filtered
 		{
-			#if USE_RAW
-			ofFile texture3dRaw(rawFileName, ofFile::WriteOnly, true);
-			texture3dRaw.write((const char*)this->vaporPixels.data().data(), this->vaporPixels.data().size() * sizeof(float));
-			#endif
-
-			ofFile texture3dMeta(metaFileName, ofFile::WriteOnly, true);
-			texture3dMeta << m_densityRange.getMin() << " " << m_densityRange.getMax() << " " <<
-							m_coordRange.getMin() << " " << m_coordRange.getMax() << " " <<
-							m_sizeRange.getMin() << " " << m_sizeRange.getMax() << " " <<
-							m_boxRange.min << " " << m_boxRange.max << " " <<
-							vaporPixels.getParticlesInBox().size() << " " <<
-							vaporPixels.getGroupIndices().size();
-
-
-			#if USE_PARTICLES_COMPUTE_SHADER
-			ofFile particlesFile(particlesFileName, ofFile::WriteOnly, true);
-			#if USE_HALF_PARTICLE
-				particlesFile.write((const char*)vaporPixels.getHalfParticlesInBox().data(), vaporPixels.getHalfParticlesInBox().size() * sizeof(HalfParticle));
-			#else
-				particlesFile.write((const char*)vaporPixels.getParticlesInBox().data(), vaporPixels.getParticlesInBox().size() * sizeof(Particle));
-			#endif
-			ofFile particlesGroupsFile(particlesGroupsFileName, ofFile::WriteOnly, true);
-			particlesGroupsFile.write((const char*)vaporPixels.getGroupIndices().data(), sizeof(size_t) * vaporPixels.getGroupIndices().size());
-			#endif
+			then = ofGetElapsedTimeMicros();
+			decltype(vaporOctree) octree;
+			octree.setBoundingBox(m_boxRange);
+			octree.setup(vaporPixels.getParticlesInBox());
+			octree.compute(log2(worldsize*2), minDensity * m_densityRange.getMin(), maxDensity * m_densityRange.getMin());
+			auto pyramid = octree.getVoxelsPyramid(VaporOctree::Density, 2);
+			if(pyramid.back().size() == vaporPixels.data().size()){
+				vaporPixels.data() = std::move(pyramid.back());
+			}else{
+				ofLogWarning("SnapshotRamses::precalculate") << "worldsize " << worldsize << " isn't a power of 2, keeping the splatted voxels";
+			}
+			now = ofGetElapsedTimeMicros();
+			cout << "time to rasterize octree voxels " << float(now - then)/1000 << "ms." << endl;
 		}
-
+		#endif
 
 
 		//------------------------------------
-		// Find out voxels that contribute more
-		// to the final texture and remove the rest
-		// as a form of lossy compression
-		#if USE_VOXELS_COMPUTE_SHADER
-
-
-		#if USE_VOXELS_DCT_COMPRESSION
-
-
-		ofFloatPixels pixels;
-		pixels.allocate(512*16, 512*32, OF_PIXELS_GRAY);
-		auto ptr = vaporPixels.data().data();
-		for(size_t z=0, x=0, y=0; z<worldsize; ++z){
-			ofFloatPixels pixelsSlice;
-			pixelsSlice.setFromExternalPixels(ptr,worldsize,worldsize,OF_PIXELS_GRAY);
-			ofSaveImage(pixelsSlice, voxelsFileName + "_" + ofToString(z) + ".tif");
-			//pixelsSlice.pasteInto(pixels,x,y);
-			ptr+=worldsize*worldsize;
-			/*x+=worldsize;
-			if(x>pixels.getWidth()){
-				x=0;
-				y+=worldsize;
-			}*/
+		// Compress the 3d texture in bricks, as a
+		// delta against the previous frame when possible
+		#if USE_VOXELS_CODEC
+		std::vector<char> memVoxels;
+		{
+			then = ofGetElapsedTimeMicros();
+			VoxelCodec::Stats stats;
+			auto mode = VOXELS_MAX_ERROR > 0 ? VoxelCodec::Quantized : VoxelCodec::Lossless;
+			auto keyInterval = keyFrame ? 1 : VOXELS_KEY_FRAME_INTERVAL;
+			memVoxels = m_voxelSequence.encode(frameIndex, vaporPixels.data(), worldsize, mode, VOXELS_MAX_ERROR, keyInterval, &stats);
+			VoxelCodec::Header header;
+			VoxelCodec::readHeader(memVoxels.data(), memVoxels.size(), header);
+			now = ofGetElapsedTimeMicros();
+			cout << "time to compress voxels " << float(now - then)/1000 << "ms. " << (VoxelCodec::isKeyFrame(header) ? "key-frame " : "delta ") <<
+					stats.numStoredBricks << "/" << stats.numBricks << " bricks, " <<
+					stats.numStoredVoxels << " voxels in " << stats.bytes/1024./1024. << "MB, max error " << stats.maxError << endl;
 		}
+		#endif
 
 
-
-		#else
-
-
-
+		//------------------------------------
+		// Write everything to a single frame file
 		{
-			const size_t numBins = 500;
-			std::array<size_t,numBins> histogram = {{0}};
-			std::array<double,numBins> histogram_contribution = {{0.}};
-			std::array<size_t,numBins> histogram_num_particles = {{0}};
-			ofxRange3f zero;
-			zero.clear();
-			std::array<ofxRange3f,numBins> histogram_ranges = {{ zero }};
-			std::array<float,numBins> histogram_factor = {{ 0.f }};
-			double totalDensity = 0.;
-
-			for(uint32_t z = 0, i=0; z<worldsize; z++){
-				for(uint32_t y = 0; y<worldsize; y++){
-					for(uint32_t x = 0; x<worldsize; x++, i++){
-						auto v = vaporPixels.data()[i];
-						totalDensity += v;
-						size_t idx = size_t(v * 99999.f);
-						size_t idx_contrib = size_t(sqrt(sqrt(v)) * float(numBins-1));
-						if(idx<numBins){
-							histogram[idx] += 1;
-						}
-						histogram_contribution[idx_contrib] += v;
-						histogram_ranges[idx_contrib].add(glm::vec3(x,y,z));
-						histogram_num_particles[idx_contrib] += 1;
-					}
-				}
-			}
-
-			auto totalSpan = glm::length(glm::vec3(worldsize, worldsize, worldsize));
-			for(size_t i=0;i<histogram_ranges.size();++i){
-				auto span3f = histogram_ranges[i].getSpan();
-				auto span = glm::length(span3f)/totalSpan;
-				auto contribution = histogram_contribution[i]/totalDensity;
-				if(span>0){
-					histogram_factor[i] = contribution / pow(span,5);
-				}else if(contribution>0){
-					histogram_factor[i] = 1;
-				}
-			}
-
-
-
-			size_t i = 0;
-			size_t total = 0;
-			double total_pct = 0.0;
-			cout << "histogram number of particles" << endl;
-			for(auto & h: histogram){
-				double pct = double(h)/double(vaporPixels.data().size());
-				total_pct += pct;
-				cout << i++ << ": " << pct << "%" << endl;
-				total += h;
-			}
-			cout << "total " << vaporPixels.data().size() << " histogram total " << total << endl;
-			cout << "total pct " << total_pct << endl;
-
-			i = 0;
-			total_pct = 0.0;
-			cout << "histogram contribution" << endl;
-			for(auto & h: histogram_contribution){
-				double pct = h/totalDensity;
-				total_pct += pct;
-				cout << i++ << ": " << pct << "%" << endl;
-			}
-			cout << "total pct " << total_pct << endl;
-
-			i = 0;
-			total_pct = 0.0;
-			cout << "histogram factor" << endl;
-			for(auto & h: histogram_factor){
-				cout << i++ << ": " << h << "%" << endl;
-			}
-
+			then = ofGetElapsedTimeMicros();
+			FrameMetadata metadata;
+			metadata.minDensity = m_densityRange.getMin();
+			metadata.maxDensity = m_densityRange.getMax();
+			metadata.minCoords = m_coordRange.getMin();
+			metadata.maxCoords = m_coordRange.getMax();
+			metadata.minSize = m_sizeRange.getMin();
+			metadata.maxSize = m_sizeRange.getMax();
+			metadata.minBox = m_boxRange.min;
+			metadata.maxBox = m_boxRange.max;
+			metadata.numParticles = vaporPixels.getParticlesInBox().size();
+			metadata.numGroups = vaporPixels.getGroupIndices().size();
+			metadata.worldsize = worldsize;
+			metadata.halfParticles = USE_HALF_PARTICLE;
+
+			FrameFileWriter frameFile;
+			frameFile.addSection(FrameFile::MetadataSection, &metadata, sizeof(metadata), sizeof(metadata));
 
+			#if USE_RAW
+			frameFile.addSection(FrameFile::RawSection, this->vaporPixels.data());
+			#endif
 
-			std::array<std::pair<float,size_t>,numBins> histogram_factor_sorted;
-			for(size_t i=0;i<histogram_factor.size();i++){
-				histogram_factor_sorted[i] = std::make_pair(histogram_factor[i], histogram_num_particles[i]);
-			}
-			std::sort(histogram_factor_sorted.begin(), histogram_factor_sorted.end(), [&](const std::pair<float,size_t> & p1, const std::pair<float,size_t> & p2){
-				return p1.first > p2.first;
-			});
-			i = 0;
-			total_pct = 0.0;
-			double totalFactor = 0;
-			size_t byteRate = 100*1024*1024; //800Mb/s @ 30fps
-			size_t accumulatedSize = 0;
-			float threshold=0;
-			size_t sizeBeforeThreshold = 0;
-			cout << "histogram factor" << endl;
-			for(auto & h: histogram_factor_sorted){
-				auto binSize = h.second * sizeof(int32_t)*2;
-				accumulatedSize+=binSize;
-				if(accumulatedSize>byteRate && threshold==0){
-					threshold = h.first;
-					cout << "found threshold at " << threshold << endl;
-				}else if(threshold == 0){
-					sizeBeforeThreshold += binSize;
-				}
-				totalFactor+=h.first;
-				cout << i++ << ": " << h.first*100 << "% " << binSize/1024. << "KB / " << accumulatedSize/1024./1024. << "MB" << endl;
-			}
+			#if USE_PARTICLES_COMPUTE_SHADER
+			#if USE_HALF_PARTICLE
+				auto & quantization = vaporPixels.getHalfQuantization();
+				auto & halfStats = vaporPixels.getHalfStats();
+				frameFile.addSection(FrameFile::HalfParticlesSection, vaporPixels.getHalfParticlesInBox());
+				frameFile.addSection(FrameFile::HalfQuantizationSection, &quantization, sizeof(quantization), sizeof(quantization));
+				cout << "half particles error: position max " << halfStats.maxPositionError << " rms " << halfStats.rmsPositionError <<
+						" (box span " << 2.f / quantization.scale << "), size max " << halfStats.maxSizeError <<
+						", density max " << halfStats.maxDensityError << " relative " << halfStats.maxRelativeDensityError << endl;
+			#else
+				frameFile.addSection(FrameFile::ParticlesSection, vaporPixels.getParticlesInBox());
+			#endif
+			std::vector<uint64_t> groups(vaporPixels.getGroupIndices().begin(), vaporPixels.getGroupIndices().end());
+			frameFile.addSection(FrameFile::GroupsSection, groups);
+			#endif
 
+			#if USE_VOXELS_CODEC
+			frameFile.addSection(FrameFile::VoxelsSection, memVoxels);
+			#endif
 
-			uint32_t level = log2(worldsize);
-			cout << "storing with level " << level << endl;
-			ofFile voxelsFile(voxelsFileName, ofFile::WriteOnly, true);
-			std::vector<uint32_t> memVoxels;
-			auto mask = worldsize-1;
-			auto fToi32 = pow(2,32);
-			size_t particlesInThresholdBin = (byteRate - sizeBeforeThreshold)/sizeof(int32_t)*2;
-			for(uint32_t z = 0, i=0; z<worldsize; z++){
-				for(uint32_t y = 0; y<worldsize; y++){
-					for(uint32_t x = 0; x<worldsize; x++, i++){
-						size_t idx_contrib = size_t(sqrt(sqrt(vaporPixels.data()[i])) * float(numBins-1));
-						auto factor = histogram_factor[idx_contrib];
-						if(factor>threshold){
-							uint32_t idx = 0;
-							idx += (x<<(level*2));
-							idx += (y<<level);
-							idx += z;
-
-							memVoxels.push_back(idx);
-							memVoxels.push_back(vaporPixels.data()[i] * fToi32);
-						}else if(threshold==factor && particlesInThresholdBin>0){
-							particlesInThresholdBin-=1;
-							uint32_t idx = 0;
-							idx += (x<<(level*2));
-							idx += (y<<level);
-							idx += z;
-
-							memVoxels.push_back(idx);
-							memVoxels.push_back(vaporPixels.data()[i] * fToi32);
-
-						}
-					}
-				}
-			}
-			voxelsFile.write((const char*)memVoxels.data(), memVoxels.size() * sizeof(uint32_t));
-			cout << "number of voxels " << memVoxels.size()/2 << endl;
-			if(memVoxels.size()*sizeof(int32_t)>128*1024*1024){
-				cout << "Couldn't compress texture to less than " << 128 << " MB" << endl;
-				std::exit(0);
-			}
-			if(memVoxels.size()==0){
-				cout << "No voxels are above the compression threshold" << endl;
+			if(!frameFile.save(frameFileName)){
+				ofLogError("SnapshotRamses::precalculate") << "Couldn't write frame file " << frameFileName;
 			}
+			now = ofGetElapsedTimeMicros();
+			cout << "time to write frame file " << float(now - then)/1000 << "ms." << endl;
 		}
-		#endif
-		#endif
 	}
 
 	//--------------------------------------------------------------
 	void SnapshotRamses::setup(Settings & settings)
 	{
-		const float * data = nullptr;
-		void * filedata = nullptr;
-		size_t filedatalen = 0;
-		metaFileName = ofFilePath::removeTrailingSlash(settings.folder) + "/" + ofToString(settings.frameIndex) + "_meta.raw";
-		rawFileName = ofFilePath::removeTrailingSlash(settings.folder) + "/" + ofToString(settings.frameIndex) + ".raw";
-		particlesFileName = ofFilePath::removeTrailingSlash(settings.folder) + "/" + ofToString(settings.frameIndex) +".particles";
-		voxelsFileName = ofFilePath::removeTrailingSlash(settings.folder) + "/" + ofToString(settings.frameIndex) + "_voxels.raw";
-		particlesGroupsFileName = ofFilePath::removeTrailingSlash(settings.folder) + "/" + ofToString(settings.frameIndex) + ".groups";
+		frameFileName = FrameFile::getPath(settings.folder, settings.frameIndex);
 
 		clear();
+		m_precalculated = false;
 
 
-		cout << "metadata " << metaFileName << endl;
-		auto voxelsSize = 0;
-		std::vector<size_t> particleGroups;
-
-		auto metadataPrecalculated = ofFile(metaFileName, ofFile::Reference).exists();
-		auto particlesPrecalculated = ofFile(particlesFileName, ofFile::Reference).exists();
-		auto voxelsPrecalculated = ofFile(voxelsFileName, ofFile::Reference).exists();
-		auto rawPrecalculated = ofFile(rawFileName, ofFile::Reference).exists();
-
-		if(settings.urlFolder!=""){
-			bool needsDownload = false;
+		cout << "frame " << frameFileName << endl;
 
-			needsDownload |= !metadataPrecalculated;
-#if USE_PARTICLES_COMPUTE_SHADER
-			needsDownload |= particlesPrecalculated;
-#endif
-#if USE_VOXELS_COMPUTE_SHADER
-			needsDownload |= voxelsPrecalculated;
-#endif
-#if USE_RAW
-			needsDownload |= rawPrecalculated;
-#endif
-
-			if(!ofFile(settings.folder + "/hdf5/" + getXHDF5Path(settings.frameIndex), ofFile::Reference).exists()){
-				sftpDownload(settings.urlFolder + "/" + getXHDF5Path(settings.frameIndex), settings.folder + "/hdf5/" + getXHDF5Path(settings.frameIndex));
-			}
-			if(!ofFile(settings.folder + "/hdf5/" + getYHDF5Path(settings.frameIndex), ofFile::Reference).exists()){
-				sftpDownload(settings.urlFolder + "/" + getYHDF5Path(settings.frameIndex), settings.folder + "/hdf5/" + getYHDF5Path(settings.frameIndex));
-			}
-			if(!ofFile(settings.folder + "/hdf5/" + getZHDF5Path(settings.frameIndex), ofFile::Reference).exists()){
-				sftpDownload(settings.urlFolder + "/" + getZHDF5Path(settings.frameIndex), settings.folder + "/hdf5/" + getZHDF5Path(settings.frameIndex));
-			}
-			if(!ofFile(settings.folder + "/hdf5/" + getDXHDF5Path(settings.frameIndex), ofFile::Reference).exists()){
-				sftpDownload(settings.urlFolder + "/" + getDXHDF5Path(settings.frameIndex), settings.folder + "/hdf5/" + getDXHDF5Path(settings.frameIndex));
-			}
-			if(!ofFile(settings.folder + "/hdf5/" + getDensityHDF5Path(settings.frameIndex), ofFile::Reference).exists()){
-				sftpDownload(settings.urlFolder + "/" + getDensityHDF5Path(settings.frameIndex), settings.folder + "/hdf5/" + getDensityHDF5Path(settings.frameIndex));
-			}
-		}
-
-		if(metadataPrecalculated){
+		FrameFile frameFile;
+		auto needsPrecalculate = true;
+		if(ofFile(frameFileName, ofFile::Reference).exists()){
 			auto then = ofGetElapsedTimeMicros();
-			ofFile texture3dMeta(metaFileName, ofFile::ReadOnly, true);
-			glm::vec3 min_coords, max_coords, min_box, max_box;
-			float min_density, max_density, min_size, max_size;
-			size_t numGroups;
-			texture3dMeta >> min_density;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_density;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> min_coords;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_coords;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> min_size;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_size;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> min_box;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_box;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> m_numCells;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> numGroups;
-			if(firstFrame){
-				m_densityRange.add(min_density);
-				m_densityRange.add(max_density);
-				m_coordRange.add(min_coords);
-				m_coordRange.add(max_coords);
-				m_sizeRange.add(min_size);
-				m_sizeRange.add(max_size);
-				m_boxRange = BoundingBox::fromMinMax(min_box, max_box);
-			}
-			particleGroups.resize(numGroups);
+			needsPrecalculate = !frameFile.load(frameFileName) || !isFrameUpToDate(frameFile, settings.frameIndex, settings.worldsize);
 			auto now = ofGetElapsedTimeMicros();
-			cout << "time to load metadata " << float(now - then)/1000 << "ms." << endl;
-
-//			if(min_density != settings.minDensity || max_density != settings.maxDensity){
-//				ofFile(rawFileName, ofFile::Reference).remove();
-//				ofFile(particlesFileName, ofFile::Reference).remove();
-//				ofFile(metaFileName, ofFile::Reference).remove();
-//				ofFile(voxelsFileName, ofFile::Reference).remove();
-//				ofFile(particlesGroupsFileName, ofFile::Reference).remove();
-
-//				metadataPrecalculated = false;
-//				particlesPrecalculated = false;
-//				voxelsPrecalculated = false;
-//				rawPrecalculated = false;
-//			}
+			cout << "time to open frame file " << float(now - then)/1000 << "ms." << endl;
 		}
-
-		auto needsPrecalculate = !metadataPrecalculated;
-#if USE_PARTICLES_COMPUTE_SHADER
-		needsPrecalculate |= !particlesPrecalculated;
-#endif
-#if USE_VOXELS_COMPUTE_SHADER
-		needsPrecalculate |= !voxelsPrecalculated;
-#endif
-#if USE_RAW
-		needsPrecalculate |= !rawPrecalculated;
-#endif
 #if HDF5_DIRECT
 		needsPrecalculate = true;
 #endif
 
+		if(needsPrecalculate && !precalculateAndLoad(settings, false, frameFile)){
+			return;
+		}
 
-		if(needsPrecalculate){
-			precalculate(settings.folder, settings.frameIndex, settings.minDensity, settings.maxDensity, settings.worldsize);
-			auto then = ofGetElapsedTimeMicros();
-			ofFile texture3dMeta(metaFileName, ofFile::ReadOnly, true);
-			glm::vec3 min_coords, max_coords, min_box, max_box;
-			float min_density, max_density, min_size, max_size;
-			size_t numGroups;
-			texture3dMeta >> min_density;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_density;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> min_coords;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_coords;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> min_size;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_size;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> min_box;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> max_box;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> m_numCells;
-			texture3dMeta.ignore(1);
-			texture3dMeta >> numGroups;
-			if(firstFrame){
-				m_densityRange.add(min_density);
-				m_densityRange.add(max_density);
-				m_coordRange.add(min_coords);
-				m_coordRange.add(max_coords);
-				m_sizeRange.add(min_size);
-				m_sizeRange.add(max_size);
-				m_boxRange = BoundingBox::fromMinMax(min_box, max_box);
+		load(settings, frameFile);
+	}
+
+	//--------------------------------------------------------------
+	bool SnapshotRamses::precalculateAndLoad(Settings & settings, bool keyFrame, FrameFile & frameFile)
+	{
+		frameFile.close();
+		if(settings.urlFolder!=""){
+			for(auto & path: {getXHDF5Path(settings.frameIndex), getYHDF5Path(settings.frameIndex), getZHDF5Path(settings.frameIndex), getDXHDF5Path(settings.frameIndex), getDensityHDF5Path(settings.frameIndex)}){
+				if(!ofFile(settings.folder + "/hdf5/" + path, ofFile::Reference).exists()){
+					sftpDownload(settings.urlFolder + "/" + path, settings.folder + "/hdf5/" + path);
+				}
 			}
-			particleGroups.resize(numGroups);
-			auto now = ofGetElapsedTimeMicros();
-			cout << "time to load metadata " << float(now - then)/1000 << "ms." << endl;
 		}
 
+		precalculate(settings.folder, settings.frameIndex, settings.minDensity, settings.maxDensity, settings.worldsize, keyFrame);
+		m_precalculated = true;
+		if(!frameFile.load(frameFileName)){
+			ofLogError("SnapshotRamses::setup") << "Couldn't load precalculated frame " << frameFileName;
+			return false;
+		}
+		return true;
+	}
+
+	//--------------------------------------------------------------
+	void SnapshotRamses::setup(Settings & settings, const FrameFile & frameFile)
+	{
+		m_precalculated = false;
+		load(settings, frameFile);
+	}
+
+	//--------------------------------------------------------------
+	void SnapshotRamses::load(Settings & settings, const FrameFile & frameFile)
+	{
+		const float * data = nullptr;
+		std::vector<size_t> particleGroups;
+		frameFileName = FrameFile::getPath(settings.folder, settings.frameIndex);
+
+		clear();
+
+		setMetadata(frameFile.getMetadata());
+
 
-		// Load data from precalculated files
+		// Load data from the frame file
 		{
 
-#if USE_VOXELS_COMPUTE_SHADER
+#if USE_VOXELS_CODEC
 			// Load voxels
 			{
-				int maxBufferTextureSize;
-				glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxBufferTextureSize);
-				voxelsSize = std::min(ofFile(voxelsFileName, ofFile::Reference).getSize(), (uint64_t)maxBufferTextureSize);
 				auto then = ofGetElapsedTimeMicros();
-				readToBuffer(voxelsFileName, voxelsSize, settings.voxelsBuffer);
+				auto stats = m_voxelSequence.getStats();
+				auto voxels = m_voxelSequence.reconstruct(settings.frameIndex, frameFile);
+				if(!voxels){
+					// A delta whose chain is broken, its reference missing or
+					// precalculated again, is written again as a key-frame.
+					// Key-frames don't depend on anything so it's only tried once.
+					size_t voxelsSize;
+					VoxelCodec::Header header;
+					auto voxelsData = frameFile.getSectionData(FrameFile::VoxelsSection, voxelsSize);
+					if(!VoxelCodec::readHeader(voxelsData, voxelsSize, header) || VoxelCodec::isKeyFrame(header)){
+						ofLogError("SnapshotRamses::setup") << "Couldn't decode voxels from " << frameFileName;
+						return;
+					}
+					ofLogWarning("SnapshotRamses::setup") << "Couldn't reconstruct " << frameFileName << ", precalculating it as a key-frame";
+					FrameFile keyFrame;
+					if(precalculateAndLoad(settings, true, keyFrame)){
+						load(settings, keyFrame);
+					}
+					return;
+				}
+				data = voxels->data();
 				auto now = ofGetElapsedTimeMicros();
-				cout << "time to load voxels file " << float(now - then)/1000 << "ms. " <<
-						"for " << voxelsSize << " bytes" << endl;
+				cout << "time to decode voxels " << float(now - then)/1000 << "ms. " <<
+						m_voxelSequence.getStats().keyFrames - stats.keyFrames << " key-frames and " <<
+						m_voxelSequence.getStats().deltas - stats.deltas << " deltas" << endl;
 			}
 #elif USE_PARTICLES_COMPUTE_SHADER || USE_VBO
 			// Load particles
 			{
 				auto then = ofGetElapsedTimeMicros();
+				size_t particlesSize;
 				#if USE_HALF_PARTICLE
-					readToBuffer(particlesFileName, m_numCells*sizeof(HalfParticle), settings.particlesBuffer);
+					auto particles = frameFile.getSectionData(FrameFile::HalfParticlesSection, particlesSize);
 				#else
-					readToBuffer(particlesFileName, m_numCells*sizeof(Particle), settings.particlesBuffer);
+					auto particles = frameFile.getSectionData(FrameFile::ParticlesSection, particlesSize);
 				#endif
+				settings.particlesBuffer.updateData(0, particlesSize, particles);
 				auto now = ofGetElapsedTimeMicros();
-				cout << "time to load particles file " << float(now - then)/1000 << "ms. " <<
+				cout << "time to load particles " << float(now - then)/1000 << "ms. " <<
 						"for " << m_numCells << " particles" << endl;
 			}
 	#if USE_PARTICLES_COMPUTE_SHADER
 			// Load particle groups
 			{
-				auto then = ofGetElapsedTimeMicros();
-				readToMemory(particlesGroupsFileName, particleGroups.size() * sizeof(size_t), (char*)particleGroups.data());
-				auto now = ofGetElapsedTimeMicros();
-				cout << "time to load groups file " << float(now - then)/1000 << "ms. " <<
-						"for " << particleGroups.size() << " groups" << endl;
+				size_t numGroups;
+				auto groups = frameFile.getSection<uint64_t>(FrameFile::GroupsSection, numGroups);
+				particleGroups.assign(groups, groups + numGroups);
 			}
 	#endif
 #elif HDF5_DIRECT
@@ -586,47 +370,27 @@ namespace ent
 #else
 			// Load raw texture
 			{
-				auto then = ofGetElapsedTimeMicros();
-				#if defined(TARGET_LINUX) && FAST_READ
-					auto fd = open (ofToDataPath(rawFileName).c_str(), O_RDONLY, S_IRUSR);
-					filedatalen = ofFile(rawFileName, ofFile::Reference).getSize();
-					filedata = mmap (nullptr, filedatalen, PROT_READ, MAP_PRIVATE, fd, 0);
-					if(filedata == (const void *)-1){
-						ofLogError() << "Couldn't read memory mapped file";
-						return;
-					}
-					//filedata += 16*sizeof(float) + 8;
-					data = (const float*)filedata;
-				#else
-					ofFile texture3dRaw(rawFileName, ofFile::ReadOnly, true);
-					this->vaporPixelsBuffer = ofBuffer(texture3dRaw, settings.worldsize * settings.worldsize * settings.worldsize * sizeof(float));
-					data = (float*)this->vaporPixelsBuffer.getData();
-				#endif
-				auto now = ofGetElapsedTimeMicros();
-				cout << "time to load raw file " << float(now - then)/1000 << "ms." << endl;
+				size_t numVoxels;
+				data = frameFile.getSection<float>(FrameFile::RawSection, numVoxels);
 			}
 #endif
 		}
 
 		auto then = ofGetElapsedTimeMicros();
 
-		#if USE_VOXELS_COMPUTE_SHADER
-			size_t numInstances = voxelsSize / (sizeof(uint32_t) * 2);
-			cout << "dispatching compute shader with " << numInstances << " instances" << endl;
-			settings.voxels2texture.begin();
-			settings.voxels2texture.setUniformTexture("voxels",settings.voxelsTexture,0);
-			settings.volumeTexture.bindAsImage(0,GL_WRITE_ONLY,0,1,0);
-			settings.voxels2texture.dispatchCompute(numInstances,1,1);
-			settings.voxels2texture.setUniform1f("numVoxels", numInstances);
-			settings.voxels2texture.end();
-			glBindImageTexture(0,0,0,0,0,GL_READ_WRITE,GL_R16F);
-			glMemoryBarrier( GL_SHADER_IMAGE_ACCESS_BARRIER_BIT );
-
-		#elif USE_PARTICLES_COMPUTE_SHADER
+		#if USE_PARTICLES_COMPUTE_SHADER && !USE_VOXELS_CODEC
 			glm::vec3 coordSpan = m_boxRange.getSpan();
 			auto normalizeFactor = std::max(std::max(coordSpan.x, coordSpan.y), coordSpan.z);
 			auto scale = settings.worldsize / normalizeFactor;
 			auto offset = -m_boxRange.min;
+			#if USE_HALF_PARTICLE
+				// Particles come relative to the quantization origin and
+				// scaled, fold the decoding into the shader transform.
+				size_t numQuantizations;
+				auto quantization = frameFile.getSection<HalfParticles::Quantization>(FrameFile::HalfQuantizationSection, numQuantizations);
+				offset = (quantization->origin + offset) * quantization->scale;
+				scale /= quantization->scale;
+			#endif
 
 			settings.particles2texture.begin();
 			settings.particles2texture.setUniformTexture("particles",settings.particlesTexture,0);
@@ -676,12 +440,6 @@ namespace ent
 
 		cout << "loaded " << m_numCells << " particles" << endl;
 
-		#if defined(TARGET_LINUX) && FAST_READ && USE_RAW
-			if(filedata!=nullptr){
-				munmap(filedata, filedatalen);
-			}
-		#endif
-
 		/*GLint num_textures;
 		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &num_textures);
 		std::vector<GLint> formats(num_textures);
@@ -699,9 +457,17 @@ namespace ent
 #if USE_PARTICLES_COMPUTE_SHADER
 		{
 			vector<Particle> particles;
-			auto pptr = settings.particlesBuffer.map<Particle>(GL_READ_ONLY);
-			particles.assign(pptr, pptr + m_numCells);
-			settings.particlesBuffer.unmap();
+			size_t numParticles;
+			#if USE_HALF_PARTICLE
+				size_t numQuantizations;
+				auto quantization = frameFile.getSection<HalfParticles::Quantization>(FrameFile::HalfQuantizationSection, numQuantizations);
+				auto pptr = frameFile.getSection<HalfParticle>(FrameFile::HalfParticlesSection, numParticles);
+				particles.resize(numParticles);
+				HalfParticles::decode(pptr, numParticles, *quantization, particles.data());
+			#else
+				auto pptr = frameFile.getSection<Particle>(FrameFile::ParticlesSection, numParticles);
+				particles.assign(pptr, pptr + numParticles);
+			#endif
 
 
 			auto then = ofGetElapsedTimeMicros();
@@ -717,6 +483,61 @@ namespace ent
 		m_bLoaded = true;
 	}
 
+	//--------------------------------------------------------------
+	void SnapshotRamses::setMetadata(const FrameMetadata & metadata)
+	{
+		if(firstFrame){
+			m_densityRange.add(metadata.minDensity);
+			m_densityRange.add(metadata.maxDensity);
+			m_coordRange.add(metadata.minCoords);
+			m_coordRange.add(metadata.maxCoords);
+			m_sizeRange.add(metadata.minSize);
+			m_sizeRange.add(metadata.maxSize);
+			m_boxRange = BoundingBox::fromMinMax(metadata.minBox, metadata.maxBox);
+		}
+		m_numCells = metadata.numParticles;
+	}
+
+	//--------------------------------------------------------------
+	bool SnapshotRamses::isFrameUpToDate(const FrameFile & frameFile, int frameIndex, size_t worldsize) const{
+		auto & metadata = frameFile.getMetadata();
+		if(metadata.worldsize != worldsize || metadata.halfParticles != USE_HALF_PARTICLE){
+			return false;
+		}
+	#if USE_PARTICLES_COMPUTE_SHADER
+		if(!frameFile.hasSection(USE_HALF_PARTICLE ? FrameFile::HalfParticlesSection : FrameFile::ParticlesSection) ||
+		   !frameFile.hasSection(FrameFile::GroupsSection) ||
+		   (USE_HALF_PARTICLE && !frameFile.hasSection(FrameFile::HalfQuantizationSection))){
+			return false;
+		}
+	#endif
+	#if USE_VOXELS_CODEC
+		size_t voxelsSize;
+		VoxelCodec::Header header;
+		auto voxels = frameFile.getSectionData(FrameFile::VoxelsSection, voxelsSize);
+		if(!VoxelCodec::readHeader(voxels, voxelsSize, header) ||
+		   header.size != worldsize ||
+		   header.mode != (VOXELS_MAX_ERROR > 0 ? VoxelCodec::Quantized : VoxelCodec::Lossless) ||
+		   header.step != VoxelCodec::getStep(header.mode, VOXELS_MAX_ERROR) ||
+		   header.keyDistance >= uint32_t(std::max(VOXELS_KEY_FRAME_INTERVAL, 1)) ||
+		   !m_voxelSequence.isReferenceUpToDate(frameIndex, header)){
+			return false;
+		}
+	#endif
+	#if USE_RAW
+		if(!frameFile.hasSection(FrameFile::RawSection)){
+			return false;
+		}
+	#endif
+		return true;
+	}
+
+	//--------------------------------------------------------------
+	bool SnapshotRamses::wasPrecalculated() const
+	{
+		return m_precalculated;
+	}
+
 	//--------------------------------------------------------------
 	void SnapshotRamses::clear()
 	{
@@ -809,6 +630,14 @@ namespace ent
 		return m_bLoaded;
 	}
 
+#if USE_VOXELS_CODEC
+	//--------------------------------------------------------------
+	VoxelSequence & SnapshotRamses::getVoxelSequence()
+	{
+		return m_voxelSequence;
+	}
+#endif
+
 	//--------------------------------------------------------------
 	std::string SnapshotRamses::getXHDF5Path(int frameIndex){
 		return "x_nout=" + ofToString(frameIndex,0,4,'0') + "_hdf5.h5";
@@ -8,6 +8,9 @@
 #include "ofxTexture3d.h"
 #include "Constants.h"
 #include "VaporOctree.h"
+#include "LinearVaporOctree.h"
+#include "FrameFile.h"
+#include "VoxelSequence.h"
 
 namespace ent
 {
@@ -32,11 +35,6 @@ namespace ent
 			float maxDensity;
 			size_t worldsize;
 			ofxTexture3d volumeTexture;
-            #if USE_VOXELS_COMPUTE_SHADER
-			    ofShader voxels2texture;
-				ofBufferObject voxelsBuffer;
-				ofTexture voxelsTexture;
-            #endif
             #if USE_PARTICLES_COMPUTE_SHADER
 				ofShader particles2texture;
 				ofBufferObject particlesBuffer;
@@ -45,6 +43,7 @@ namespace ent
 		};
 
 		void setup(Settings & settings);
+		void setup(Settings & settings, const FrameFile & frameFile);
 		void clear();
 
 		void update(ofShader& shader);
@@ -61,9 +60,24 @@ namespace ent
 		bool isLoaded() const;
 		BoundingBox m_boxRange;
 
+		// Delta voxel frames are only up to date if their reference, loaded
+		// through the voxel sequence, wasn't precalculated again since.
+		bool isFrameUpToDate(const FrameFile & frameFile, int frameIndex, size_t worldsize) const;
+
+		// Whether the last setup had to write the frame file, frames
+		// loaded before from that file are stale.
+		bool wasPrecalculated() const;
+
+#if USE_VOXELS_CODEC
+		VoxelSequence & getVoxelSequence();
+#endif
+
 	protected:
 		void loadhdf5(const std::string& file, std::vector<float>& elements);
-		void precalculate(const std::string folder, int frameIndex, float minDensity, float maxDensity, size_t worldsize);
+		void precalculate(const std::string folder, int frameIndex, float minDensity, float maxDensity, size_t worldsize, bool keyFrame);
+		bool precalculateAndLoad(Settings & settings, bool keyFrame, FrameFile & frameFile);
+		void load(Settings & settings, const FrameFile & frameFile);
+		void setMetadata(const FrameMetadata & metadata);
 		static std::string getXHDF5Path(int frameIndex);
 		static std::string getYHDF5Path(int frameIndex);
 		static std::string getZHDF5Path(int frameIndex);
@@ -78,17 +92,20 @@ namespace ent
 		std::size_t m_numCells;
 		bool m_bLoaded;
 		Vapor3DTexture vaporPixels;
-		ofBuffer vaporPixelsBuffer;
 
 		ofVbo m_vboMesh;
-		std::string rawFileName;
-		std::string particlesFileName;
-		std::string metaFileName;
-		std::string voxelsFileName;
-		std::string particlesGroupsFileName;
+#if USE_VOXELS_CODEC
+		VoxelSequence m_voxelSequence;
+#endif
+		std::string frameFileName;
 
+#if USE_LINEAR_OCTREE
+		LinearVaporOctree vaporOctree;
+#else
 		VaporOctree vaporOctree;
+#endif
 
 		bool firstFrame = true;
+		bool m_precalculated = false;
 	};
 }
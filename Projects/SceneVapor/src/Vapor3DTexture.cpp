@@ -23,28 +23,6 @@ namespace ent{
 	}
 }
 
-namespace{
-	inline size_t idx_clamp(int value, int size){
-		return size_t(std::max(std::min(value, size),0));
-	}
-
-	struct Box{
-		glm::vec3 min;
-		glm::vec3 max;
-	};
-
-	inline float boxVolume(float size) {
-		return size * size * size;
-	}
-
-	template<typename B>
-	inline float boxesIntersectionVolume(const B & b1, const B & b2){
-		return max(min(b1.max.x, b2.max.x) - max(b1.min.x, b2.min.x),0.f)
-		* max(min(b1.max.y, b2.max.y) - max(b1.min.y, b2.min.y),0.f)
-		* max(min(b1.max.z, b2.max.z) - max(b1.min.z, b2.min.z),0.f);
-	}
-}
-
 const std::vector<float> & Vapor3DTexture::data() const{
 	return m_data;
 }
@@ -70,19 +48,15 @@ inline void Vapor3DTexture::set(size_t idx, float value){
 	m_data[idx] = value;
 }
 
-void Vapor3DTexture::setup(const std::vector<Particle> & particles, size_t size, float minDensity, float maxDensity, ofxRange3f coordsRange){
-	this->m_size = size;
-	this->m_quadsize = size * size;
-	this->m_cubesize = size * this->m_quadsize;
-	this->m_data.clear();
-	this->m_data.assign(size*size*size, 0);
-	this->particlesInBox.clear();
-	this->groupIndices.clear();
+float Vapor3DTexture::getScale(size_t size, const ofxRange3f & coordsRange){
 	glm::vec3 coordSpan = coordsRange.getSpan();
 	auto normalizeFactor = std::max(std::max(coordSpan.x, coordSpan.y), coordSpan.z);
-	auto scale = size / normalizeFactor;
-	auto offset = -coordsRange.getMin();
-	int isize = int(size);
+	return size / normalizeFactor;
+}
+
+void Vapor3DTexture::setup(const std::vector<Particle> & particles, size_t size, float minDensity, float maxDensity, ofxRange3f coordsRange){
+	auto scale = getScale(size, coordsRange);
+	std::vector<Particle> particlesInBox;
 	for(auto & particle: particles){
 		if(!coordsRange.contains(particle.getMaxPos()) ||
 		   !coordsRange.contains(particle.getMinPos()) ||
@@ -92,6 +66,19 @@ void Vapor3DTexture::setup(const std::vector<Particle> & particles, size_t size,
 			particlesInBox.push_back(particle);
 		}
 	}
+	setupFiltered(std::move(particlesInBox), size, minDensity, maxDensity, coordsRange);
+}
+
+void Vapor3DTexture::setupFiltered(std::vector<Particle> && particles, size_t size, float minDensity, float maxDensity, ofxRange3f coordsRange){
+	this->m_size = size;
+	this->m_quadsize = size * size;
+	this->m_cubesize = size * this->m_quadsize;
+	this->m_data.clear();
+	this->m_data.assign(size*size*size, 0);
+	this->particlesInBox = std::move(particles);
+	this->groupIndices.clear();
+	auto scale = getScale(size, coordsRange);
+	auto offset = -coordsRange.getMin();
 
 #if USE_PARTICLES_HISTOGRAM
 	ofxRange3f zero;
@@ -188,117 +175,53 @@ void Vapor3DTexture::setup(const std::vector<Particle> & particles, size_t size,
 #endif
 
 #if USE_PARTICLES_COMPUTE_SHADER
-	auto total = particlesInBox.size();
-	std::vector<Particle> intersectingParticles;
-	intersectingParticles.reserve(particlesInBox.size());
-	std::swap(intersectingParticles, particlesInBox);
-	while(!intersectingParticles.empty()){
-		auto nonIntersecting = std::partition(intersectingParticles.begin(), intersectingParticles.end(), [&](const Particle & particle){
-			float octree_coords_x = ent::offset_scale(particle.pos.x, offset.x, scale);
-			float octree_coords_y = ent::offset_scale(particle.pos.y, offset.y, scale);
-			float octree_coords_z = ent::offset_scale(particle.pos.z, offset.z, scale);
-			glm::vec3 particlepos = {octree_coords_x, octree_coords_y, octree_coords_z};
-			float psize = particle.size * scale * 2;
-
-			if(int(psize)>1){
-				Box particleBox = { particlepos - glm::vec3{psize*0.5,psize*0.5,psize*0.5}, particlepos + glm::vec3{psize*0.5,psize*0.5,psize*0.5}};
-				float particleVolume = boxVolume(psize);
-				auto min_x = idx_clamp(int(octree_coords_x-psize), isize-1);
-				auto max_x = idx_clamp(int(octree_coords_x+psize), isize);
-				auto min_y = idx_clamp(int(octree_coords_y-psize), isize-1);
-				auto max_y = idx_clamp(int(octree_coords_y+psize), isize);
-				auto min_z = idx_clamp(int(octree_coords_z-psize), isize-1);
-				auto max_z = idx_clamp(int(octree_coords_z+psize), isize);
-				for(size_t z = min_z; z<max_z; z++){
-					for(size_t y = min_y; y<max_y; y++){
-						for(size_t x = min_x; x<max_x; x++){
-							auto data_idx = index(x,y,z);
-							if(get(data_idx)>0){
-								return true;
-							}
-						}
-					}
-				}
-				for(size_t z = min_z; z<max_z; z++){
-					for(size_t y = min_y; y<max_y; y++){
-						for(size_t x = min_x; x<max_x; x++){
-							auto data_idx = index(x,y,z);
-							get(data_idx) += 1.0;
-						}
-					}
-				}
-			}else{
-				auto data_idx = index(octree_coords_x, octree_coords_y, octree_coords_z);
-				if(get(data_idx)>0){
-					return true;
-				}else{
-					get(data_idx) += 1.0;
-				}
-			}
-			return false;
-		});
-		particlesInBox.insert(particlesInBox.end(), nonIntersecting, intersectingParticles.end());
-
+	{
+		auto then = ofGetElapsedTimeMicros();
+		grouper.group(particlesInBox, offset, scale, size, groupIndices);
+		auto now = ofGetElapsedTimeMicros();
+		auto & stats = grouper.getStats();
 		cout << "---------------------------------------------------" << endl;
-		cout << "intersecting " << nonIntersecting - intersectingParticles.begin() << " non intersecting " << intersectingParticles.end() - nonIntersecting << " intersecting " <<
-				float(nonIntersecting - intersectingParticles.begin()) / float(total) << "%" << endl;
-
-		intersectingParticles.erase(nonIntersecting, intersectingParticles.end());
-		groupIndices.push_back(particlesInBox.size());
-
-		m_data.assign(m_data.size(), 0.f);
+		cout << "grouped " << stats.numParticles << " particles in " << stats.numGroups << " non intersecting groups, " <<
+				stats.numPasses << " passes over " << stats.numBricks << " bricks " << float(now - then)/1000 << "ms." << endl;
 	}
 
-	particlesHalfInBox.resize(particlesInBox.size());
 	{
 		auto minLimit = std::min(0.f, minDensity);
 		auto scale = 1./(maxDensity - minLimit);
 		auto offset = -minLimit;
-		std::transform(particlesInBox.begin(), particlesInBox.end(), particlesHalfInBox.begin(), [&](Particle & p){
+		for(auto & p: particlesInBox){
 			p.density = ent::offset_scale(p.density, offset, scale);
-			return HalfParticle(p);
-		});
+		}
 	}
+
+	#if USE_HALF_PARTICLE
+	{
+		auto then = ofGetElapsedTimeMicros();
+		halfQuantization = HalfParticles::getQuantization(coordsRange);
+		particlesHalfInBox.resize(particlesInBox.size());
+		HalfParticles::encode(particlesInBox.data(), particlesInBox.size(), halfQuantization, particlesHalfInBox.data(), &halfStats);
+		auto now = ofGetElapsedTimeMicros();
+		cout << "time to convert " << halfStats.numParticles << " particles to half " << float(now - then)/1000 << "ms. " <<
+				(HalfParticles::hasF16C() ? "(f16c)" : "(scalar)") << endl;
+	}
+	#endif
 #endif
 
-#if USE_VOXELS_COMPUTE_SHADER || USE_RAW
+#if USE_VOXELS_CODEC || USE_RAW
 	float maxSize = 0;
 	float avgSize = 0;
 	for(auto & particle: particlesInBox){
-		float octree_coords_x = ent::offset_scale(particle.pos.x, offset.x, scale);
-		float octree_coords_y = ent::offset_scale(particle.pos.y, offset.y, scale);
-		float octree_coords_z = ent::offset_scale(particle.pos.z, offset.z, scale);
-
-		glm::vec3 particlepos = {octree_coords_x, octree_coords_y, octree_coords_z};
 		float psize = particle.size * scale;
 		maxSize = std::max(maxSize, psize);
 		avgSize += psize;
-
-		if(int(psize)>1){
-			Box particleBox = { particlepos - glm::vec3{psize*0.5,psize*0.5,psize*0.5}, particlepos + glm::vec3{psize*0.5,psize*0.5,psize*0.5}};
-			float particleVolume = boxVolume(psize);
-			auto min_x = idx_clamp(int(octree_coords_x-psize), isize-1);
-			auto max_x = idx_clamp(int(octree_coords_x+psize), isize);
-			auto min_y = idx_clamp(int(octree_coords_y-psize), isize-1);
-			auto max_y = idx_clamp(int(octree_coords_y+psize), isize);
-			auto min_z = idx_clamp(int(octree_coords_z-psize), isize-1);
-			auto max_z = idx_clamp(int(octree_coords_z+psize), isize);
-			for(size_t z = min_z; z<max_z; z++){
-				for(size_t y = min_y; y<max_y; y++){
-					for(size_t x = min_x; x<max_x; x++){
-						glm::vec3 voxelpos = {x, y, z};
-						Box voxel = {voxelpos, voxelpos + glm::vec3{1.0f, 1.0f, 1.0f}};
-						auto factor = boxesIntersectionVolume(voxel, particleBox) / particleVolume;
-						this->add(x, y, z, factor * particle.density);
-					}
-				}
-			}
-		}else{
-			this->add(octree_coords_x, octree_coords_y, octree_coords_z, particle.density);
-		}
 	}
 	avgSize /= particlesInBox.size();
 
+	auto then = ofGetElapsedTimeMicros();
+	splatter.splat(particlesInBox, offset, scale, size, m_data);
+	auto now = ofGetElapsedTimeMicros();
+	cout << "time to splat " << particlesInBox.size() << " particles into " << splatter.getNumBinnedParticles() << " tile entries " << float(now - then)/1000 << "ms." << endl;
+
 	cout << "max particle size " << maxSize << endl;
 	cout << "avg particle size " << avgSize << endl;
 
@@ -334,3 +257,11 @@ const std::vector<size_t> & Vapor3DTexture::getGroupIndices() const{
 const std::vector<HalfParticle> & Vapor3DTexture::getHalfParticlesInBox() const{
 	return particlesHalfInBox;
 }
+
+const HalfParticles::Quantization & Vapor3DTexture::getHalfQuantization() const{
+	return halfQuantization;
+}
+
+const HalfParticles::Stats & Vapor3DTexture::getHalfStats() const{
+	return halfStats;
+}
@@ -6,18 +6,27 @@
 #include "ofPixels.h"
 #include "Particle.h"
 #include "ofxRange.h"
+#include "VoxelSplatter.h"
+#include "ParticleGrouper.h"
+#include "HalfParticles.h"
 
 
 class Vapor3DTexture
 {
 	public:
 		void setup(const std::vector<Particle> & particles, size_t size, float minDensity, float maxDensity, ofxRange3f coordsRange);
+		// Same as setup for particles that are already filtered to
+		// coordsRange and MAX_PARTICLE_SIZE, eg. by ParticleFilter.
+		void setupFiltered(std::vector<Particle> && particles, size_t size, float minDensity, float maxDensity, ofxRange3f coordsRange);
+		static float getScale(size_t size, const ofxRange3f & coordsRange);
 		size_t size() const;
 		const std::vector<float> & data() const;
 		std::vector<float> & data();
 		std::pair<float,float> minmax() const;
 		const std::vector<Particle> & getParticlesInBox() const;
 		const std::vector<HalfParticle> & getHalfParticlesInBox() const;
+		const HalfParticles::Quantization & getHalfQuantization() const;
+		const HalfParticles::Stats & getHalfStats() const;
 		const std::vector<size_t> & getGroupIndices() const;
 	private:
 		inline void add(size_t x, size_t y, size_t z, float value);
@@ -28,7 +37,11 @@ class Vapor3DTexture
 		size_t m_size, m_cubesize, m_quadsize;
 		std::vector<Particle> particlesInBox;
 		std::vector<HalfParticle> particlesHalfInBox;
+		HalfParticles::Quantization halfQuantization;
+		HalfParticles::Stats halfStats;
 		std::vector<size_t> groupIndices;
+		VoxelSplatter splatter;
+		ParticleGrouper grouper;
 };
 
 #endif // OCTREE_H
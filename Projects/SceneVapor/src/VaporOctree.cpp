@@ -7,53 +7,10 @@
 #include "ofUtils.h"
 #include "ofxEasing.h"
 #include "Helpers.h"
+#include "Billboard.h"
 #include <future>
 #include <numeric>
-
-namespace {
-void billboard(const ofTrueTypeFont & f, std::string text, glm::mat4 projection, glm::mat4 modelview, glm::vec3 pos){
-	auto rViewport = ofGetCurrentViewport();
-
-	auto mat = projection * modelview;
-	auto dScreen4 = mat * glm::vec4(pos,1.0);
-	auto dScreen = dScreen4.xyz() / dScreen4.w;
-	dScreen += glm::vec3(1.0) ;
-	dScreen *= 0.5;
-
-	dScreen.x += rViewport.x;
-	dScreen.x *= rViewport.width;
-
-	dScreen.y += rViewport.y;
-	dScreen.y *= rViewport.height;
-
-	if (dScreen.z >= 1) return;
-
-
-	ofSetMatrixMode(OF_MATRIX_PROJECTION);
-	ofPushMatrix();
-	ofLoadIdentityMatrix();
-
-	ofSetMatrixMode(OF_MATRIX_MODELVIEW);
-	ofPushMatrix();
-
-	glm::mat4 modelView;
-	modelView = glm::translate(modelView, glm::vec3(-1,-1,0));
-	modelView = glm::scale(modelView, glm::vec3(2/rViewport.width, 2/rViewport.height, 1));
-	modelView = glm::translate(modelView, glm::vec3(dScreen.x, dScreen.y, 0));
-	ofLoadMatrix(modelView);
-	auto m = f.getStringMesh(text, 0, 0, false);
-	f.getFontTexture().bind();
-	m.draw();
-	f.getFontTexture().unbind();
-
-
-	ofSetMatrixMode(OF_MATRIX_PROJECTION);
-	ofPopMatrix();
-
-	ofSetMatrixMode(OF_MATRIX_MODELVIEW);
-	ofPopMatrix();
-}
-}
+#include "tbb/tbb.h"
 
 struct BoundingBoxSearch {
 	inline BoundingBoxSearch(const ofVec3f & min, const ofVec3f & max, float density)
@@ -100,6 +57,11 @@ void VaporOctree::setup(const std::vector <Particle> & particles){
 }
 
 
+void VaporOctree::setBoundingBox(const BoundingBox & bb){
+	this->bb = bb;
+	firstFrame = false;
+}
+
 bool VaporOctree::divide(size_t resolution, float minDensity, float maxDensity){
 	float span = maxDensity - minDensity;
 	float thresDensity = minDensity + span * 0.002f;
@@ -353,14 +315,102 @@ ofFloatPixels VaporOctree::getPixels(size_t z, float minDensity, float maxDensit
 	ofFloatPixels pixels;
 	size_t size = pow(2, resolution);
 	pixels.allocate(size, size, 1);
-	for(size_t y = 0, i = 0; y < size; ++y){
-		for(size_t x = 0; x < size; ++x, i++){
-			pixels[i] = getDensity(x, y, z) > 0 ? 1.0 : 0.0; //ofMap(getDensity(x,y,z), minDensity, maxDensity, 0, 1.0);
+	rasterize(glm::uvec3(0, 0, z), glm::uvec3(size, size, z + 1), Occupancy, pixels.getData(), size, size * size);
+	return pixels;
+}
+
+void VaporOctree::rasterize(const glm::uvec3 & min, const glm::uvec3 & max, RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const{
+	if(min.x >= max.x || min.y >= max.y || min.z >= max.z){
+		return;
+	}
+	rasterize(min, max - glm::uvec3(1), min, mode, voxels, rowStride, sliceStride);
+}
+
+void VaporOctree::rasterize(const glm::uvec3 & lo, const glm::uvec3 & hi, const glm::uvec3 & origin, RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const{
+	if(isLeaf()){
+		float value = mode == Occupancy ? (density > 0 ? 1.0 : 0.0) : density;
+		for(size_t z = lo.z; z <= hi.z; ++z){
+			for(size_t y = lo.y; y <= hi.y; ++y){
+				auto row = voxels + (z - origin.z) * sliceStride + (y - origin.y) * rowStride;
+				std::fill(row + (lo.x - origin.x), row + (hi.x - origin.x + 1), value);
+			}
+		}
+		return;
+	}
+
+	// Same routing as getDensity, coordinates equal to the center go
+	// to the lower child.
+	glm::uvec3 center(this->x, this->y, this->z);
+	for(size_t i = 0; i < children.size(); ++i){
+		glm::uvec3 upper((i >> 2) & 1, (i >> 1) & 1, i & 1);
+		auto childLo = lo;
+		auto childHi = hi;
+		bool empty = false;
+		for(size_t c = 0; c < 3; ++c){
+			if(upper[c]){
+				childLo[c] = std::max(lo[c], center[c] + 1);
+			}else{
+				childHi[c] = std::min(hi[c], center[c]);
+			}
+			empty |= childLo[c] > childHi[c];
 		}
+		if(!empty){
+			children[i].rasterize(childLo, childHi, origin, mode, voxels, rowStride, sliceStride);
+		}
+	}
+}
+
+std::vector<float> VaporOctree::getVoxels(RasterMode mode) const{
+	return std::move(getVoxelsPyramid(mode, 1).front());
+}
+
+std::vector<std::vector<float>> VaporOctree::getVoxelsPyramid(RasterMode mode, size_t numLevels) const{
+	return rasterizeVoxelsPyramid(resolution, numLevels, [&](const glm::uvec3 & min, const glm::uvec3 & max, float * voxels, size_t rowStride, size_t sliceStride){
+		rasterize(min, max, mode, voxels, rowStride, sliceStride);
+	});
+}
+
+std::vector<std::vector<float>> rasterizeVoxelsPyramid(size_t resolution, size_t numLevels, const VoxelRasterizer & rasterize){
+	const size_t BlockSize = 32;
+	size_t size = size_t(1) << resolution;
+	std::vector<std::vector<float>> pyramid(1);
+	auto & voxels = pyramid.back();
+	voxels.resize(size * size * size);
+	tbb::parallel_for(tbb::blocked_range3d<size_t>(0, size, BlockSize, 0, size, BlockSize, 0, size, BlockSize), [&](const tbb::blocked_range3d<size_t> & r){
+		glm::uvec3 min(r.cols().begin(), r.rows().begin(), r.pages().begin());
+		glm::uvec3 max(r.cols().end(), r.rows().end(), r.pages().end());
+		auto block = voxels.data() + (size_t(min.z) * size + min.y) * size + min.x;
+		rasterize(min, max, block, size, size * size);
+	});
+	while(pyramid.size() < numLevels && size > 1){
+		auto level = VaporOctree::downsample(pyramid.back(), size);
+		pyramid.push_back(std::move(level));
+		size /= 2;
 	}
-	return std::move(pixels);
+	return pyramid;
 }
 
+std::vector<float> VaporOctree::downsample(const std::vector<float> & voxels, size_t size){
+	size_t half = size / 2;
+	std::vector<float> level(half * half * half);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, half), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t z = r.begin(); z < r.end(); ++z){
+			for(size_t y = 0; y < half; ++y){
+				auto src0 = voxels.data() + ((z * 2) * size + y * 2) * size;
+				auto src1 = src0 + size;
+				auto src2 = src0 + size * size;
+				auto src3 = src2 + size;
+				auto dst = level.data() + (z * half + y) * half;
+				for(size_t x = 0; x < half; ++x){
+					auto x0 = x * 2;
+					auto x1 = x0 + 1;
+					dst[x] = (src0[x0] + src0[x1] + src1[x0] + src1[x1] + src2[x0] + src2[x1] + src3[x0] + src3[x1]) * 0.125f;
+				}
+			}
+		}
+	});
+	return level;
+}
 
 float VaporOctree::getDensity(size_t x, size_t y, size_t z) const {
 	if(children.empty()){
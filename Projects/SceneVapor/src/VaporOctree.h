@@ -6,6 +6,7 @@
 #include "ofPixels.h"
 #include "Particle.h"
 #include "ofMesh.h"
+#include <functional>
 
 
 class VaporOctree
@@ -13,6 +14,10 @@ class VaporOctree
 	public:
 		VaporOctree();
 		void setup(const std::vector<Particle> & particles);
+
+		// The box the grid covers, instead of the bounds of the particles
+		// of the first setup.
+		void setBoundingBox(const BoundingBox & bb);
 		void compute(size_t resolution, float minDensity, float maxDensity);
 		float getDensity() const;
 		bool isLeaf() const;
@@ -33,11 +38,32 @@ class VaporOctree
 
 		ofMesh getMesh(float minDensity, float maxDensity, MeshSort meshsort, int minLevel) const;
 
+		enum RasterMode{
+			Density,
+			Occupancy,
+		};
+
+		// Writes the value of the leafs covering the voxels in [min, max)
+		// of the 2^resolution³ grid walking the tree once. voxels points to
+		// the voxel at min, strides are in floats.
+		void rasterize(const glm::uvec3 & min, const glm::uvec3 & max, RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const;
+
+		// Whole grid rasterized in parallel over disjoint blocks.
+		std::vector<float> getVoxels(RasterMode mode) const;
+
+		// getVoxels followed by up to numLevels - 1 levels each half the
+		// size of the previous one.
+		std::vector<std::vector<float>> getVoxelsPyramid(RasterMode mode, size_t numLevels) const;
+
+		// 2x2x2 box filter of a size³ grid.
+		static std::vector<float> downsample(const std::vector<float> & voxels, size_t size);
+
 	private:
 		void compute(size_t resolution, float minDensity, float maxDensity, size_t level);
 		bool divide(size_t resolution, float minDensity, float maxDensity);
 		void getChildrenRecursively(std::vector<const VaporOctree*> & childrenPtr) const;
 		size_t getMaxLevel(size_t current) const;
+		void rasterize(const glm::uvec3 & lo, const glm::uvec3 & hi, const glm::uvec3 & origin, RasterMode mode, float * voxels, size_t rowStride, size_t sliceStride) const;
 		std::shared_ptr<std::vector<Particle>> particles;
 		std::vector<size_t> particlesIndex;
 		BoundingBox bb;
@@ -49,4 +75,13 @@ class VaporOctree
 		bool firstFrame = true;
 };
 
+// A tree's rasterize(min, max, voxels, rowStride, sliceStride) for one
+// mode.
+typedef std::function<void(const glm::uvec3 & min, const glm::uvec3 & max, float * voxels, size_t rowStride, size_t sliceStride)> VoxelRasterizer;
+
+// Rasterizes the whole 2^resolution³ grid in parallel over disjoint
+// blocks, followed by up to numLevels - 1 levels each half the size of
+// the previous one. Shared by VaporOctree and LinearVaporOctree.
+std::vector<std::vector<float>> rasterizeVoxelsPyramid(size_t resolution, size_t numLevels, const VoxelRasterizer & rasterize);
+
 #endif // OCTREE_H
@@ -0,0 +1,398 @@
+#include "VoxelCodec.h"
+#include "ofLog.h"
+#include "tbb/tbb.h"
+#include <bitset>
+#include <cmath>
+
+namespace{
+	constexpr size_t MaskWords = VoxelCodec::BrickSize * VoxelCodec::BrickSize * VoxelCodec::BrickSize / 64;
+
+	struct BrickInfo{
+		uint64_t mask[MaskWords];
+		uint32_t count;
+		uint32_t bits;
+		int64_t base;
+		uint64_t bytes;
+		double error;
+	};
+
+	inline uint32_t floatBits(float v){
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		return bits;
+	}
+
+	inline uint32_t bitWidth(uint64_t range){
+		uint32_t bits = 0;
+		while(bits < 64 && (range >> bits) != 0){
+			++bits;
+		}
+		return bits;
+	}
+
+	inline void pack(uint64_t * words, uint64_t k, uint32_t bits, uint64_t value){
+		auto pos = k * bits;
+		auto w = pos / 64;
+		auto s = pos % 64;
+		words[w] |= value << s;
+		if(s + bits > 64){
+			words[w + 1] |= value >> (64 - s);
+		}
+	}
+
+	// Calls f(voxel index in the volume, bit in the brick mask) for
+	// every voxel of a brick that falls inside the volume.
+	template<typename F>
+	inline void forEachVoxel(size_t brick, size_t bricksPerSide, size_t size, F && f){
+		const size_t B = VoxelCodec::BrickSize;
+		size_t x0 = (brick % bricksPerSide) * B;
+		size_t y0 = (brick / bricksPerSide % bricksPerSide) * B;
+		size_t z0 = (brick / bricksPerSide / bricksPerSide) * B;
+		size_t x1 = std::min(x0 + B, size);
+		size_t y1 = std::min(y0 + B, size);
+		size_t z1 = std::min(z0 + B, size);
+		for(size_t z = z0; z < z1; ++z){
+			for(size_t y = y0; y < y1; ++y){
+				auto row = (z * size + y) * size;
+				auto bit = ((z - z0) * B + (y - y0)) * B;
+				for(size_t x = x0; x < x1; ++x){
+					f(row + x, bit + x - x0);
+				}
+			}
+		}
+	}
+
+	// Calls f(pointer to the row start, row width, bit of the row start
+	// in the brick mask) for every row of a brick inside the volume.
+	template<typename F>
+	inline void forEachRow(size_t brick, size_t bricksPerSide, size_t size, float * voxels, F && f){
+		const size_t B = VoxelCodec::BrickSize;
+		size_t x0 = (brick % bricksPerSide) * B;
+		size_t y0 = (brick / bricksPerSide % bricksPerSide) * B;
+		size_t z0 = (brick / bricksPerSide / bricksPerSide) * B;
+		size_t x1 = std::min(x0 + B, size);
+		size_t y1 = std::min(y0 + B, size);
+		size_t z1 = std::min(z0 + B, size);
+		for(size_t z = z0; z < z1; ++z){
+			for(size_t y = y0; y < y1; ++y){
+				f(voxels + (z * size + y) * size + x0, x1 - x0, ((z - z0) * B + (y - y0)) * B);
+			}
+		}
+	}
+}
+
+std::vector<char> VoxelCodec::encode(const float * voxels, size_t size, Mode mode, float maxError, Stats * stats){
+	return encodeBricks(voxels, nullptr, size, mode, maxError, 0, 0, stats);
+}
+
+std::vector<char> VoxelCodec::encodeDelta(const float * voxels, const float * reference, size_t size, Mode mode, float maxError,
+										  uint32_t keyDistance, uint64_t referenceChecksum, Stats * stats){
+	return encodeBricks(voxels, reference, size, mode, maxError, keyDistance, referenceChecksum, stats);
+}
+
+std::vector<char> VoxelCodec::encodeBricks(const float * voxels, const float * reference, size_t size, Mode mode, float maxError,
+										   uint32_t keyDistance, uint64_t referenceChecksum, Stats * stats){
+	auto bricksPerSide = (size + BrickSize - 1) / BrickSize;
+	auto numBricks = bricksPerSide * bricksPerSide * bricksPerSide;
+	double step = getStep(mode, maxError);
+	auto quantize = [&](float v){
+		return int64_t(std::llround(v / step));
+	};
+
+	// Values stored for a voxel, for deltas against the previous frame
+	// the quantized difference. Reference voxels were decoded as q * step
+	// so quantizing them again gives back the same q.
+	auto quantizeDelta = [&](size_t i){
+		return reference ? quantize(voxels[i]) - quantize(reference[i]) : quantize(voxels[i]);
+	};
+	auto changed = [&](size_t i){
+		return reference ? floatBits(voxels[i]) != floatBits(reference[i]) : floatBits(voxels[i]) != 0;
+	};
+
+	//------------------------------------
+	// Mask, value range and size of every brick
+	std::vector<BrickInfo> infos(numBricks);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numBricks), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t brick = r.begin(); brick < r.end(); ++brick){
+			auto & info = infos[brick];
+			std::fill(info.mask, info.mask + MaskWords, 0);
+			info.count = 0;
+			info.error = 0;
+			int64_t minQ = std::numeric_limits<int64_t>::max();
+			int64_t maxQ = std::numeric_limits<int64_t>::lowest();
+			forEachVoxel(brick, bricksPerSide, size, [&](size_t i, size_t bit){
+				bool stored;
+				if(mode == Lossless){
+					stored = changed(i);
+				}else{
+					auto q = quantizeDelta(i);
+					stored = q != 0;
+					if(stored){
+						minQ = std::min(minQ, q);
+						maxQ = std::max(maxQ, q);
+					}
+				}
+				if(stored){
+					info.mask[bit / 64] |= uint64_t(1) << (bit % 64);
+					info.count += 1;
+				}
+			});
+
+			if(info.count == 0){
+				info.bits = 0;
+				info.base = 0;
+				info.bytes = 0;
+			}else if(mode == Lossless){
+				info.bits = 32;
+				info.base = 0;
+				info.bytes = sizeof(info.mask) + (info.count * sizeof(float) + 7) / 8 * 8;
+			}else{
+				info.bits = bitWidth(uint64_t(maxQ) - uint64_t(minQ));
+				info.base = minQ;
+				info.bytes = sizeof(info.mask) + (uint64_t(info.count) * info.bits + 63) / 64 * 8;
+			}
+		}
+	});
+
+	//------------------------------------
+	// Layout: header, stored bricks table, payload
+	std::vector<Brick> bricks;
+	uint64_t payloadSize = 0;
+	for(size_t brick = 0; brick < numBricks; ++brick){
+		auto & info = infos[brick];
+		if(info.count == 0){
+			continue;
+		}
+		bricks.push_back({uint32_t(brick), info.bits, info.base, payloadSize});
+		payloadSize += info.bytes;
+	}
+
+	Header header;
+	header.magic = Magic;
+	header.version = Version;
+	header.size = size;
+	header.mode = mode;
+	header.step = step;
+	header.numBricks = bricks.size();
+	header.keyDistance = keyDistance;
+	header.reserved = 0;
+	header.referenceChecksum = referenceChecksum;
+	auto payloadStart = sizeof(Header) + bricks.size() * sizeof(Brick);
+	std::vector<char> data(payloadStart + payloadSize, 0);
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(Header), bricks.data(), bricks.size() * sizeof(Brick));
+
+	//------------------------------------
+	// Payload
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, bricks.size()), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t b = r.begin(); b < r.end(); ++b){
+			auto & brick = bricks[b];
+			auto & info = infos[brick.index];
+			auto out = data.data() + payloadStart + brick.offset;
+			memcpy(out, info.mask, sizeof(info.mask));
+			out += sizeof(info.mask);
+			uint64_t k = 0;
+			if(mode == Lossless){
+				forEachVoxel(brick.index, bricksPerSide, size, [&](size_t i, size_t bit){
+					if(info.mask[bit / 64] & (uint64_t(1) << (bit % 64))){
+						memcpy(out + k * sizeof(float), voxels + i, sizeof(float));
+						k += 1;
+					}
+				});
+			}else{
+				auto words = reinterpret_cast<uint64_t*>(out);
+				forEachVoxel(brick.index, bricksPerSide, size, [&](size_t i, size_t bit){
+					auto q = quantizeDelta(i);
+					if(info.mask[bit / 64] & (uint64_t(1) << (bit % 64))){
+						if(brick.bits > 0){
+							pack(words, k, brick.bits, uint64_t(q) - uint64_t(brick.base));
+						}
+						k += 1;
+					}
+					auto decoded = float(double(quantize(voxels[i])) * step);
+					info.error = std::max(info.error, std::abs(double(decoded) - double(voxels[i])));
+				});
+			}
+		}
+	});
+
+	if(stats){
+		stats->numBricks = numBricks;
+		stats->numStoredBricks = bricks.size();
+		stats->numStoredVoxels = 0;
+		stats->maxError = 0;
+		for(auto & info: infos){
+			stats->numStoredVoxels += info.count;
+			stats->maxError = std::max(stats->maxError, info.error);
+		}
+		stats->bytes = data.size();
+	}
+
+	return data;
+}
+
+bool VoxelCodec::readHeader(const char * data, size_t dataSize, Header & header){
+	if(data == nullptr || dataSize < sizeof(Header)){
+		return false;
+	}
+	memcpy(&header, data, sizeof(Header));
+	return header.magic == Magic &&
+		   header.version == Version &&
+		   (header.mode == Lossless || header.mode == Quantized) &&
+		   header.numBricks <= (dataSize - sizeof(Header)) / sizeof(Brick);
+}
+
+bool VoxelCodec::isKeyFrame(const Header & header){
+	return header.keyDistance == 0;
+}
+
+double VoxelCodec::getStep(Mode mode, float maxError){
+	if(mode != Quantized || maxError <= 0){
+		return 0.0;
+	}
+	int exponent;
+	std::frexp(2.0 * maxError, &exponent);
+	return std::ldexp(1.0, exponent - 1);
+}
+
+bool VoxelCodec::decode(const char * data, size_t dataSize, std::vector<float> & voxels){
+	return decodeBricks(data, dataSize, voxels, false);
+}
+
+bool VoxelCodec::applyDelta(const char * data, size_t dataSize, std::vector<float> & voxels){
+	return decodeBricks(data, dataSize, voxels, true);
+}
+
+bool VoxelCodec::decodeBricks(const char * data, size_t dataSize, std::vector<float> & voxels, bool delta){
+	Header header;
+	if(!readHeader(data, dataSize, header)){
+		ofLogError("VoxelCodec::decode") << "Wrong header";
+		return false;
+	}
+	if(isKeyFrame(header) == delta){
+		ofLogError("VoxelCodec::decode") << (delta ? "Expected a delta, found a key-frame" : "Expected a key-frame, found a delta");
+		return false;
+	}
+
+	size_t size = header.size;
+	auto bricksPerSide = (size + BrickSize - 1) / BrickSize;
+	auto numBricks = bricksPerSide * bricksPerSide * bricksPerSide;
+	auto bricks = reinterpret_cast<const Brick*>(data + sizeof(Header));
+	auto payloadStart = sizeof(Header) + header.numBricks * sizeof(Brick);
+	auto payloadSize = dataSize - payloadStart;
+
+	// Bricks are stored in increasing index order, checking it also
+	// guarantees no brick is written twice by the parallel loop below.
+	std::vector<int32_t> lookup(delta ? 0 : numBricks, -1);
+	for(size_t b = 0; b < header.numBricks; ++b){
+		auto & brick = bricks[b];
+		if(brick.index >= numBricks || brick.bits > 64 || brick.offset + sizeof(uint64_t) * MaskWords > payloadSize ||
+		   (b > 0 && brick.index <= bricks[b - 1].index)){
+			ofLogError("VoxelCodec::decode") << "Brick " << b << " is out of bounds";
+			return false;
+		}
+		if(!delta){
+			lookup[brick.index] = b;
+		}
+	}
+
+	if(delta && voxels.size() != size * size * size){
+		ofLogError("VoxelCodec::decode") << "Delta of a " << size << "³ volume applied to " << voxels.size() << " voxels";
+		return false;
+	}
+	voxels.resize(size * size * size);
+	std::atomic<bool> corrupted{false};
+	auto numTasks = delta ? header.numBricks : numBricks;
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numTasks), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t t = r.begin(); t < r.end(); ++t){
+			if(!delta && lookup[t] < 0){
+				forEachRow(t, bricksPerSide, size, voxels.data(), [&](float * row, size_t width, size_t){
+					std::fill(row, row + width, 0.f);
+				});
+				continue;
+			}
+
+			auto & brick = bricks[delta ? t : lookup[t]];
+			auto b = brick.index;
+			auto in = data + payloadStart + brick.offset;
+			uint64_t mask[MaskWords];
+			memcpy(mask, in, sizeof(mask));
+			in += sizeof(mask);
+			size_t count = 0;
+			for(auto word: mask){
+				count += std::bitset<64>(word).count();
+			}
+			auto valuesBytes = header.mode == Lossless ? count * sizeof(float) : (count * brick.bits + 63) / 64 * 8;
+			if(brick.offset + sizeof(mask) + valuesBytes > payloadSize){
+				corrupted = true;
+				continue;
+			}
+
+			// Unpack the whole brick first so the scatter below is a
+			// plain copy, full rows in one go. Deltas keep the quantized
+			// differences, they need the reference voxel to be decoded.
+			// Lossless values are read in place.
+			float unpacked[BrickSize * BrickSize * BrickSize];
+			int64_t deltas[BrickSize * BrickSize * BrickSize];
+			auto values = reinterpret_cast<const char*>(unpacked);
+			if(header.mode == Lossless){
+				values = in;
+			}else{
+				auto words = reinterpret_cast<const uint64_t*>(in);
+				auto bits = brick.bits;
+				auto valueMask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+				uint64_t pos = 0;
+				for(size_t k = 0; k < count; ++k, pos += bits){
+					auto w = pos / 64;
+					auto s = pos % 64;
+					auto value = bits == 0 ? 0 : words[w] >> s;
+					if(s + bits > 64){
+						value |= words[w + 1] << (64 - s);
+					}
+					auto q = brick.base + int64_t(value & valueMask);
+					if(delta){
+						deltas[k] = q;
+					}else{
+						unpacked[k] = float(double(q) * header.step);
+					}
+				}
+			}
+
+			size_t k = 0;
+			forEachRow(b, bricksPerSide, size, voxels.data(), [&](float * row, size_t width, size_t bit){
+				auto rowMask = (mask[bit / 64] >> (bit % 64)) & 0xff;
+				if(rowMask == 0){
+					if(!delta){
+						std::fill(row, row + width, 0.f);
+					}
+					return;
+				}
+				if(rowMask == 0xff && width == BrickSize && (header.mode == Lossless || !delta)){
+					memcpy(row, values + k * sizeof(float), BrickSize * sizeof(float));
+					k += BrickSize;
+					return;
+				}
+				for(size_t x = 0; x < width; ++x, rowMask >>= 1){
+					if((rowMask & 1) == 0){
+						if(!delta){
+							row[x] = 0;
+						}
+					}else if(header.mode == Lossless || !delta){
+						memcpy(row + x, values + k * sizeof(float), sizeof(float));
+						k += 1;
+					}else{
+						auto q = deltas[k] + int64_t(std::llround(row[x] / header.step));
+						row[x] = float(double(q) * header.step);
+						k += 1;
+					}
+				}
+			});
+		}
+	});
+
+	if(corrupted){
+		ofLogError("VoxelCodec::decode") << "Corrupted brick data";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,90 @@
+#ifndef VOXEL_CODEC_H
+#define VOXEL_CODEC_H
+
+#include "ofConstants.h"
+
+// Sparse codec for size³ density volumes.
+//
+// The volume is split in 8³ bricks, bricks where every voxel is zero
+// are not stored at all. Every other brick stores a 512 bit mask of its
+// non zero voxels followed by their values, either as the original
+// floats (Lossless) or as integers quantized to steps of the largest
+// power of two not above 2 * maxError and bit packed with the smallest
+// width that fits the brick (Quantized). A power of two step makes the
+// decoded q * step exact in float, so every decoded voxel is within
+// maxError of the original without float rounding on top.
+//
+// A frame can also be encoded as a delta against the decoded previous
+// frame of a sequence: only bricks with voxels that changed are stored,
+// their mask marks the changed voxels and the values are the new floats
+// (Lossless) or the difference of the quantized values (Quantized), so
+// the error stays within maxError no matter how long the chain of
+// deltas is. keyDistance counts the deltas since the last key-frame and
+// referenceChecksum identifies the stream the delta was encoded against.
+//
+// Bricks are encoded and decoded in parallel and each one is written
+// by a single task, decoding writes every voxel of the volume exactly
+// once and applying a delta only touches the stored bricks.
+class VoxelCodec
+{
+public:
+	enum Mode: uint32_t{
+		Lossless,
+		Quantized,
+	};
+
+	static constexpr size_t BrickSize = 8;
+	static constexpr uint32_t Magic = 0x43584f56; // VOXC
+	static constexpr uint32_t Version = 2;
+
+	struct Header{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t size;
+		Mode mode;
+		double step;
+		uint64_t numBricks;
+		uint32_t keyDistance;
+		uint32_t reserved;
+		uint64_t referenceChecksum;
+	};
+
+	struct Stats{
+		size_t numBricks = 0;
+		size_t numStoredBricks = 0;
+		size_t numStoredVoxels = 0;
+		size_t bytes = 0;
+		double maxError = 0;
+	};
+
+	static std::vector<char> encode(const float * voxels, size_t size, Mode mode, float maxError, Stats * stats = nullptr);
+
+	// reference has to be the decoded previous frame, not the original.
+	static std::vector<char> encodeDelta(const float * voxels, const float * reference, size_t size, Mode mode, float maxError,
+										 uint32_t keyDistance, uint64_t referenceChecksum, Stats * stats = nullptr);
+
+	// decode only accepts key-frames, applyDelta expects voxels to hold
+	// the frame the delta was encoded against.
+	static bool decode(const char * data, size_t dataSize, std::vector<float> & voxels);
+	static bool applyDelta(const char * data, size_t dataSize, std::vector<float> & voxels);
+	static bool readHeader(const char * data, size_t dataSize, Header & header);
+
+	static bool isKeyFrame(const Header & header);
+
+	// Quantization step used for maxError, 0 in Lossless mode.
+	static double getStep(Mode mode, float maxError);
+
+private:
+	static std::vector<char> encodeBricks(const float * voxels, const float * reference, size_t size, Mode mode, float maxError,
+										  uint32_t keyDistance, uint64_t referenceChecksum, Stats * stats);
+	static bool decodeBricks(const char * data, size_t dataSize, std::vector<float> & voxels, bool delta);
+
+	struct Brick{
+		uint32_t index;
+		uint32_t bits;
+		int64_t base;
+		uint64_t offset;
+	};
+};
+
+#endif // VOXEL_CODEC_H
@@ -0,0 +1,46 @@
+#ifndef VOXEL_FOOTPRINT_H
+#define VOXEL_FOOTPRINT_H
+
+#include "ofConstants.h"
+#include "ofVectorMath.h"
+
+// Voxels a particle touches when splatted, shared by VoxelSplatter and
+// ParticleGrouper so both agree on the footprint. Same as
+// shaders/particles2texture3d.glsl computes it.
+namespace voxel{
+	inline size_t idx_clamp(int value, int size){
+		return size_t(std::max(std::min(value, size),0));
+	}
+
+	struct Box{
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	inline float boxVolume(float size) {
+		return size * size * size;
+	}
+
+	inline float boxesIntersectionVolume(const Box & b1, const Box & b2){
+		return std::max(std::min(b1.max.x, b2.max.x) - std::max(b1.min.x, b2.min.x),0.f)
+		* std::max(std::min(b1.max.y, b2.max.y) - std::max(b1.min.y, b2.min.y),0.f)
+		* std::max(std::min(b1.max.z, b2.max.z) - std::max(b1.min.z, b2.min.z),0.f);
+	}
+
+	// Voxel range [min, max) covered by a particle at pos, in voxels, of
+	// size psize in a size³ grid. Particles of a voxel or less land in
+	// the single voxel they are in.
+	inline void footprintRange(const glm::vec3 & pos, float psize, int size, uint16_t min[3], uint16_t max[3]){
+		for(int c = 0; c < 3; ++c){
+			if(int(psize)>1){
+				min[c] = idx_clamp(int(pos[c]-psize), size-1);
+				max[c] = idx_clamp(int(pos[c]+psize), size);
+			}else{
+				min[c] = idx_clamp(int(pos[c]), size-1);
+				max[c] = min[c] + 1;
+			}
+		}
+	}
+}
+
+#endif // VOXEL_FOOTPRINT_H
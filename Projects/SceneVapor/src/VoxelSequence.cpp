@@ -0,0 +1,125 @@
+#include "VoxelSequence.h"
+#include "tbb/tbb.h"
+
+namespace ent
+{
+	//--------------------------------------------------------------
+	void VoxelSequence::setup(Loader loader){
+		clear();
+		this->loader = loader;
+	}
+
+	//--------------------------------------------------------------
+	void VoxelSequence::clear(){
+		voxels.clear();
+		frameIndex = -1;
+		checksum = 0;
+		keyDistance = 0;
+		stats = Stats();
+	}
+
+	//--------------------------------------------------------------
+	const std::vector<float> * VoxelSequence::reconstruct(int frameIndex, const FrameFile & frame){
+		auto section = frame.getSectionInfo(FrameFile::VoxelsSection);
+		size_t dataSize;
+		auto data = frame.getSectionData(FrameFile::VoxelsSection, dataSize);
+		VoxelCodec::Header header;
+		if(section == nullptr || !VoxelCodec::readHeader(data, dataSize, header)){
+			ofLogError("VoxelSequence::reconstruct") << "Frame " << frameIndex << " has no voxels";
+			return nullptr;
+		}
+
+		if(frameIndex == this->frameIndex && section->checksum == checksum){
+			stats.hits += 1;
+			return &voxels;
+		}
+
+		if(VoxelCodec::isKeyFrame(header)){
+			this->frameIndex = -1;
+			if(!VoxelCodec::decode(data, dataSize, voxels)){
+				return nullptr;
+			}
+			stats.keyFrames += 1;
+		}else{
+			// Walk back to the reference unless it's the frame we already
+			// have, the chain ends at most keyDistance frames back.
+			if(this->frameIndex != frameIndex - 1 || checksum != header.referenceChecksum){
+				auto reference = loader ? loader(frameIndex - 1) : nullptr;
+				if(!reference || !reconstruct(frameIndex - 1, *reference)){
+					ofLogError("VoxelSequence::reconstruct") << "Couldn't reconstruct the reference of frame " << frameIndex;
+					return nullptr;
+				}
+			}
+			if(checksum != header.referenceChecksum){
+				ofLogError("VoxelSequence::reconstruct") << "Frame " << frameIndex << " was encoded against a different version of frame " << frameIndex - 1;
+				return nullptr;
+			}
+			this->frameIndex = -1;
+			if(!VoxelCodec::applyDelta(data, dataSize, voxels)){
+				return nullptr;
+			}
+			stats.deltas += 1;
+		}
+
+		this->frameIndex = frameIndex;
+		checksum = section->checksum;
+		keyDistance = header.keyDistance;
+		return &voxels;
+	}
+
+	//--------------------------------------------------------------
+	const std::vector<float> * VoxelSequence::reconstruct(int frameIndex){
+		auto frame = loader ? loader(frameIndex) : nullptr;
+		if(!frame){
+			return nullptr;
+		}
+		return reconstruct(frameIndex, *frame);
+	}
+
+	//--------------------------------------------------------------
+	bool VoxelSequence::isReferenceUpToDate(int frameIndex, const VoxelCodec::Header & header) const{
+		if(VoxelCodec::isKeyFrame(header)){
+			return true;
+		}
+		auto reference = loader ? loader(frameIndex - 1) : nullptr;
+		auto section = reference ? reference->getSectionInfo(FrameFile::VoxelsSection) : nullptr;
+		return section != nullptr && section->checksum == header.referenceChecksum;
+	}
+
+	//--------------------------------------------------------------
+	std::vector<char> VoxelSequence::encode(int frameIndex, const std::vector<float> & frameVoxels, size_t size,
+											VoxelCodec::Mode mode, float maxError, size_t keyInterval,
+											VoxelCodec::Stats * stats){
+		if(keyInterval > 1){
+			if(this->frameIndex != frameIndex - 1 && loader){
+				auto reference = loader(frameIndex - 1);
+				if(reference){
+					reconstruct(frameIndex - 1, *reference);
+				}
+			}
+			if(this->frameIndex == frameIndex - 1 && keyDistance + 1 < keyInterval && voxels.size() == frameVoxels.size()){
+				return VoxelCodec::encodeDelta(frameVoxels.data(), voxels.data(), size, mode, maxError, keyDistance + 1, checksum, stats);
+			}
+		}
+		return VoxelCodec::encode(frameVoxels.data(), size, mode, maxError, stats);
+	}
+
+	//--------------------------------------------------------------
+	int VoxelSequence::getFrameIndex() const{
+		return frameIndex;
+	}
+
+	//--------------------------------------------------------------
+	const VoxelSequence::Stats & VoxelSequence::getStats() const{
+		return stats;
+	}
+
+	//--------------------------------------------------------------
+	void VoxelSequence::mix(const float * prev, const float * next, size_t count, float pct, float * out){
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, count, 65536), [&](const tbb::blocked_range<size_t> & r){
+			for(size_t i = r.begin(); i < r.end(); ++i){
+				out[i] = prev[i] + (next[i] - prev[i]) * pct;
+			}
+		});
+	}
+}
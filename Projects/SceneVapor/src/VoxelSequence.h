@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FrameFile.h"
+#include "VoxelCodec.h"
+
+namespace ent
+{
+	// Voxels of a sequence stored as key-frames plus brick deltas against
+	// the previous frame (see VoxelCodec). A frame is encoded as a delta
+	// only while the previous one can be reconstructed and the distance
+	// to the last key-frame is under the key-frame interval, so seeking
+	// to any frame decodes one key-frame and at most interval - 1 deltas.
+	//
+	// The last reconstructed frame is kept so playing forward applies a
+	// single delta per frame in place. Everything runs on the CPU, the
+	// result can be uploaded for mix3D or mixed without a GL context.
+	class VoxelSequence
+	{
+	public:
+		// Returns the frame file for an index or nullptr if it's not
+		// available, frames are only requested while walking back to
+		// the key-frame of the frame being reconstructed.
+		typedef std::function<std::shared_ptr<const FrameFile>(int frameIndex)> Loader;
+
+		struct Stats{
+			uint64_t keyFrames = 0;
+			uint64_t deltas = 0;
+			uint64_t hits = 0;
+		};
+
+		void setup(Loader loader);
+		void clear();
+
+		// Reconstructs the voxels of frameIndex. frame is the already loaded
+		// file for that index, only the frames it depends on are loaded.
+		// Returns nullptr if the frame or any of its references can't be
+		// decoded.
+		const std::vector<float> * reconstruct(int frameIndex, const FrameFile & frame);
+		const std::vector<float> * reconstruct(int frameIndex);
+
+		// Whether the reference of a delta frame, frameIndex - 1 as the
+		// loader returns it now, still has the voxels the delta was
+		// encoded against. Always true for key-frames.
+		bool isReferenceUpToDate(int frameIndex, const VoxelCodec::Header & header) const;
+
+		// Encodes the voxels of frameIndex as a delta against frameIndex - 1
+		// when possible or as a key-frame otherwise. keyInterval <= 1
+		// makes every frame a key-frame.
+		std::vector<char> encode(int frameIndex, const std::vector<float> & voxels, size_t size,
+								 VoxelCodec::Mode mode, float maxError, size_t keyInterval,
+								 VoxelCodec::Stats * stats = nullptr);
+
+		int getFrameIndex() const;
+		const Stats & getStats() const;
+
+		// CPU version of shaders/mix3D.comp.
+		static void mix(const float * prev, const float * next, size_t count, float pct, float * out);
+
+	private:
+		Loader loader;
+		std::vector<float> voxels;
+		int frameIndex = -1;
+		uint64_t checksum = 0;
+		uint32_t keyDistance = 0;
+		Stats stats;
+	};
+}
@@ -0,0 +1,180 @@
+#include "VoxelSplatter.h"
+#include "VoxelFootprint.h"
+#include "tbb/tbb.h"
+
+using namespace voxel;
+
+namespace{
+	// Particles are binned in chunks of this size, it has to be fixed
+	// and not depend on the number of threads so the binning order is
+	// always the same.
+	constexpr size_t ChunkSize = 16384;
+
+	inline uint32_t spreadBits(uint32_t v){
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v <<  8)) & 0x0300F00F;
+		v = (v | (v <<  4)) & 0x030C30C3;
+		v = (v | (v <<  2)) & 0x09249249;
+		return v;
+	}
+
+	inline uint32_t morton(uint32_t x, uint32_t y, uint32_t z){
+		return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+	}
+}
+
+void VoxelSplatter::setMode(Mode mode){
+	this->mode = mode;
+}
+
+void VoxelSplatter::splat(const std::vector<Particle> & particles, const glm::vec3 & offset, float scale, size_t size, std::vector<float> & grid){
+	int isize = int(size);
+	size_t tilesPerSide = (size + TileSize - 1) / TileSize;
+	size_t mortonSide = 1;
+	while(mortonSide < tilesPerSide){
+		mortonSide *= 2;
+	}
+	numTiles = mortonSide * mortonSide * mortonSide;
+
+	//------------------------------------
+	// Voxel footprint of every particle
+	footprints.resize(particles.size());
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particles.size()), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t i = r.begin(); i < r.end(); ++i){
+			auto & particle = particles[i];
+			auto & footprint = footprints[i];
+			footprint.pos.x = (particle.pos.x + offset.x) * scale;
+			footprint.pos.y = (particle.pos.y + offset.y) * scale;
+			footprint.pos.z = (particle.pos.z + offset.z) * scale;
+			footprint.psize = mode == ComputeShader ? particle.size * 2 * scale : particle.size * scale;
+			footprintRange(footprint.pos, footprint.psize, isize, footprint.min, footprint.max);
+		}
+	});
+
+	auto forEachTile = [&](const Footprint & footprint, auto && f){
+		if(footprint.max[0] <= footprint.min[0] || footprint.max[1] <= footprint.min[1] || footprint.max[2] <= footprint.min[2]){
+			return;
+		}
+		for(uint32_t tz = footprint.min[2] / TileSize; tz <= uint32_t(footprint.max[2] - 1) / TileSize; ++tz){
+			for(uint32_t ty = footprint.min[1] / TileSize; ty <= uint32_t(footprint.max[1] - 1) / TileSize; ++ty){
+				for(uint32_t tx = footprint.min[0] / TileSize; tx <= uint32_t(footprint.max[0] - 1) / TileSize; ++tx){
+					f(morton(tx, ty, tz));
+				}
+			}
+		}
+	};
+
+	//------------------------------------
+	// Bin particles by tile: count per tile and chunk, scan, scatter.
+	size_t numChunks = (particles.size() + ChunkSize - 1) / ChunkSize;
+	chunkCounts.assign(numTiles * numChunks, 0);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numChunks, 1), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t chunk = r.begin(); chunk < r.end(); ++chunk){
+			auto end = std::min(particles.size(), (chunk + 1) * ChunkSize);
+			for(size_t i = chunk * ChunkSize; i < end; ++i){
+				forEachTile(footprints[i], [&](uint32_t tile){
+					chunkCounts[tile * numChunks + chunk] += 1;
+				});
+			}
+		}
+	});
+
+	tileOffsets.resize(numTiles + 1);
+	uint32_t total = 0;
+	for(size_t tile = 0; tile < numTiles; ++tile){
+		tileOffsets[tile] = total;
+		for(size_t chunk = 0; chunk < numChunks; ++chunk){
+			auto count = chunkCounts[tile * numChunks + chunk];
+			chunkCounts[tile * numChunks + chunk] = total;
+			total += count;
+		}
+	}
+	tileOffsets[numTiles] = total;
+
+	tileParticles.resize(total);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numChunks, 1), [&](const tbb::blocked_range<size_t> & r){
+		for(size_t chunk = r.begin(); chunk < r.end(); ++chunk){
+			auto end = std::min(particles.size(), (chunk + 1) * ChunkSize);
+			for(size_t i = chunk * ChunkSize; i < end; ++i){
+				forEachTile(footprints[i], [&](uint32_t tile){
+					tileParticles[chunkCounts[tile * numChunks + chunk]++] = i;
+				});
+			}
+		}
+	});
+
+	//------------------------------------
+	// Accumulate each tile in a thread local scratch buffer and copy
+	// it to the grid. Every voxel belongs to exactly one tile so tiles
+	// can be written without synchronization.
+	std::vector<glm::uvec3> tileCoords(numTiles, glm::uvec3(mortonSide));
+	for(uint32_t tz = 0; tz < tilesPerSide; ++tz){
+		for(uint32_t ty = 0; ty < tilesPerSide; ++ty){
+			for(uint32_t tx = 0; tx < tilesPerSide; ++tx){
+				tileCoords[morton(tx, ty, tz)] = glm::uvec3(tx, ty, tz);
+			}
+		}
+	}
+
+	grid.resize(size * size * size);
+	tbb::enumerable_thread_specific<std::vector<float>> scratchBuffers(TileSize * TileSize * TileSize);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numTiles, 1), [&](const tbb::blocked_range<size_t> & r){
+		auto & scratch = scratchBuffers.local();
+		for(size_t tile = r.begin(); tile < r.end(); ++tile){
+			if(tileCoords[tile].x >= tilesPerSide){
+				continue;
+			}
+			size_t x0 = tileCoords[tile].x * TileSize;
+			size_t y0 = tileCoords[tile].y * TileSize;
+			size_t z0 = tileCoords[tile].z * TileSize;
+			size_t x1 = std::min(x0 + TileSize, size);
+			size_t y1 = std::min(y0 + TileSize, size);
+			size_t z1 = std::min(z0 + TileSize, size);
+			std::fill(scratch.begin(), scratch.end(), 0.f);
+
+			for(auto p = tileOffsets[tile]; p < tileOffsets[tile + 1]; ++p){
+				auto i = tileParticles[p];
+				auto & footprint = footprints[i];
+				auto density = particles[i].density;
+				auto psize = footprint.psize;
+				if(int(psize)>1){
+					Box particleBox = { footprint.pos - glm::vec3{psize*0.5f,psize*0.5f,psize*0.5f}, footprint.pos + glm::vec3{psize*0.5f,psize*0.5f,psize*0.5f}};
+					float particleVolume = boxVolume(psize);
+					for(size_t z = std::max<size_t>(footprint.min[2], z0); z < std::min<size_t>(footprint.max[2], z1); z++){
+						for(size_t y = std::max<size_t>(footprint.min[1], y0); y < std::min<size_t>(footprint.max[1], y1); y++){
+							auto row = scratch.data() + ((z - z0) * TileSize + (y - y0)) * TileSize;
+							for(size_t x = std::max<size_t>(footprint.min[0], x0); x < std::min<size_t>(footprint.max[0], x1); x++){
+								glm::vec3 voxelpos = {x, y, z};
+								Box voxel = {voxelpos, voxelpos + glm::vec3{1.0f, 1.0f, 1.0f}};
+								auto factor = boxesIntersectionVolume(voxel, particleBox) / particleVolume;
+								row[x - x0] += factor * density;
+							}
+						}
+					}
+				}else{
+					auto idx = ((footprint.min[2] - z0) * TileSize + (footprint.min[1] - y0)) * TileSize + (footprint.min[0] - x0);
+					if(mode == ComputeShader){
+						scratch[idx] += density / boxVolume(psize);
+					}else{
+						scratch[idx] += density;
+					}
+				}
+			}
+
+			for(size_t z = z0; z < z1; z++){
+				for(size_t y = y0; y < y1; y++){
+					auto row = scratch.data() + ((z - z0) * TileSize + (y - y0)) * TileSize;
+					std::copy(row, row + (x1 - x0), grid.data() + (z * size + y) * size + x0);
+				}
+			}
+		}
+	});
+}
+
+size_t VoxelSplatter::getNumTiles() const{
+	return numTiles;
+}
+
+size_t VoxelSplatter::getNumBinnedParticles() const{
+	return tileParticles.size();
+}
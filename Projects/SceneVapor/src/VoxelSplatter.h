@@ -0,0 +1,52 @@
+#ifndef VOXEL_SPLATTER_H
+#define VOXEL_SPLATTER_H
+
+#include "ofConstants.h"
+#include "ofVectorMath.h"
+#include "Particle.h"
+
+// Splats particles into a size³ density grid in parallel.
+//
+// Particles are first binned into the Morton ordered tiles their
+// footprint overlaps, using a counting sort over fixed size chunks so
+// every tile ends up with its particles in their original order. Each
+// tile is then accumulated in a per thread scratch buffer and copied
+// to the grid, so every voxel receives its contributions in the same
+// order as a serial splat: the result is bit identical to it no matter
+// how many threads run.
+class VoxelSplatter
+{
+public:
+	enum Mode{
+		// Same weights as the serial USE_RAW path in Vapor3DTexture.
+		Raw,
+		// Same weights as shaders/particles2texture3d.glsl: doubled
+		// particle size and point splats divided by the particle volume.
+		ComputeShader,
+	};
+
+	static constexpr size_t TileSize = 32;
+
+	void setMode(Mode mode);
+	void splat(const std::vector<Particle> & particles, const glm::vec3 & offset, float scale, size_t size, std::vector<float> & grid);
+
+	size_t getNumTiles() const;
+	size_t getNumBinnedParticles() const;
+
+private:
+	struct Footprint{
+		glm::vec3 pos;
+		float psize;
+		uint16_t min[3];
+		uint16_t max[3];
+	};
+
+	Mode mode = Raw;
+	std::vector<Footprint> footprints;
+	std::vector<uint32_t> chunkCounts;
+	std::vector<uint32_t> tileOffsets;
+	std::vector<uint32_t> tileParticles;
+	size_t numTiles = 0;
+};
+
+#endif // VOXEL_SPLATTER_H
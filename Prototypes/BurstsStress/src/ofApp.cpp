@@ -0,0 +1,107 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	auto threads = settings.threads;
+#ifdef _OPENMP
+	if(threads <= 0){
+		threads = omp_get_max_threads();
+	}
+#else
+	ofLogWarning("BurstsStress") << "Built without OpenMP, both runs are serial";
+	threads = 1;
+#endif
+
+	auto serial = run(1);
+	auto parallel = run(threads);
+
+	size_t firstDifferentFrame = settings.frames;
+	for(size_t i = 0; i < settings.frames; ++i){
+		if(serial.hashes[i] != parallel.hashes[i]){
+			firstDifferentFrame = i;
+			break;
+		}
+	}
+
+	std::vector<std::string> failures;
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	for(auto & r: {std::make_pair(1, &serial), std::make_pair(threads, &parallel)}){
+		ss << r.first << " thread" << (r.first > 1 ? "s: " : ": ")
+		   << r.second->maxParticles << " particles max, " << r.second->maxAlive << " alive max, "
+		   << r.second->updateMicros / 1000. / settings.frames << "ms/update, "
+		   << r.second->numFailedChecks << " failed checks" << endl;
+		if(r.second->numFailedChecks > 0){
+			failures.push_back(ofToString(r.second->numFailedChecks) + " checks with " + ofToString(r.first) + " threads");
+		}
+	}
+	if(firstDifferentFrame < settings.frames){
+		failures.push_back("state differs from frame " + ofToString(firstDifferentFrame));
+	}else{
+		ss << "state matches on every frame" << endl;
+	}
+	ofxHeadless::exit("BurstsStress", ss, failures);
+}
+
+//--------------------------------------------------------------
+ofApp::Run ofApp::run(int numThreads){
+#ifdef _OPENMP
+	omp_set_num_threads(numThreads);
+#endif
+
+	entropy::bubbles::Bursts bursts;
+	bursts.init(true);
+	bursts.resolution = settings.resolution;
+	bursts.maxLinks = settings.maxLinks;
+	bursts.compactRate = settings.compactRate;
+
+	// addDrop draws from ofRandom too, the same seed gives the same drops
+	ofSeedRandom(settings.seed);
+	Run run;
+	run.hashes.reserve(settings.frames);
+	for(size_t frame = 0; frame < settings.frames; ++frame){
+		auto numDrops = int(ofRandom(settings.maxDropsPerFrame + 1));
+		for(int i = 0; i < numDrops; ++i){
+			glm::vec3 center(ofRandom(-settings.halfDim, settings.halfDim), ofRandom(-settings.halfDim, settings.halfDim), ofRandom(-settings.halfDim, settings.halfDim));
+			bursts.addDrop(center, settings.radius);
+		}
+
+		auto then = ofGetElapsedTimeMicros();
+		bursts.update(settings.dt);
+		run.updateMicros += ofGetElapsedTimeMicros() - then;
+
+		if(!bursts.check()){
+			ofLogError("BurstsStress") << "Check failed at frame " << frame << " with " << numThreads << " threads";
+			run.numFailedChecks += 1;
+		}
+		run.hashes.push_back(bursts.getStateHash());
+		run.maxParticles = std::max(run.maxParticles, bursts.getNumParticles());
+		run.maxAlive = std::max(run.maxAlive, bursts.getNumAlive());
+	}
+	return run;
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("BurstsStress", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("frames", settings.frames);
+	json.get("dt", settings.dt);
+	json.get("maxDropsPerFrame", settings.maxDropsPerFrame);
+	json.get("radius", settings.radius);
+	json.get("halfDim", settings.halfDim);
+	json.get("resolution", settings.resolution);
+	json.get("maxLinks", settings.maxLinks);
+	json.get("compactRate", settings.compactRate);
+	json.get("threads", settings.threads);
+}
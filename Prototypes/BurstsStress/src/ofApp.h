@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Bursts.h"
+
+// Headless stress test for entropy::bubbles::Bursts.
+//
+// Fires a random number of drops every frame so new drops keep reusing
+// the particles of older ones while those are still dying, and checks the
+// free list and the links after every update. The same drops are run once
+// on a single thread and once on as many threads as OpenMP gives, the
+// state hash of every frame has to match, so a race or anything that
+// depends on the scheduling shows up as the first frame that differs.
+// Exits with 1 if anything failed.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 3030;
+			size_t frames = 1800;
+			double dt = 1. / 60.;
+			int maxDropsPerFrame = 8;
+			float radius = 30.f;
+			float halfDim = 400.f;
+			int resolution = 8;
+			int maxLinks = 8;
+			int compactRate = 60;
+			int threads = 0;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Run{
+			std::vector<uint64_t> hashes;
+			size_t numFailedChecks = 0;
+			size_t maxParticles = 0;
+			size_t maxAlive = 0;
+			uint64_t updateMicros = 0;
+		};
+
+		void loadSettings();
+		Run run(int numThreads);
+
+		Settings settings;
+};
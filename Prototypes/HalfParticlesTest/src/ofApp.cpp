@@ -0,0 +1,158 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+
+namespace{
+	constexpr size_t ChunkSize = 1 << 16;
+	constexpr uint64_t NumFloats = uint64_t(1) << 32;
+
+	uint32_t asUint(float value){
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	bool isNaN(uint16_t half){
+		return (half & 0x7c00) == 0x7c00 && (half & 0x3ff) != 0;
+	}
+
+	std::string hex(uint32_t bits){
+		std::ostringstream ss;
+		ss << "0x" << std::hex << bits;
+		return ss.str();
+	}
+
+	// Only the first few mismatches of each check are listed, the count
+	// of the rest comes after them.
+	struct Mismatches{
+		std::vector<std::string> & failures;
+		size_t maxReported;
+		size_t count;
+
+		void add(const std::string & failure){
+			if(count++ < maxReported){
+				failures.push_back(failure);
+			}
+		}
+
+		void close(const std::string & what){
+			if(count > maxReported){
+				failures.push_back(ofToString(count - maxReported) + " more " + what);
+			}
+		}
+	};
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	std::vector<std::string> failures;
+	auto halfs = checkHalfs(failures);
+	auto floats = checkFloats(failures);
+
+	auto f16c = HalfParticles::hasF16C();
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	if(f16c){
+		ss << "F16C against the scalar conversion" << endl;
+	}else{
+		ss << "no F16C on this cpu, only the scalar round trip is checked" << endl;
+	}
+	for(auto & t: {std::make_pair("half -> float", halfs), std::make_pair("float -> half", floats)}){
+		auto numValues = std::max<uint64_t>(t.second.numValues, 1);
+		ss << t.first << ": " << t.second.numValues << " values, scalar " << t.second.scalarMicros * 1000. / numValues << "ns/value";
+		if(f16c){
+			ss << ", F16C " << t.second.f16cMicros * 1000. / numValues << "ns/value";
+		}
+		ss << endl;
+	}
+	ofxHeadless::exit("HalfParticlesTest", ss, failures);
+}
+
+//--------------------------------------------------------------
+ofApp::Timing ofApp::checkHalfs(std::vector<std::string> & failures) const{
+	std::vector<uint16_t> halfs(65536), roundTrip(halfs.size());
+	std::iota(halfs.begin(), halfs.end(), 0);
+	std::vector<float> scalar(halfs.size()), f16c(halfs.size());
+
+	Timing timing;
+	timing.numValues = halfs.size();
+	auto then = ofGetElapsedTimeMicros();
+	HalfParticles::toFloatScalar(halfs.data(), halfs.size(), scalar.data());
+	timing.scalarMicros = ofGetElapsedTimeMicros() - then;
+
+	if(HalfParticles::hasF16C()){
+		then = ofGetElapsedTimeMicros();
+		HalfParticles::toFloat(halfs.data(), halfs.size(), f16c.data());
+		timing.f16cMicros = ofGetElapsedTimeMicros() - then;
+
+		Mismatches mismatches{failures, settings.maxReported, 0};
+		for(size_t i = 0; i < halfs.size(); ++i){
+			if(asUint(scalar[i]) != asUint(f16c[i])){
+				mismatches.add("half " + hex(halfs[i]) + " is " + hex(asUint(scalar[i])) + " on the scalar path, " + hex(asUint(f16c[i])) + " with F16C");
+			}
+		}
+		mismatches.close("halfs convert differently");
+	}
+
+	// F16C quiets signaling NaNs on the way to float, their payload stays
+	HalfParticles::toHalfScalar(scalar.data(), scalar.size(), roundTrip.data());
+	Mismatches mismatches{failures, settings.maxReported, 0};
+	for(size_t i = 0; i < halfs.size(); ++i){
+		auto expected = uint16_t(halfs[i] | (isNaN(halfs[i]) ? 0x200 : 0));
+		if(roundTrip[i] != expected){
+			mismatches.add("half " + hex(halfs[i]) + " comes back as " + hex(roundTrip[i]));
+		}
+	}
+	mismatches.close("halfs don't come back the same");
+
+	return timing;
+}
+
+//--------------------------------------------------------------
+ofApp::Timing ofApp::checkFloats(std::vector<std::string> & failures) const{
+	std::vector<float> values(ChunkSize);
+	std::vector<uint16_t> scalar(ChunkSize), f16c(ChunkSize);
+	uint64_t stride = std::max<uint32_t>(settings.floatStride, 1);
+	auto hasF16C = HalfParticles::hasF16C();
+
+	Timing timing;
+	Mismatches mismatches{failures, settings.maxReported, 0};
+	for(uint64_t first = 0; first < NumFloats; first += stride * ChunkSize){
+		size_t n = 0;
+		for(; n < ChunkSize && first + n * stride < NumFloats; ++n){
+			auto bits = uint32_t(first + n * stride);
+			memcpy(&values[n], &bits, sizeof(bits));
+		}
+		timing.numValues += n;
+
+		auto then = ofGetElapsedTimeMicros();
+		HalfParticles::toHalfScalar(values.data(), n, scalar.data());
+		timing.scalarMicros += ofGetElapsedTimeMicros() - then;
+		if(!hasF16C){
+			continue;
+		}
+
+		then = ofGetElapsedTimeMicros();
+		HalfParticles::toHalf(values.data(), n, f16c.data());
+		timing.f16cMicros += ofGetElapsedTimeMicros() - then;
+		for(size_t i = 0; i < n; ++i){
+			if(scalar[i] != f16c[i]){
+				mismatches.add("float " + hex(asUint(values[i])) + " is " + hex(scalar[i]) + " on the scalar path, " + hex(f16c[i]) + " with F16C");
+			}
+		}
+	}
+	mismatches.close("floats convert differently");
+
+	return timing;
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("HalfParticlesTest", settingsPath);
+	json.get("floatStride", settings.floatStride);
+	json.get("maxReported", settings.maxReported);
+}
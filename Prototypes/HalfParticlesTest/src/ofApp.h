@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ofMain.h"
+#include "HalfParticles.h"
+
+// Headless check of the float <-> half conversions in HalfParticles.
+//
+// Runs all 65536 halves and a sweep over the float bit patterns, every
+// floatStride-th one, through the scalar fallback and, when the cpu has
+// it, through F16C and checks both give the same bits. Every half also
+// has to come back the same through a float on the scalar path, NaNs
+// quieted. Reports how long each path takes per value and exits with 1
+// if anything differs.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint32_t floatStride = 1;
+			size_t maxReported = 8;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Timing{
+			uint64_t scalarMicros = 0;
+			uint64_t f16cMicros = 0;
+			uint64_t numValues = 0;
+		};
+
+		Timing checkHalfs(std::vector<std::string> & failures) const;
+		Timing checkFloats(std::vector<std::string> & failures) const;
+		void loadSettings();
+
+		Settings settings;
+};
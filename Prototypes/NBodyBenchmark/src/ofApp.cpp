@@ -0,0 +1,185 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+#include "NBodySystemBarnesHut.h"
+#include "NBodySystemTiled.h"
+
+#include <thread>
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	std::vector<Result> results;
+	for(auto numBodies: settings.bodyCounts){
+		ofSeedRandom(settings.seed);
+		std::vector<float> pos, vel;
+		randomizeBodies(numBodies, pos, vel);
+		auto startEnergy = getEnergy(pos.data(), vel.data(), numBodies);
+
+		std::vector<float> referencePos;
+		if(numBodies <= settings.maxReferenceBodies){
+			entropy::NBodySystemCPU reference(numBodies, true);
+			results.push_back(run(reference, "NBodySystemCPU", pos, vel, startEnergy, referencePos));
+		}
+
+		entropy::NBodySystemTiled tiled(numBodies, true);
+		tiled.setTileSize(settings.tileSize);
+		std::vector<float> tiledPos;
+		results.push_back(run(tiled, "NBodySystemTiled", pos, vel, startEnergy, tiledPos));
+
+		entropy::NBodySystemBarnesHut barnesHut(numBodies, true);
+		barnesHut.setTheta(settings.theta);
+		barnesHut.setLeafSize(settings.leafSize);
+		std::vector<float> barnesHutPos;
+		results.push_back(run(barnesHut, "NBodySystemBarnesHut", pos, vel, startEnergy, barnesHutPos));
+
+		if(!referencePos.empty()){
+			for(auto & p: {std::make_pair(&tiledPos, &results[results.size() - 2]), std::make_pair(&barnesHutPos, &results.back())}){
+				double sum = 0.;
+				for(int i = 0; i < numBodies; ++i){
+					for(int k = 0; k < 3; ++k){
+						double d = (*p.first)[i * 4 + k] - referencePos[i * 4 + k];
+						sum += d * d;
+					}
+				}
+				p.second->positionError = std::sqrt(sum / numBodies);
+			}
+		}
+	}
+
+	std::vector<std::string> failures;
+	std::ostringstream ss;
+	for(auto & r: results){
+		auto seconds = r.micros / 1e6;
+		ss << r.name << ", " << r.numBodies << " bodies: "
+		   << std::fixed << std::setprecision(2)
+		   << r.micros / 1000. / settings.steps << "ms/step, "
+		   << r.interactions / seconds / 1e6 << " M interactions/s, "
+		   << std::scientific << std::setprecision(3)
+		   << "energy drift " << r.energyDrift;
+		if(r.positionError >= 0.){
+			ss << ", rms distance to NBodySystemCPU " << r.positionError;
+		}
+		ss << std::defaultfloat << endl;
+		if(!std::isfinite(r.energyDrift)){
+			failures.push_back(r.name + ", " + ofToString(r.numBodies) + " bodies: energy drift isn't finite");
+		}
+	}
+	ofxHeadless::exit("NBodyBenchmark", ss, failures);
+}
+
+//--------------------------------------------------------------
+// NBODY_CONFIG_RANDOM of PartyCLApp::randomizeBodies, drawing again instead
+// of skipping a body when a point falls outside the unit sphere.
+void ofApp::randomizeBodies(int numBodies, std::vector<float> & pos, std::vector<float> & vel){
+	float scalePos = settings.clusterScale * std::max(1.0f, numBodies / 1024.f);
+	float scaleVel = settings.velocityScale * scalePos;
+
+	pos.resize(numBodies * 4);
+	vel.resize(numBodies * 4);
+	auto randomInSphere = [](){
+		ofVec3f p;
+		do{
+			p.set(ofRandomf(), ofRandomf(), ofRandomf());
+		}while(p.lengthSquared() > 1);
+		return p;
+	};
+	for(int i = 0; i < numBodies; ++i){
+		auto p = randomInSphere() * scalePos;
+		auto v = randomInSphere() * scaleVel;
+		pos[i * 4 + 0] = p.x;
+		pos[i * 4 + 1] = p.y;
+		pos[i * 4 + 2] = p.z;
+		pos[i * 4 + 3] = 1.f; // mass
+		vel[i * 4 + 0] = v.x;
+		vel[i * 4 + 1] = v.y;
+		vel[i * 4 + 2] = v.z;
+		vel[i * 4 + 3] = 1.f; // inverse mass
+	}
+}
+
+//--------------------------------------------------------------
+// kinetic energy minus the potential of every pair, with the softening of the
+// forces, in double and spread over all the threads since it's O(n^2) too
+double ofApp::getEnergy(const float * pos, const float * vel, int numBodies) const{
+	const double softeningSquared = double(settings.softening) * settings.softening;
+	int numThreads = settings.threads > 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<double> energies(numThreads, 0.);
+	std::vector<std::thread> threads;
+	for(int t = 0; t < numThreads; ++t){
+		threads.emplace_back([&, t](){
+			double energy = 0.;
+			// interleaved rows, the pairs per row go down with i
+			for(int i = t; i < numBodies; i += numThreads){
+				double mass = pos[i * 4 + 3];
+				double speedSquared = 0.;
+				for(int k = 0; k < 3; ++k){
+					speedSquared += double(vel[i * 4 + k]) * vel[i * 4 + k];
+				}
+				energy += 0.5 * mass * speedSquared;
+
+				double potential = 0.;
+				for(int j = i + 1; j < numBodies; ++j){
+					double distSquared = softeningSquared;
+					for(int k = 0; k < 3; ++k){
+						double d = double(pos[j * 4 + k]) - pos[i * 4 + k];
+						distSquared += d * d;
+					}
+					potential += pos[j * 4 + 3] / std::sqrt(distSquared);
+				}
+				energy -= mass * potential;
+			}
+			energies[t] = energy;
+		});
+	}
+	for(auto & thread: threads){
+		thread.join();
+	}
+	return std::accumulate(energies.begin(), energies.end(), 0.);
+}
+
+//--------------------------------------------------------------
+ofApp::Result ofApp::run(entropy::NBodySystemCPU & system, const std::string & name, const std::vector<float> & pos, const std::vector<float> & vel, double startEnergy, std::vector<float> & endPos){
+	system.setNumThreads(settings.threads);
+	system.setSoftening(settings.softening);
+	system.setDamping(1.f);
+	system.setArray(entropy::NBodySystem::ARRAY_POSITION, pos.data());
+	system.setArray(entropy::NBodySystem::ARRAY_VELOCITY, vel.data());
+
+	Result result;
+	result.name = name;
+	result.numBodies = system.getNumBodies();
+	for(int step = 0; step < settings.steps; ++step){
+		auto then = ofGetElapsedTimeMicros();
+		system.update(settings.timestep);
+		result.micros += ofGetElapsedTimeMicros() - then;
+		result.interactions += system.getNumInteractions();
+	}
+
+	auto endVel = system.getArray(entropy::NBodySystem::ARRAY_VELOCITY);
+	auto endPosData = system.getArray(entropy::NBodySystem::ARRAY_POSITION);
+	endPos.assign(endPosData, endPosData + result.numBodies * 4);
+	auto endEnergy = getEnergy(endPos.data(), endVel, result.numBodies);
+	result.energyDrift = std::abs((endEnergy - startEnergy) / startEnergy);
+	return result;
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("NBodyBenchmark", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("bodyCounts", settings.bodyCounts);
+	json.get("steps", settings.steps);
+	json.get("timestep", settings.timestep);
+	json.get("clusterScale", settings.clusterScale);
+	json.get("velocityScale", settings.velocityScale);
+	json.get("softening", settings.softening);
+	json.get("theta", settings.theta);
+	json.get("leafSize", settings.leafSize);
+	json.get("tileSize", settings.tileSize);
+	json.get("maxReferenceBodies", settings.maxReferenceBodies);
+	json.get("threads", settings.threads);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ofMain.h"
+#include "NBodySystemCPU.h"
+
+// Headless benchmark for the CPU n-body systems of PartyCL, the direct sum
+// in NBodySystemCPU, the tiled SSE direct sum in NBodySystemTiled and the
+// Barnes-Hut tree in NBodySystemBarnesHut.
+//
+// For each body count, starts the same random cluster as PartyCL's
+// NBODY_CONFIG_RANDOM (all masses 1, no damping) on every system, runs a
+// number of steps and reports interactions per second, the relative change
+// of the total energy and how far the bodies end up from the ones of
+// NBodySystemCPU. NBodySystemCPU is serial and O(n^2), it's skipped above
+// maxReferenceBodies. Exits with 1 if any energy stops being finite.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 2016;
+			std::vector<int> bodyCounts = { 1024, 4096, 16384, 65536 };
+			int steps = 10;
+			// preset 0 of PartyCL, but with a smaller timestep, at .016 the
+			// energy isn't kept by any of them
+			float timestep = 0.001f;
+			float clusterScale = 1.54f;
+			float velocityScale = 8.f;
+			float softening = 0.1f;
+			float theta = 0.5f;
+			int leafSize = 16;
+			int tileSize = 1024;
+			int maxReferenceBodies = 16384;
+			int threads = 0;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Result{
+			std::string name;
+			int numBodies = 0;
+			uint64_t interactions = 0;
+			uint64_t micros = 0;
+			double energyDrift = 0.;
+			// rms distance to the bodies of NBodySystemCPU, negative without it
+			double positionError = -1.;
+		};
+
+		void loadSettings();
+		void randomizeBodies(int numBodies, std::vector<float> & pos, std::vector<float> & vel);
+		double getEnergy(const float * pos, const float * vel, int numBodies) const;
+		Result run(entropy::NBodySystemCPU & system, const std::string & name, const std::vector<float> & pos, const std::vector<float> & vel, double startEnergy, std::vector<float> & endPos);
+
+		Settings settings;
+};
@@ -0,0 +1,7 @@
+#include "ofxHeadless.h"
+#include "ofApp.h"
+
+//========================================================================
+int main(int argc, char ** argv){
+	return ofxHeadless::run<ofApp>(argc, argv);
+}
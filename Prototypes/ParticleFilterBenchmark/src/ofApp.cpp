@@ -0,0 +1,223 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+#include "Constants.h"
+#include <numeric>
+#include <random>
+
+namespace{
+	bool equal(const ofxRange3f & a, const ofxRange3f & b){
+		return a.getMin() == b.getMin() && a.getMax() == b.getMax();
+	}
+
+	bool equal(const ofxRange1f & a, const ofxRange1f & b){
+		return a.getMin() == b.getMin() && a.getMax() == b.getMax();
+	}
+
+	bool equal(const Particle & a, const Particle & b){
+		return a.pos == b.pos && a.size == b.size && a.density == b.density;
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+	generate();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	Serial serial;
+	ParticleFilter filter;
+	Fused fused;
+	for(size_t run = 0; run < std::max<size_t>(settings.runs, 1); ++run){
+		auto serialRun = runSerial();
+		auto fusedRun = runFused(filter);
+		if(run == 0){
+			serial = std::move(serialRun);
+			fused = fusedRun;
+			continue;
+		}
+		serial.buildMicros = std::min(serial.buildMicros, serialRun.buildMicros);
+		serial.rangesMicros = std::min(serial.rangesMicros, serialRun.rangesMicros);
+		serial.filterMicros = std::min(serial.filterMicros, serialRun.filterMicros);
+		fused.rangesMicros = std::min(fused.rangesMicros, fusedRun.rangesMicros);
+		fused.filterMicros = std::min(fused.filterMicros, fusedRun.filterMicros);
+		fused.columnsMicros = std::min(fused.columnsMicros, fusedRun.columnsMicros);
+	}
+
+	std::vector<std::string> failures;
+	compare(serial, filter, failures);
+
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << settings.numParticles << " particles, " << filter.getStats().numKept << " in the box, best of " << std::max<size_t>(settings.runs, 1) << " runs" << endl;
+	ss << "serial: build " << serial.buildMicros / 1000. << "ms. ranges " << serial.rangesMicros / 1000. << "ms. filter " << serial.filterMicros / 1000. << "ms." << endl;
+	ss << "fused: ranges " << fused.rangesMicros / 1000. << "ms. ranges + filter " << fused.filterMicros / 1000. << "ms. with columns " << fused.columnsMicros / 1000. << "ms." << endl;
+	ss << "first frame " << (serial.buildMicros + serial.rangesMicros + serial.filterMicros) / 1000. << "ms. -> " << (fused.rangesMicros + fused.filterMicros) / 1000. << "ms." << endl;
+	ss << "next frames " << (serial.buildMicros + serial.filterMicros) / 1000. << "ms. -> " << fused.filterMicros / 1000. << "ms." << endl;
+	ofxHeadless::exit("ParticleFilterBenchmark", ss, failures);
+}
+
+//--------------------------------------------------------------
+void ofApp::generate(){
+	auto numParticles = settings.numParticles;
+	for(auto * column: {&posX, &posY, &posZ, &cellSize, &density}){
+		column->resize(numParticles);
+	}
+	std::mt19937 rng(settings.seed);
+	std::normal_distribution<float> pos(0, 1);
+	std::uniform_int_distribution<int> level(0, 5);
+	std::exponential_distribution<float> dens(1);
+	for(size_t i = 0; i < numParticles; ++i){
+		posX[i] = pos(rng);
+		posY[i] = pos(rng);
+		posZ[i] = pos(rng);
+		cellSize[i] = 0.01f * (1 << level(rng));
+		density[i] = dens(rng);
+	}
+}
+
+//--------------------------------------------------------------
+ofxRange3f ofApp::getBox() const{
+	ofxRange3f box;
+	box.clear();
+	box.add(glm::vec3(-settings.boxHalfSize));
+	box.add(glm::vec3(settings.boxHalfSize));
+	return box;
+}
+
+//--------------------------------------------------------------
+ofApp::Serial ofApp::runSerial() const{
+	// Serial loops as in SnapshotRamses::precalculate and Vapor3DTexture::setup
+	Serial serial;
+	auto numParticles = settings.numParticles;
+	auto then = ofGetElapsedTimeMicros();
+	serial.particles.resize(numParticles);
+	for(size_t i = 0; i < numParticles; ++i){
+		serial.particles[i] = {{posX[i], posY[i], posZ[i]}, cellSize[i], density[i]};
+	}
+	auto afterBuild = ofGetElapsedTimeMicros();
+
+	serial.densityRange.clear();
+	serial.sizeRange.clear();
+	serial.coordRange.clear();
+	serial.thresholdRange.clear();
+	for(size_t i = 0; i < numParticles; ++i){
+		serial.densityRange.add(density[i]);
+		serial.coordRange.add(glm::vec3(posX[i], posY[i], posZ[i]));
+		serial.sizeRange.add(cellSize[i]);
+	}
+	auto threshold = serial.densityRange.getMin() + (serial.densityRange.getMax() - serial.densityRange.getMin()) * settings.thresholdFactor;
+	serial.thresholdRange = std::accumulate(serial.particles.begin(), serial.particles.end(), serial.thresholdRange, [&](ofxRange3f range, const Particle & p){
+		if(p.density > threshold){
+			range.add(p.pos.xyz());
+		}
+		return range;
+	});
+	auto afterRanges = ofGetElapsedTimeMicros();
+
+	auto box = getBox();
+	for(auto & particle: serial.particles){
+		if(!box.contains(particle.getMaxPos()) ||
+		   !box.contains(particle.getMinPos()) ||
+		   (MAX_PARTICLE_SIZE > -1 && particle.size * settings.scale > MAX_PARTICLE_SIZE)){
+			continue;
+		}else{
+			serial.particlesInBox.push_back(particle);
+		}
+	}
+	auto afterFilter = ofGetElapsedTimeMicros();
+
+	serial.buildMicros = afterBuild - then;
+	serial.rangesMicros = afterRanges - afterBuild;
+	serial.filterMicros = afterFilter - afterRanges;
+	return serial;
+}
+
+//--------------------------------------------------------------
+ofApp::Fused ofApp::runFused(ParticleFilter & filter) const{
+	// The first frame needs the density range before the threshold, later
+	// frames only filter.
+	Fused fused;
+	ParticleFilter::Columns columns{posX.data(), posY.data(), posZ.data(), cellSize.data(), density.data(), settings.numParticles};
+	ParticleFilter::Settings filterSettings;
+	filterSettings.outputParticles = false;
+	auto then = ofGetElapsedTimeMicros();
+	filter.process(columns, filterSettings);
+	auto afterRanges = ofGetElapsedTimeMicros();
+
+	auto & stats = filter.getStats();
+	filterSettings.densityThreshold = stats.densityRange.getMin() + (stats.densityRange.getMax() - stats.densityRange.getMin()) * settings.thresholdFactor;
+	filterSettings.filter = true;
+	filterSettings.box = getBox();
+	filterSettings.scale = settings.scale;
+	filterSettings.maxScaledSize = MAX_PARTICLE_SIZE > -1 ? MAX_PARTICLE_SIZE : std::numeric_limits<float>::max();
+	filterSettings.outputParticles = true;
+	filter.process(columns, filterSettings);
+	auto afterFilter = ofGetElapsedTimeMicros();
+
+	filterSettings.outputColumns = true;
+	filter.process(columns, filterSettings);
+	auto afterColumns = ofGetElapsedTimeMicros();
+
+	fused.rangesMicros = afterRanges - then;
+	fused.filterMicros = afterFilter - afterRanges;
+	fused.columnsMicros = afterColumns - afterFilter;
+	return fused;
+}
+
+//--------------------------------------------------------------
+void ofApp::compare(const Serial & serial, const ParticleFilter & filter, std::vector<std::string> & failures) const{
+	auto & stats = filter.getStats();
+	if(!equal(stats.coordRange, serial.coordRange)){
+		failures.push_back("coordinate range differs from the serial loop");
+	}
+	if(!equal(stats.sizeRange, serial.sizeRange)){
+		failures.push_back("size range differs from the serial loop");
+	}
+	if(!equal(stats.densityRange, serial.densityRange)){
+		failures.push_back("density range differs from the serial loop");
+	}
+	if(!equal(stats.thresholdRange, serial.thresholdRange)){
+		failures.push_back("range over the density threshold differs from the serial loop");
+	}
+	auto histogramTotal = std::accumulate(stats.densityHistogram.begin(), stats.densityHistogram.end(), size_t(0));
+	if(histogramTotal != settings.numParticles){
+		failures.push_back("density histogram counts " + ofToString(histogramTotal) + " particles");
+	}
+
+	auto & expected = serial.particlesInBox;
+	auto & particles = filter.getParticles();
+	auto & columns = filter.getColumns();
+	if(stats.numKept != expected.size() || particles.size() != expected.size() || columns.x.size() != expected.size()){
+		failures.push_back("kept " + ofToString(stats.numKept) + " particles, expected " + ofToString(expected.size()));
+		return;
+	}
+	size_t particleMismatches = 0, columnMismatches = 0;
+	for(size_t i = 0; i < expected.size(); ++i){
+		if(!equal(particles[i], expected[i])){
+			particleMismatches += 1;
+		}
+		Particle column({columns.x[i], columns.y[i], columns.z[i]}, columns.size[i], columns.density[i]);
+		if(!equal(column, expected[i])){
+			columnMismatches += 1;
+		}
+	}
+	if(particleMismatches > 0){
+		failures.push_back(ofToString(particleMismatches) + " kept particles differ from the serial loop");
+	}
+	if(columnMismatches > 0){
+		failures.push_back(ofToString(columnMismatches) + " kept columns differ from the serial loop");
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("ParticleFilterBenchmark", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("numParticles", settings.numParticles);
+	json.get("boxHalfSize", settings.boxHalfSize);
+	json.get("scale", settings.scale);
+	json.get("thresholdFactor", settings.thresholdFactor);
+	json.get("runs", settings.runs);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ParticleFilter.h"
+
+// Headless benchmark for ParticleFilter.
+//
+// Generates columns of particles like the ones read from the HDF5 files
+// and runs the serial loops SnapshotRamses::precalculate and
+// Vapor3DTexture::setup used before, building the particles, their
+// ranges, the range over the density threshold and the particles in the
+// box, against the fused passes: the first frame needs the density range
+// before the threshold, later frames only filter. Reports the best of a
+// few runs of each and checks the fused ranges and kept particles, in
+// order and as columns, against the serial ones. Exits with 1 if
+// anything differs.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 0;
+			size_t numParticles = 5000000;
+			float boxHalfSize = 2.f;
+			float scale = 512 / 4.f;
+			float thresholdFactor = 0.001f;
+			size_t runs = 3;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Serial{
+			std::vector<Particle> particles;
+			ofxRange3f coordRange;
+			ofxRange1f sizeRange;
+			ofxRange1f densityRange;
+			ofxRange3f thresholdRange;
+			std::vector<Particle> particlesInBox;
+			uint64_t buildMicros = 0;
+			uint64_t rangesMicros = 0;
+			uint64_t filterMicros = 0;
+		};
+
+		struct Fused{
+			uint64_t rangesMicros = 0;
+			uint64_t filterMicros = 0;
+			uint64_t columnsMicros = 0;
+		};
+
+		void loadSettings();
+		void generate();
+		ofxRange3f getBox() const;
+		Serial runSerial() const;
+		Fused runFused(ParticleFilter & filter) const;
+		void compare(const Serial & serial, const ParticleFilter & filter, std::vector<std::string> & failures) const;
+
+		Settings settings;
+		std::vector<float> posX, posY, posZ, cellSize, density;
+};
@@ -0,0 +1,337 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+
+	environment = nm::Environment::Ptr(new nm::Environment(glm::vec3(-settings.halfDim), glm::vec3(settings.halfDim)));
+	environment->state = settings.state;
+	environment->energy = settings.energy;
+	environment->systemSpeed = settings.systemSpeed;
+
+	typedef nm::Octree<nm::Particle> Octree;
+	Octree::THETA() = settings.theta;
+	Octree::MAX_LEAF_SIZE() = settings.maxLeafSize;
+	Octree::QUADRUPOLES() = settings.quadrupoles;
+	Octree::SOFTENING() = settings.softening;
+	Octree::INCREMENTAL() = settings.incremental;
+	Octree::REBUILD_IMBALANCE() = settings.rebuildImbalance;
+
+	particleSystem.init(environment, settings.capacity, true);
+	particleSystem.setSeed(settings.seed);
+	particleSystem.setDeterministic(settings.deterministic);
+	particleSystem.setCheckLevel((nm::ParticleSystem::CheckLevel)settings.checkLevel);
+
+	// the initial state is drawn from its own stream, same distribution as
+	// ofApp::reset in SceneParticles but independent of ofRandom
+	nm::Random random(settings.seed, 0);
+
+	// clusters come from a stream of their own so the particles outside
+	// them are placed the same with or without
+	nm::Random clusterRandom(settings.seed, 1);
+	std::vector<glm::vec3> clusterCenters(settings.numClusters);
+	for(auto & center: clusterCenters){
+		center = glm::vec3(clusterRandom.uniform() * 2.f - 1.f, clusterRandom.uniform() * 2.f - 1.f, clusterRandom.uniform() * 2.f - 1.f) * (settings.halfDim - settings.clusterRadius);
+	}
+
+	for(size_t type = 0; type < settings.particles.size(); ++type){
+		for(int i = 0; i < settings.particles[type]; ++i){
+			glm::vec3 position(
+				(random.uniform() * 2.f - 1.f) * settings.halfDim,
+				(random.uniform() * 2.f - 1.f) * settings.halfDim,
+				(random.uniform() * 2.f - 1.f) * settings.halfDim
+			);
+			if(!clusterCenters.empty() && clusterRandom.uniform() < settings.clusterFraction){
+				auto & center = clusterCenters[clusterRandom.uniform(clusterCenters.size())];
+				position = center + clusterRandom.sphere(settings.clusterRadius * clusterRandom.uniform());
+			}
+
+			// Box-Muller, mean 60 deviation 20
+			float u1 = std::max(random.uniform(), 1e-7f);
+			float u2 = random.uniform();
+			float speed = 60.f + 20.f * sqrt(-2.f * log(u1)) * cos(glm::two_pi<float>() * u2);
+			glm::vec3 velocity = random.sphere(speed);
+
+			particleSystem.addParticle((nm::Particle::Type)type, position, velocity);
+		}
+	}
+
+	listeners.push(environment->deadParticlesEvent.newListener([this](nm::DeadParticlesEventArgs & args){
+		numDead += args.numDead;
+	}));
+	photonEnvironment = nm::Environment::Ptr(new nm::Environment(glm::vec3(-settings.halfDim), glm::vec3(settings.halfDim)));
+	photonEnvironment->state = settings.state;
+	photonEnvironment->energy = settings.energy;
+	photonEnvironment->systemSpeed = settings.systemSpeed;
+	photons.init(photonEnvironment, true);
+
+	std::vector<glm::vec3> initialPhotons(std::min<size_t>(settings.photons, nm::Photons::MAX_PHOTONS));
+	for(auto & position: initialPhotons){
+		position = glm::vec3(random.uniform() * 2.f - 1.f, random.uniform() * 2.f - 1.f, random.uniform() * 2.f - 1.f) * settings.halfDim;
+	}
+	nm::PhotonEventArgs initialPhotonsArgs{initialPhotons.data(), unsigned(initialPhotons.size())};
+	ofNotifyEvent(photonEnvironment->photonEvent, initialPhotonsArgs);
+
+	listeners.push(environment->photonEvent.newListener([this](nm::PhotonEventArgs & args){
+		numPhotons += args.numPhotons;
+		ofNotifyEvent(photonEnvironment->photonEvent, args);
+	}));
+
+	timings.reserve(settings.frames);
+	updateTimes.reserve(settings.frames);
+	trajectory.reserve(settings.frames);
+	loadGolden();
+
+	ofLogNotice("ParticlesBenchmark") << particleSystem.getParticles().size() << " particles, "
+									  << settings.frames << " frames, seed " << settings.seed
+									  << (settings.deterministic ? ", deterministic" : ", parallel interactions");
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	if(trajectory.size() == settings.frames){
+		return;
+	}
+
+	auto then = ofGetElapsedTimeMicros();
+	particleSystem.update(settings.dt);
+	updateTimes.push_back(ofGetElapsedTimeMicros() - then);
+	timings.push_back(particleSystem.getTimings());
+	auto & octreeStats = particleSystem.getOctree().getUpdateStats();
+	numRebuilds += octreeStats.rebuilt;
+	numMoved += octreeStats.moved;
+
+	then = ofGetElapsedTimeMicros();
+	photons.update(settings.dt);
+	auto now = ofGetElapsedTimeMicros();
+	photonMicros += now - then;
+	photons.pack();
+	photonPackingMicros += ofGetElapsedTimeMicros() - now;
+	numPackedPhotons += photons.size();
+
+	Frame frame;
+	frame.hash = particleSystem.getStateHash();
+	frame.numParticles = particleSystem.getParticles().size();
+	auto frameNum = trajectory.size();
+	if(firstDivergentFrame > frameNum && frameNum < golden.size() &&
+	   (golden[frameNum].hash != frame.hash || golden[frameNum].numParticles != frame.numParticles)){
+		firstDivergentFrame = frameNum;
+	}
+	trajectory.push_back(frame);
+
+	if(trajectory.size() == settings.frames){
+		if(!settings.golden.empty() && (settings.record || golden.empty())){
+			saveGolden();
+		}
+		report();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::exit(){
+	listeners.unsubscribeAll();
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("ParticlesBenchmark", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("frames", settings.frames);
+	json.get("dt", settings.dt);
+	json.get("capacity", settings.capacity);
+	json.get("halfDim", settings.halfDim);
+	json.get("state", settings.state);
+	json.get("energy", settings.energy);
+	json.get("systemSpeed", settings.systemSpeed);
+	json.get("deterministic", settings.deterministic);
+	json.get("checkLevel", settings.checkLevel);
+	json.get("theta", settings.theta);
+	json.get("maxLeafSize", settings.maxLeafSize);
+	json.get("quadrupoles", settings.quadrupoles);
+	json.get("softening", settings.softening);
+	json.get("incremental", settings.incremental);
+	json.get("rebuildImbalance", settings.rebuildImbalance);
+	json.get("forceErrorSamples", settings.forceErrorSamples);
+	json.get("rangeQuerySamples", settings.rangeQuerySamples);
+	json.get("rangeQueryDistance", settings.rangeQueryDistance);
+	json.get("rangeQueryMaxResults", settings.rangeQueryMaxResults);
+	json.get("clusterFraction", settings.clusterFraction);
+	json.get("numClusters", settings.numClusters);
+	json.get("clusterRadius", settings.clusterRadius);
+	json.get("photons", settings.photons);
+	json.get("golden", settings.golden);
+	json.get("record", settings.record);
+	if(json.getJson().count("particles")){
+		auto & particles = json.getJson()["particles"];
+		for(size_t i = 0; i < particles.size() && i < settings.particles.size(); ++i){
+			settings.particles[i] = particles[i];
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::loadGolden(){
+	if(settings.record || settings.golden.empty()){
+		return;
+	}
+
+	if(!ofFile::doesFileExist(settings.golden)){
+		ofLogNotice("ParticlesBenchmark") << "No golden trajectory at " << settings.golden << ", recording one";
+		return;
+	}
+
+	// one line per frame: frame number, state hash, number of particles
+	for(auto & line: ofBufferFromFile(settings.golden).getLines()){
+		std::istringstream ss(line);
+		size_t frameNum;
+		Frame frame;
+		if(ss >> frameNum >> std::hex >> frame.hash >> std::dec >> frame.numParticles){
+			golden.push_back(frame);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::saveGolden() const{
+	std::ostringstream ss;
+	for(size_t i = 0; i < trajectory.size(); ++i){
+		ss << i << " " << std::hex << trajectory[i].hash << std::dec << " " << trajectory[i].numParticles << "\n";
+	}
+	ofBuffer buffer;
+	buffer.set(ss.str());
+	if(ofBufferToFile(settings.golden, buffer)){
+		ofLogNotice("ParticlesBenchmark") << "Recorded golden trajectory of " << trajectory.size() << " frames to " << settings.golden;
+	}else{
+		ofLogError("ParticlesBenchmark") << "Couldn't write the golden trajectory to " << settings.golden;
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::report(){
+	typedef nm::ParticleSystem::Timings Timings;
+	std::vector<std::pair<std::string, uint64_t Timings::*>> phases{
+		{"octree", &Timings::octree},
+		{"center of charge", &Timings::centerOfCharge},
+		{"forces", &Timings::forces},
+		{"integration", &Timings::integration},
+		{"interactions", &Timings::interactions},
+		{"compaction", &Timings::compaction},
+		{"gpu packing", &Timings::packing},
+		{"upload", &Timings::upload},
+	};
+
+	auto frames = std::max<size_t>(timings.size(), 1);
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << "phase                mean ms     max ms" << endl;
+	for(auto & phase: phases){
+		uint64_t sum = 0, max = 0;
+		for(auto & t: timings){
+			sum += t.*phase.second;
+			max = std::max(max, t.*phase.second);
+		}
+		ss << std::left << std::setw(18) << phase.first << std::right
+		   << std::setw(10) << sum / 1000. / frames
+		   << std::setw(11) << max / 1000. << endl;
+	}
+	auto sum = std::accumulate(updateTimes.begin(), updateTimes.end(), uint64_t(0));
+	auto max = updateTimes.empty() ? 0 : *std::max_element(updateTimes.begin(), updateTimes.end());
+	ss << std::left << std::setw(18) << "update" << std::right
+	   << std::setw(10) << sum / 1000. / frames
+	   << std::setw(11) << max / 1000. << endl;
+	size_t numPacked = 0;
+	uint64_t packingMicros = 0;
+	for(size_t i = 0; i < timings.size(); ++i){
+		numPacked += trajectory[i].numParticles;
+		packingMicros += timings[i].packing;
+	}
+	ss << "gpu packing: " << sizeof(nm::ParticleGpuData) << " bytes/particle, "
+	   << packingMicros * 1000. / std::max<size_t>(numPacked, 1) << " ns/particle" << endl;
+	ss << trajectory.back().numParticles << " particles left, " << numDead << " died, " << numPhotons << " photons" << endl;
+	ss << "photons: " << photons.size() << " alive, " << photons.getNumEligible() << " eligible for pair production, update "
+	   << photonMicros * 1000. / std::max<size_t>(numPackedPhotons, 1) << " ns/photon, packing "
+	   << photonPackingMicros * 1000. / std::max<size_t>(numPackedPhotons, 1) << " ns/photon, "
+	   << sizeof(photons.getInstances()[0]) << " bytes/photon" << endl;
+	ss << "final state hash " << std::hex << trajectory.back().hash << std::dec << endl;
+
+	auto & octree = particleSystem.getOctree();
+	ss << "octree: " << octree.getNumLeaves() << " leaves, depth " << octree.getDepth()
+	   << ", theta " << settings.theta << ", max leaf size " << settings.maxLeafSize
+	   << (settings.quadrupoles ? ", quadrupoles" : ", monopoles") << endl;
+	ss << "octree updates: " << (settings.incremental ? "incremental" : "rebuilt every frame")
+	   << ", rebuilt " << numRebuilds << " of " << timings.size() << " frames, "
+	   << numMoved / double(frames) << " particles reinserted/frame" << endl;
+	if(settings.forceErrorSamples > 0){
+		auto error = particleSystem.computeForceError(settings.forceErrorSamples);
+		ss << std::scientific << std::setprecision(2)
+		   << "force error over " << error.numSamples << " particles: mean " << error.meanRelative
+		   << " rms " << error.rmsRelative << " max " << error.maxRelative << endl
+		   << std::fixed << std::setprecision(3)
+		   << "tree " << error.treeMicros / 1000. << "ms, direct sum " << error.directMicros / 1000. << "ms" << endl;
+	}
+	if(settings.rangeQuerySamples > 0){
+		reportRangeQueries(ss);
+	}
+	std::vector<std::string> failures;
+	if(!golden.empty()){
+		if(firstDivergentFrame < trajectory.size()){
+			failures.push_back("diverges from " + settings.golden + " at frame " + ofToString(firstDivergentFrame));
+		}else if(golden.size() < trajectory.size()){
+			ss << "matches the " << golden.size() << " frames of " << settings.golden << endl;
+		}else{
+			ss << "matches " << settings.golden << endl;
+		}
+	}
+	ofxHeadless::exit("ParticlesBenchmark", ss, failures);
+}
+
+//--------------------------------------------------------------
+void ofApp::reportRangeQueries(std::ostream & ss){
+	// the queries match the positions the tree was built from
+	particleSystem.rebuildOctree();
+
+	auto & particles = particleSystem.getParticles();
+	if(particles.empty()){
+		return;
+	}
+	auto numSamples = std::min(settings.rangeQuerySamples, particles.size());
+	auto distanceSquared = settings.rangeQueryDistance * settings.rangeQueryDistance;
+	std::vector<nm::ParticleStore::Handle> results(particles.size()), expected;
+	size_t numResults = 0, numMismatches = 0;
+	uint64_t treeMicros = 0, bruteForceMicros = 0;
+	for(size_t s = 0; s < numSamples; ++s){
+		unsigned index = s * particles.size() / numSamples;
+
+		// every other query only wants the type of the particle it's for,
+		// every fourth one stops at rangeQueryMaxResults
+		auto typeMask = s % 2 ? nm::Particle::getTypeMask(particles.getType(index)) : nm::Particle::ALL_TYPES;
+		auto maxResults = s % 4 == 3 ? std::min(settings.rangeQueryMaxResults, results.size()) : results.size();
+
+		auto then = ofGetElapsedTimeMicros();
+		auto count = particleSystem.findNearestThan(index, settings.rangeQueryDistance, typeMask, gsl::span<nm::ParticleStore::Handle>(results.data(), maxResults));
+		auto now = ofGetElapsedTimeMicros();
+		treeMicros += now - then;
+		then = now;
+
+		expected.clear();
+		for(unsigned i = 0; i < particles.size(); ++i){
+			if(i != index && particles.alive[i] && (nm::Particle::getTypeMask(particles.getType(i)) & typeMask) &&
+			   glm::distance2(particles.pos[i], particles.pos[index]) < distanceSquared){
+				expected.push_back(particles.getHandle(i));
+			}
+		}
+		bruteForceMicros += ofGetElapsedTimeMicros() - then;
+
+		// a capped query can return any of them
+		std::sort(results.begin(), results.begin() + count);
+		std::sort(expected.begin(), expected.end());
+		if(count != std::min(expected.size(), maxResults) || !std::includes(expected.begin(), expected.end(), results.begin(), results.begin() + count)){
+			++numMismatches;
+		}
+		numResults += count;
+	}
+	ss << "range queries within " << settings.rangeQueryDistance << " of " << numSamples << " particles: "
+	   << numResults / numSamples << " neighbours, " << numMismatches << " differ from the brute force" << endl
+	   << "tree " << treeMicros / double(numSamples) << "us/query, brute force " << bruteForceMicros / double(numSamples) << "us/query" << endl;
+}
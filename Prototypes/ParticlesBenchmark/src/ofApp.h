@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ParticleSystem.h"
+#include "Photons.h"
+
+// Headless benchmark and replay harness for nm::ParticleSystem::update.
+//
+// Seeds the system from a settings file, steps a fixed number of frames
+// with a fixed dt and reports how long each phase of the update took.
+// The state hash of every frame is recorded as a golden trajectory or,
+// if one was already recorded for the same settings, compared against
+// it so a change in the update that changes the simulation shows up as
+// the first frame that diverges. At the end the octree forces are compared
+// against the direct sum to see what the chosen theta costs in accuracy
+// and the octree range queries, filtered by type and capped for some of
+// them, against a brute force search. settings_5k.json, settings_50k.json
+// and settings_500k.json only run the range queries, over partly
+// clustered particles.
+//
+// The photons the system emits, plus a pool of them emitted at setup, go
+// to a headless nm::Photons with its own environment so its pair
+// production doesn't feed back into the trajectory, its update and the
+// packing of its instances are timed separately.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 3030;
+			size_t frames = 600;
+			double dt = 1. / 60.;
+			size_t capacity = nm::ParticleSystem::DEFAULT_CAPACITY;
+			float halfDim = 400.f;
+			int state = nm::Environment::STANDARD_MODEL;
+			float energy = 1.f;
+			float systemSpeed = .5f;
+			bool deterministic = true;
+			int checkLevel = nm::ParticleSystem::CHECK_NONE;
+			float theta = .5f;
+			int maxLeafSize = 16;
+			bool quadrupoles = true;
+			float softening = 1.f;
+			bool incremental = true;
+			float rebuildImbalance = 2.f;
+			size_t forceErrorSamples = 256;
+			size_t rangeQuerySamples = 256;
+			float rangeQueryDistance = 20.f;
+			size_t rangeQueryMaxResults = 8;
+			// share of the particles placed in numClusters balls of clusterRadius
+			float clusterFraction = 0.f;
+			size_t numClusters = 8;
+			float clusterRadius = 20.f;
+			size_t photons = 20000;
+			std::array<int, nm::Particle::NUM_TYPES> particles{{300, 300, 300, 300, 300, 300, 0, 0}};
+			std::string golden = "golden.txt";
+			bool record = false;
+		};
+
+		void setup();
+		void update();
+		void exit();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Frame{
+			uint64_t hash;
+			size_t numParticles;
+		};
+
+		void loadSettings();
+		void loadGolden();
+		void saveGolden() const;
+		void report();
+		void reportRangeQueries(std::ostream & ss);
+
+		Settings settings;
+		nm::Environment::Ptr environment;
+		nm::ParticleSystem particleSystem;
+		nm::Environment::Ptr photonEnvironment;
+		nm::Photons photons;
+
+		std::vector<nm::ParticleSystem::Timings> timings;
+		std::vector<uint64_t> updateTimes;
+		std::vector<Frame> trajectory;
+		std::vector<Frame> golden;
+		size_t firstDivergentFrame = std::numeric_limits<size_t>::max();
+		size_t numDead = 0;
+		size_t numPhotons = 0;
+		size_t numRebuilds = 0;
+		size_t numMoved = 0;
+		uint64_t photonMicros = 0;
+		uint64_t photonPackingMicros = 0;
+		size_t numPackedPhotons = 0;
+		ofEventListeners listeners;
+};
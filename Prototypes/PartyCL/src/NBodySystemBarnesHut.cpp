@@ -0,0 +1,233 @@
+//
+//  NBodySystemBarnesHut.cpp
+//  PartyCL
+//
+//
+
+#include "NBodySystemBarnesHut.h"
+
+namespace
+{
+    // Morton keys hold 21 bits per axis.
+    const int kMaxLevel = 21;
+
+    //--------------------------------------------------------------
+    // Spreads the low 21 bits of v so there are 2 zeros between them.
+    uint64_t spreadBits(uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
+}
+
+namespace entropy
+{
+    //--------------------------------------------------------------
+    NBodySystemBarnesHut::NBodySystemBarnesHut(int numBodies, bool bHeadless)
+    : NBodySystemCPU(numBodies, bHeadless),
+    _rootSize(0),
+    _theta(0.5f),
+    _leafSize(16),
+    _numInteractions(0)
+    {
+        _rootCorner[0] = _rootCorner[1] = _rootCorner[2] = 0;
+    }
+
+    //--------------------------------------------------------------
+    NBodySystemBarnesHut::~NBodySystemBarnesHut()
+    {}
+
+    //--------------------------------------------------------------
+    void NBodySystemBarnesHut::_sortBodies()
+    {
+        const float* pos = _pos[_currentRead];
+
+        // Cube around all the bodies, a little larger so none quantizes past the edge.
+        float minPos[3] = { pos[0], pos[1], pos[2] };
+        float maxPos[3] = { pos[0], pos[1], pos[2] };
+        for (int i = 1; i < _numBodies; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                minPos[k] = std::min(minPos[k], pos[i*4+k]);
+                maxPos[k] = std::max(maxPos[k], pos[i*4+k]);
+            }
+        }
+        _rootSize = std::max(std::max(maxPos[0] - minPos[0], maxPos[1] - minPos[1]), maxPos[2] - minPos[2]);
+        _rootSize = std::max(_rootSize * 1.001f, 1e-6f);
+        for (int k = 0; k < 3; ++k) {
+            _rootCorner[k] = (minPos[k] + maxPos[k] - _rootSize) * 0.5f;
+        }
+
+        // x in the low bit of each triplet, then y then z, like the children of a node.
+        vector<std::pair<uint64_t, int>> keyed(_numBodies);
+        const float scale = (1 << kMaxLevel) / _rootSize;
+        _parallelFor(_numBodies, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                uint64_t key = 0;
+                for (int k = 0; k < 3; ++k) {
+                    int cell = (int)ofClamp((pos[i*4+k] - _rootCorner[k]) * scale, 0, (1 << kMaxLevel) - 1);
+                    key |= spreadBits(cell) << k;
+                }
+                keyed[i] = std::make_pair(key, i);
+            }
+        });
+        std::sort(keyed.begin(), keyed.end());
+
+        _keys.resize(_numBodies);
+        _order.resize(_numBodies);
+        for (auto& sorted : _sorted) {
+            sorted.resize(_numBodies);
+        }
+        for (int s = 0; s < _numBodies; ++s) {
+            _keys[s] = keyed[s].first;
+            _order[s] = keyed[s].second;
+            for (int k = 0; k < 4; ++k) {
+                _sorted[k][s] = pos[keyed[s].second*4+k];
+            }
+        }
+    }
+
+    //--------------------------------------------------------------
+    int NBodySystemBarnesHut::_buildNode(int bodyBegin, int bodyEnd, int level, const float corner[3], float size)
+    {
+        const int index = _nodes.size();
+        _nodes.push_back(Node());
+
+        double com[3] = { 0, 0, 0 };
+        double mass = 0;
+        bool bLeaf = (bodyEnd - bodyBegin <= _leafSize) || (level == kMaxLevel);
+        if (bLeaf) {
+            for (int s = bodyBegin; s < bodyEnd; ++s) {
+                for (int k = 0; k < 3; ++k) {
+                    com[k] += (double)_sorted[k][s] * _sorted[3][s];
+                }
+                mass += _sorted[3][s];
+            }
+        }
+        else {
+            // The keys in the node share everything above these 3 bits, which are
+            // the octant of the child.
+            const int shift = 3 * (kMaxLevel - 1 - level);
+            const float childSize = size * 0.5f;
+            int begin = bodyBegin;
+            for (int octant = 0; octant < 8 && begin < bodyEnd; ++octant) {
+                int end = std::partition_point(_keys.begin() + begin, _keys.begin() + bodyEnd, [&](uint64_t key) {
+                    return (int)((key >> shift) & 7) <= octant;
+                }) - _keys.begin();
+                if (end == begin) continue;
+
+                float childCorner[3];
+                for (int k = 0; k < 3; ++k) {
+                    childCorner[k] = corner[k] + ((octant >> k) & 1) * childSize;
+                }
+                int child = _buildNode(begin, end, level + 1, childCorner, childSize);
+
+                // _nodes grows while building, don't keep references across the call.
+                for (int k = 0; k < 3; ++k) {
+                    com[k] += (double)_nodes[child].com[k] * _nodes[child].mass;
+                }
+                mass += _nodes[child].mass;
+
+                begin = end;
+            }
+        }
+
+        Node& node = _nodes[index];
+        float offsetSqr = 0;
+        for (int k = 0; k < 3; ++k) {
+            float center = corner[k] + size * 0.5f;
+            node.com[k] = (mass > 0) ? (float)(com[k] / mass) : center;
+            offsetSqr += (node.com[k] - center) * (node.com[k] - center);
+        }
+        node.mass = mass;
+
+        // Barnes' b_max criterion, the offset keeps a body right next to an
+        // off-center mass from using it whole.
+        if (_theta > 0) {
+            float openDist = size / _theta + sqrtf(offsetSqr);
+            node.openDistSqr = openDist * openDist;
+        }
+        else {
+            node.openDistSqr = std::numeric_limits<float>::max();
+        }
+
+        node.bodyBegin = bodyBegin;
+        node.bodyEnd = bodyEnd;
+        node.bLeaf = bLeaf;
+        node.next = _nodes.size();
+
+        return index;
+    }
+
+    //--------------------------------------------------------------
+    void NBodySystemBarnesHut::_walkTree(float accel[3], const float posMass[4], uint64_t& numInteractions) const
+    {
+        const int numNodes = _nodes.size();
+        int n = 0;
+        while (n < numNodes) {
+            const Node& node = _nodes[n];
+
+            float r[3] = { node.com[0] - posMass[0], node.com[1] - posMass[1], node.com[2] - posMass[2] };
+            float distSqr = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+            if (distSqr >= node.openDistSqr) {
+                // Far enough, the whole node at its center of mass.
+                float invDist = 1.0f / sqrtf(distSqr + _softeningSquared);
+                float s = node.mass * invDist * invDist * invDist;
+                for (int k = 0; k < 3; ++k) {
+                    accel[k] += r[k] * s;
+                }
+                ++numInteractions;
+                n = node.next;
+            }
+            else if (node.bLeaf) {
+                for (int s = node.bodyBegin; s < node.bodyEnd; ++s) {
+                    float rb[3] = { _sorted[0][s] - posMass[0], _sorted[1][s] - posMass[1], _sorted[2][s] - posMass[2] };
+                    float bodyDistSqr = rb[0] * rb[0] + rb[1] * rb[1] + rb[2] * rb[2] + _softeningSquared;
+                    float invDist = 1.0f / sqrtf(bodyDistSqr);
+                    float f = _sorted[3][s] * invDist * invDist * invDist;
+                    for (int k = 0; k < 3; ++k) {
+                        accel[k] += rb[k] * f;
+                    }
+                }
+                numInteractions += node.bodyEnd - node.bodyBegin;
+                n = node.next;
+            }
+            else {
+                // Open it, the first child is next.
+                ++n;
+            }
+        }
+    }
+
+    //--------------------------------------------------------------
+    void NBodySystemBarnesHut::_computeNBodyGravitation()
+    {
+        _numInteractions = 0;
+        _nodes.clear();
+        if (_numBodies == 0) return;
+
+        _sortBodies();
+        _buildNode(0, _numBodies, 0, _rootCorner, _rootSize);
+
+        // In Morton order, so neighbouring bodies on a thread walk the same nodes.
+        _parallelFor(_numBodies, [&](int begin, int end) {
+            uint64_t numInteractions = 0;
+            for (int s = begin; s < end; ++s) {
+                float posMass[4] = { _sorted[0][s], _sorted[1][s], _sorted[2][s], _sorted[3][s] };
+                float accel[3] = { 0, 0, 0 };
+                _walkTree(accel, posMass, numInteractions);
+
+                // Force = mass * acceleration, _integrateNBodySystem divides it back.
+                int i = _order[s];
+                for (int k = 0; k < 3; ++k) {
+                    _force[i*4+k] = accel[k] * posMass[3];
+                }
+            }
+            _numInteractions += numInteractions;
+        });
+    }
+}
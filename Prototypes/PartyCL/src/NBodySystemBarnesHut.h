@@ -0,0 +1,85 @@
+//
+//  NBodySystemBarnesHut.h
+//  PartyCL
+//
+//
+
+#pragma once
+
+#include <atomic>
+
+#include "NBodySystemCPU.h"
+
+namespace entropy
+{
+    // Barnes-Hut tree code, O(n log n) instead of the O(n^2) direct sum.
+    //
+    // Every update the bodies are sorted along a Morton curve and an octree is
+    // built over the sorted ranges, depth first, each node knowing where its
+    // subtree ends so the walk needs no stack. A node far enough from a body
+    // acts as a single body at its center of mass, the rest are opened, down
+    // to leaves of at most _leafSize bodies summed directly.
+    //
+    // Sources are weighted by their own mass like in NBodySystemTiled.
+    class NBodySystemBarnesHut
+    : public NBodySystemCPU
+    {
+    public:
+        NBodySystemBarnesHut(int numBodies, bool bHeadless = false);
+        virtual ~NBodySystemBarnesHut();
+
+        // Opening angle, a node is used whole when size / distance < theta.
+        // 0 opens everything, the usual range is 0.3 to 1.
+        void setTheta(float theta)
+        { _theta = theta; }
+
+        void setLeafSize(int leafSize)
+        { _leafSize = std::max(1, leafSize); }
+
+        virtual uint64_t getNumInteractions() const
+        { return _numInteractions; }
+
+        size_t getNumNodes() const
+        { return _nodes.size(); }
+
+    protected: // methods
+        virtual void _computeNBodyGravitation();
+
+        void _sortBodies();
+        int _buildNode(int bodyBegin, int bodyEnd, int level, const float corner[3], float size);
+        void _walkTree(float accel[3], const float posMass[4], uint64_t& numInteractions) const;
+
+    protected: // data
+        struct Node
+        {
+            float com[3];
+            float mass;
+
+            // Bodies closer than this to the center of mass open the node,
+            // (size / theta + offset of the center of mass from the center)^2.
+            float openDistSqr;
+
+            int bodyBegin;
+            int bodyEnd;
+
+            // Index after the subtree, children start at the next index.
+            int next;
+            bool bLeaf;
+        };
+
+        vector<Node> _nodes;
+
+        // Bodies in Morton order, x, y, z and mass, and where each one came from.
+        vector<uint64_t> _keys;
+        vector<int> _order;
+        vector<float> _sorted[4];
+
+        float _rootCorner[3];
+        float _rootSize;
+
+        float _theta;
+        int _leafSize;
+
+        std::atomic<uint64_t> _numInteractions;
+    };
+}
@@ -8,16 +8,20 @@
 
 #include "NBodySystemCPU.h"
 
+#include <thread>
+
 namespace entropy
 {
     //--------------------------------------------------------------
-    NBodySystemCPU::NBodySystemCPU(int numBodies)
+    NBodySystemCPU::NBodySystemCPU(int numBodies, bool bHeadless)
     : NBodySystem(numBodies),
     _force(0),
     _softeningSquared(.00125f),
     _damping(0.995f),
     _currentRead(0),
-    _currentWrite(1)
+    _currentWrite(1),
+    _numThreads(0),
+    _bHeadless(bHeadless)
     {
         for (int i = 0; i < 2; ++i) {
             _pos[i] = nullptr;
@@ -52,7 +56,9 @@ namespace entropy
         _force  = new float[_numBodies*4];
         memset(_force, 0, _numBodies*4*sizeof(float));
 
-        _vbo.setVertexData(_pos[_currentWrite], 4, _numBodies, GL_DYNAMIC_DRAW);
+        if (!_bHeadless) {
+            _vbo.setVertexData(_pos[_currentWrite], 4, _numBodies, GL_DYNAMIC_DRAW);
+        }
 
         _bInitialized = true;
     }
@@ -83,7 +89,9 @@ namespace entropy
         _integrateNBodySystem(deltaTime);
 
         // Upload data to VBO.
-        _vbo.setVertexData(_pos[_currentWrite], 4, _numBodies, GL_DYNAMIC_DRAW);
+        if (!_bHeadless) {
+            _vbo.setVertexData(_pos[_currentWrite], 4, _numBodies, GL_DYNAMIC_DRAW);
+        }
 
         std::swap(_currentRead, _currentWrite);
     }
@@ -97,7 +105,7 @@ namespace entropy
     //--------------------------------------------------------------
     float* NBodySystemCPU::getArray(ArrayType type)
     {
-        if (!_bInitialized) return;
+        if (!_bInitialized) return nullptr;
 
         float* data = 0;
         switch (type)
@@ -180,6 +188,26 @@ namespace entropy
         }
     }
 
+    //--------------------------------------------------------------
+    void NBodySystemCPU::_parallelFor(int count, const std::function<void(int, int)>& func) const
+    {
+        int numThreads = _numThreads ? _numThreads : std::max(1u, std::thread::hardware_concurrency());
+        numThreads = std::max(1, std::min(numThreads, count));
+        if (numThreads == 1) {
+            func(0, count);
+            return;
+        }
+
+        vector<std::thread> threads;
+        for (int t = 1; t < numThreads; ++t) {
+            threads.emplace_back(func, (int)((int64_t)count * t / numThreads), (int)((int64_t)count * (t + 1) / numThreads));
+        }
+        func(0, count / numThreads);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
     //--------------------------------------------------------------
     void NBodySystemCPU::_integrateNBodySystem(float deltaTime)
     {
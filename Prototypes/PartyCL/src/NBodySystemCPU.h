@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include "NBodySystem.h"
 
 namespace entropy
@@ -16,7 +18,8 @@ namespace entropy
     : public NBodySystem
     {
     public:
-        NBodySystemCPU(int numBodies);
+        // A headless system never touches the VBO, for running without a GL context.
+        NBodySystemCPU(int numBodies, bool bHeadless = false);
         virtual ~NBodySystemCPU();
 
         virtual void update(float deltaTime);
@@ -31,6 +34,14 @@ namespace entropy
         virtual float* getArray(ArrayType type);
         virtual void setArray(ArrayType type, const float *data);
 
+        // Body-body and body-node interactions of the last update.
+        virtual uint64_t getNumInteractions() const
+        { return (uint64_t)_numBodies * _numBodies; }
+
+        // 0 uses all hardware threads.
+        void setNumThreads(unsigned int numThreads)
+        { _numThreads = numThreads; }
+
     protected: // methods
         NBodySystemCPU() {} // default constructor
 
@@ -38,9 +49,12 @@ namespace entropy
         virtual void _finalize();
 
         void _bodyBodyInteraction(float accel[3], float posMass0[4], float posMass1[4], float softeningSquared);
-        void _computeNBodyGravitation();
+        virtual void _computeNBodyGravitation();
         void _integrateNBodySystem(float deltaTime);
 
+        // Splits [0, count) in one range per thread and runs func(begin, end) on each.
+        void _parallelFor(int count, const std::function<void(int, int)>& func) const;
+
     protected: // data
         float* _pos[2];
         float* _vel[2];
@@ -53,6 +67,9 @@ namespace entropy
 
         unsigned int _currentRead;
         unsigned int _currentWrite;
+
+        unsigned int _numThreads;
+        bool _bHeadless;
     };
 }
 
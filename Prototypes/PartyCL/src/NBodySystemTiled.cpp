@@ -0,0 +1,135 @@
+//
+//  NBodySystemTiled.cpp
+//  PartyCL
+//
+//
+
+#include "NBodySystemTiled.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define NBODY_TILED_SSE 1
+    #include <xmmintrin.h>
+#else
+    #define NBODY_TILED_SSE 0
+#endif
+
+namespace
+{
+    //--------------------------------------------------------------
+    // Adds the acceleration from the sources [begin, end) on the body at
+    // posMass to accel. The count is a multiple of 4.
+    void tileInteractions(float accel[3], const float posMass[4], const float* x, const float* y, const float* z, const float* m, int begin, int end, float softeningSquared)
+    {
+#if NBODY_TILED_SSE
+        const __m128 px = _mm_set1_ps(posMass[0]);
+        const __m128 py = _mm_set1_ps(posMass[1]);
+        const __m128 pz = _mm_set1_ps(posMass[2]);
+        const __m128 eps2 = _mm_set1_ps(softeningSquared);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 threeHalves = _mm_set1_ps(1.5f);
+
+        __m128 ax = _mm_setzero_ps();
+        __m128 ay = _mm_setzero_ps();
+        __m128 az = _mm_setzero_ps();
+        for (int j = begin; j < end; j += 4) {
+            // r_ij  [3 FLOPS]
+            __m128 rx = _mm_sub_ps(_mm_loadu_ps(x + j), px);
+            __m128 ry = _mm_sub_ps(_mm_loadu_ps(y + j), py);
+            __m128 rz = _mm_sub_ps(_mm_loadu_ps(z + j), pz);
+
+            // d^2 + e^2 [6 FLOPS]
+            __m128 distSqr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_add_ps(_mm_mul_ps(rz, rz), eps2));
+
+            // invDist = rsqrt + one Newton-Raphson step, close to 1 / sqrtf.
+            __m128 invDist = _mm_rsqrt_ps(distSqr);
+            invDist = _mm_mul_ps(invDist, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, distSqr), _mm_mul_ps(invDist, invDist))));
+            __m128 invDistCube = _mm_mul_ps(invDist, _mm_mul_ps(invDist, invDist));
+
+            // s = m_j * invDistCube [1 FLOP]
+            __m128 s = _mm_mul_ps(_mm_loadu_ps(m + j), invDistCube);
+
+            // a_i = a_i + s * r_ij [6 FLOPS]
+            ax = _mm_add_ps(ax, _mm_mul_ps(rx, s));
+            ay = _mm_add_ps(ay, _mm_mul_ps(ry, s));
+            az = _mm_add_ps(az, _mm_mul_ps(rz, s));
+        }
+
+        float lanes[3][4];
+        _mm_storeu_ps(lanes[0], ax);
+        _mm_storeu_ps(lanes[1], ay);
+        _mm_storeu_ps(lanes[2], az);
+        for (int k = 0; k < 3; ++k) {
+            accel[k] += (lanes[k][0] + lanes[k][1]) + (lanes[k][2] + lanes[k][3]);
+        }
+#else
+        // Same 4 lanes, for the compiler to vectorize.
+        float lanes[3][4] = {};
+        for (int j = begin; j < end; j += 4) {
+            for (int l = 0; l < 4; ++l) {
+                float r[3] = { x[j + l] - posMass[0], y[j + l] - posMass[1], z[j + l] - posMass[2] };
+                float distSqr = r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + softeningSquared;
+                float invDist = 1.0f / sqrtf(distSqr);
+                float s = m[j + l] * invDist * invDist * invDist;
+                for (int k = 0; k < 3; ++k) {
+                    lanes[k][l] += r[k] * s;
+                }
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            accel[k] += (lanes[k][0] + lanes[k][1]) + (lanes[k][2] + lanes[k][3]);
+        }
+#endif
+    }
+}
+
+namespace entropy
+{
+    //--------------------------------------------------------------
+    NBodySystemTiled::NBodySystemTiled(int numBodies, bool bHeadless)
+    : NBodySystemCPU(numBodies, bHeadless),
+    _tileSize(1024)
+    {}
+
+    //--------------------------------------------------------------
+    NBodySystemTiled::~NBodySystemTiled()
+    {}
+
+    //--------------------------------------------------------------
+    void NBodySystemTiled::_computeNBodyGravitation()
+    {
+        const float* pos = _pos[_currentRead];
+        const int numSources = (_numBodies + 3) & ~3;
+
+        // Padding sits on the first body with no mass, it adds 0 like the body
+        // itself does, as long as the softening isn't 0.
+        for (int k = 0; k < 4; ++k) {
+            _sources[k].resize(numSources);
+            for (int i = 0; i < _numBodies; ++i) {
+                _sources[k][i] = pos[i*4+k];
+            }
+            for (int i = _numBodies; i < numSources; ++i) {
+                _sources[k][i] = (k < 3) ? pos[k] : 0.0f;
+            }
+        }
+
+        _parallelFor(_numBodies, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                _force[i*4] = _force[i*4+1] = _force[i*4+2] = 0;
+            }
+
+            for (int tileBegin = 0; tileBegin < numSources; tileBegin += _tileSize) {
+                int tileEnd = std::min(tileBegin + _tileSize, numSources);
+                for (int i = begin; i < end; ++i) {
+                    tileInteractions(&_force[i*4], &pos[i*4], _sources[0].data(), _sources[1].data(), _sources[2].data(), _sources[3].data(), tileBegin, tileEnd, _softeningSquared);
+                }
+            }
+
+            // Force = mass * acceleration, _integrateNBodySystem divides it back.
+            for (int i = begin; i < end; ++i) {
+                for (int k = 0; k < 3; ++k) {
+                    _force[i*4+k] *= pos[i*4+3];
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,39 @@
+//
+//  NBodySystemTiled.h
+//  PartyCL
+//
+//
+
+#pragma once
+
+#include "NBodySystemCPU.h"
+
+namespace entropy
+{
+    // Direct sum like NBodySystemCPU, on SoA copies of the bodies. The sources
+    // are visited _tileSize bodies at a time so they stay in L1, each thread
+    // takes a range of bodies and the interactions run 4 at a time with SSE.
+    //
+    // The sources are weighted by their own mass like in the OpenCL kernel,
+    // NBodySystemCPU weighs them by the mass of the body the force is on, the
+    // same thing when all masses are 1.
+    class NBodySystemTiled
+    : public NBodySystemCPU
+    {
+    public:
+        NBodySystemTiled(int numBodies, bool bHeadless = false);
+        virtual ~NBodySystemTiled();
+
+        void setTileSize(int tileSize)
+        { _tileSize = std::max(4, tileSize & ~3); }
+
+    protected: // methods
+        virtual void _computeNBodyGravitation();
+
+    protected: // data
+        // x, y, z and mass, padded to a multiple of 4 with massless bodies.
+        vector<float> _sources[4];
+
+        int _tileSize;
+    };
+}
@@ -3,6 +3,9 @@
 #include "PartyCLApp.h"
 
 #define USE_OPENCL 1
+// CPU systems when USE_OPENCL is off, NBodySystemCPU without either.
+//#define USE_TILED 1
+//#define USE_BARNES_HUT 1
 //#define LOAD_TIPSY 1
 
 namespace entropy
@@ -130,6 +133,10 @@ namespace entropy
         // Init system.
 #ifdef USE_OPENCL
         system = new NBodySystemOpenCL(numBodies, p, q);
+#elif defined(USE_BARNES_HUT)
+        system = new NBodySystemBarnesHut(numBodies);
+#elif defined(USE_TILED)
+        system = new NBodySystemTiled(numBodies);
 #else
         system = new NBodySystemCPU(numBodies);
 #endif
@@ -3,8 +3,10 @@
 #include "ofMain.h"
 #include "ofxGui.h"
 
+#include "NBodySystemBarnesHut.h"
 #include "NBodySystemCPU.h"
 #include "NBodySystemOpenCL.h"
+#include "NBodySystemTiled.h"
 #include "ParticleRenderer.h"
 #include "Preset.h"
 
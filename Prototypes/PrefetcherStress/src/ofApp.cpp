@@ -0,0 +1,219 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+
+using namespace ent;
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	if(settings.numFrames < 3 || settings.budgetFrames < settings.lookAhead + 2){
+		ofLogError("PrefetcherStress") << "Needs at least 3 frames and a budget of lookAhead + 2 frames";
+		ofExit(1);
+		return;
+	}
+	if(!writeSequence()){
+		ofExit(1);
+		return;
+	}
+
+	// The last frame is the corrupted one, the passes only go through
+	// the valid ones but the look-ahead still runs into it.
+	auto corruptFrame = settings.numFrames - 1;
+	auto numValid = size_t(settings.numFrames - 1);
+	byteBudget = settings.budgetFrames * frameFileBytes;
+
+	FramePrefetcher::Settings prefetcherSettings;
+	prefetcherSettings.folder = settings.folder;
+	prefetcherSettings.startIndex = 0;
+	prefetcherSettings.numFrames = settings.numFrames;
+	prefetcherSettings.byteBudget = byteBudget;
+	prefetcherSettings.lookAhead = settings.lookAhead;
+	prefetcherSettings.numThreads = settings.threads;
+	prefetcher.setup(prefetcherSettings);
+
+	std::vector<Pass> passes;
+	std::vector<std::string> failures;
+	auto expect = [&](bool condition, const std::string & pass, const std::string & what){
+		if(!condition){
+			failures.push_back(pass + ": " + what);
+		}
+	};
+	auto run = [&](const std::string & name, auto && f){
+		Pass pass;
+		auto before = prefetcher.getStats();
+		f(pass);
+		passes.push_back(diff(name, before, pass));
+		return passes.back();
+	};
+	auto play = [&](int frameIndex, Pass & pass){
+		prefetcher.request(frameIndex);
+		acquire(frameIndex, pass);
+		ofSleepMillis(settings.frameMillis);
+	};
+
+	// Nothing requested yet so the workers are idle, the first acquire
+	// has to load on this thread and the second one find it.
+	auto cold = run("cold", [&](Pass & pass){
+		acquire(0, pass);
+		acquire(0, pass);
+	});
+	expect(cold.stats.misses == 1 && cold.stats.hits == 1 && cold.stats.stalls == 0, cold.name, "expected 1 miss, 1 hit and no stalls");
+
+	// Every frame is requested before it's acquired so none can miss,
+	// at most the first ones after a change of direction can stall.
+	auto forward = run("forward", [&](Pass & pass){
+		for(size_t i = 0; i < numValid; ++i){
+			play(i, pass);
+		}
+	});
+	auto backward = run("backward", [&](Pass & pass){
+		for(size_t i = numValid; i > 0; --i){
+			play(i - 1, pass);
+		}
+	});
+	for(auto scrub: {&forward, &backward}){
+		expect(scrub->stats.misses == 0, scrub->name, "missed " + ofToString(scrub->stats.misses) + " requested frames");
+		expect(scrub->stats.hits + scrub->stats.stalls == numValid, scrub->name, "hits and stalls don't add up to the frames played");
+		expect(scrub->stats.stalls <= settings.maxStallsPerScrub, scrub->name, "stalled " + ofToString(scrub->stats.stalls) + " times");
+		expect(scrub->stats.evictions > 0, scrub->name, "didn't evict with a budget of " + ofToString(settings.budgetFrames) + " frames");
+	}
+
+	// Random jumps, the look-ahead rarely helps but nothing requested
+	// can miss either.
+	ofSeedRandom(settings.seed);
+	auto jumps = run("jumps", [&](Pass & pass){
+		for(size_t i = 0; i < settings.jumps; ++i){
+			play(int(ofRandom(numValid)), pass);
+		}
+	});
+	expect(jumps.stats.misses == 0, jumps.name, "missed " + ofToString(jumps.stats.misses) + " requested frames");
+
+	// The look-ahead already ran into the corrupted frame and failed to
+	// load it, it has to fail again instead of coming back as a frame.
+	// Failed frames hold no bytes, if they were evicted the evictions
+	// would stop matching the frames that left the pool.
+	expect(prefetcher.acquire(corruptFrame) == nullptr, "corrupt", "loaded the corrupted frame");
+
+	for(auto & pass: passes){
+		expect(pass.wrongFrames == 0, pass.name, ofToString(pass.wrongFrames) + " frames with the wrong contents");
+		expect(pass.overBudget == 0, pass.name, "over the byte budget " + ofToString(pass.overBudget) + " times");
+		expect(pass.inconsistentPool == 0, pass.name, "frames loaded minus evicted didn't match the pool " + ofToString(pass.inconsistentPool) + " times");
+	}
+	prefetcher.close();
+
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << settings.numFrames << " frames of " << frameFileBytes << " bytes, budget " << settings.budgetFrames
+	   << " frames, look-ahead " << settings.lookAhead << ", " << settings.threads << " threads" << endl;
+	ss << "pass        acquired  hits  misses  stalls  stall ms  loaded  evicted" << endl;
+	for(auto & pass: passes){
+		ss << std::left << std::setw(10) << pass.name << std::right
+		   << std::setw(10) << pass.acquired
+		   << std::setw(6) << pass.stats.hits
+		   << std::setw(8) << pass.stats.misses
+		   << std::setw(8) << pass.stats.stalls
+		   << std::setw(10) << pass.stats.stallMicros / 1000.
+		   << std::setw(8) << pass.stats.framesLoaded
+		   << std::setw(9) << pass.stats.evictions << endl;
+	}
+	ofxHeadless::exit("PrefetcherStress", ss, failures);
+}
+
+//--------------------------------------------------------------
+bool ofApp::writeSequence(){
+	ofDirectory::createDirectory(settings.folder, true, true);
+
+	FrameMetadata metadata{};
+	std::vector<uint32_t> raw(settings.frameBytes / sizeof(uint32_t));
+	for(int frameIndex = 0; frameIndex < settings.numFrames - 1; ++frameIndex){
+		for(size_t i = 0; i < raw.size(); ++i){
+			raw[i] = uint32_t(frameIndex) * 2654435761u + uint32_t(i);
+		}
+		FrameFileWriter writer;
+		writer.addSection(FrameFile::MetadataSection, &metadata, sizeof(metadata), sizeof(metadata));
+		writer.addSection(FrameFile::RawSection, raw);
+		if(!writer.save(FrameFile::getPath(settings.folder, frameIndex))){
+			ofLogError("PrefetcherStress") << "Couldn't write frame " << frameIndex;
+			return false;
+		}
+	}
+
+	ofBuffer garbage;
+	garbage.set(std::string(FrameFile::PageSize, 'x'));
+	if(!ofBufferToFile(FrameFile::getPath(settings.folder, settings.numFrames - 1), garbage)){
+		ofLogError("PrefetcherStress") << "Couldn't write the corrupted frame";
+		return false;
+	}
+
+	frameFileBytes = ofFile(FrameFile::getPath(settings.folder, 0), ofFile::Reference).getSize();
+	return frameFileBytes > 0;
+}
+
+//--------------------------------------------------------------
+bool ofApp::checkFrame(const FrameFile & frame, int frameIndex) const{
+	size_t count;
+	auto raw = frame.getSection<uint32_t>(FrameFile::RawSection, count);
+	if(raw == nullptr || count != settings.frameBytes / sizeof(uint32_t)){
+		return false;
+	}
+	for(size_t i = 0; i < count; ++i){
+		if(raw[i] != uint32_t(frameIndex) * 2654435761u + uint32_t(i)){
+			return false;
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+void ofApp::acquire(int frameIndex, Pass & pass){
+	auto frame = prefetcher.acquire(frameIndex);
+	pass.acquired += 1;
+	if(!frame || !checkFrame(*frame, frameIndex)){
+		pass.wrongFrames += 1;
+	}
+
+	// Taken under a single lock so the workers can't change the pool
+	// between the counters and its contents.
+	auto stats = prefetcher.getStats();
+	if(stats.poolBytes > byteBudget){
+		pass.overBudget += 1;
+	}
+	if(stats.framesLoaded - stats.evictions != stats.poolFrames){
+		pass.inconsistentPool += 1;
+	}
+}
+
+//--------------------------------------------------------------
+ofApp::Pass ofApp::diff(const std::string & name, const FramePrefetcher::Stats & before, Pass & pass) const{
+	auto after = prefetcher.getStats();
+	pass.name = name;
+	pass.stats.hits = after.hits - before.hits;
+	pass.stats.misses = after.misses - before.misses;
+	pass.stats.stalls = after.stalls - before.stalls;
+	pass.stats.stallMicros = after.stallMicros - before.stallMicros;
+	pass.stats.evictions = after.evictions - before.evictions;
+	pass.stats.framesLoaded = after.framesLoaded - before.framesLoaded;
+	pass.stats.bytesLoaded = after.bytesLoaded - before.bytesLoaded;
+	pass.stats.poolBytes = after.poolBytes;
+	pass.stats.poolFrames = after.poolFrames;
+	return pass;
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("PrefetcherStress", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("folder", settings.folder);
+	json.get("numFrames", settings.numFrames);
+	json.get("frameBytes", settings.frameBytes);
+	json.get("budgetFrames", settings.budgetFrames);
+	json.get("lookAhead", settings.lookAhead);
+	json.get("threads", settings.threads);
+	json.get("frameMillis", settings.frameMillis);
+	json.get("jumps", settings.jumps);
+	json.get("maxStallsPerScrub", settings.maxStallsPerScrub);
+}
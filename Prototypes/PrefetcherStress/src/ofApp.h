@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FramePrefetcher.h"
+
+// Headless test for ent::FramePrefetcher against a synthetic sequence.
+//
+// Writes a few small frame files, with the last one corrupted, and gives
+// the prefetcher a byte budget that only fits some of them so scrubbing
+// through the sequence has to evict. Then acquires a cold frame, scrubs
+// forwards and backwards at a fixed frame rate and jumps around, checking
+// the contents of every frame, the hit, miss and stall counters of every
+// pass and that the pool never goes over budget or loses track of what
+// it holds. Exits with 1 if anything failed.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 3030;
+			std::string folder = "frames";
+			int numFrames = 32;
+			size_t frameBytes = 256 * 1024;
+			size_t budgetFrames = 8;
+			size_t lookAhead = 4;
+			size_t threads = 2;
+			int frameMillis = 10;
+			size_t jumps = 64;
+			size_t maxStallsPerScrub = 2;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Pass{
+			std::string name;
+			size_t acquired = 0;
+			size_t wrongFrames = 0;
+			size_t overBudget = 0;
+			size_t inconsistentPool = 0;
+			ent::FramePrefetcher::Stats stats;
+		};
+
+		void loadSettings();
+		bool writeSequence();
+		bool checkFrame(const ent::FrameFile & frame, int frameIndex) const;
+		void acquire(int frameIndex, Pass & pass);
+		Pass diff(const std::string & name, const ent::FramePrefetcher::Stats & before, Pass & pass) const;
+
+		Settings settings;
+		ent::FramePrefetcher prefetcher;
+		size_t frameFileBytes = 0;
+		size_t byteBudget = 0;
+};
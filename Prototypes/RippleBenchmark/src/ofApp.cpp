@@ -0,0 +1,336 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using entropy::bubbles::RippleCPU;
+
+namespace{
+	//--------------------------------------------------------------
+	float sample(const std::vector<float> & field, const glm::ivec3 & dims, bool threeD, glm::ivec3 cell, int channel){
+		if(threeD){
+			// imageLoad outside the image is 0
+			if(cell.x < 0 || cell.y < 0 || cell.z < 0 || cell.x >= dims.x || cell.y >= dims.y || cell.z >= dims.z){
+				return 0.f;
+			}
+		}else{
+			// the 2D textures clamp to the edge
+			cell.x = ofClamp(cell.x, 0, dims.x - 1);
+			cell.y = ofClamp(cell.y, 0, dims.y - 1);
+		}
+		return field[((size_t(cell.z) * dims.y + cell.y) * dims.x + cell.x) * 4 + channel];
+	}
+
+	//--------------------------------------------------------------
+	// ripple.frag and ripple3D.comp for a single channel of a single cell
+	float referenceStep(const std::vector<float> & prev, const std::vector<float> & curr, const glm::ivec3 & dims, bool threeD, float damping, const glm::ivec3 & cell, int channel){
+		static const glm::ivec3 offsets[6] = {
+			{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1},
+		};
+		float sum = 0.f;
+		for(int i = 0; i < (threeD ? 6 : 4); ++i){
+			sum += sample(prev, dims, threeD, cell + offsets[i], channel);
+		}
+		sum = (sum / (threeD ? 3.f : 2.f)) - sample(curr, dims, threeD, cell, channel);
+		sum *= damping;
+		return RippleCPU::roundToHalf(sum);
+	}
+
+	//--------------------------------------------------------------
+	// odd sizes, so there are partial tiles everywhere
+	glm::ivec3 getValidationDimensions(bool threeD){
+		return threeD ? glm::ivec3(67, 45, 33) : glm::ivec3(257, 131, 1);
+	}
+
+	//--------------------------------------------------------------
+	void allocateRandom(RippleCPU & ripple, const glm::ivec3 & dims, bool threeD){
+		if(threeD){
+			ripple.allocate(dims);
+		}else{
+			ripple.allocate(glm::ivec2(dims.x, dims.y));
+		}
+		for(int idx = 0; idx < 2; ++idx){
+			auto data = ripple.getData(idx);
+			for(size_t i = 0; i < ripple.getNumCells() * 4; ++i){
+				data[i] = RippleCPU::roundToHalf(ofRandom(-1.f, 1.f));
+			}
+		}
+	}
+
+	//--------------------------------------------------------------
+	size_t countDifferentBits(const float * a, const float * b, size_t count){
+		size_t different = 0;
+		for(size_t i = 0; i < count; ++i){
+			different += std::memcmp(a + i, b + i, sizeof(float)) != 0;
+		}
+		return different;
+	}
+
+	//--------------------------------------------------------------
+	// Keeps a copy of the field the pool picks to draw, update() has to
+	// leave it as it was until the next pick.
+	template<typename Pool>
+	class DrawnFieldPool : public Pool{
+	public:
+		bool isDrawnFieldIntact() const{
+			auto data = this->ripple.getData(this->drawIdx);
+			return std::memcmp(data, this->drawn.data(), this->drawn.size() * sizeof(float)) == 0;
+		}
+
+		size_t numComputes = 0;
+
+	protected:
+		void setDrawTextureIndex(int idx) override{
+			Pool::setDrawTextureIndex(idx);
+			auto data = this->ripple.getData(idx);
+			this->drawn.assign(data, data + this->ripple.getNumCells() * 4);
+		}
+
+		void stepRipples(int numSteps) override{
+			Pool::stepRipples(numSteps);
+			++this->numComputes;
+		}
+
+		std::vector<float> drawn;
+	};
+
+	//--------------------------------------------------------------
+	uint64_t hashFields(const RippleCPU & ripple){
+		uint64_t hash = 14695981039346656037ull;
+		for(int idx = 0; idx < 3; ++idx){
+			auto bytes = reinterpret_cast<const uint8_t *>(ripple.getData(idx));
+			for(size_t i = 0; i < ripple.getNumCells() * 4 * sizeof(float); ++i){
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+#ifdef _OPENMP
+	if(settings.threads > 0){
+		omp_set_num_threads(settings.threads);
+	}
+#endif
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	auto mismatches2D = validate(false);
+	auto mismatches3D = validate(true);
+	auto advanceMismatches2D = validateAdvance(false);
+	auto advanceMismatches3D = validateAdvance(true);
+	size_t drawnMismatches2D = 0;
+	size_t drawnMismatches3D = 0;
+	for(auto rippleSteps: settings.rippleSteps){
+		drawnMismatches2D += validateDrawn<entropy::bubbles::PoolCPU2D>(rippleSteps);
+		drawnMismatches3D += validateDrawn<entropy::bubbles::PoolCPU3D>(rippleSteps);
+	}
+
+	std::vector<std::pair<std::string, Result>> results;
+	for(auto rippleSteps: settings.rippleSteps){
+		entropy::bubbles::PoolCPU2D pool2D;
+		pool2D.setDimensions(glm::vec2(settings.width, settings.height));
+		results.emplace_back(std::string("2D ") + ofToString(settings.width) + "x" + ofToString(settings.height), run(pool2D, rippleSteps));
+	}
+	for(auto rippleSteps: settings.rippleSteps){
+		entropy::bubbles::PoolCPU3D pool3D;
+		pool3D.setDimensions(glm::vec3(settings.size3D));
+		results.emplace_back(std::string("3D ") + ofToString(settings.size3D) + "^3", run(pool3D, rippleSteps));
+	}
+
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(2);
+	ss << "2D validation: " << mismatches2D << " values differ from the shader transcription" << endl;
+	ss << "3D validation: " << mismatches3D << " values differ from the shader transcription" << endl;
+	ss << "2D advance: " << advanceMismatches2D << " values differ from single steps" << endl;
+	ss << "3D advance: " << advanceMismatches3D << " values differ from single steps" << endl;
+	ss << "2D ripple rate " << settings.validateRippleRate << ": " << drawnMismatches2D << " frames changed the drawn field" << endl;
+	ss << "3D ripple rate " << settings.validateRippleRate << ": " << drawnMismatches3D << " frames changed the drawn field" << endl;
+	for(auto & r: results){
+		ss << r.first << ", " << r.second.rippleSteps << " steps/frame: " << r.second.steps << " steps, "
+		   << r.second.cellsPerSecond / 1e6 << " Mcells/s, "
+		   << r.second.updateMicros / 1000. / settings.frames << "ms/frame, "
+		   << "hash " << std::hex << r.second.hash << std::dec << endl;
+	}
+
+	std::vector<std::string> failures;
+	if(mismatches2D + mismatches3D > 0){
+		failures.push_back("validation against the shader transcription");
+	}
+	if(advanceMismatches2D + advanceMismatches3D > 0){
+		failures.push_back("advance against single steps");
+	}
+	if(drawnMismatches2D + drawnMismatches3D > 0){
+		failures.push_back("ripple rate " + ofToString(settings.validateRippleRate) + " against the drawn field");
+	}
+	ofxHeadless::exit("RippleBenchmark", ss, failures);
+}
+
+//--------------------------------------------------------------
+size_t ofApp::validate(bool threeD){
+	// small tiles, every tile edge case shows up
+	auto dims = getValidationDimensions(threeD);
+	RippleCPU ripple;
+	ofSeedRandom(settings.seed);
+	allocateRandom(ripple, dims, threeD);
+	ripple.tileSize2D = glm::ivec2(64, 8);
+	ripple.tileSize3D = glm::ivec2(16, 4);
+
+	// same buffer dance as PoolBase
+	const auto damping = 0.995f / 10.0f + 0.9f;
+	const auto count = ripple.getNumCells() * 4;
+	int prevIdx = 0, currIdx = 1, tempIdx = 2;
+	size_t mismatches = 0;
+	std::vector<float> expected(count);
+	for(int step = 0; step < settings.validateSteps; ++step){
+		std::swap(currIdx, prevIdx);
+		if(step % 5 == 0){
+			auto center = glm::vec3(ofRandom(dims.x), ofRandom(dims.y), threeD ? ofRandom(dims.z) : 0.f);
+			ripple.addRing(prevIdx, center, 12.f, threeD ? 1.f : .5f, ofFloatColor(0.29f, 0.56f, 1.0f, 1.0f));
+		}
+
+		std::vector<float> prev(ripple.getData(prevIdx), ripple.getData(prevIdx) + count);
+		std::vector<float> curr(ripple.getData(currIdx), ripple.getData(currIdx) + count);
+		for(int z = 0; z < dims.z; ++z){
+			for(int y = 0; y < dims.y; ++y){
+				for(int x = 0; x < dims.x; ++x){
+					for(int c = 0; c < 4; ++c){
+						expected[((size_t(z) * dims.y + y) * dims.x + x) * 4 + c] = referenceStep(prev, curr, dims, threeD, damping, glm::ivec3(x, y, z), c);
+					}
+				}
+			}
+		}
+		ripple.step(tempIdx, prevIdx, currIdx, damping);
+		mismatches += countDifferentBits(expected.data(), ripple.getData(tempIdx), count);
+		ripple.swap(currIdx, tempIdx);
+
+		// mix() is x * (1 - a) + y * a
+		const auto pct = (step + 1) / float(settings.validateSteps + 1);
+		ripple.mix(tempIdx, prevIdx, currIdx, pct);
+		for(size_t i = 0; i < count; ++i){
+			expected[i] = RippleCPU::roundToHalf(ripple.getData(prevIdx)[i] * (1.f - pct) + ripple.getData(currIdx)[i] * pct);
+		}
+		mismatches += countDifferentBits(expected.data(), ripple.getData(tempIdx), count);
+	}
+	return mismatches;
+}
+
+//--------------------------------------------------------------
+size_t ofApp::validateAdvance(bool threeD){
+	// one field stepped one step at a time, a copy advanced in small odd
+	// blocks so halos cross several blocks and hit the edges
+	auto dims = getValidationDimensions(threeD);
+	RippleCPU stepped;
+	ofSeedRandom(settings.seed);
+	allocateRandom(stepped, dims, threeD);
+	RippleCPU advanced = stepped;
+	advanced.blockSize2D = glm::ivec3(37, 11, 1);
+	advanced.blockSize3D = glm::ivec3(13, 7, 5);
+
+	const auto damping = 0.995f / 10.0f + 0.9f;
+	const auto count = stepped.getNumCells() * 4;
+	int prevIdx = 0, currIdx = 1, tempIdx = 2;
+	size_t mismatches = 0;
+	int numSteps = 1;
+	for(int round = 0; round < settings.validateSteps; ++round){
+		std::swap(currIdx, prevIdx);
+		auto center = glm::vec3(ofRandom(dims.x), ofRandom(dims.y), threeD ? ofRandom(dims.z) : 0.f);
+		stepped.addRing(prevIdx, center, 12.f, threeD ? 1.f : .5f, ofFloatColor(0.29f, 0.56f, 1.0f, 1.0f));
+		advanced.addRing(prevIdx, center, 12.f, threeD ? 1.f : .5f, ofFloatColor(0.29f, 0.56f, 1.0f, 1.0f));
+
+		// what PoolBase::stepRipples does, and what the CPU pools do instead
+		int steppedPrevIdx = prevIdx, steppedCurrIdx = currIdx;
+		for(int i = 0; i < numSteps; ++i){
+			if(i > 0){
+				std::swap(steppedCurrIdx, steppedPrevIdx);
+			}
+			stepped.step(tempIdx, steppedPrevIdx, steppedCurrIdx, damping);
+			stepped.swap(steppedCurrIdx, tempIdx);
+		}
+		advanced.advance(prevIdx, currIdx, tempIdx, damping, numSteps);
+
+		// the newest field is in curr for one and in prev for the other
+		mismatches += countDifferentBits(stepped.getData(steppedCurrIdx), advanced.getData(prevIdx), count);
+		mismatches += countDifferentBits(stepped.getData(steppedPrevIdx), advanced.getData(currIdx), count);
+
+		// the pools swap the indices after advance(), move the stepped fields to
+		// match so both start the next round the same
+		std::swap(currIdx, prevIdx);
+		if(steppedCurrIdx != currIdx){
+			stepped.swap(currIdx, prevIdx);
+		}
+		numSteps = numSteps % 8 + 1;
+	}
+	return mismatches;
+}
+
+//--------------------------------------------------------------
+template<typename Pool>
+size_t ofApp::validateDrawn(int rippleSteps){
+	// a few cycles, every cycle ends drawing its target and computing the
+	// next one around it
+	auto dims = getValidationDimensions(std::is_same<Pool, entropy::bubbles::PoolCPU3D>::value);
+	auto rippleRate = std::max(settings.validateRippleRate, 2);
+	DrawnFieldPool<Pool> pool;
+	pool.setDimensions(glm::vec3(dims.x, dims.y, dims.z));
+	pool.init(true);
+	pool.rippleRate = rippleRate;
+	pool.rippleSteps = rippleSteps;
+
+	ofSeedRandom(settings.seed);
+	size_t mismatches = 0;
+	for(int frame = 0; frame < rippleRate * 4 + 1; ++frame){
+		pool.update(1. / 60.);
+		if(!pool.isDrawnFieldIntact()){
+			++mismatches;
+		}
+	}
+
+	// not a single cycle means nothing was checked
+	return pool.numComputes < 4 ? mismatches + 1 : mismatches;
+}
+
+//--------------------------------------------------------------
+template<typename Pool>
+ofApp::Result ofApp::run(Pool & pool, int rippleSteps){
+	pool.init(true);
+	pool.rippleRate = settings.rippleRate;
+	pool.rippleSteps = rippleSteps;
+
+	// the drops draw from ofRandom, the same seed gives the same fields
+	ofSeedRandom(settings.seed);
+	Result result;
+	result.rippleSteps = rippleSteps;
+	for(size_t frame = 0; frame < settings.frames; ++frame){
+		auto then = ofGetElapsedTimeMicros();
+		pool.update(1. / 60.);
+		result.updateMicros += ofGetElapsedTimeMicros() - then;
+	}
+
+	auto & stats = pool.getRipple().getStats();
+	result.steps = stats.steps;
+	result.cellsPerSecond = stats.getCellsPerSecond();
+	result.hash = hashFields(pool.getRipple());
+	return result;
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("RippleBenchmark", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("frames", settings.frames);
+	json.get("width", settings.width);
+	json.get("height", settings.height);
+	json.get("size3D", settings.size3D);
+	json.get("rippleRate", settings.rippleRate);
+	json.get("rippleSteps", settings.rippleSteps);
+	json.get("validateSteps", settings.validateSteps);
+	json.get("validateRippleRate", settings.validateRippleRate);
+	json.get("threads", settings.threads);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ofMain.h"
+#include "PoolCPU2D.h"
+#include "PoolCPU3D.h"
+
+// Headless benchmark for the CPU ripple pools, entropy::bubbles::PoolCPU2D
+// and PoolCPU3D.
+//
+// First steps small fields with odd sizes and tiny tiles, so there are
+// partial tiles and tile edges everywhere, and compares every value bit
+// for bit with a cell by cell transcription of ripple.frag, ripple3D.comp
+// and the mix shaders, and checks that advancing several steps at once in
+// blocks gives the same bits as stepping one at a time, and that with a
+// ripple rate over 1 the field being drawn doesn't change when the pools
+// compute the next target at the end of a cycle. Then runs both pools for
+// a number of frames with the same seed, once per entry of rippleSteps,
+// and reports cells per second and a hash of the fields, the hash only
+// changes if the results do. Exits with 1 on any mismatch.
+//
+// Runs without a GL context, so the transcription stands in for the GPU:
+// the GL pools' output is never read back and compared.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 3030;
+			size_t frames = 300;
+			int width = 1920;
+			int height = 1080;
+			int size3D = 256;
+			int rippleRate = 1;
+			std::vector<int> rippleSteps = { 1, 4 };
+			int validateSteps = 20;
+			int validateRippleRate = 4;
+			int threads = 0;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Result{
+			int rippleSteps = 1;
+			uint64_t steps = 0;
+			double cellsPerSecond = 0.;
+			uint64_t updateMicros = 0;
+			uint64_t hash = 0;
+		};
+
+		void loadSettings();
+		size_t validate(bool threeD);
+		size_t validateAdvance(bool threeD);
+		template<typename Pool>
+		size_t validateDrawn(int rippleSteps);
+		template<typename Pool>
+		Result run(Pool & pool, int rippleSteps);
+
+		Settings settings;
+};
@@ -0,0 +1,217 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+#include <random>
+
+namespace{
+	inline uint32_t floatBits(float v){
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		return bits;
+	}
+
+	std::string modeName(VoxelCodec::Mode mode){
+		return mode == VoxelCodec::Lossless ? "lossless" : "quantized";
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	std::vector<std::pair<VoxelCodec::Mode, float>> modes{{VoxelCodec::Lossless, 0.f}};
+	for(auto maxError: settings.maxErrors){
+		modes.emplace_back(VoxelCodec::Quantized, maxError);
+	}
+
+	std::vector<Result> results;
+	for(auto size: settings.sizes){
+		auto random = randomVolume(size, settings.seed);
+		auto sparse = sparseVolume(size, settings.seed, 0);
+		for(auto & mode: modes){
+			results.push_back(testKeyFrame("random", random, size, mode.first, mode.second));
+			results.push_back(testKeyFrame("sparse", sparse, size, mode.first, mode.second));
+			results.push_back(testDeltas(size, mode.first, mode.second));
+		}
+	}
+
+	std::vector<std::string> failures;
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << "decoding on " << std::thread::hardware_concurrency() << " hardware threads" << endl;
+	ss << "volume     size  mode       max error  frames    ratio    measured error  decode GB/s" << endl;
+	for(auto & result: results){
+		ss << std::left << std::setw(9) << result.volume << std::right
+		   << std::setw(6) << result.size << "  "
+		   << std::left << std::setw(9) << modeName(result.mode) << std::right
+		   << std::setw(12) << std::setprecision(4) << result.maxError
+		   << std::setw(8) << result.frames
+		   << std::setw(9) << std::setprecision(2) << double(result.size * result.size * result.size * sizeof(float) * result.frames) / std::max<size_t>(result.encodedBytes, 1)
+		   << std::setw(18) << std::scientific << std::setprecision(3) << result.error << std::fixed
+		   << std::setw(13) << result.decodeGBps << endl;
+
+		auto name = result.volume + " " + ofToString(result.size) + "³ " + modeName(result.mode) +
+					(result.mode == VoxelCodec::Quantized ? " " + ofToString(result.maxError) : "");
+		if(!result.decoded){
+			failures.push_back(name + ": couldn't be decoded");
+		}else if(result.mismatches > 0){
+			failures.push_back(name + ": " + ofToString(result.mismatches) +
+							   (result.mode == VoxelCodec::Lossless ? " voxels differ from the original" : " voxels over the max error"));
+		}
+		if(result.volume != "deltas" && result.size >= settings.minDecodeSize && settings.minDecodeGBps > 0 &&
+		   result.decodeGBps < settings.minDecodeGBps){
+			failures.push_back(name + ": decodes at " + ofToString(result.decodeGBps) + "GB/s, under " + ofToString(settings.minDecodeGBps) + "GB/s");
+		}
+	}
+	ofxHeadless::exit("VoxelCodecBenchmark", ss, failures);
+}
+
+//--------------------------------------------------------------
+std::vector<float> ofApp::randomVolume(size_t size, uint64_t seed) const{
+	std::mt19937_64 random(seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::vector<float> voxels(size * size * size);
+	for(auto & v: voxels){
+		auto kind = uniform(random);
+		auto value = uniform(random);
+		if(kind < 1.f / 16.f){
+			v = 0.f;
+		}else if(kind < 1.f / 16.f + 1.f / 256.f){
+			v = -0.f;
+		}else if(kind < 1.f / 16.f + 2.f / 256.f){
+			v = value * std::numeric_limits<float>::denorm_min() * 1000.f;
+		}else if(kind < 1.f / 16.f + 3.f / 256.f){
+			v = 1000.f + value * 1e6f;
+		}else if(kind < 1.f / 16.f + 4.f / 256.f){
+			v = -value;
+		}else{
+			v = value;
+		}
+	}
+	return voxels;
+}
+
+//--------------------------------------------------------------
+std::vector<float> ofApp::sparseVolume(size_t size, uint64_t seed, size_t frame) const{
+	// Same blobs for every frame of a seed, moving a bit every frame.
+	std::mt19937_64 random(seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::vector<float> voxels(size * size * size, 0.f);
+	auto radius = settings.blobRadius * size;
+	for(size_t b = 0; b < settings.numBlobs; ++b){
+		glm::vec3 center(uniform(random), uniform(random), uniform(random));
+		glm::vec3 velocity(uniform(random) - .5f, uniform(random) - .5f, uniform(random) - .5f);
+		auto amplitude = .5f + uniform(random) * 1.5f;
+		center = (center * .8f + glm::vec3(.1f) + velocity * .02f * float(frame)) * float(size);
+
+		int min[3], max[3];
+		for(int c = 0; c < 3; ++c){
+			min[c] = std::max(int(center[c] - radius), 0);
+			max[c] = std::min(int(center[c] + radius) + 1, int(size));
+		}
+		for(int z = min[2]; z < max[2]; ++z){
+			for(int y = min[1]; y < max[1]; ++y){
+				for(int x = min[0]; x < max[0]; ++x){
+					auto d = glm::vec3(x, y, z) - center;
+					auto d2 = (d.x * d.x + d.y * d.y + d.z * d.z) / (radius * radius);
+					if(d2 < 1.f){
+						voxels[(z * size + y) * size + x] += amplitude * (1.f - d2);
+					}
+				}
+			}
+		}
+	}
+	return voxels;
+}
+
+//--------------------------------------------------------------
+void ofApp::compare(const std::vector<float> & original, const std::vector<float> & decoded, Result & result) const{
+	if(decoded.size() != original.size()){
+		result.decoded = false;
+		return;
+	}
+	for(size_t i = 0; i < original.size(); ++i){
+		if(result.mode == VoxelCodec::Lossless){
+			if(floatBits(decoded[i]) != floatBits(original[i])){
+				result.mismatches += 1;
+			}
+		}else{
+			auto error = std::abs(double(decoded[i]) - double(original[i]));
+			result.error = std::max(result.error, error);
+			if(error > result.maxError){
+				result.mismatches += 1;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------
+ofApp::Result ofApp::testKeyFrame(const std::string & name, const std::vector<float> & voxels, size_t size, VoxelCodec::Mode mode, float maxError) const{
+	Result result;
+	result.volume = name;
+	result.size = size;
+	result.mode = mode;
+	result.maxError = maxError;
+	result.frames = 1;
+
+	auto encoded = VoxelCodec::encode(voxels.data(), size, mode, maxError);
+	result.encodedBytes = encoded.size();
+
+	std::vector<float> decoded;
+	uint64_t best = std::numeric_limits<uint64_t>::max();
+	for(size_t run = 0; run < std::max<size_t>(settings.decodeRuns, 1); ++run){
+		auto then = ofGetElapsedTimeMicros();
+		result.decoded &= VoxelCodec::decode(encoded.data(), encoded.size(), decoded);
+		best = std::min(best, ofGetElapsedTimeMicros() - then);
+	}
+	result.decodeGBps = double(voxels.size() * sizeof(float)) / (std::max<uint64_t>(best, 1) * 1000.);
+	compare(voxels, decoded, result);
+	return result;
+}
+
+//--------------------------------------------------------------
+ofApp::Result ofApp::testDeltas(size_t size, VoxelCodec::Mode mode, float maxError) const{
+	Result result;
+	result.volume = "deltas";
+	result.size = size;
+	result.mode = mode;
+	result.maxError = maxError;
+
+	// Every delta is encoded against the decoded previous frame, like
+	// VoxelSequence does, so the error can't build up along the chain.
+	std::vector<float> decoded;
+	uint64_t decodeMicros = 0;
+	for(size_t frame = 0; frame <= settings.deltaFrames; ++frame){
+		auto voxels = sparseVolume(size, settings.seed, frame);
+		auto encoded = frame == 0 ?
+					   VoxelCodec::encode(voxels.data(), size, mode, maxError) :
+					   VoxelCodec::encodeDelta(voxels.data(), decoded.data(), size, mode, maxError, frame, 0);
+		result.encodedBytes += encoded.size();
+
+		auto then = ofGetElapsedTimeMicros();
+		result.decoded &= frame == 0 ?
+						  VoxelCodec::decode(encoded.data(), encoded.size(), decoded) :
+						  VoxelCodec::applyDelta(encoded.data(), encoded.size(), decoded);
+		decodeMicros += ofGetElapsedTimeMicros() - then;
+		result.frames += 1;
+		compare(voxels, decoded, result);
+	}
+	result.decodeGBps = double(size * size * size * sizeof(float) * result.frames) / (std::max<uint64_t>(decodeMicros, 1) * 1000.);
+	return result;
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("VoxelCodecBenchmark", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("sizes", settings.sizes);
+	json.get("maxErrors", settings.maxErrors);
+	json.get("numBlobs", settings.numBlobs);
+	json.get("blobRadius", settings.blobRadius);
+	json.get("deltaFrames", settings.deltaFrames);
+	json.get("decodeRuns", settings.decodeRuns);
+	json.get("minDecodeGBps", settings.minDecodeGBps);
+	json.get("minDecodeSize", settings.minDecodeSize);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ofMain.h"
+#include "VoxelCodec.h"
+
+// Headless check and benchmark for VoxelCodec.
+//
+// Encodes dense random volumes, with zeros, negative zeros, denormals
+// and large values mixed in, and sparse volumes of a few blobs, in
+// Lossless mode and in Quantized mode for every max error. Every decoded
+// volume has to be bit identical to the original in Lossless mode and
+// within the max error of it in Quantized mode, also along a chain of
+// deltas of the sparse volumes with their blobs moving. Reports the
+// compression ratio and the decode throughput, the best of a few runs,
+// and checks it against a minimum on the bigger volumes. Decoding runs on
+// every hardware thread, the default minimum assumes a multi-core machine
+// like the one the scene plays on. Exits with 1 if anything failed.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 3030;
+			std::vector<size_t> sizes{64, 100, 256};
+			std::vector<float> maxErrors{0.0005f, 0.01f, 0.1f};
+			size_t numBlobs = 24;
+			float blobRadius = 0.06f;
+			size_t deltaFrames = 8;
+			size_t decodeRuns = 5;
+			double minDecodeGBps = 1.;
+			size_t minDecodeSize = 128;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Result{
+			std::string volume;
+			size_t size = 0;
+			VoxelCodec::Mode mode = VoxelCodec::Lossless;
+			float maxError = 0;
+			size_t frames = 0;
+			size_t encodedBytes = 0;
+			size_t mismatches = 0;
+			double error = 0;
+			double decodeGBps = 0;
+			bool decoded = true;
+		};
+
+		void loadSettings();
+		std::vector<float> randomVolume(size_t size, uint64_t seed) const;
+		std::vector<float> sparseVolume(size_t size, uint64_t seed, size_t frame) const;
+		void compare(const std::vector<float> & original, const std::vector<float> & decoded, Result & result) const;
+		Result testKeyFrame(const std::string & name, const std::vector<float> & voxels, size_t size, VoxelCodec::Mode mode, float maxError) const;
+		Result testDeltas(size_t size, VoxelCodec::Mode mode, float maxError) const;
+
+		Settings settings;
+};
@@ -0,0 +1,315 @@
+#include "ofApp.h"
+#include "ofxHeadless.h"
+
+using namespace ent;
+
+namespace{
+	inline uint32_t floatBits(float v){
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		return bits;
+	}
+
+	std::string modeName(VoxelCodec::Mode mode){
+		return mode == VoxelCodec::Lossless ? "lossless" : "quantized";
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+	loadSettings();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+	if(settings.numFrames < 3 || settings.rangeStart <= 0 || settings.rangeStart >= settings.numFrames ||
+	   settings.staleFrame < 0 || settings.staleFrame + 2 >= settings.numFrames){
+		ofLogError("VoxelSequenceTest") << "Needs at least 3 frames and the range start and stale frame inside the sequence";
+		ofExit(1);
+		return;
+	}
+
+	frames.clear();
+	for(int frameIndex = 0; frameIndex < settings.numFrames; ++frameIndex){
+		frames.push_back(volume(frameIndex));
+	}
+
+	std::vector<std::string> failures;
+	std::vector<Result> results;
+	for(auto mode: {VoxelCodec::Lossless, VoxelCodec::Quantized}){
+		results.push_back(test(mode, failures));
+	}
+
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << settings.numFrames << " frames of " << settings.size << "³, key-frame interval " << settings.keyInterval << endl;
+	ss << "mode       key-frames  bytes      key-frames only  ratio  measured error  forward ms/frame  seek ms" << endl;
+	for(auto & result: results){
+		ss << std::left << std::setw(9) << modeName(result.mode) << std::right
+		   << std::setw(12) << result.keyFrames
+		   << std::setw(11) << result.bytes
+		   << std::setw(17) << result.keyFramesOnlyBytes
+		   << std::setw(7) << std::setprecision(2) << double(result.keyFramesOnlyBytes) / std::max<size_t>(result.bytes, 1)
+		   << std::setw(16) << std::scientific << std::setprecision(3) << result.error << std::fixed
+		   << std::setw(18) << result.forwardMillis
+		   << std::setw(9) << result.seekMillis << endl;
+	}
+	ofxHeadless::exit("VoxelSequenceTest", ss, failures);
+}
+
+//--------------------------------------------------------------
+std::vector<float> ofApp::volume(int frameIndex) const{
+	// The same static blobs in every frame and a single one moving
+	// across the volume, so only the bricks around it change.
+	std::mt19937_64 random(settings.seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	auto size = settings.size;
+	std::vector<float> voxels(size * size * size, 0.f);
+	auto radius = settings.blobRadius * size;
+	for(size_t b = 0; b <= settings.numBlobs; ++b){
+		glm::vec3 center(uniform(random), uniform(random), uniform(random));
+		auto amplitude = .5f + uniform(random) * 1.5f;
+		if(b == settings.numBlobs){
+			center.x = float(frameIndex) / float(settings.numFrames);
+		}
+		center = (center * .8f + glm::vec3(.1f)) * float(size);
+
+		int min[3], max[3];
+		for(int c = 0; c < 3; ++c){
+			min[c] = std::max(int(center[c] - radius), 0);
+			max[c] = std::min(int(center[c] + radius) + 1, int(size));
+		}
+		for(int z = min[2]; z < max[2]; ++z){
+			for(int y = min[1]; y < max[1]; ++y){
+				for(int x = min[0]; x < max[0]; ++x){
+					auto d = glm::vec3(x, y, z) - center;
+					auto d2 = (d.x * d.x + d.y * d.y + d.z * d.z) / (radius * radius);
+					if(d2 < 1.f){
+						voxels[(z * size + y) * size + x] += amplitude * (1.f - d2);
+					}
+				}
+			}
+		}
+	}
+	return voxels;
+}
+
+//--------------------------------------------------------------
+std::string ofApp::getFolder(VoxelCodec::Mode mode) const{
+	return settings.folder + "/" + modeName(mode);
+}
+
+//--------------------------------------------------------------
+VoxelSequence::Loader ofApp::getLoader(const std::string & folder, int endIndex) const{
+	// Like SequenceRamses, frames before the start of the range are
+	// loaded too so a range can start in the middle of a delta chain.
+	return [folder, endIndex](int frameIndex) -> std::shared_ptr<const FrameFile>{
+		if(frameIndex < 0 || frameIndex >= endIndex){
+			return nullptr;
+		}
+		auto frame = std::make_shared<FrameFile>();
+		if(!frame->load(FrameFile::getPath(folder, frameIndex))){
+			return nullptr;
+		}
+		return frame;
+	};
+}
+
+//--------------------------------------------------------------
+bool ofApp::write(VoxelSequence & sequence, const std::string & folder, int frameIndex, VoxelCodec::Mode mode,
+				  const std::vector<float> & voxels, size_t keyInterval, size_t & bytes) const{
+	auto maxError = mode == VoxelCodec::Quantized ? settings.maxError : 0.f;
+	auto encoded = sequence.encode(frameIndex, voxels, settings.size, mode, maxError, keyInterval);
+
+	FrameMetadata metadata{};
+	metadata.worldsize = settings.size;
+	FrameFileWriter writer;
+	writer.addSection(FrameFile::MetadataSection, &metadata, sizeof(metadata), sizeof(metadata));
+	writer.addSection(FrameFile::VoxelsSection, encoded);
+	if(!writer.save(FrameFile::getPath(folder, frameIndex))){
+		return false;
+	}
+	bytes += encoded.size();
+	return true;
+}
+
+//--------------------------------------------------------------
+bool ofApp::readHeader(const std::shared_ptr<const FrameFile> & frame, VoxelCodec::Header & header) const{
+	if(!frame){
+		return false;
+	}
+	size_t dataSize;
+	auto data = frame->getSectionData(FrameFile::VoxelsSection, dataSize);
+	return VoxelCodec::readHeader(data, dataSize, header);
+}
+
+//--------------------------------------------------------------
+void ofApp::compare(const std::vector<float> & original, const std::vector<float> * decoded, Result & result) const{
+	if(decoded == nullptr || decoded->size() != original.size()){
+		result.undecodable += 1;
+		return;
+	}
+	for(size_t i = 0; i < original.size(); ++i){
+		if(result.mode == VoxelCodec::Lossless){
+			if(floatBits((*decoded)[i]) != floatBits(original[i])){
+				result.mismatches += 1;
+			}
+		}else{
+			auto error = std::abs(double((*decoded)[i]) - double(original[i]));
+			result.error = std::max(result.error, error);
+			if(error > settings.maxError){
+				result.mismatches += 1;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------
+ofApp::Result ofApp::test(VoxelCodec::Mode mode, std::vector<std::string> & failures) const{
+	Result result;
+	result.mode = mode;
+	auto expect = [&](bool condition, const std::string & what){
+		if(!condition){
+			failures.push_back(modeName(mode) + ": " + what);
+		}
+	};
+	auto decodes = [](const VoxelSequence & sequence, const VoxelSequence::Stats & before){
+		return sequence.getStats().keyFrames + sequence.getStats().deltas - before.keyFrames - before.deltas;
+	};
+
+	auto folder = getFolder(mode);
+	auto loader = getLoader(folder, settings.numFrames);
+	auto maxError = mode == VoxelCodec::Quantized ? settings.maxError : 0.f;
+	ofDirectory::createDirectory(folder, true, true);
+
+	// Every frame is written before the next one is encoded, the deltas
+	// are encoded against the previous frame as it's read back.
+	VoxelSequence writer;
+	writer.setup(loader);
+	std::vector<uint32_t> keyDistances;
+	for(int frameIndex = 0; frameIndex < settings.numFrames; ++frameIndex){
+		auto & voxels = frames[frameIndex];
+		if(!write(writer, folder, frameIndex, mode, voxels, settings.keyInterval, result.bytes)){
+			expect(false, "couldn't write frame " + ofToString(frameIndex));
+			return result;
+		}
+		result.keyFramesOnlyBytes += VoxelCodec::encode(voxels.data(), settings.size, mode, maxError).size();
+
+		VoxelCodec::Header header;
+		if(!readHeader(loader(frameIndex), header)){
+			expect(false, "couldn't read frame " + ofToString(frameIndex) + " back");
+			return result;
+		}
+		keyDistances.push_back(header.keyDistance);
+		result.keyFrames += VoxelCodec::isKeyFrame(header) ? 1 : 0;
+	}
+	auto interval = std::max<size_t>(settings.keyInterval, 1);
+	expect(result.keyFrames == (settings.numFrames + interval - 1) / interval,
+		   ofToString(result.keyFrames) + " key-frames for an interval of " + ofToString(interval));
+
+	// Playing forward decodes every frame once, a key-frame or a single
+	// delta on top of the previous frame.
+	{
+		VoxelSequence player;
+		player.setup(loader);
+		auto then = ofGetElapsedTimeMicros();
+		for(int frameIndex = 0; frameIndex < settings.numFrames; ++frameIndex){
+			compare(frames[frameIndex], player.reconstruct(frameIndex), result);
+		}
+		result.forwardMillis = (ofGetElapsedTimeMicros() - then) / 1000. / settings.numFrames;
+		expect(player.getStats().keyFrames == result.keyFrames && player.getStats().deltas == settings.numFrames - result.keyFrames,
+			   "playing forward decoded " + ofToString(player.getStats().keyFrames) + " key-frames and " +
+			   ofToString(player.getStats().deltas) + " deltas");
+	}
+
+	// A seek decodes the previous key-frame and the deltas up to the
+	// frame, at most the interval.
+	{
+		VoxelSequence player;
+		player.setup(loader);
+		std::mt19937_64 random(settings.seed);
+		std::uniform_int_distribution<int> frame(0, settings.numFrames - 1);
+		size_t overDecoded = 0;
+		auto then = ofGetElapsedTimeMicros();
+		for(size_t i = 0; i < settings.seeks; ++i){
+			auto frameIndex = frame(random);
+			auto before = player.getStats();
+			compare(frames[frameIndex], player.reconstruct(frameIndex), result);
+			if(decodes(player, before) > keyDistances[frameIndex] + 1){
+				overDecoded += 1;
+			}
+		}
+		result.seekMillis = (ofGetElapsedTimeMicros() - then) / 1000. / std::max<size_t>(settings.seeks, 1);
+		expect(overDecoded == 0, ofToString(overDecoded) + " seeks decoded more than the chain to their key-frame");
+	}
+
+	// A range starting in the middle of a chain loads the frames before
+	// it to reconstruct its first frame.
+	{
+		VoxelSequence player;
+		player.setup(loader);
+		auto decoded = player.reconstruct(settings.rangeStart);
+		expect(decoded != nullptr && decodes(player, VoxelSequence::Stats()) == keyDistances[settings.rangeStart] + 1,
+			   "couldn't start a range at frame " + ofToString(settings.rangeStart));
+		compare(frames[settings.rangeStart], decoded, result);
+	}
+
+	// Writing a frame again, as a key-frame like SnapshotRamses does when
+	// it can't reconstruct it, makes the delta after it stale: it has to
+	// be detected before decoding and fail to reconstruct. Writing that
+	// one again as a key-frame makes the next stale in turn, until a
+	// frame is written as a delta against the new version.
+	{
+		auto stale = settings.staleFrame;
+		expect(keyDistances[stale + 1] > 0 && keyDistances[stale + 2] > 0,
+			   "frames " + ofToString(stale + 1) + " and " + ofToString(stale + 2) + " have to be deltas to test stale references");
+
+		auto changed = frames[stale];
+		for(auto & v: changed){
+			v *= 1.5f;
+		}
+		size_t bytes = 0;
+		VoxelSequence rewriter;
+		rewriter.setup(loader);
+		write(rewriter, folder, stale, mode, changed, 1, bytes);
+
+		VoxelSequence checker;
+		checker.setup(loader);
+		VoxelCodec::Header header;
+		readHeader(loader(stale + 1), header);
+		expect(!checker.isReferenceUpToDate(stale + 1, header), "didn't notice the reference of frame " + ofToString(stale + 1) + " changed");
+		expect(checker.reconstruct(stale + 1) == nullptr, "reconstructed frame " + ofToString(stale + 1) + " on top of a changed reference");
+
+		write(rewriter, folder, stale + 1, mode, frames[stale + 1], 1, bytes);
+		readHeader(loader(stale + 2), header);
+		expect(!checker.isReferenceUpToDate(stale + 2, header), "didn't notice the reference of frame " + ofToString(stale + 2) + " changed");
+		compare(frames[stale + 1], checker.reconstruct(stale + 1), result);
+
+		write(rewriter, folder, stale + 2, mode, frames[stale + 2], settings.keyInterval, bytes);
+		readHeader(loader(stale + 2), header);
+		expect(!VoxelCodec::isKeyFrame(header) && checker.isReferenceUpToDate(stale + 2, header),
+			   "frame " + ofToString(stale + 2) + " wasn't written as a delta of the new reference");
+		compare(frames[stale + 2], checker.reconstruct(stale + 2), result);
+	}
+
+	expect(result.undecodable == 0, ofToString(result.undecodable) + " frames couldn't be reconstructed");
+	expect(result.mismatches == 0, ofToString(result.mismatches) +
+		   (mode == VoxelCodec::Lossless ? " voxels differ from the original" : " voxels over the max error"));
+	return result;
+}
+
+//--------------------------------------------------------------
+void ofApp::loadSettings(){
+	ofxHeadless::Settings json("VoxelSequenceTest", settingsPath);
+	json.get("seed", settings.seed);
+	json.get("folder", settings.folder);
+	json.get("size", settings.size);
+	json.get("numFrames", settings.numFrames);
+	json.get("keyInterval", settings.keyInterval);
+	json.get("maxError", settings.maxError);
+	json.get("numBlobs", settings.numBlobs);
+	json.get("blobRadius", settings.blobRadius);
+	json.get("seeks", settings.seeks);
+	json.get("rangeStart", settings.rangeStart);
+	json.get("staleFrame", settings.staleFrame);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FrameFile.h"
+#include "VoxelSequence.h"
+#include <random>
+
+// Headless test for ent::VoxelSequence on a small synthetic sequence.
+//
+// Writes a sequence of frame files with a few static blobs and a single
+// moving one, like SnapshotRamses does, in Lossless mode and in Quantized
+// mode, and compares its size to storing every frame as a key-frame. Then
+// plays it forward, seeks to random frames and starts a range in the
+// middle of a delta chain, checking every reconstructed frame against the
+// original and how many frames each reconstruction had to decode. Last it
+// writes a reference again and checks the deltas after it are detected
+// as stale and can be written again as key-frames. Exits with 1 if
+// anything failed.
+class ofApp : public ofBaseApp{
+
+	public:
+		struct Settings{
+			uint64_t seed = 3030;
+			std::string folder = "frames";
+			size_t size = 64;
+			int numFrames = 20;
+			size_t keyInterval = 8;
+			float maxError = 0.01f;
+			size_t numBlobs = 6;
+			float blobRadius = 0.1f;
+			size_t seeks = 64;
+			int rangeStart = 5;
+			int staleFrame = 2;
+		};
+
+		void setup();
+		void update();
+
+		std::string settingsPath = "settings.json";
+
+	private:
+		struct Result{
+			VoxelCodec::Mode mode = VoxelCodec::Lossless;
+			size_t keyFrames = 0;
+			size_t bytes = 0;
+			size_t keyFramesOnlyBytes = 0;
+			size_t undecodable = 0;
+			size_t mismatches = 0;
+			double error = 0;
+			double forwardMillis = 0;
+			double seekMillis = 0;
+		};
+
+		void loadSettings();
+		std::vector<float> volume(int frameIndex) const;
+		std::string getFolder(VoxelCodec::Mode mode) const;
+		ent::VoxelSequence::Loader getLoader(const std::string & folder, int endIndex) const;
+		bool write(ent::VoxelSequence & sequence, const std::string & folder, int frameIndex, VoxelCodec::Mode mode,
+				   const std::vector<float> & voxels, size_t keyInterval, size_t & bytes) const;
+		bool readHeader(const std::shared_ptr<const ent::FrameFile> & frame, VoxelCodec::Header & header) const;
+		void compare(const std::vector<float> & original, const std::vector<float> * decoded, Result & result) const;
+		Result test(VoxelCodec::Mode mode, std::vector<std::string> & failures) const;
+
+		Settings settings;
+		std::vector<std::vector<float>> frames;
+};
@@ -25,18 +25,24 @@ uniform vec4 colors[NUM_PARTICLE_TYPES];
 
 void main( void )
 {
-	int idx = gl_InstanceID * 4;
-	mat4 modelMatrix = mat4(
-	    texelFetch( uOffsetTex, idx+0 ),
-	    texelFetch( uOffsetTex, idx+1 ),
-	    texelFetch( uOffsetTex, idx+2 ),
-	    texelFetch( uOffsetTex, idx+3 )
-	);
-	out_position = modelMatrix * ( position * vec4( uScale, uScale, uScale, 1.0 ) );
+	// position and scale, velocity, see nm::ParticleGpuData
+	int idx = gl_InstanceID * 2;
+	vec4 positionScale = texelFetch( uOffsetTex, idx+0 );
+	vec3 velocity = texelFetch( uOffsetTex, idx+1 ).xyz;
+
+	// same rotation as lookAt(0, velocity, up)
+	vec3 f = length(velocity) > 0.0 ? normalize(velocity) : vec3(0.0, 0.0, -1.0);
+	vec3 s = cross(f, vec3(0.0, 1.0, 0.0));
+	s = length(s) > 0.0 ? normalize(s) : vec3(1.0, 0.0, 0.0);
+	vec3 u = cross(s, f);
+	mat3 rotation = transpose(mat3(s, u, -f));
+
+	vec3 vertex = rotation * (position.xyz * uScale) * positionScale.w;
+	out_position = vec4(vertex + positionScale.xyz, 1.0);
 #if COLOR_PER_TYPE
 	out_color = colors[int(uType) % NUM_PARTICLE_TYPES];
 #else
 	out_color = colors[(int(uType) + gl_VertexID) % NUM_PARTICLE_TYPES];
 #endif
-	out_normal = vec4(mat3(modelMatrix) * normal, 1.0);
+	out_normal = vec4(positionScale.w * (rotation * normal), 1.0);
 }
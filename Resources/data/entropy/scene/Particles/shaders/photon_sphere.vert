@@ -0,0 +1,13 @@
+#version 330
+
+#pragma include <inc/ofDefaultUniforms.glsl>
+#pragma include <inc/ofDefaultVertexInAttributes.glsl>
+
+// scaled position and radius of every photon, see nm::Photons::pack
+uniform samplerBuffer uPhotonsTex;
+
+void main()
+{
+	vec4 positionRadius = texelFetch(uPhotonsTex, gl_InstanceID);
+	gl_Position = modelViewProjectionMatrix * vec4(position.xyz * positionRadius.w + positionRadius.xyz, 1.0);
+}
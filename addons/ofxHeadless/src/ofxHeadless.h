@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofAppNoWindow.h"
+
+// Shared pieces of the headless prototypes: they run without a window or
+// GL context, do all their work in ofApp::update, read their settings
+// from a json file and exit with 1 if any of their checks failed.
+namespace ofxHeadless{
+	// Runs App with an optional settings file as the first argument,
+	// App::settingsPath defaults to bin/data/settings.json
+	template<typename App>
+	int run(int argc, char ** argv){
+		ofInit();
+		auto window = std::make_shared<ofAppNoWindow>();
+		auto app = std::make_shared<App>();
+		if(argc > 1){
+			app->settingsPath = argv[1];
+		}
+		ofRunApp(window, app);
+		return ofRunMainLoop();
+	}
+
+	// The json at a settings path, missing files and keys keep the
+	// defaults already in the values passed to get
+	class Settings{
+	public:
+		Settings(const std::string & module, const std::string & path){
+			if(ofFile::doesFileExist(path)){
+				json = ofLoadJson(path);
+			}else{
+				ofLogWarning(module) << "No settings at " << path << ", using the defaults";
+			}
+		}
+
+		template<typename Value>
+		void get(const std::string & name, Value & value) const{
+			if(json.count(name)){
+				value = json[name].get<Value>();
+			}
+		}
+
+		const ofJson & getJson() const{
+			return json;
+		}
+
+	private:
+		ofJson json;
+	};
+
+	// Logs the report followed by the failures, or that all checks passed,
+	// and exits with 1 if there's any failure
+	inline void exit(const std::string & module, std::ostringstream & ss, const std::vector<std::string> & failures){
+		for(auto & failure: failures){
+			ss << "FAILED " << failure << endl;
+		}
+		if(failures.empty()){
+			ss << "all checks passed";
+		}
+		ofLogNotice(module) << endl << ss.str();
+
+		ofExit(failures.empty() ? 0 : 1);
+	}
+}